@@ -54,6 +54,10 @@ class AllocatorTestSuite {
         alloc_type_ = "hipc::ThreadLocalAllocator";
         break;
       }
+      case AllocatorType::kSlabAllocator: {
+        alloc_type_ = "hipc::SlabAllocator";
+        break;
+      }
       case AllocatorType::kTestAllocator: {
         alloc_type_ = "hipc::TestAllocator";
         break;
@@ -256,6 +260,9 @@ void FullAllocatorTestPerThread() {
   // Thread-local allocator
   AllocatorTest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>(
       AllocatorType::kThreadLocalAllocator, MemoryBackendType::kMallocBackend);
+  // Slab allocator
+  AllocatorTest<hipc::PosixShmMmap, hipc::SlabAllocator>(
+      AllocatorType::kSlabAllocator, MemoryBackendType::kMallocBackend);
   // Test allocator
   AllocatorTest<hipc::PosixShmMmap, hipc::TestAllocator>(
       AllocatorType::kTestAllocator, MemoryBackendType::kMallocBackend);
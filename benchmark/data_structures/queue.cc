@@ -19,6 +19,7 @@
 #include <string>
 
 // hermes
+#include "hermes_shm/data_structures/ipc/mpmc_queue.h"
 #include "hermes_shm/data_structures/ipc/ring_ptr_queue.h"
 #include "hermes_shm/data_structures/ipc/ring_queue.h"
 #include "hermes_shm/data_structures/ipc/split_ticket_queue.h"
@@ -55,6 +56,10 @@ class QueueTest {
       queue_type_ = "hipc::mpsc_ptr_queue";
     } else if constexpr (std::is_same_v<hipc::spsc_queue<T>, QueueT>) {
       queue_type_ = "hipc::spsc_queue";
+    } else if constexpr (std::is_same_v<hipc::mpmc_queue<T>, QueueT>) {
+      queue_type_ = "hipc::mpmc_queue";
+    } else if constexpr (std::is_same_v<hipc::mpmc_ptr_queue<T>, QueueT>) {
+      queue_type_ = "hipc::mpmc_ptr_queue";
     } else if constexpr (std::is_same_v<hipc::ticket_queue<T>, QueueT>) {
       queue_type_ = "hipc::ticket_queue";
     } else if constexpr (std::is_same_v<hipc::split_ticket_queue<T>, QueueT>) {
@@ -150,6 +155,10 @@ class QueueTest {
           queue_->emplace(var.Get());
         } else if constexpr (std::is_same_v<QueueT, hipc::spsc_queue<T>>) {
           queue_->emplace(var.Get());
+        } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_queue<T>>) {
+          queue_->emplace(var.Get());
+        } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_ptr_queue<T>>) {
+          queue_->emplace(var.Get());
         } else if constexpr (std::is_same_v<QueueT, hipc::ticket_queue<T>>) {
           queue_->emplace(var.Get());
         } else if constexpr (std::is_same_v<QueueT,
@@ -181,6 +190,14 @@ class QueueTest {
         } else if constexpr (std::is_same_v<QueueT, hipc::spsc_queue<T>>) {
           queue_->pop(x_);
           USE(x_);
+        } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_queue<T>>) {
+          T x;
+          while (queue_->pop(x).IsNull());
+          USE(x);
+        } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_ptr_queue<T>>) {
+          T x;
+          while (queue_->pop(x).IsNull());
+          USE(x);
         } else if constexpr (std::is_same_v<QueueT, hipc::ticket_queue<T>>) {
           while (queue_->pop(x_).IsNull());
         } else if constexpr (std::is_same_v<QueueT,
@@ -207,6 +224,12 @@ class QueueTest {
     } else if constexpr (std::is_same_v<QueueT, hipc::spsc_queue<T>>) {
       queue_ =
           alloc->template NewObjLocal<QueueT>(HSHM_DEFAULT_MEM_CTX, count).ptr_;
+    } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_queue<T>>) {
+      queue_ =
+          alloc->template NewObjLocal<QueueT>(HSHM_DEFAULT_MEM_CTX, count).ptr_;
+    } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_ptr_queue<T>>) {
+      queue_ =
+          alloc->template NewObjLocal<QueueT>(HSHM_DEFAULT_MEM_CTX, count).ptr_;
     } else if constexpr (std::is_same_v<QueueT, hipc::ticket_queue<T>>) {
       queue_ =
           alloc->template NewObjLocal<QueueT>(HSHM_DEFAULT_MEM_CTX, count).ptr_;
@@ -227,6 +250,10 @@ class QueueTest {
       HSHM_DEFAULT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, queue_);
     } else if constexpr (std::is_same_v<QueueT, hipc::spsc_queue<T>>) {
       HSHM_DEFAULT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, queue_);
+    } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_queue<T>>) {
+      HSHM_DEFAULT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, queue_);
+    } else if constexpr (std::is_same_v<QueueT, hipc::mpmc_ptr_queue<T>>) {
+      HSHM_DEFAULT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, queue_);
     } else if constexpr (std::is_same_v<QueueT, hipc::ticket_queue<T>>) {
       HSHM_DEFAULT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, queue_);
     } else if constexpr (std::is_same_v<QueueT, hipc::split_ticket_queue<T>>) {
@@ -270,6 +297,18 @@ void FullQueueTest() {
   QueueTest<size_t, hipc::spsc_queue<size_t>>().Test(count_per_rank, 1);
   QueueTest<std::string, hipc::spsc_queue<std::string>>().Test();
   QueueTest<hipc::string, hipc::spsc_queue<hipc::string>>().Test();
+
+  // hipc::mpmc_queue tests
+  QueueTest<size_t, hipc::mpmc_queue<size_t>>().Test(count_per_rank, 1);
+  QueueTest<size_t, hipc::mpmc_queue<size_t>>().Test(count_per_rank, 4);
+  QueueTest<size_t, hipc::mpmc_queue<size_t>>().Test(count_per_rank, 8);
+  QueueTest<std::string, hipc::mpmc_queue<std::string>>().Test();
+  QueueTest<hipc::string, hipc::mpmc_queue<hipc::string>>().Test();
+
+  // hipc::mpmc_ptr_queue tests
+  QueueTest<size_t, hipc::mpmc_ptr_queue<size_t>>().Test(count_per_rank, 1);
+  QueueTest<size_t, hipc::mpmc_ptr_queue<size_t>>().Test(count_per_rank, 4);
+  QueueTest<size_t, hipc::mpmc_ptr_queue<size_t>>().Test(count_per_rank, 8);
 }
 
 TEST_CASE("QueueBenchmark") { FullQueueTest(); }
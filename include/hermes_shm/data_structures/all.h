@@ -21,6 +21,7 @@
 #include "ipc/key_set.h"
 #include "ipc/lifo_list_queue.h"
 #include "ipc/list.h"
+#include "ipc/mpmc_queue.h"
 #include "ipc/mpsc_lifo_list_queue.h"
 #include "ipc/pair.h"
 #include "ipc/pod_array.h"
@@ -78,6 +79,11 @@
   using fixed_mpsc_ptr_queue = HSHM_NS::fixed_mpsc_ptr_queue<T, ALLOC_T>;    \
                                                                              \
   template <typename T>                                                      \
+  using mpmc_queue = HSHM_NS::mpmc_queue<T, ALLOC_T>;                        \
+  template <typename T>                                                      \
+  using mpmc_ptr_queue = HSHM_NS::mpmc_ptr_queue<T, ALLOC_T>;                \
+                                                                             \
+  template <typename T>                                                      \
   using slist = HSHM_NS::slist<T, ALLOC_T>;                                  \
                                                                              \
   template <typename T>                                                      \
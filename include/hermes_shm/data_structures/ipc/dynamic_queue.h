@@ -10,52 +10,108 @@
 #include "hermes_shm/data_structures/internal/shm_internal.h"
 #include "hermes_shm/data_structures/ipc/functional.h"
 #include "hermes_shm/data_structures/serialization/serialize_common.h"
-#include "list.h"
-#include "ring_queue.h"
+#include "hermes_shm/thread/lock/mutex.h"
+#include "hermes_shm/types/atomic.h"
+#include "hermes_shm/types/qtok.h"
 
 namespace hshm::ipc {
 
+/** A slot of a dynamic_queue segment */
+template <typename T>
+struct dynamic_queue_slot {
+  hipc::atomic<hshm::u32> ready_; /**< Set once val_ is constructed */
+  delay_ar<T> val_;
+};
+
+/** The header of a dynamic_queue segment. The slots follow it. */
+struct dynamic_queue_segment {
+  hipc::atomic<qtok_id> enq_; /**< The next slot a producer takes */
+  char pad0_[64 - sizeof(qtok_id)];
+  hipc::atomic<qtok_id> deq_; /**< The next slot a consumer takes */
+  char pad1_[64 - sizeof(qtok_id)];
+  AtomicOffsetPointer next_;     /**< The segment after this one */
+  hipc::atomic<hshm::u32> refs_; /**< Threads that pinned this segment */
+  qtok_id base_;                 /**< The ticket of the first slot */
+  OffsetPointer free_next_;      /**< The next segment in the pool */
+};
+
+/** Unpins a dynamic_queue segment when it goes out of scope */
+struct ScopedSegmentPin {
+  dynamic_queue_segment *seg_;
+
+  /** Take over the pin of \a seg */
+  HSHM_INLINE_CROSS_FUN
+  explicit ScopedSegmentPin(dynamic_queue_segment *seg) : seg_(seg) {}
+
+  /** Unpin the segment */
+  HSHM_INLINE_CROSS_FUN
+  ~ScopedSegmentPin() { seg_->refs_.fetch_sub(1); }
+};
+
 /**
- * MACROS used to simplify the ring_queue_base namespace
+ * MACROS used to simplify the dynamic_queue namespace
  * Used as inputs to the HIPC_CONTAINER_TEMPLATE
  * */
 #define CLASS_NAME dynamic_queue
 #define CLASS_NEW_ARGS T
 
 /**
- * An mpsc queue that changes in size dynamically
- */
+ * An unbounded lock-free queue for multiple producers and multiple
+ * consumers.
+ *
+ * The queue is a linked list of segments of block_size slots each.
+ * Producers take a slot of the tail segment with a fetch_add on its enq_,
+ * and consumers take the slot at deq_ of the head segment with a CAS once
+ * it is ready. The producer that finds the tail segment full links a new
+ * one; the consumer that finds the head segment drained unlinks it.
+ *
+ * A thread pins a segment in refs_ while it uses it. Unlinked segments go
+ * to a pool and are reused once nobody pins them, so a queue that stays
+ * under some size stops allocating. Only moving to another segment, once
+ * every block_size operations, touches the pool and its lock.
+ *
+ * pop() returns a null qtok if the queue is empty or the producer of the
+ * head slot has not finished.
+ * */
 template <typename T, HSHM_CLASS_TEMPL_WITH_DEFAULTS>
 class dynamic_queue : public ShmContainer {
  public:
   HIPC_CONTAINER_TEMPLATE((CLASS_NAME), (CLASS_NEW_ARGS))
-  typedef hipc::list<T, HSHM_CLASS_TEMPL_ARGS> Vector;
+  typedef dynamic_queue_segment segment_t;
+  typedef dynamic_queue_slot<T> slot_t;
 
  public:
-  hshm::Mutex lock_;
-  Vector splits_;
-  hipc::atomic<hshm::size_t> head_, tail_;
+  /** Consumers and producers each own a cache line */
+  AtomicOffsetPointer head_;
+  char pad0_[64 - sizeof(AtomicOffsetPointer)];
+  AtomicOffsetPointer tail_;
+  char pad1_[64 - sizeof(AtomicOffsetPointer)];
+  hshm::Mutex pool_lock_;
+  OffsetPointer pool_; /**< Unlinked segments */
   size_t block_size_;
 
   /**====================================
    * Default Constructor
    * ===================================*/
  public:
-  dynamic_queue(size_t block_size = 64) : splits_() {
+  dynamic_queue(size_t block_size = 64) {
     shm_init(HSHM_MEMORY_MANAGER->GetDefaultAllocator<AllocT>(), block_size);
   }
 
-  dynamic_queue(const hipc::CtxAllocator<AllocT> &alloc, size_t block_size = 64)
-      : splits_(alloc), block_size_(block_size) {
+  dynamic_queue(const hipc::CtxAllocator<AllocT> &alloc,
+                size_t block_size = 64) {
     shm_init(alloc, block_size);
   }
 
   void shm_init(const hipc::CtxAllocator<AllocT> &alloc,
                 size_t block_size = 64) {
     init_shm_container(alloc);
+    pool_lock_.Init();
+    pool_.SetNull();
     block_size_ = block_size;
-    head_ = 0;
-    tail_ = 0;
+    OffsetPointer seg = NewSegment(0);
+    head_ = seg;
+    tail_ = seg;
   }
 
   /**====================================
@@ -81,13 +137,30 @@ class dynamic_queue : public ShmContainer {
     return *this;
   }
 
-  /** SHM copy constructor + operator main */
+  /**
+   * SHM copy constructor + operator main. \a other must not be pushed or
+   * popped during the copy.
+   * */
   HSHM_CROSS_FUN
   void shm_strong_copy_op(const dynamic_queue &other) {
-    splits_ = other.splits_;
-    head_ = other.head_.load();
-    tail_ = other.tail_.load();
+    pool_lock_.Init();
+    pool_.SetNull();
     block_size_ = other.block_size_;
+    OffsetPointer seg = NewSegment(0);
+    head_ = seg;
+    tail_ = seg;
+    OffsetPointer off = other.head_;
+    while (!off.IsNull()) {
+      segment_t *other_seg = other.GetSegment(off);
+      slot_t *slots = GetSlots(other_seg);
+      size_t enq = other.GetFilled(other_seg);
+      for (size_t i = other_seg->deq_.load(); i < enq; ++i) {
+        if (slots[i].ready_.load()) {
+          emplace(*slots[i].val_);
+        }
+      }
+      off = other_seg->next_;
+    }
   }
 
   /**====================================
@@ -128,9 +201,10 @@ class dynamic_queue : public ShmContainer {
       init_shm_container(alloc);
     }
     if (GetAllocator() == other.GetAllocator()) {
-      splits_ = std::move(other.splits_);
-      head_ = other.head_.load();
-      tail_ = other.tail_.load();
+      pool_lock_.Init();
+      head_ = other.head_;
+      tail_ = other.tail_;
+      pool_ = other.pool_;
       block_size_ = other.block_size_;
       other.SetNull();
     } else {
@@ -143,29 +217,77 @@ class dynamic_queue : public ShmContainer {
    * Destructor
    * ===================================*/
 
-  /** SHM destructor.  */
+  /** SHM destructor. Frees the linked and the pooled segments. */
   HSHM_CROSS_FUN
-  void shm_destroy_main() {}
+  void shm_destroy_main() {
+    OffsetPointer off = head_;
+    while (!off.IsNull()) {
+      segment_t *seg = GetSegment(off);
+      slot_t *slots = GetSlots(seg);
+      size_t enq = GetFilled(seg);
+      for (size_t i = seg->deq_.load(); i < enq; ++i) {
+        if (slots[i].ready_.load()) {
+          HSHM_DESTROY_AR(slots[i].val_)
+        }
+      }
+      OffsetPointer next = seg->next_;
+      GetAllocator()->FreeOffsetNoNullCheck(GetMemCtx(), off);
+      off = next;
+    }
+    off = pool_;
+    while (!off.IsNull()) {
+      OffsetPointer next = GetSegment(off)->free_next_;
+      GetAllocator()->FreeOffsetNoNullCheck(GetMemCtx(), off);
+      off = next;
+    }
+  }
 
-  /** Check if the list is empty */
+  /** Check if the queue is empty */
   HSHM_CROSS_FUN
-  bool IsNull() const { return false; }
+  bool IsNull() const { return head_.IsNull(); }
 
-  /** Sets this list as empty */
+  /** Sets this queue as empty */
   HSHM_CROSS_FUN
-  void SetNull() {}
+  void SetNull() {
+    head_.SetNull();
+    tail_.SetNull();
+    pool_.SetNull();
+  }
 
   /**====================================
-   * MPSC Queue Methods
+   * MPMC Queue Methods
    * ===================================*/
 
-  /** Construct an element at \a pos position in the list */
+  /**
+   * Construct an element at the tail of the queue. The tail segment stays
+   * pinned until this returns, even if linking a new segment throws.
+   * */
   template <typename... Args>
   HSHM_CROSS_FUN qtok_t emplace(Args &&...args) {
-    ScopedMutex lock(lock_, 0);
-    qtok_id tail = tail_.fetch_add(1);
-    splits_.emplace_back(std::forward<Args>(args)...);
-    return qtok_t(tail);
+    while (true) {
+      OffsetPointer off;
+      segment_t *seg = Pin(tail_, off);
+      ScopedSegmentPin pin(seg);
+      qtok_id enq = seg->enq_.fetch_add(1);
+      if (enq < block_size_) {
+        slot_t &slot = GetSlots(seg)[enq];
+        HSHM_MAKE_AR(slot.val_, GetCtxAllocator(), std::forward<Args>(args)...)
+        slot.ready_.store(1, std::memory_order_release);
+        return qtok_t(seg->base_ + enq);
+      }
+      // The segment is full: link a new one after it
+      size_t next = seg->next_.load();
+      if (next == OffsetPointer::GetNull().load()) {
+        OffsetPointer new_seg = NewSegment(seg->base_ + block_size_);
+        if (seg->next_.compare_exchange_strong(next, new_seg.load())) {
+          next = new_seg.load();
+        } else {
+          FreeSegment(new_seg);
+        }
+      }
+      size_t tail = off.load();
+      tail_.compare_exchange_strong(tail, next);
+    }
   }
 
   /** Push an elemnt in the list (wrapper) */
@@ -177,41 +299,45 @@ class dynamic_queue : public ShmContainer {
   /** Consumer pops the head object */
   HSHM_CROSS_FUN
   qtok_t pop(T &val) {
-    ScopedMutex lock(lock_, 0);
-    qtok_t ret = qtok_t::GetNull();
-    if (splits_.size() > 0) {
-      ret = qtok_t(head_.fetch_add(1));
-      val = splits_.front();
-      splits_.erase(splits_.begin());
-    }
-    return ret;
+    return Pop([&val](T &entry) { val = std::move(entry); });
   }
 
   /** Consumer pops the head object */
   HSHM_CROSS_FUN
   qtok_t pop() {
-    ScopedMutex lock(lock_, 0);
-    qtok_t ret = qtok_t::GetNull();
-    if (splits_.size() > 0) {
-      ret = qtok_t(head_.fetch_add(1));
-      splits_.erase(splits_.begin());
-    }
-    return ret;
+    return Pop([](T &) {});
   }
 
-  /** Get queue depth */
+  /** Get queue depth: the slots of the linked segments */
   HSHM_CROSS_FUN
-  size_t GetDepth() { return splits_.size(); }
+  size_t GetDepth() {
+    OffsetPointer head_off, tail_off;
+    segment_t *head = Pin(head_, head_off);
+    segment_t *tail = Pin(tail_, tail_off);
+    qtok_id first = head->base_;
+    qtok_id last = tail->base_ + block_size_;
+    Unpin(tail);
+    Unpin(head);
+    if (last < first) {
+      return 0;
+    }
+    return (size_t)(last - first);
+  }
 
   /** Get size at this moment */
   HSHM_CROSS_FUN
   size_t GetSize() {
-    hshm::size_t tail = tail_.load();
-    hshm::size_t head = head_.load();
-    if (tail < head) {
+    OffsetPointer head_off, tail_off;
+    segment_t *head = Pin(head_, head_off);
+    segment_t *tail = Pin(tail_, tail_off);
+    qtok_id first = head->base_ + head->deq_.load();
+    qtok_id last = tail->base_ + GetFilled(tail);
+    Unpin(tail);
+    Unpin(head);
+    if (last < first) {
       return 0;
     }
-    return (size_t)(tail - head);
+    return (size_t)(last - first);
   }
 
   /** Get size (wrapper) */
@@ -221,6 +347,144 @@ class dynamic_queue : public ShmContainer {
   /** Get size (wrapper) */
   HSHM_INLINE_CROSS_FUN
   size_t Size() { return GetSize(); }
+
+ private:
+  /** Take the head object and pass it to \a take */
+  template <typename TakeT>
+  HSHM_CROSS_FUN qtok_t Pop(TakeT &&take) {
+    while (true) {
+      OffsetPointer off;
+      segment_t *seg = Pin(head_, off);
+      qtok_id deq = seg->deq_.load(std::memory_order_relaxed);
+      while (deq < block_size_) {
+        slot_t &slot = GetSlots(seg)[deq];
+        if (!slot.ready_.load(std::memory_order_acquire)) {
+          // The queue is empty or the producer has not finished
+          Unpin(seg);
+          return qtok_t::GetNull();
+        }
+        if (seg->deq_.compare_exchange_weak(deq, deq + 1)) {
+          take(*slot.val_);
+          HSHM_DESTROY_AR(slot.val_)
+          qtok_id id = seg->base_ + deq;
+          Unpin(seg);
+          return qtok_t(id);
+        }
+      }
+      // Every slot was popped: unlink the segment
+      size_t next = seg->next_.load();
+      if (next == OffsetPointer::GetNull().load()) {
+        Unpin(seg);
+        return qtok_t::GetNull();
+      }
+      // The tail must not point to a segment in the pool
+      size_t tail = off.load();
+      while (tail == off.load() &&
+             !tail_.compare_exchange_weak(tail, next)) {
+      }
+      size_t head = off.load();
+      bool unlinked = head_.compare_exchange_strong(head, next);
+      Unpin(seg);
+      if (unlinked) {
+        FreeSegment(off);
+      }
+    }
+  }
+
+  /**
+   * Pin the segment \a ptr points to, so it is not reused until Unpin().
+   * A thread that pins a segment just after it is unlinked sees \a ptr
+   * change and tries again.
+   *
+   * @param off the offset of the pinned segment
+   * */
+  HSHM_INLINE_CROSS_FUN
+  segment_t *Pin(AtomicOffsetPointer &ptr, OffsetPointer &off) {
+    while (true) {
+      off = ptr;
+      segment_t *seg = GetSegment(off);
+      seg->refs_.fetch_add(1);
+      if (ptr.load() == off.load()) {
+        return seg;
+      }
+      seg->refs_.fetch_sub(1);
+    }
+  }
+
+  /** Let the pool reuse \a seg */
+  HSHM_INLINE_CROSS_FUN
+  void Unpin(segment_t *seg) { seg->refs_.fetch_sub(1); }
+
+  /**
+   * Get an empty segment whose first slot has ticket \a base. Reuses a
+   * pooled segment that nobody pins, or allocates one.
+   * */
+  HSHM_CROSS_FUN
+  OffsetPointer NewSegment(qtok_id base) {
+    OffsetPointer off = OffsetPointer::GetNull();
+    segment_t *seg = nullptr;
+    {
+      ScopedMutex lock(pool_lock_, 0);
+      OffsetPointer *prev = &pool_;
+      while (!prev->IsNull()) {
+        segment_t *cur = GetSegment(*prev);
+        if (cur->refs_.load() == 0) {
+          off = *prev;
+          seg = cur;
+          *prev = cur->free_next_;
+          break;
+        }
+        prev = &cur->free_next_;
+      }
+    }
+    if (seg == nullptr) {
+      size_t size = sizeof(segment_t) + block_size_ * sizeof(slot_t);
+      off = GetAllocator()->AllocateOffset(GetMemCtx(), size);
+      if (off.IsNull()) {
+        HSHM_THROW_ERROR(OUT_OF_MEMORY, size,
+                         GetAllocator()->GetCurrentlyAllocatedSize());
+      }
+      seg = GetSegment(off);
+      seg->refs_ = 0;
+    }
+    seg->enq_ = 0;
+    seg->deq_ = 0;
+    seg->next_.SetNull();
+    seg->base_ = base;
+    seg->free_next_.SetNull();
+    slot_t *slots = GetSlots(seg);
+    for (size_t i = 0; i < block_size_; ++i) {
+      slots[i].ready_ = 0;
+    }
+    return off;
+  }
+
+  /** Put the unlinked segment \a off in the pool */
+  HSHM_CROSS_FUN
+  void FreeSegment(const OffsetPointer &off) {
+    ScopedMutex lock(pool_lock_, 0);
+    GetSegment(off)->free_next_ = pool_;
+    pool_ = off;
+  }
+
+  /** The segment at \a off */
+  HSHM_INLINE_CROSS_FUN
+  segment_t *GetSegment(const OffsetPointer &off) const {
+    return GetAllocator()->template Convert<segment_t>(off);
+  }
+
+  /** The slots of \a seg */
+  HSHM_INLINE_CROSS_FUN
+  static slot_t *GetSlots(segment_t *seg) {
+    return reinterpret_cast<slot_t *>(seg + 1);
+  }
+
+  /** The number of slots producers have taken in \a seg */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetFilled(segment_t *seg) const {
+    size_t enq = seg->enq_.load();
+    return enq < block_size_ ? enq : block_size_;
+  }
 };
 
 }  // namespace hshm::ipc
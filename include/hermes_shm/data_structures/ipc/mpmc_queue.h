@@ -0,0 +1,422 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_SHM_INCLUDE_HSHM_SHM_DATA_STRUCTURES_IPC_MPMC_QUEUE_H_
+#define HSHM_SHM_INCLUDE_HSHM_SHM_DATA_STRUCTURES_IPC_MPMC_QUEUE_H_
+
+#include <type_traits>
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/data_structures/internal/shm_internal.h"
+#include "hermes_shm/thread/lock/futex.h"
+#include "hermes_shm/types/atomic.h"
+#include "hermes_shm/types/qtok.h"
+#include "pair.h"
+#include "vector.h"
+
+namespace hshm::ipc {
+
+/** A slot of an mpmc_ptr_queue: the value is stored inline */
+template <typename T>
+struct mpmc_ptr_slot {
+  hipc::atomic<qtok_id> seq_;
+  T val_;
+};
+
+/** Forward declaration of mpmc_queue_base */
+template <typename T, bool IS_PTR, HSHM_CLASS_TEMPL_WITH_DEFAULTS>
+class mpmc_queue_base;
+
+/**
+ * MACROS used to simplify the mpmc_queue_base namespace
+ * Used as inputs to the HIPC_CONTAINER_TEMPLATE
+ * */
+#define CLASS_NAME mpmc_queue_base
+#define CLASS_NEW_ARGS T, IS_PTR
+
+/**
+ * A bounded lock-free queue for multiple producers and multiple consumers.
+ *
+ * Each slot holds a sequence number next to its value. A slot is free for
+ * the push of ticket i when its sequence is i, and holds the value of
+ * ticket i when its sequence is i + 1. Producers claim a ticket with a CAS
+ * on tail_ and consumers with a CAS on head_, so a push and a pop only
+ * contend on the slot they both touch, never on a lock.
+ *
+ * emplace() returns a null qtok if the queue is full and pop() returns a
+ * null qtok if it is empty; push_wait() and pop_wait() sleep instead. The
+ * depth is fixed at construction.
+ *
+ * @param T The type of the data to store in the queue
+ * @param IS_PTR Store T inline next to the sequence, instead of in a
+ * shm pair. Meant for arithmetic types and pointers.
+ * */
+template <typename T, bool IS_PTR, HSHM_CLASS_TEMPL>
+class mpmc_queue_base : public ShmContainer {
+ public:
+  HIPC_CONTAINER_TEMPLATE((CLASS_NAME), (CLASS_NEW_ARGS))
+
+ public:
+  /**====================================
+   * Typedefs
+   * ===================================*/
+  typedef pair<hipc::atomic<qtok_id>, T, HSHM_CLASS_TEMPL_ARGS> pair_t;
+  typedef std::conditional_t<IS_PTR, mpmc_ptr_slot<T>, pair_t> slot_t;
+  typedef vector<slot_t, HSHM_CLASS_TEMPL_ARGS> vector_t;
+
+ public:
+  /**====================================
+   * Variables
+   * ===================================*/
+  delay_ar<vector_t> queue_;
+  /** Producers and consumers each own a cache line */
+  char pad0_[64];
+  hipc::atomic<qtok_id> tail_;
+  char pad1_[64 - sizeof(qtok_id)];
+  hipc::atomic<qtok_id> head_;
+  char pad2_[64 - sizeof(qtok_id)];
+  /** Consumers sleep on pop_event_, producers on push_event_ */
+  Futex pop_event_;
+  Futex push_event_;
+  char pad3_[64 - 2 * sizeof(Futex)];
+
+ public:
+  /**====================================
+   * Default Constructor
+   * ===================================*/
+
+  /** Constructor. Default. */
+  HSHM_CROSS_FUN
+  explicit mpmc_queue_base(size_t depth = 1024) {
+    shm_init(HSHM_MEMORY_MANAGER->GetDefaultAllocator<AllocT>(), depth);
+  }
+
+  /** SHM constructor. Default. */
+  HSHM_CROSS_FUN
+  explicit mpmc_queue_base(const hipc::CtxAllocator<AllocT> &alloc,
+                           size_t depth = 1024) {
+    shm_init(alloc, depth);
+  }
+
+  /** SHM Constructor */
+  HSHM_CROSS_FUN
+  void shm_init(const hipc::CtxAllocator<AllocT> &alloc, size_t depth = 1024) {
+    init_shm_container(alloc);
+    HSHM_MAKE_AR(queue_, GetCtxAllocator(), depth);
+    SetNull();
+  }
+
+  /**====================================
+   * Copy Constructors
+   * ===================================*/
+
+  /** SHM copy constructor */
+  HSHM_CROSS_FUN
+  explicit mpmc_queue_base(const hipc::CtxAllocator<AllocT> &alloc,
+                           const mpmc_queue_base &other) {
+    init_shm_container(alloc);
+    shm_strong_copy_op(other);
+  }
+
+  /** SHM copy assignment operator */
+  HSHM_CROSS_FUN
+  mpmc_queue_base &operator=(const mpmc_queue_base &other) {
+    if (this != &other) {
+      shm_destroy();
+      shm_strong_copy_op(other);
+    }
+    return *this;
+  }
+
+  /** SHM copy constructor + operator main */
+  HSHM_CROSS_FUN
+  void shm_strong_copy_op(const mpmc_queue_base &other) {
+    head_ = other.head_.load();
+    tail_ = other.tail_.load();
+    (*queue_) = (*other.queue_);
+  }
+
+  /**====================================
+   * Move Constructors
+   * ===================================*/
+
+  /** Move constructor. */
+  HSHM_CROSS_FUN
+  mpmc_queue_base(mpmc_queue_base &&other) noexcept {
+    shm_move_op<false>(other.GetCtxAllocator(),
+                       std::forward<mpmc_queue_base>(other));
+  }
+
+  /** SHM move constructor. */
+  HSHM_CROSS_FUN
+  mpmc_queue_base(const hipc::CtxAllocator<AllocT> &alloc,
+                  mpmc_queue_base &&other) noexcept {
+    shm_move_op<false>(alloc, std::forward<mpmc_queue_base>(other));
+  }
+
+  /** SHM move assignment operator. */
+  HSHM_CROSS_FUN
+  mpmc_queue_base &operator=(mpmc_queue_base &&other) noexcept {
+    if (this != &other) {
+      shm_move_op<true>(other.GetCtxAllocator(),
+                        std::forward<mpmc_queue_base>(other));
+    }
+    return *this;
+  }
+
+  /** SHM move assignment operator. */
+  template <bool IS_ASSIGN>
+  HSHM_CROSS_FUN void shm_move_op(const hipc::CtxAllocator<AllocT> &alloc,
+                                  mpmc_queue_base &&other) noexcept {
+    if constexpr (IS_ASSIGN) {
+      shm_destroy();
+    } else {
+      init_shm_container(alloc);
+    }
+    if (GetAllocator() == other.GetAllocator()) {
+      head_ = other.head_.load();
+      tail_ = other.tail_.load();
+      (*queue_) = std::move(*other.queue_);
+      other.head_ = 0;
+      other.tail_ = 0;
+    } else {
+      shm_strong_copy_op(other);
+      other.shm_destroy();
+    }
+  }
+
+  /**====================================
+   * Destructor
+   * ===================================*/
+
+  /** SHM destructor.  */
+  HSHM_CROSS_FUN
+  void shm_destroy_main() { (*queue_).shm_destroy(); }
+
+  /** Check if the queue is empty */
+  HSHM_CROSS_FUN
+  bool IsNull() const { return (*queue_).IsNull(); }
+
+  /** Sets this queue as empty and every slot as free */
+  HSHM_CROSS_FUN
+  void SetNull() {
+    head_ = 0;
+    tail_ = 0;
+    vector_t &queue = (*queue_);
+    for (size_t i = 0; i < queue.size(); ++i) {
+      GetSeq(queue[i]).store(i);
+    }
+  }
+
+  /**====================================
+   * MPMC Queue Methods
+   * ===================================*/
+
+  /** Construct an element at the tail of the queue */
+  template <typename... Args>
+  HSHM_CROSS_FUN qtok_t emplace(Args &&...args) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    qtok_id tail = tail_.load(std::memory_order_relaxed);
+    while (true) {
+      slot_t &slot = queue[tail % depth];
+      qtok_id seq = GetSeq(slot).load(std::memory_order_acquire);
+      i64 diff = (i64)seq - (i64)tail;
+      if (diff == 0) {
+        // The slot is free: claim the ticket
+        if (tail_.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed)) {
+          SetVal(slot, std::forward<Args>(args)...);
+          GetSeq(slot).store(tail + 1, std::memory_order_release);
+          pop_event_.NotifyOne();
+          return qtok_t(tail);
+        }
+      } else if (diff < 0) {
+        // The slot still holds the value from one lap ago
+        return qtok_t::GetNull();
+      } else {
+        // Another producer claimed this ticket
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** Push an element in the queue (wrapper) */
+  template <typename... Args>
+  HSHM_INLINE_CROSS_FUN qtok_t push(Args &&...args) {
+    return emplace(std::forward<Args>(args)...);
+  }
+
+  /**
+   * Push \a val, sleeping while the queue is full
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t push_wait(const T &val, size_t timeout_us = Futex::kForever) {
+    return push_event_.Await([&] { return emplace(val); },
+                             [&] { return GetSize() < GetDepth(); },
+                             timeout_us);
+  }
+
+  /** Pop the head object */
+  HSHM_CROSS_FUN
+  qtok_t pop(T &val) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    qtok_id head;
+    slot_t *slot = ClaimHead(head);
+    if (slot == nullptr) {
+      return qtok_t::GetNull();
+    }
+    val = std::move(GetVal(*slot));
+    GetSeq(*slot).store(head + depth, std::memory_order_release);
+    push_event_.NotifyOne();
+    return qtok_t(head);
+  }
+
+  /**
+   * Pop the head object, sleeping while the queue is empty
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t pop_wait(T &val, size_t timeout_us = Futex::kForever) {
+    return pop_event_.Await([&] { return pop(val); },
+                            [&] { return GetSize() > 0; }, timeout_us);
+  }
+
+  /** Pop the head object and discard it */
+  HSHM_CROSS_FUN
+  qtok_t pop() {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    qtok_id head;
+    slot_t *slot = ClaimHead(head);
+    if (slot == nullptr) {
+      return qtok_t::GetNull();
+    }
+    GetSeq(*slot).store(head + depth, std::memory_order_release);
+    push_event_.NotifyOne();
+    return qtok_t(head);
+  }
+
+  /** Get queue depth */
+  HSHM_CROSS_FUN
+  size_t GetDepth() { return queue_->size(); }
+
+  /** Get size at this moment */
+  HSHM_CROSS_FUN
+  size_t GetSize() {
+    size_t tail = tail_.load();
+    size_t head = head_.load();
+    if (tail < head) {
+      return 0;
+    }
+    return tail - head;
+  }
+
+  /** Get size (wrapper) */
+  HSHM_INLINE_CROSS_FUN
+  size_t size() { return GetSize(); }
+
+  /** Get size (wrapper) */
+  HSHM_INLINE_CROSS_FUN
+  size_t Size() { return GetSize(); }
+
+ private:
+  /**
+   * Claim the slot at the head of the queue
+   *
+   * @param head the ticket of the claimed slot
+   * @return the slot, or nullptr if the queue is empty
+   * */
+  HSHM_INLINE_CROSS_FUN
+  slot_t *ClaimHead(qtok_id &head) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    head = head_.load(std::memory_order_relaxed);
+    while (true) {
+      slot_t &slot = queue[head % depth];
+      qtok_id seq = GetSeq(slot).load(std::memory_order_acquire);
+      i64 diff = (i64)seq - (i64)(head + 1);
+      if (diff == 0) {
+        // The slot is filled: claim the ticket
+        if (head_.compare_exchange_weak(head, head + 1,
+                                        std::memory_order_relaxed)) {
+          return &slot;
+        }
+      } else if (diff < 0) {
+        // The producer of this ticket has not finished
+        return nullptr;
+      } else {
+        // Another consumer claimed this ticket
+        head = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** The sequence number of \a slot */
+  HSHM_INLINE_CROSS_FUN
+  static hipc::atomic<qtok_id> &GetSeq(slot_t &slot) {
+    if constexpr (IS_PTR) {
+      return slot.seq_;
+    } else {
+      return slot.GetFirst();
+    }
+  }
+
+  /** The value of \a slot */
+  HSHM_INLINE_CROSS_FUN
+  static T &GetVal(slot_t &slot) {
+    if constexpr (IS_PTR) {
+      return slot.val_;
+    } else {
+      return slot.GetSecond();
+    }
+  }
+
+  /** Construct the value of \a slot, leaving its sequence untouched */
+  template <typename... Args>
+  HSHM_INLINE_CROSS_FUN void SetVal(slot_t &slot, Args &&...args) {
+    if constexpr (IS_PTR) {
+      slot.val_ = T(std::forward<Args>(args)...);
+    } else {
+      hipc::Allocator::DestructObj(slot.GetSecond());
+      HSHM_MAKE_AR(slot.second_, GetCtxAllocator(),
+                   std::forward<Args>(args)...)
+    }
+  }
+};
+
+template <typename T, HSHM_CLASS_TEMPL_WITH_DEFAULTS>
+using mpmc_queue = mpmc_queue_base<T, false, HSHM_CLASS_TEMPL_ARGS>;
+
+template <typename T, HSHM_CLASS_TEMPL_WITH_DEFAULTS>
+using mpmc_ptr_queue = mpmc_queue_base<T, true, HSHM_CLASS_TEMPL_ARGS>;
+
+}  // namespace hshm::ipc
+
+namespace hshm {
+
+template <typename T, HSHM_CLASS_TEMPL_WITH_PRIV_DEFAULTS>
+using mpmc_queue = hipc::mpmc_queue_base<T, false, HSHM_CLASS_TEMPL_ARGS>;
+
+template <typename T, HSHM_CLASS_TEMPL_WITH_PRIV_DEFAULTS>
+using mpmc_ptr_queue = hipc::mpmc_queue_base<T, true, HSHM_CLASS_TEMPL_ARGS>;
+
+}  // namespace hshm
+
+#undef CLASS_NAME
+#undef CLASS_NEW_ARGS
+
+#endif  // HSHM_SHM_INCLUDE_HSHM_SHM_DATA_STRUCTURES_IPC_MPMC_QUEUE_H_
@@ -206,6 +206,31 @@ class mpsc_lifo_list_queue : public ShmContainer {
   HSHM_INLINE_CROSS_FUN
   qtok_t emplace(T *entry) { return enqueue(entry); }
 
+  /** Enqueue \a count entries with a single atomic operation */
+  HSHM_CROSS_FUN
+  qtok_t enqueue_batch(T **entries, size_t count) {
+    if (count == 0) {
+      return qtok_t::GetNull();
+    }
+    // Link the entries together privately
+    auto *alloc = GetAllocator();
+    for (size_t i = 0; i + 1 < count; ++i) {
+      FullPtr<T> next(alloc, entries[i + 1]);
+      entries[i]->next_shm_ = next.shm_.off_.load();
+    }
+    // Splice the chain onto the list
+    FullPtr<T> head(alloc, entries[0]);
+    T *last = entries[count - 1];
+    bool ret;
+    do {
+      size_t tail_shm = tail_shm_.load();
+      last->next_shm_ = tail_shm;
+      ret = tail_shm_.compare_exchange_weak(tail_shm, head.shm_.off_.load());
+    } while (!ret);
+    count_.fetch_add(count);
+    return qtok_t(1);
+  }
+
   /** Push. wrapper for enqueue */
   HSHM_INLINE_CROSS_FUN
   qtok_t push(T *entry) { return enqueue(entry); }
@@ -46,6 +46,9 @@ class ring_ptr_queue_base : public ShmContainer {
   hipc::opt_atomic<qtok_id, IsPushAtomic> tail_;
   hipc::opt_atomic<qtok_id, IsPopAtomic> head_;
   ibitfield flags_;
+  /** Consumers sleep on pop_event_, producers on push_event_ */
+  Futex pop_event_;
+  Futex push_event_;
 
  public:
   /**====================================
@@ -203,17 +206,7 @@ class ring_ptr_queue_base : public ShmContainer {
     // Check if there's space in the queue.
     if constexpr (IsPushAtomic) {
       if constexpr (!HasFixedReqs) {
-        size_t size = tail - head + 1;
-        if (size > queue.size()) {
-          while (true) {
-            head = head_.load();
-            size = tail - head + 1;
-            if (size <= GetDepth()) {
-              break;
-            }
-            HSHM_THREAD_MODEL->Yield();
-          }
-        }
+        WaitForSlot(tail);
       }
     } else {
       size_t size = tail - head + 1;
@@ -223,13 +216,7 @@ class ring_ptr_queue_base : public ShmContainer {
       }
     }
 
-    // Emplace into queue at our slot
-    size_t depth = queue.size();
-    uint32_t idx = tail % depth;
-    Mark(val, queue[idx]);
-
-    // Let pop know that the data is fully prepared
-    return qtok_t(tail);
+    return EmplaceAt(tail, val);
   }
 
   /** Push an elemnt in the list (wrapper) */
@@ -238,6 +225,93 @@ class ring_ptr_queue_base : public ShmContainer {
     return emplace(std::forward<Args>(args)...);
   }
 
+  /**
+   * Push the \a count values at \a vals. Their slots are reserved with a
+   * single update of the tail, so a batch costs one contended atomic.
+   *
+   * @return the number of values pushed. Queues with atomic pushes wait
+   * for space and push all of them; others stop when the queue is full.
+   * */
+  HSHM_CROSS_FUN
+  size_t push_n(const T *vals, size_t count) {
+    size_t depth = GetDepth();
+    if constexpr (IsPushAtomic) {
+      // A reservation larger than the queue would never fit
+      for (size_t off = 0; off < count; off += depth) {
+        size_t n = count - off < depth ? count - off : depth;
+        qtok_id tail = tail_.fetch_add(n);
+        if constexpr (!HasFixedReqs) {
+          WaitForSlot(tail + n - 1);
+        }
+        FillSlots(tail, vals + off, n);
+      }
+      return count;
+    } else {
+      qtok_id tail = tail_.load();
+      qtok_id head = head_.load();
+      size_t n = depth - (tail - head);
+      if (n > count) {
+        n = count;
+      }
+      if (n == 0) {
+        return 0;
+      }
+      tail_.fetch_add(n);
+      FillSlots(tail, vals, n);
+      return n;
+    }
+  }
+
+  /**
+   * Pop up to \a max objects into \a out. The head is advanced once for
+   * the whole batch.
+   *
+   * @return the number of objects popped
+   * */
+  HSHM_CROSS_FUN
+  size_t pop_n(T *out, size_t max) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    qtok_id head = head_.load();
+    qtok_id tail = tail_.load();
+    size_t n = 0;
+    for (; n < max && head + n < tail; ++n) {
+      T &entry = queue[(size_t)((head + n) % depth)];
+      if (!IsMarked(entry)) {
+        break;
+      }
+      Unmark(out[n], entry);
+    }
+    if (n > 0) {
+      head_.fetch_add(n);
+      push_event_.NotifyAll();
+    }
+    return n;
+  }
+
+  /**
+   * Push \a val, sleeping while the queue is full
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t push_wait(const T &val, size_t timeout_us = Futex::kForever) {
+    return push_event_.Await([&] { return TryEmplace(val); },
+                             [&] { return GetSize() < GetDepth(); },
+                             timeout_us);
+  }
+
+  /**
+   * Pop the head object, sleeping while the queue is empty
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t pop_wait(T &val, size_t timeout_us = Futex::kForever) {
+    return pop_event_.Await([&] { return pop(val); },
+                            [&] { return GetSize() > 0; }, timeout_us);
+  }
+
  public:
   /** Consumer pops the head object */
   HSHM_CROSS_FUN
@@ -260,6 +334,7 @@ class ring_ptr_queue_base : public ShmContainer {
     if (is_marked) {
       Unmark(val, entry);
       head_.fetch_add(1);
+      push_event_.NotifyAll();
       return qtok_t(head);
     } else {
       return qtok_t::GetNull();
@@ -284,6 +359,7 @@ class ring_ptr_queue_base : public ShmContainer {
     bool is_marked = IsMarked(entry);
     if (is_marked) {
       head_.fetch_add(1);
+      push_event_.NotifyAll();
       return qtok_t(head);
     } else {
       return qtok_t::GetNull();
@@ -312,12 +388,68 @@ class ring_ptr_queue_base : public ShmContainer {
     if (is_marked) {
       Unmark(val, entry);
       tail_.fetch_sub(1);
+      push_event_.NotifyAll();
       return qtok_t(tail);
     } else {
       return qtok_t::GetNull();
     }
   }
 
+  /**
+   * Mark \a val into the slot of ticket \a tail, which was reserved by
+   * the caller, and let pop know it is ready
+   * */
+  HSHM_INLINE_CROSS_FUN
+  qtok_t EmplaceAt(qtok_id tail, const T &val) {
+    vector_t &queue = (*queue_);
+    Mark(val, queue[(size_t)(tail % queue.size())]);
+    pop_event_.NotifyOne();
+    return qtok_t(tail);
+  }
+
+  /**
+   * Emplace only if the queue has space. Atomic pushes reserve their
+   * ticket with a CAS instead of waiting for it in emplace, so a caller
+   * that gives up never leaves a reserved slot empty.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  qtok_t TryEmplace(const T &val) {
+    if constexpr (!IsPushAtomic) {
+      return emplace(val);
+    } else {
+      while (true) {
+        // The head never passes a tail read after it
+        qtok_id head = head_.load();
+        qtok_id tail = tail_.load();
+        if (tail - head >= GetDepth()) {
+          return qtok_t::GetNull();
+        }
+        if (tail_.compare_exchange_weak(tail, tail + 1)) {
+          return EmplaceAt(tail, val);
+        }
+      }
+    }
+  }
+
+  /** Wait until the slot of ticket \a tail is free */
+  HSHM_INLINE_CROSS_FUN
+  void WaitForSlot(qtok_id tail) {
+    while (tail - head_.load() >= GetDepth()) {
+      push_event_.Wait([&] { return tail - head_.load() < GetDepth(); });
+    }
+  }
+
+  /** Mark \a n values into the slots reserved from ticket \a tail */
+  HSHM_INLINE_CROSS_FUN
+  void FillSlots(qtok_id tail, const T *vals, size_t n) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    for (size_t i = 0; i < n; ++i) {
+      Mark(vals[i], queue[(size_t)((tail + i) % depth)]);
+    }
+    pop_event_.Notify(n < INT_MAX ? (int)n : INT_MAX);
+  }
+
   /** Mark an entry */
   HSHM_INLINE_CROSS_FUN
   void Mark(const T &val, T &entry) {
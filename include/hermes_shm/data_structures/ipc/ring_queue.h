@@ -51,9 +51,25 @@ class ring_queue_base : public ShmContainer {
    * Variables
    * ===================================*/
   delay_ar<vector_t> queue_;
+  ibitfield flags_;
+  /**
+   * Producers and the consumer each own a cache line, so a push does not
+   * invalidate the line the consumer polls. Each side keeps a copy of the
+   * other's index and only reads the shared one when its copy says the
+   * queue is full (producers) or empty (consumer). The queue may be placed
+   * at any offset, so each group is followed by a full line of padding.
+   * */
+  char pad0_[64];
   hipc::opt_atomic<qtok_id, IsPushAtomic> tail_;
+  hipc::opt_atomic<qtok_id, IsPushAtomic> head_cache_;
+  char pad1_[64];
   hipc::opt_atomic<qtok_id, IsPopAtomic> head_;
-  ibitfield flags_;
+  hipc::opt_atomic<qtok_id, IsPopAtomic> tail_cache_;
+  char pad2_[64];
+  /** Consumers sleep on pop_event_, producers on push_event_ */
+  Futex pop_event_;
+  Futex push_event_;
+  char pad3_[64];
 
  public:
   /**====================================
@@ -111,8 +127,7 @@ class ring_queue_base : public ShmContainer {
   /** SHM copy constructor + operator main */
   HSHM_CROSS_FUN
   void shm_strong_copy_op(const ring_queue_base &other) {
-    head_ = other.head_.load();
-    tail_ = other.tail_.load();
+    SetIndices(other.head_.load(), other.tail_.load());
     (*queue_) = (*other.queue_);
   }
 
@@ -154,8 +169,7 @@ class ring_queue_base : public ShmContainer {
       init_shm_container(alloc);
     }
     if (GetAllocator() == other.GetAllocator()) {
-      head_ = other.head_.load();
-      tail_ = other.tail_.load();
+      SetIndices(other.head_.load(), other.tail_.load());
       (*queue_) = std::move(*other.queue_);
       other.SetNull();
     } else {
@@ -178,9 +192,15 @@ class ring_queue_base : public ShmContainer {
 
   /** Sets this list as empty */
   HSHM_CROSS_FUN
-  void SetNull() {
-    head_ = 0;
-    tail_ = 0;
+  void SetNull() { SetIndices(0, 0); }
+
+  /** Set the head and tail, along with the copies of them */
+  HSHM_CROSS_FUN
+  void SetIndices(qtok_id head, qtok_id tail) {
+    head_ = head;
+    head_cache_ = head;
+    tail_ = tail;
+    tail_cache_ = tail;
   }
 
   /**====================================
@@ -200,43 +220,30 @@ class ring_queue_base : public ShmContainer {
   HSHM_CROSS_FUN qtok_t emplace(Args &&...args) {
     // Allocate a slot in the queue
     // The slot is marked NULL, so pop won't do anything if context switch
-    qtok_id head = head_.load();
     qtok_id tail = tail_.fetch_add(1);
     vector_t &queue = (*queue_);
 
-    // Check if there's space in the queue.
+    // Check if there's space in the queue. The head is only re-read when
+    // the cached copy says the queue is full.
     if constexpr (IsPushAtomic) {
       if constexpr (!HasFixedReqs) {
-        size_t size = tail - head + 1;
-        if (size > queue.size()) {
-          while (true) {
-            head = head_.load();
-            size = tail - head + 1;
-            if (size <= GetDepth()) {
-              break;
-            }
-            HSHM_THREAD_MODEL->Yield();
-          }
-        }
+        WaitForSlot(tail);
       }
     } else {
+      qtok_id head = head_cache_.load();
       qtok_id size = tail - head + 1;
+      if (size > queue.size()) {
+        head = head_.load();
+        head_cache_ = head;
+        size = tail - head + 1;
+      }
       if (size > queue.size()) {
         tail_.fetch_sub(1);
         return qtok_t::GetNull();
       }
     }
 
-    // Emplace into queue at our slot
-    uint32_t idx = tail % queue.size();
-    auto iter = queue.begin() + idx;
-    queue.replace(iter, hshm::PiecewiseConstruct(), make_argpack(),
-                  make_argpack(std::forward<Args>(args)...));
-
-    // Let pop know that the data is fully prepared
-    pair_t &entry = (*iter);
-    entry.GetFirst().SetBits(1);
-    return qtok_t(tail);
+    return EmplaceAt(tail, std::forward<Args>(args)...);
   }
 
   /** Push an elemnt in the list (wrapper) */
@@ -245,13 +252,103 @@ class ring_queue_base : public ShmContainer {
     return emplace(std::forward<Args>(args)...);
   }
 
+  /**
+   * Push the \a count values at \a vals. Their slots are reserved with a
+   * single update of the tail, so a batch costs one contended atomic.
+   *
+   * @return the number of values pushed. Queues with atomic pushes wait
+   * for space and push all of them; others stop when the queue is full.
+   * */
+  HSHM_CROSS_FUN
+  size_t push_n(const T *vals, size_t count) {
+    size_t depth = GetDepth();
+    if constexpr (IsPushAtomic) {
+      // A reservation larger than the queue would never fit
+      for (size_t off = 0; off < count; off += depth) {
+        size_t n = count - off < depth ? count - off : depth;
+        qtok_id tail = tail_.fetch_add(n);
+        if constexpr (!HasFixedReqs) {
+          WaitForSlot(tail + n - 1);
+        }
+        FillSlots(tail, vals + off, n);
+      }
+      return count;
+    } else {
+      qtok_id tail = tail_.load();
+      qtok_id head = head_cache_.load();
+      if (tail - head + count > depth) {
+        head = head_.load();
+        head_cache_ = head;
+      }
+      size_t n = depth - (tail - head);
+      if (n > count) {
+        n = count;
+      }
+      if (n == 0) {
+        return 0;
+      }
+      tail_.fetch_add(n);
+      FillSlots(tail, vals, n);
+      return n;
+    }
+  }
+
+  /**
+   * Pop up to \a max objects into \a out. The head is advanced once for
+   * the whole batch.
+   *
+   * @return the number of objects popped
+   * */
+  HSHM_CROSS_FUN
+  size_t pop_n(T *out, size_t max) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    qtok_id head = head_.load();
+    size_t n = 0;
+    for (; n < max && !IsEmptyAt(head + n); ++n) {
+      pair_t &entry = queue[(size_t)((head + n) % depth)];
+      if (!entry.GetFirst().Any(1)) {
+        break;
+      }
+      out[n] = std::move(entry.GetSecond());
+      entry.GetFirst().Clear();
+    }
+    if (n > 0) {
+      head_.fetch_add(n);
+      push_event_.NotifyAll();
+    }
+    return n;
+  }
+
+  /**
+   * Push \a val, sleeping while the queue is full
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t push_wait(const T &val, size_t timeout_us = Futex::kForever) {
+    return push_event_.Await([&] { return TryEmplace(val); },
+                             [&] { return GetSize() < GetDepth(); },
+                             timeout_us);
+  }
+
+  /**
+   * Pop the head object, sleeping while the queue is empty
+   *
+   * @return a null token if \a timeout_us passed first
+   * */
+  HSHM_CROSS_FUN
+  qtok_t pop_wait(T &val, size_t timeout_us = Futex::kForever) {
+    return pop_event_.Await([&] { return pop(val); },
+                            [&] { return GetSize() > 0; }, timeout_us);
+  }
+
   /** Consumer pops the head object */
   HSHM_CROSS_FUN
   qtok_t pop(T &val) {
     // Don't pop if there's no entries
     qtok_id head = head_.load();
-    qtok_id tail = tail_.load();
-    if (head >= tail) {
+    if (IsEmptyAt(head)) {
       return qtok_t::GetNull();
     }
 
@@ -262,6 +359,7 @@ class ring_queue_base : public ShmContainer {
       val = std::move(entry.GetSecond());
       entry.GetFirst().Clear();
       head_.fetch_add(1);
+      push_event_.NotifyAll();
       return qtok_t(head);
     } else {
       return qtok_t::GetNull();
@@ -273,8 +371,7 @@ class ring_queue_base : public ShmContainer {
   qtok_t pop() {
     // Don't pop if there's no entries
     qtok_id head = head_.load();
-    qtok_id tail = tail_.load();
-    if (head >= tail) {
+    if (IsEmptyAt(head)) {
       return qtok_t::GetNull();
     }
 
@@ -284,6 +381,7 @@ class ring_queue_base : public ShmContainer {
     if (entry.GetFirst().Any(1)) {
       entry.GetFirst().Clear();
       head_.fetch_add(1);
+      push_event_.NotifyAll();
       return qtok_t(head);
     } else {
       return qtok_t::GetNull();
@@ -308,6 +406,8 @@ class ring_queue_base : public ShmContainer {
       val = std::move(entry.GetSecond());
       entry.GetFirst().Clear();
       tail_.fetch_sub(1);
+      tail_cache_ = tail;
+      push_event_.NotifyAll();
       return qtok_t(tail);
     } else {
       return qtok_t::GetNull();
@@ -319,8 +419,7 @@ class ring_queue_base : public ShmContainer {
   qtok_t peek(T *&val, int off = 0) {
     // Don't pop if there's no entries
     qtok_id head = head_.load() + off;
-    qtok_id tail = tail_.load();
-    if (head >= tail) {
+    if (IsEmptyAt(head)) {
       return qtok_t::GetNull();
     }
 
@@ -340,8 +439,7 @@ class ring_queue_base : public ShmContainer {
   qtok_t peek(pair_t *&val, int off = 0) {
     // Don't pop if there's no entries
     qtok_id head = head_.load() + off;
-    qtok_id tail = tail_.load();
-    if (head >= tail) {
+    if (IsEmptyAt(head)) {
       return qtok_t::GetNull();
     }
 
@@ -360,6 +458,107 @@ class ring_queue_base : public ShmContainer {
   HSHM_CROSS_FUN
   size_t GetDepth() { return queue_->size(); }
 
+ private:
+  /**
+   * Construct an element in the slot of ticket \a tail, which was
+   * reserved by the caller, and let pop know it is ready
+   * */
+  template <typename... Args>
+  HSHM_INLINE_CROSS_FUN qtok_t EmplaceAt(qtok_id tail, Args &&...args) {
+    vector_t &queue = (*queue_);
+    uint32_t idx = tail % queue.size();
+    auto iter = queue.begin() + idx;
+    queue.replace(iter, hshm::PiecewiseConstruct(), make_argpack(),
+                  make_argpack(std::forward<Args>(args)...));
+
+    // Let pop know that the data is fully prepared
+    pair_t &entry = (*iter);
+    entry.GetFirst().SetBits(1);
+    pop_event_.NotifyOne();
+    return qtok_t(tail);
+  }
+
+  /**
+   * Emplace only if the queue has space. Atomic pushes reserve their
+   * ticket with a CAS instead of waiting for it in emplace, so a caller
+   * that gives up never leaves a reserved slot empty.
+   * */
+  template <typename... Args>
+  HSHM_INLINE_CROSS_FUN qtok_t TryEmplace(Args &&...args) {
+    if constexpr (!IsPushAtomic) {
+      return emplace(std::forward<Args>(args)...);
+    } else {
+      while (true) {
+        // The head never passes a tail read after it
+        qtok_id head = head_.load();
+        qtok_id tail = tail_.load();
+        if (tail - head >= GetDepth()) {
+          return qtok_t::GetNull();
+        }
+        if (tail_.compare_exchange_weak(tail, tail + 1)) {
+          return EmplaceAt(tail, std::forward<Args>(args)...);
+        }
+      }
+    }
+  }
+
+  /**
+   * Wait until the slot of ticket \a tail is free. The head is only
+   * re-read when the cached copy says the queue is full.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void WaitForSlot(qtok_id tail) {
+    qtok_id head = head_cache_.load();
+    if (tail - head < GetDepth()) {
+      return;
+    }
+    while (true) {
+      head = head_.load();
+      if (tail - head < GetDepth()) {
+        break;
+      }
+      push_event_.Wait([&] { return tail - head_.load() < GetDepth(); });
+    }
+    head_cache_ = head;
+  }
+
+  /**
+   * Copy \a n values into the slots reserved from ticket \a tail and
+   * mark them ready. Trivially copyable values are assigned in place
+   * rather than destroyed and constructed.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void FillSlots(qtok_id tail, const T *vals, size_t n) {
+    vector_t &queue = (*queue_);
+    size_t depth = queue.size();
+    for (size_t i = 0; i < n; ++i) {
+      size_t idx = (size_t)((tail + i) % depth);
+      if constexpr (std::is_trivially_copyable_v<T>) {
+        queue[idx].GetSecond() = vals[i];
+      } else {
+        queue.replace(queue.begin() + idx, hshm::PiecewiseConstruct(),
+                      make_argpack(), make_argpack(vals[i]));
+      }
+      queue[idx].GetFirst().SetBits(1);
+    }
+    pop_event_.Notify(n < INT_MAX ? (int)n : INT_MAX);
+  }
+
+  /**
+   * Whether the consumer has no entry at \a head. The tail is only
+   * re-read when the cached copy says there is none.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool IsEmptyAt(qtok_id head) {
+    if (head < tail_cache_.load()) {
+      return false;
+    }
+    qtok_id tail = tail_.load();
+    tail_cache_ = tail;
+    return head >= tail;
+  }
+
+ public:
   /** Get size at this moment */
   HSHM_CROSS_FUN
   size_t GetSize() {
@@ -214,6 +214,46 @@ class split_ticket_queue : public ShmContainer {
     }
     return qtok_t::GetNull();
   }
+
+  /**
+   * Push \a count tickets, filling one split before moving on to the
+   * next, so a batch takes one lock per split it touches
+   *
+   * @return the number of tickets pushed
+   * */
+  HSHM_CROSS_FUN
+  size_t push_n(const T *tkts, size_t count) {
+    uint16_t rr = rr_tail_.fetch_add(1);
+    auto &splits = (*splits_);
+    size_t num_splits = splits.size();
+    uint16_t qid_start = rr % num_splits;
+    size_t done = 0;
+    for (size_t i = 0; i < num_splits && done < count; ++i) {
+      uint32_t qid = (qid_start + i) % num_splits;
+      done += splits[qid].push_n(tkts + done, count - done);
+    }
+    return done;
+  }
+
+  /**
+   * Pop up to \a max tickets, draining one split before moving on to
+   * the next
+   *
+   * @return the number of tickets popped
+   * */
+  HSHM_CROSS_FUN
+  size_t pop_n(T *tkts, size_t max) {
+    uint16_t rr = rr_head_.fetch_add(1);
+    auto &splits = (*splits_);
+    size_t num_splits = splits.size();
+    uint16_t qid_start = rr % num_splits;
+    size_t done = 0;
+    for (size_t i = 0; i < num_splits && done < max; ++i) {
+      uint32_t qid = (qid_start + i) % num_splits;
+      done += splits[qid].pop_n(tkts + done, max - done);
+    }
+    return done;
+  }
 };
 
 }  // namespace hshm::ipc
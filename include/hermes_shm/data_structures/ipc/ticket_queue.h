@@ -186,6 +186,22 @@ class ticket_queue : public ShmContainer {
     lock_.Unlock();
     return qtok;
   }
+
+  /** Push \a count tickets under one acquisition of the lock */
+  HSHM_INLINE_CROSS_FUN size_t push_n(const T *tkts, size_t count) {
+    lock_.Lock(0);
+    size_t n = queue_->push_n(tkts, count);
+    lock_.Unlock();
+    return n;
+  }
+
+  /** Pop up to \a max tickets under one acquisition of the lock */
+  HSHM_INLINE_CROSS_FUN size_t pop_n(T *tkts, size_t max) {
+    lock_.Lock(0);
+    size_t n = queue_->pop_n(tkts, max);
+    lock_.Unlock();
+    return n;
+  }
 };
 
 }  // namespace hshm::ipc
@@ -3,20 +3,33 @@
 
 #include "hermes_shm/introspect/system_info.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 #include "hermes_shm/constants/macros.h"
+#include "hermes_shm/util/timer.h"
 #if defined(HSHM_ENABLE_PROCFS_SYSINFO)
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
 #if __linux__
+#include <linux/futex.h>
 #include <sys/sysinfo.h>
 #else
 #include <sys/sysctl.h>
 #endif
+#include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
 #include <windows.h>
@@ -273,6 +286,41 @@ void SystemInfo::YieldThread() {
 #endif
 }
 
+bool SystemInfo::FutexWait(void *addr, u32 expected, size_t timeout_us) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(SYS_futex)
+  // Not FUTEX_PRIVATE_FLAG: the word may be shared between processes
+  struct timespec ts;
+  struct timespec *tsp = nullptr;
+  if (timeout_us != kFutexForever) {
+    ts.tv_sec = timeout_us / 1000000;
+    ts.tv_nsec = (timeout_us % 1000000) * 1000;
+    tsp = &ts;
+  }
+  long ret = syscall(SYS_futex, addr, FUTEX_WAIT, expected, tsp, nullptr, 0);
+  return ret == 0 || errno != ETIMEDOUT;
+#else
+  // No futex: wake up often enough to notice the change
+  (void)addr;
+  (void)expected;
+  size_t us = timeout_us < 50 ? timeout_us : 50;
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  usleep(us);
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  Sleep((DWORD)((us + 999) / 1000));
+#endif
+  return true;
+#endif
+}
+
+void SystemInfo::FutexWake(void *addr, int count) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(SYS_futex)
+  syscall(SYS_futex, addr, FUTEX_WAKE, count, nullptr, nullptr, 0);
+#else
+  (void)addr;
+  (void)count;
+#endif
+}
+
 bool SystemInfo::CreateTls(ThreadLocalKey &key, void *data) {
 #ifdef HSHM_ENABLE_PROCFS_SYSINFO
   key.pthread_key_ = pthread_key_create(&key.pthread_key_, nullptr);
@@ -337,6 +385,14 @@ bool SystemInfo::OpenSharedMemory(File &fd, const std::string &name) {
 #endif
 }
 
+bool SystemInfo::ResizeSharedMemory(const File &fd, size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  return ftruncate(fd.posix_fd_, size) == 0;
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  return false;
+#endif
+}
+
 void SystemInfo::CloseSharedMemory(File &file) {
 #if defined(HSHM_ENABLE_PROCFS_SYSINFO)
   close(file.posix_fd_);
@@ -406,6 +462,412 @@ void SystemInfo::UnmapMemory(void *ptr, size_t size) {
 #endif
 }
 
+bool SystemInfo::CreateNewFileMemory(File &fd, const std::string &path,
+                                     size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  fd.posix_fd_ = open(path.c_str(), O_CREAT | O_RDWR, 0666);
+  if (fd.posix_fd_ < 0) {
+    return false;
+  }
+  int ret = ftruncate(fd.posix_fd_, size);
+  if (ret < 0) {
+    close(fd.posix_fd_);
+    return false;
+  }
+  return true;
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  return false;
+#endif
+}
+
+bool SystemInfo::OpenFileMemory(File &fd, const std::string &path) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  fd.posix_fd_ = open(path.c_str(), O_RDWR, 0666);
+  return fd.posix_fd_ >= 0;
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  return false;
+#endif
+}
+
+void SystemInfo::DestroyFileMemory(const std::string &path) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  unlink(path.c_str());
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+#endif
+}
+
+void *SystemInfo::MapSyncMemory(const File &fd, size_t size, i64 off) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(MAP_SYNC) && \
+    defined(MAP_SHARED_VALIDATE)
+  // Fails with EOPNOTSUPP unless the file is on a DAX filesystem
+  void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED_VALIDATE | MAP_SYNC, fd.posix_fd_, off);
+  if (ptr == MAP_FAILED) {
+    return nullptr;
+  }
+  return ptr;
+#else
+  return nullptr;
+#endif
+}
+
+bool SystemInfo::SyncMemory(void *ptr, size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  size_t page_size = (size_t)GetPageSize();
+  size_t start = (size_t)ptr & ~(page_size - 1);
+  return msync(reinterpret_cast<void *>(start), (size_t)ptr + size - start,
+               MS_SYNC) == 0;
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  return FlushViewOfFile(ptr, size) != 0;
+#endif
+}
+
+bool SystemInfo::LockFile(const File &fd, bool exclusive, bool wait) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+#if defined(F_OFD_SETLK)
+  // Open file description locks convert between modes atomically
+  struct flock lock = {};
+  lock.l_type = exclusive ? F_WRLCK : F_RDLCK;
+  lock.l_whence = SEEK_SET;
+  return fcntl(fd.posix_fd_, wait ? F_OFD_SETLKW : F_OFD_SETLK, &lock) == 0;
+#else
+  int op = (exclusive ? LOCK_EX : LOCK_SH) | (wait ? 0 : LOCK_NB);
+  return flock(fd.posix_fd_, op) == 0;
+#endif
+#elif defined(HSHM_ENABLE_WINDOWS_SYSINFO)
+  return false;
+#endif
+}
+
+bool SystemInfo::CreateSealedMemory(File &fd, const std::string &name,
+                                    size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(MFD_ALLOW_SEALING)
+  fd.posix_fd_ = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd.posix_fd_ < 0) {
+    return false;
+  }
+  // Sealing the size lets processes that receive the fd trust it
+  if (ftruncate(fd.posix_fd_, size) < 0 ||
+      fcntl(fd.posix_fd_, F_ADD_SEALS,
+            F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+    close(fd.posix_fd_);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::IsSealedMemory(const File &fd) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(F_GET_SEALS)
+  int seals = fcntl(fd.posix_fd_, F_GET_SEALS);
+  int need = F_SEAL_GROW | F_SEAL_SHRINK;
+  return seals >= 0 && (seals & need) == need;
+#else
+  return false;
+#endif
+}
+
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_CMSG_CLOEXEC
+#define MSG_CMSG_CLOEXEC 0
+#endif
+
+/**
+ * Fill in a Unix socket address. A path starting with '@' names a socket in
+ * the Linux abstract namespace, which leaves nothing behind on a crash.
+ * */
+static bool MakeSocketAddr(const std::string &path, struct sockaddr_un &addr,
+                           socklen_t &len) {
+  addr = {};
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size());
+  if (path[0] == '@') {
+    addr.sun_path[0] = 0;
+  }
+  len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + path.size());
+  return true;
+}
+#endif
+
+bool SystemInfo::ListenSocket(File &sock, const std::string &path) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  struct sockaddr_un addr;
+  socklen_t len;
+  if (!MakeSocketAddr(path, addr, len)) {
+    return false;
+  }
+  sock.posix_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock.posix_fd_ < 0) {
+    return false;
+  }
+  if (path[0] != '@') {
+    unlink(path.c_str());
+  }
+  if (bind(sock.posix_fd_, (struct sockaddr *)&addr, len) < 0 ||
+      listen(sock.posix_fd_, SOMAXCONN) < 0) {
+    close(sock.posix_fd_);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::AcceptSocket(const File &sock, File &conn) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  do {
+#if defined(__linux__)
+    conn.posix_fd_ = accept4(sock.posix_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+#else
+    conn.posix_fd_ = accept(sock.posix_fd_, nullptr, nullptr);
+#endif
+  } while (conn.posix_fd_ < 0 && errno == EINTR);
+  return conn.posix_fd_ >= 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::ConnectSocket(File &sock, const std::string &path) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  struct sockaddr_un addr;
+  socklen_t len;
+  if (!MakeSocketAddr(path, addr, len)) {
+    return false;
+  }
+  sock.posix_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (sock.posix_fd_ < 0) {
+    return false;
+  }
+  if (connect(sock.posix_fd_, (struct sockaddr *)&addr, len) < 0) {
+    close(sock.posix_fd_);
+    return false;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SystemInfo::CloseSocket(File &sock, const std::string &path) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  close(sock.posix_fd_);
+  if (!path.empty() && path[0] != '@') {
+    unlink(path.c_str());
+  }
+#endif
+}
+
+bool SystemInfo::SendFile(const File &sock, const File &fd) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  char byte = 0;
+  struct iovec iov = {&byte, 1};
+  alignas(struct cmsghdr) char ctl[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl;
+  msg.msg_controllen = sizeof(ctl);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(cmsg), &fd.posix_fd_, sizeof(int));
+  ssize_t ret;
+  do {
+    ret = sendmsg(sock.posix_fd_, &msg, MSG_NOSIGNAL);
+  } while (ret < 0 && errno == EINTR);
+  return ret == 1;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::RecvFile(const File &sock, File &fd) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  char byte;
+  struct iovec iov = {&byte, 1};
+  alignas(struct cmsghdr) char ctl[CMSG_SPACE(sizeof(int))] = {};
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl;
+  msg.msg_controllen = sizeof(ctl);
+  ssize_t ret;
+  do {
+    ret = recvmsg(sock.posix_fd_, &msg, MSG_CMSG_CLOEXEC);
+  } while (ret < 0 && errno == EINTR);
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (ret != 1 || cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+    return false;
+  }
+  memcpy(&fd.posix_fd_, CMSG_DATA(cmsg), sizeof(int));
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::AdviseHugePages(void *ptr, size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(MADV_HUGEPAGE)
+  return madvise(ptr, size, MADV_HUGEPAGE) == 0;
+#else
+  return false;
+#endif
+}
+
+bool SystemInfo::BindNumaMemory(void *ptr, size_t size, NumaPolicy policy,
+                                u64 node_mask) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(SYS_mbind)
+  if (policy == NumaPolicy::kDefault) {
+    return true;
+  }
+  unsigned long mask = (unsigned long)node_mask;
+  // The kernel reads maxnode - 1 bits of the mask, so pass one extra
+  long ret = syscall(SYS_mbind, ptr, size, (int)policy, &mask,
+                     sizeof(mask) * 8 + 1, 0);
+  return ret == 0;
+#else
+  return false;
+#endif
+}
+
+void SystemInfo::PrefaultMemory(void *ptr, size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+#if defined(__linux__)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+  if (madvise(ptr, size, MADV_POPULATE_WRITE) == 0) {
+    return;
+  }
+#endif
+  // Older kernels: touch each page
+  size_t page_size = (size_t)GetPageSize();
+  volatile char *data = reinterpret_cast<volatile char *>(ptr);
+  for (size_t off = 0; off < size; off += page_size) {
+    data[off] = data[off];
+  }
+#endif
+}
+
+/**
+ * Pre-fault [ptr, ptr + size) on \a nthreads threads, or one per CPU if
+ * \a nthreads is not positive, and zero it if \a zero is set. Each
+ * thread is pinned to its own CPU and touches one contiguous chunk, so
+ * under the default NUMA policy each chunk is placed on the node of the
+ * thread that touched it. Chunks are multiples of 2MB so that a huge page
+ * is never split between threads.
+ *
+ * @return the milliseconds spent
+ * */
+double SystemInfo::ParallelPrefaultMemory(void *ptr, size_t size, bool zero,
+                                          int nthreads) {
+  hshm::Timer timer;
+  timer.Resume();
+  if (nthreads <= 0) {
+    nthreads = GetCpuCount();
+  }
+  size_t align = hshm::Unit<size_t>::Megabytes(2);
+  size_t chunk = (size + nthreads - 1) / nthreads;
+  chunk = (chunk + align - 1) / align * align;
+  if (chunk == 0) {
+    chunk = align;
+  }
+  size_t nchunks = (size + chunk - 1) / chunk;
+  auto touch = [ptr, size, chunk, zero](size_t i) {
+    char *start = reinterpret_cast<char *>(ptr) + i * chunk;
+    size_t len = std::min(chunk, size - i * chunk);
+    if (zero) {
+      memset(start, 0, len);
+    } else {
+      PrefaultMemory(start, len);
+    }
+  };
+  if (nchunks <= 1) {
+    if (nchunks == 1) {
+      touch(0);
+    }
+    timer.Pause();
+    return timer.GetMsec();
+  }
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(__linux__)
+  cpu_set_t allowed;
+  std::vector<int> cpus;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed)) {
+        cpus.push_back(cpu);
+      }
+    }
+  }
+#endif
+  std::vector<std::thread> workers;
+  workers.reserve(nchunks);
+  for (size_t i = 0; i < nchunks; ++i) {
+    workers.emplace_back([&, i]() {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO) && defined(__linux__)
+      if (!cpus.empty()) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cpus[i % cpus.size()], &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+      }
+#endif
+      touch(i);
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  timer.Pause();
+  return timer.GetMsec();
+}
+
+/**
+ * Release the physical memory of the whole pages in [ptr, ptr + size).
+ * The pages read as zero when next touched. The backing store of shared
+ * mappings is freed as well, so the memory is returned even while other
+ * processes map it.
+ *
+ * @return the number of bytes released
+ * */
+size_t SystemInfo::DiscardMemory(void *ptr, size_t size) {
+#if defined(HSHM_ENABLE_PROCFS_SYSINFO)
+  size_t page_size = (size_t)GetPageSize();
+  size_t start = ((size_t)ptr + page_size - 1) & ~(page_size - 1);
+  size_t end = ((size_t)ptr + size) & ~(page_size - 1);
+  if (end <= start) {
+    return 0;
+  }
+  void *addr = reinterpret_cast<void *>(start);
+#if defined(MADV_REMOVE)
+  // Punches a hole in the shm object; fails on private mappings
+  if (madvise(addr, end - start, MADV_REMOVE) == 0) {
+    return end - start;
+  }
+#endif
+  if (madvise(addr, end - start, MADV_DONTNEED) == 0) {
+    return end - start;
+  }
+#endif
+  return 0;
+}
+
 void *SystemInfo::AlignedAlloc(size_t alignment, size_t size) {
 #if defined(HSHM_ENABLE_PROCFS_SYSINFO)
   return aligned_alloc(alignment, size);
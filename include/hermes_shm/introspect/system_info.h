@@ -40,6 +40,14 @@ union File {
   HANDLE windows_fd_;
 };
 
+/** NUMA memory placement policies (values match Linux MPOL_*) */
+enum class NumaPolicy {
+  kDefault = 0,    /**< Allocate on the node of the faulting CPU */
+  kPreferred = 1,  /**< Prefer the first node in the mask */
+  kBind = 2,       /**< Only allocate on the nodes in the mask */
+  kInterleave = 3  /**< Interleave pages across the nodes in the mask */
+};
+
 /** A unification of certain OS system calls */
 class SystemInfo {
  public:
@@ -52,6 +60,8 @@ class SystemInfo {
 #ifdef HSHM_IS_HOST
   std::vector<size_t> cur_cpu_freq_;
 #endif
+  /** A FutexWait timeout that never expires */
+  static constexpr size_t kFutexForever = ~(size_t)0;
 
  public:
   HSHM_CROSS_FUN
@@ -93,6 +103,10 @@ class SystemInfo {
 
   HSHM_DLL static void YieldThread();
 
+  HSHM_DLL static bool FutexWait(void *addr, u32 expected, size_t timeout_us);
+
+  HSHM_DLL static void FutexWake(void *addr, int count);
+
   HSHM_DLL static bool CreateTls(ThreadLocalKey &key, void *data);
 
   HSHM_DLL static bool SetTls(const ThreadLocalKey &key, void *data);
@@ -104,6 +118,8 @@ class SystemInfo {
 
   HSHM_DLL static bool OpenSharedMemory(File &fd, const std::string &name);
 
+  HSHM_DLL static bool ResizeSharedMemory(const File &fd, size_t size);
+
   HSHM_DLL static void CloseSharedMemory(File &file);
 
   HSHM_DLL static void DestroySharedMemory(const std::string &name);
@@ -114,6 +130,48 @@ class SystemInfo {
 
   HSHM_DLL static void UnmapMemory(void *ptr, size_t size);
 
+  HSHM_DLL static bool CreateNewFileMemory(File &fd, const std::string &path,
+                                           size_t size);
+
+  HSHM_DLL static bool OpenFileMemory(File &fd, const std::string &path);
+
+  HSHM_DLL static void DestroyFileMemory(const std::string &path);
+
+  HSHM_DLL static void *MapSyncMemory(const File &fd, size_t size, i64 off);
+
+  HSHM_DLL static bool SyncMemory(void *ptr, size_t size);
+
+  HSHM_DLL static bool LockFile(const File &fd, bool exclusive, bool wait);
+
+  HSHM_DLL static bool CreateSealedMemory(File &fd, const std::string &name,
+                                          size_t size);
+
+  HSHM_DLL static bool IsSealedMemory(const File &fd);
+
+  HSHM_DLL static bool ListenSocket(File &sock, const std::string &path);
+
+  HSHM_DLL static bool AcceptSocket(const File &sock, File &conn);
+
+  HSHM_DLL static bool ConnectSocket(File &sock, const std::string &path);
+
+  HSHM_DLL static void CloseSocket(File &sock, const std::string &path = "");
+
+  HSHM_DLL static bool SendFile(const File &sock, const File &fd);
+
+  HSHM_DLL static bool RecvFile(const File &sock, File &fd);
+
+  HSHM_DLL static bool AdviseHugePages(void *ptr, size_t size);
+
+  HSHM_DLL static bool BindNumaMemory(void *ptr, size_t size,
+                                      NumaPolicy policy, u64 node_mask);
+
+  HSHM_DLL static void PrefaultMemory(void *ptr, size_t size);
+
+  HSHM_DLL static double ParallelPrefaultMemory(void *ptr, size_t size,
+                                                bool zero, int nthreads);
+
+  HSHM_DLL static size_t DiscardMemory(void *ptr, size_t size);
+
   HSHM_DLL static void *AlignedAlloc(size_t alignment, size_t size);
 
   HSHM_DLL static std::string Getenv(
@@ -23,6 +23,8 @@
 
 namespace hshm::ipc {
 
+class MemoryBackend;
+
 /**
  * The allocator type.
  * Used to reconstruct allocator from shared memory
@@ -33,6 +35,7 @@ enum class AllocatorType {
   kFixedPageAllocator,
   kScalablePageAllocator,
   kThreadLocalAllocator,
+  kSlabAllocator,
   kTestAllocator
 };
 
@@ -99,11 +102,12 @@ class Allocator {
   char *buffer_;
   size_t buffer_size_;
   char *custom_header_;
+  MemoryBackend *backend_; /**< The backend of buffer_, if known */
 
  public:
   /** Default constructor */
   HSHM_INLINE_CROSS_FUN
-  Allocator() : custom_header_(nullptr) {}
+  Allocator() : custom_header_(nullptr), backend_(nullptr) {}
 
   /** Get the allocator identifier */
   HSHM_INLINE_CROSS_FUN
@@ -123,6 +127,16 @@ class Allocator {
     return reinterpret_cast<HEADER_T *>(custom_header_);
   }
 
+  /**
+   * Round the offset of the region following the custom header up to a
+   * cache line. Otherwise an odd-sized custom header leaves every atomic
+   * in the region misaligned, and each one becomes a split lock.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  static size_t AlignRegionOffset(size_t off) {
+    return (off + 63) & ~(size_t)63;
+  }
+
   /**
    * Convert a process-independent pointer into a process-specific pointer
    *
@@ -314,6 +328,24 @@ class BaseAllocator : public CoreAllocT {
     CoreAllocT::FreeOffsetNoNullCheck(ctx, p);
   }
 
+  /**
+   * Allocate \a count regions of \a size size into \a out
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const MemContext &ctx, size_t size,
+                                          size_t count, PointerT *out) {
+    CoreAllocT::AllocateOffsetBatch(ctx, size, count, out);
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const MemContext &ctx, PointerT *ptrs,
+                                      size_t count) {
+    CoreAllocT::FreeOffsetBatch(ctx, ptrs, count);
+  }
+
   /**
    * Create a thread-local storage segment. This storage
    * is unique even across processes.
@@ -413,6 +445,45 @@ class BaseAllocator : public CoreAllocT {
     FreeOffsetNoNullCheck(ctx, OffsetPointer(p.off_.load()));
   }
 
+  /**
+   * Free the memory pointed to by \a p once no thread that has pinned the
+   * allocator's epoch (EpochEnter) can still reach it. Only allocators with
+   * an EpochManager support this. Retiring allocates a small tracking node,
+   * so it raises OUT_OF_MEMORY if the allocator is exhausted.
+   * */
+  template <typename PointerT = Pointer>
+  HSHM_INLINE_CROSS_FUN void Retire(const MemContext &ctx, const PointerT &p) {
+    if (p.IsNull()) {
+      HSHM_THROW_ERROR(INVALID_FREE);
+    }
+    CoreAllocT::RetireOffset(ctx, OffsetPointer(p.off_.load()));
+  }
+
+  /**
+   * Allocate \a count regions of \a size size into \a out. This is
+   * cheaper than \a count calls to Allocate: each allocator amortizes
+   * its locking and accounting over the batch.
+   * */
+  template <typename PointerT = Pointer>
+  HSHM_INLINE_CROSS_FUN void AllocateBatch(const MemContext &ctx, size_t size,
+                                           size_t count, PointerT *out) {
+    AllocateOffsetBatch<PointerT>(ctx, size, count, out);
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs
+   * */
+  template <typename PointerT = Pointer>
+  HSHM_INLINE_CROSS_FUN void FreeBatch(const MemContext &ctx, PointerT *ptrs,
+                                       size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      if (ptrs[i].IsNull()) {
+        HSHM_THROW_ERROR(INVALID_FREE);
+      }
+    }
+    FreeOffsetBatch<PointerT>(ctx, ptrs, count);
+  }
+
   /**====================================
    * Private Pointer Allocators
    * ===================================*/
@@ -1149,6 +1220,20 @@ class _NullAllocator : public Allocator {
   HSHM_CROSS_FUN
   void FreeOffsetNoNullCheck(const MemContext &ctx, OffsetPointer p) {}
 
+  /**
+   * Allocate \a count regions of \a size size into \a out
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const MemContext &ctx, size_t size,
+                                          size_t count, PointerT *out) {}
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const MemContext &ctx, PointerT *ptrs,
+                                      size_t count) {}
+
   /**
    * Create a globally-unique thread ID
    * */
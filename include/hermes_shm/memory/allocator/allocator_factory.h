@@ -18,6 +18,7 @@
 #include "hermes_shm/memory/memory_manager_.h"
 #include "malloc_allocator.h"
 #include "scalable_page_allocator.h"
+#include "slab_allocator.h"
 #include "stack_allocator.h"
 #include "test_allocator.h"
 #include "thread_local_allocator.h"
@@ -27,6 +28,7 @@ namespace hshm::ipc {
 #define HSHM_ALLOC_DSRL_CASE(ALLOC_NAME)                                    \
   case AllocatorType::k##ALLOC_NAME: {                                      \
     auto alloc = HSHM_ROOT_ALLOC->NewObj<ALLOC_NAME>(HSHM_DEFAULT_MEM_CTX); \
+    alloc->backend_ = backend;                                              \
     alloc->shm_deserialize(buffer, buffer_size);                            \
     return alloc;                                                           \
   }
@@ -51,16 +53,19 @@ class AllocatorFactory {
   template <typename AllocT, typename... Args>
   static AllocT* shm_init(AllocatorId alloc_id, size_t custom_header_size,
                           MemoryBackend* backend, Args&&... args) {
-    return shm_init<AllocT>(alloc_id, custom_header_size, backend->data_,
-                            backend->data_size_, std::forward<Args>(args)...);
+    auto alloc = HSHM_ROOT_ALLOC->NewObj<AllocT>(HSHM_DEFAULT_MEM_CTX);
+    alloc->backend_ = backend;
+    alloc->shm_init(alloc_id, custom_header_size, backend->data_,
+                    backend->data_size_, std::forward<Args>(args)...);
+    return alloc;
   }
 
   /**
    * Deserialize the allocator managing this backend.
    * */
   template <typename AllocT = Allocator>
-  HSHM_CROSS_FUN static AllocT* shm_deserialize(char* buffer,
-                                                size_t buffer_size) {
+  HSHM_CROSS_FUN static AllocT* shm_deserialize(
+      char* buffer, size_t buffer_size, MemoryBackend* backend = nullptr) {
     auto header_ = reinterpret_cast<AllocatorHeader*>(buffer);
     switch (header_->allocator_type_) {
       // Stack Allocator
@@ -68,6 +73,7 @@ class AllocatorFactory {
       HSHM_ALLOC_DSRL_CASE(MallocAllocator)
       HSHM_ALLOC_DSRL_CASE(ScalablePageAllocator)
       HSHM_ALLOC_DSRL_CASE(ThreadLocalAllocator)
+      HSHM_ALLOC_DSRL_CASE(SlabAllocator)
       HSHM_ALLOC_DSRL_CASE(TestAllocator)
       default:
         return nullptr;
@@ -82,7 +88,8 @@ class AllocatorFactory {
     if (backend == nullptr) {
       return nullptr;
     }
-    return shm_deserialize<AllocT>(backend->data_, backend->data_size_);
+    return shm_deserialize<AllocT>(backend->data_, backend->data_size_,
+                                   backend);
   }
 
   /**
@@ -93,7 +100,8 @@ class AllocatorFactory {
     if (other == nullptr) {
       return nullptr;
     }
-    return shm_deserialize<AllocT>(other->buffer_, other->buffer_size_);
+    return shm_deserialize<AllocT>(other->buffer_, other->buffer_size_,
+                                   other->backend_);
   }
 };
 
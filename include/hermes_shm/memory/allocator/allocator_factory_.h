@@ -32,6 +32,9 @@ typedef BaseAllocator<_StackAllocator> StackAllocator;
 class _ThreadLocalAllocator;
 typedef BaseAllocator<_ThreadLocalAllocator> ThreadLocalAllocator;
 
+class _SlabAllocator;
+typedef BaseAllocator<_SlabAllocator> SlabAllocator;
+
 class _TestAllocator;
 typedef BaseAllocator<_TestAllocator> TestAllocator;
 
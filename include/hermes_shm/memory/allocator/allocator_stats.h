@@ -0,0 +1,344 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_ALLOCATOR_STATS_H_
+#define HSHM_MEMORY_ALLOCATOR_ALLOCATOR_STATS_H_
+
+#include <vector>
+
+#include "allocator.h"
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/types/atomic.h"
+
+namespace hshm::ipc {
+
+/**
+ * The allocation counters of one thread, padded to a cache line. Only
+ * the owning thread writes them, so they are updated with relaxed loads
+ * and stores instead of read-modify-write atomics. The shared slot used
+ * by threads that could not claim one is updated with fetch_add.
+ * */
+struct AllocatorStatsSlot {
+  /** The number of size classes counted */
+  static constexpr size_t num_classes_ = 32;
+  /** The power-of-two exponent of the smallest class (16B) */
+  static constexpr size_t min_class_exp_ = 4;
+
+  hipc::atomic<hshm::size_t> claimed_;  /**< Whether a thread owns the slot */
+  hipc::atomic<hshm::u64> tid_;         /**< The thread that last owned it */
+  hipc::atomic<hshm::u64> bytes_alloc_; /**< Bytes allocated */
+  hipc::atomic<hshm::u64> bytes_freed_; /**< Bytes freed */
+  hipc::atomic<hshm::u64> peak_;        /**< Peak of allocated - freed */
+  hipc::atomic<hshm::u64> allocs_[num_classes_]; /**< Allocations per class */
+  hipc::atomic<hshm::u64> frees_[num_classes_];  /**< Frees per class */
+  char pad_[64 - (5 + 2 * num_classes_) * sizeof(hshm::u64) % 64];
+
+  /** Reset the counters */
+  HSHM_CROSS_FUN
+  void Clear() {
+    claimed_ = 0;
+    tid_ = 0;
+    bytes_alloc_ = 0;
+    bytes_freed_ = 0;
+    peak_ = 0;
+    for (size_t i = 0; i < num_classes_; ++i) {
+      allocs_[i] = 0;
+      frees_[i] = 0;
+    }
+  }
+
+  /**
+   * The class of an allocation of \a size bytes. Class i counts sizes in
+   * (2^(i+3), 2^(i+4)]. The last class also counts everything larger.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetClass(size_t size) {
+    if (size <= ((size_t)1 << min_class_exp_)) {
+      return 0;
+    }
+#if defined(HSHM_IS_GPU)
+    size_t exp = 64 - __clzll((long long)(size - 1));
+#elif defined(HSHM_COMPILER_MSVC)
+    unsigned long idx;
+    _BitScanReverse64(&idx, (unsigned __int64)(size - 1));
+    size_t exp = (size_t)idx + 1;
+#else
+    size_t exp = 64 - __builtin_clzll((unsigned long long)(size - 1));
+#endif
+    size_t cls = exp - min_class_exp_;
+    return cls < num_classes_ ? cls : num_classes_ - 1;
+  }
+
+  /** Count \a count allocations of \a size bytes each */
+  HSHM_INLINE_CROSS_FUN
+  void RecordAlloc(size_t size, size_t count, bool shared) {
+    size_t cls = GetClass(size);
+    hshm::u64 bytes = (hshm::u64)size * count;
+    hshm::u64 alloc;
+    if (shared) {
+      allocs_[cls].fetch_add(count, std::memory_order_relaxed);
+      alloc = bytes_alloc_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    } else {
+      Bump(allocs_[cls], count);
+      alloc = Bump(bytes_alloc_, bytes);
+    }
+    // Frees by other threads may leave a thread with a negative balance
+    hshm::i64 in_use =
+        (hshm::i64)(alloc - bytes_freed_.load(std::memory_order_relaxed));
+    hshm::u64 peak = peak_.load(std::memory_order_relaxed);
+    if (!shared && in_use > (hshm::i64)peak) {
+      peak_.store((hshm::u64)in_use, std::memory_order_relaxed);
+    }
+    while (shared && in_use > (hshm::i64)peak &&
+           !peak_.compare_exchange_weak(peak, (hshm::u64)in_use)) {
+    }
+  }
+
+  /** Count \a count frees of \a size bytes each */
+  HSHM_INLINE_CROSS_FUN
+  void RecordFree(size_t size, size_t count, bool shared) {
+    size_t cls = GetClass(size);
+    hshm::u64 bytes = (hshm::u64)size * count;
+    if (shared) {
+      frees_[cls].fetch_add(count, std::memory_order_relaxed);
+      bytes_freed_.fetch_add(bytes, std::memory_order_relaxed);
+      return;
+    }
+    Bump(frees_[cls], count);
+    Bump(bytes_freed_, bytes);
+  }
+
+  /** Add \a count to a counter only this thread writes */
+  HSHM_INLINE_CROSS_FUN
+  static hshm::u64 Bump(hipc::atomic<hshm::u64> &counter, hshm::u64 count) {
+    hshm::u64 val = counter.load(std::memory_order_relaxed) + count;
+    counter.store(val, std::memory_order_relaxed);
+    return val;
+  }
+};
+
+/** The counters of one thread, as reported by AllocatorStats */
+struct AllocatorThreadStats {
+  hshm::u64 tid_;         /**< The thread that last owned the slot */
+  bool active_;           /**< Whether the thread still owns the slot */
+  hshm::u64 allocs_;      /**< The number of allocations */
+  hshm::u64 frees_;       /**< The number of frees */
+  hshm::u64 bytes_alloc_; /**< Bytes allocated */
+  hshm::u64 bytes_freed_; /**< Bytes freed */
+  hshm::u64 peak_;        /**< Peak of bytes allocated minus bytes freed */
+};
+
+/** A snapshot of the statistics of an allocator */
+struct AllocatorStats {
+  static constexpr size_t num_classes_ = AllocatorStatsSlot::num_classes_;
+
+  hshm::u64 allocs_[num_classes_]; /**< Allocations per size class */
+  hshm::u64 frees_[num_classes_];  /**< Frees per size class */
+  hshm::u64 bytes_in_use_;         /**< Bytes allocated and not freed */
+  /** Bytes carved from the backend for pages, chunks and slabs */
+  hshm::u64 bytes_reserved_;
+  /**
+   * Reserved bytes that are not in use: free lists, free large pages and
+   * the uncarved parts of chunks and slabs
+   * */
+  hshm::u64 bytes_cached_;
+  /**
+   * The high-water mark of bytes in use. It is the sum of every thread's
+   * own peak: exact when one thread allocates, and an upper bound when
+   * several threads reach their peaks at different times.
+   * */
+  hshm::u64 peak_bytes_;
+  /** bytes_cached_ / bytes_reserved_ */
+  double fragmentation_;
+  /** The counters of each thread that allocated */
+  std::vector<AllocatorThreadStats> threads_;
+
+  /** The largest allocation counted in class \a cls */
+  static size_t GetClassSize(size_t cls) {
+    return (size_t)1 << (cls + AllocatorStatsSlot::min_class_exp_);
+  }
+};
+
+/**
+ * Per-thread allocation statistics kept in shared memory.
+ *
+ * Each thread claims a slot the first time it allocates and is the only
+ * writer of its counters, so counting takes no shared atomics. A slot
+ * keeps its counters when its thread releases it, so totals survive
+ * thread exit and a slot may accumulate several threads over time.
+ * Threads that find every slot claimed, or that have no thread-local
+ * storage, share one extra slot updated with atomics. Snapshots sum the
+ * slots on demand and may be taken by any process attached to the
+ * allocator.
+ * */
+class AllocatorStatsTable {
+ public:
+  /** The number of slots threads can claim */
+  static constexpr size_t max_slots_ = 64;
+
+ public:
+  /** Heap bytes used by allocator metadata, excluded from reserved bytes */
+  hshm::size_t base_;
+  AllocatorStatsSlot slots_[max_slots_ + 1];
+
+ public:
+  /** Default constructor */
+  HSHM_CROSS_FUN
+  AllocatorStatsTable() = default;
+
+  /** Explicit initialization */
+  HSHM_CROSS_FUN
+  void shm_init() {
+    base_ = 0;
+    for (size_t i = 0; i <= max_slots_; ++i) {
+      slots_[i].Clear();
+    }
+    slots_[max_slots_].claimed_ = 1;
+  }
+
+  /** The slot shared by threads without a slot of their own */
+  HSHM_INLINE_CROSS_FUN
+  AllocatorStatsSlot *GetSharedSlot() { return &slots_[max_slots_]; }
+
+  /** Claim a slot for the thread \a tid */
+  HSHM_CROSS_FUN
+  AllocatorStatsSlot *Register(hshm::u64 tid) {
+    for (size_t i = 0; i < max_slots_; ++i) {
+      hshm::size_t unclaimed = 0;
+      if (slots_[i].claimed_.load() == 0 &&
+          slots_[i].claimed_.compare_exchange_strong(unclaimed, 1)) {
+        slots_[i].tid_ = tid;
+        return &slots_[i];
+      }
+    }
+    return GetSharedSlot();
+  }
+
+  /** Release \a slot, keeping its counters */
+  HSHM_CROSS_FUN
+  void Unregister(AllocatorStatsSlot *slot) {
+    if (slot != GetSharedSlot()) {
+      slot->claimed_ = 0;
+    }
+  }
+
+  /**
+   * Release the slots claimed by threads of processes that exited
+   * without detaching, keeping their counters
+   * */
+  HSHM_CROSS_FUN
+  void ReleaseSlots() {
+    for (size_t i = 0; i < max_slots_; ++i) {
+      slots_[i].claimed_ = 0;
+    }
+  }
+
+  /** Count \a count allocations of \a size bytes in \a slot */
+  HSHM_INLINE_CROSS_FUN
+  void RecordAlloc(AllocatorStatsSlot *slot, size_t size, size_t count = 1) {
+    slot->RecordAlloc(size, count, slot == GetSharedSlot());
+  }
+
+  /** Count \a count frees of \a size bytes in \a slot */
+  HSHM_INLINE_CROSS_FUN
+  void RecordFree(AllocatorStatsSlot *slot, size_t size, size_t count = 1) {
+    slot->RecordFree(size, count, slot == GetSharedSlot());
+  }
+
+  /**
+   * Sum the counters of every slot
+   *
+   * @param reserved the heap bytes carved by the allocator, including
+   * the base_ bytes of metadata
+   * */
+  AllocatorStats Snapshot(size_t reserved) {
+    AllocatorStats stats;
+    for (size_t i = 0; i < AllocatorStats::num_classes_; ++i) {
+      stats.allocs_[i] = 0;
+      stats.frees_[i] = 0;
+    }
+    hshm::u64 bytes_alloc = 0, bytes_freed = 0, peak = 0;
+    for (size_t i = 0; i <= max_slots_; ++i) {
+      AllocatorStatsSlot &slot = slots_[i];
+      AllocatorThreadStats thread;
+      thread.tid_ = slot.tid_.load();
+      thread.active_ = i < max_slots_ && slot.claimed_.load() != 0;
+      thread.allocs_ = 0;
+      thread.frees_ = 0;
+      for (size_t j = 0; j < AllocatorStats::num_classes_; ++j) {
+        hshm::u64 allocs = slot.allocs_[j].load(std::memory_order_relaxed);
+        hshm::u64 frees = slot.frees_[j].load(std::memory_order_relaxed);
+        stats.allocs_[j] += allocs;
+        stats.frees_[j] += frees;
+        thread.allocs_ += allocs;
+        thread.frees_ += frees;
+      }
+      thread.bytes_alloc_ = slot.bytes_alloc_.load(std::memory_order_relaxed);
+      thread.bytes_freed_ = slot.bytes_freed_.load(std::memory_order_relaxed);
+      thread.peak_ = slot.peak_.load(std::memory_order_relaxed);
+      bytes_alloc += thread.bytes_alloc_;
+      bytes_freed += thread.bytes_freed_;
+      peak += thread.peak_;
+      if (thread.allocs_ || thread.frees_) {
+        stats.threads_.emplace_back(thread);
+      }
+    }
+    // Slots are read one at a time, so concurrent frees may be seen first
+    stats.bytes_in_use_ = bytes_alloc > bytes_freed ? bytes_alloc - bytes_freed
+                                                    : 0;
+    stats.bytes_reserved_ = reserved > base_ ? reserved - base_ : 0;
+    stats.bytes_cached_ = stats.bytes_reserved_ > stats.bytes_in_use_
+                              ? stats.bytes_reserved_ - stats.bytes_in_use_
+                              : 0;
+    stats.fragmentation_ =
+        stats.bytes_reserved_
+            ? (double)stats.bytes_cached_ / (double)stats.bytes_reserved_
+            : 0;
+    stats.peak_bytes_ = peak > stats.bytes_in_use_ ? peak : stats.bytes_in_use_;
+    return stats;
+  }
+};
+
+/** A thread's slot in the AllocatorStatsTable of an allocator */
+template <typename AllocT>
+class AllocatorStatsTls : public thread::ThreadLocalData {
+ public:
+  AllocT *alloc_;
+  AllocatorId alloc_id_;
+  AllocatorStatsTable *table_;
+  AllocatorStatsSlot *slot_;
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  AllocatorStatsTls(AllocT *alloc, AllocatorStatsTable *table)
+      : alloc_(alloc),
+        alloc_id_(alloc->GetId()),
+        table_(table),
+        slot_(table->Register(HSHM_THREAD_MODEL->GetTid().tid_)) {}
+
+  /** Called when the owning thread exits */
+  HSHM_CROSS_FUN
+  void destroy() {
+#ifdef HSHM_IS_HOST
+    // The allocator may have been destroyed before this thread
+    if (HSHM_MEMORY_MANAGER->GetAllocator<AllocT>(alloc_id_) == alloc_) {
+      table_->Unregister(slot_);
+    }
+    delete this;
+#endif
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_ALLOCATOR_STATS_H_
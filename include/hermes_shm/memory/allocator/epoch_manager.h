@@ -0,0 +1,259 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_EPOCH_MANAGER_H_
+#define HSHM_MEMORY_ALLOCATOR_EPOCH_MANAGER_H_
+
+#include "allocator.h"
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/types/atomic.h"
+#include "hermes_shm/util/errors.h"
+
+namespace hshm::ipc {
+
+/** The epoch state of one thread, padded to a cache line */
+struct EpochSlot {
+  hipc::atomic<hshm::size_t> epoch_;   /**< (epoch << 1) | pinned */
+  hipc::atomic<hshm::size_t> claimed_; /**< Whether a thread owns the slot */
+  char pad_[64 - 2 * sizeof(hipc::atomic<hshm::size_t>)];
+};
+
+/** A retired allocation in a limbo list */
+struct EpochRetireNode {
+  hshm::size_t next_; /**< Offset of the next node in the limbo list */
+  hshm::size_t ptr_;  /**< Offset of the retired allocation */
+};
+
+/**
+ * Epoch-based reclamation of allocations shared between processes.
+ *
+ * A thread pins the current global epoch while it reads a lock-free
+ * structure. Memory unlinked from the structure is retired instead of
+ * freed. It is kept in the limbo list of the epoch it was retired in.
+ * The global epoch only advances once every pinned thread has observed
+ * it, so memory retired in epoch e is unreachable once the epoch is e + 2.
+ * At that point it is freed back to the allocator.
+ *
+ * Pinned readers may still access retired memory, so it cannot hold the
+ * limbo link itself. Each retire allocates a small EpochRetireNode from
+ * the same allocator, which is freed along with the allocation.
+ * */
+class EpochManager {
+ public:
+  /** The maximum number of threads that can pin an epoch */
+  static constexpr size_t max_slots_ = 256;
+  /** The number of limbo lists */
+  static constexpr size_t num_limbo_ = 3;
+  /** The number of retires between attempts to advance the epoch */
+  static constexpr size_t collect_interval_ = 64;
+
+ public:
+  hipc::atomic<hshm::size_t> epoch_;      /**< The global epoch */
+  hipc::atomic<hshm::size_t> collecting_; /**< Collector lock */
+  hipc::atomic<hshm::size_t> retired_;    /**< Number of retires */
+  hipc::atomic<hshm::size_t> limbo_[num_limbo_];
+  EpochSlot slots_[max_slots_];
+
+ public:
+  /** Default constructor */
+  HSHM_CROSS_FUN
+  EpochManager() = default;
+
+  /** Explicit initialization */
+  HSHM_CROSS_FUN
+  void shm_init() {
+    epoch_ = 0;
+    collecting_ = 0;
+    retired_ = 0;
+    for (size_t i = 0; i < num_limbo_; ++i) {
+      limbo_[i] = OffsetPointer::GetNull().load();
+    }
+    for (size_t i = 0; i < max_slots_; ++i) {
+      slots_[i].epoch_ = 0;
+      slots_[i].claimed_ = 0;
+    }
+  }
+
+  /** Claim a slot for the calling thread */
+  HSHM_CROSS_FUN
+  size_t Register() {
+    for (size_t i = 0; i < max_slots_; ++i) {
+      hshm::size_t unclaimed = 0;
+      if (slots_[i].claimed_.load() == 0 &&
+          slots_[i].claimed_.compare_exchange_strong(unclaimed, 1)) {
+        slots_[i].epoch_ = 0;
+        return i;
+      }
+    }
+    HSHM_THROW_ERROR(TOO_MANY_EPOCH_THREADS, max_slots_);
+    return max_slots_;
+  }
+
+  /** Release the slot \a slot */
+  HSHM_CROSS_FUN
+  void Unregister(size_t slot) {
+    slots_[slot].epoch_ = 0;
+    slots_[slot].claimed_ = 0;
+  }
+
+  /** Pin the current epoch in \a slot */
+  HSHM_INLINE_CROSS_FUN
+  void Enter(size_t slot) {
+    slots_[slot].epoch_.store((epoch_.load() << 1) | 1);
+  }
+
+  /** Unpin \a slot */
+  HSHM_INLINE_CROSS_FUN
+  void Exit(size_t slot) { slots_[slot].epoch_.store(0); }
+
+  /**
+   * Retire the allocation \a p of \a alloc. It must already be unreachable
+   * by threads that are not pinned.
+   *
+   * Retiring allocates an EpochRetireNode from \a alloc to track \a p. If
+   * that fails, OUT_OF_MEMORY is raised and \a p is not retired; the caller
+   * still owns it. Pinned readers may still hold \a p, so it is never
+   * freed early. On the GPU, where errors are not raised, \a p is leaked.
+   * */
+  template <typename AllocT>
+  HSHM_CROSS_FUN void Retire(AllocT *alloc, OffsetPointer p) {
+    OffsetPointer node_off =
+        alloc->AllocateOffset(HSHM_DEFAULT_MEM_CTX, sizeof(EpochRetireNode));
+    if (node_off.IsNull()) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, sizeof(EpochRetireNode),
+                       alloc->GetCurrentlyAllocatedSize());
+      return;
+    }
+    EpochRetireNode *node = alloc->template Convert<EpochRetireNode>(node_off);
+    node->ptr_ = p.load();
+    hipc::atomic<hshm::size_t> &limbo = limbo_[epoch_.load() % num_limbo_];
+    hshm::size_t head;
+    do {
+      head = limbo.load();
+      node->next_ = head;
+    } while (!limbo.compare_exchange_weak(head, node_off.load()));
+    if ((retired_.fetch_add(1) + 1) % collect_interval_ == 0) {
+      Collect(alloc);
+    }
+  }
+
+  /**
+   * Advance the epoch if every pinned thread has observed it, and free
+   * the allocations that can no longer be reached.
+   *
+   * @return whether the epoch advanced
+   * */
+  template <typename AllocT>
+  HSHM_CROSS_FUN bool Collect(AllocT *alloc) {
+    hshm::size_t unlocked = 0;
+    if (!collecting_.compare_exchange_strong(unlocked, 1)) {
+      return false;
+    }
+    hshm::size_t epoch = epoch_.load();
+    for (size_t i = 0; i < max_slots_; ++i) {
+      hshm::size_t pinned = slots_[i].epoch_.load();
+      if ((pinned & 1) && (pinned >> 1) != epoch) {
+        collecting_ = 0;
+        return false;
+      }
+    }
+    // Memory retired in epoch - 1 is reclaimed once the epoch is epoch + 1
+    epoch_.store(epoch + 1);
+    hshm::size_t head = limbo_[(epoch + 2) % num_limbo_].exchange(
+        OffsetPointer::GetNull().load());
+    collecting_ = 0;
+    while (!OffsetPointer(head).IsNull()) {
+      OffsetPointer node_off(head);
+      EpochRetireNode *node =
+          alloc->template Convert<EpochRetireNode>(node_off);
+      head = node->next_;
+      alloc->FreeOffsetNoNullCheck(HSHM_DEFAULT_MEM_CTX,
+                                   OffsetPointer(node->ptr_));
+      alloc->FreeOffsetNoNullCheck(HSHM_DEFAULT_MEM_CTX, node_off);
+    }
+    return true;
+  }
+};
+
+/** A thread's registration with the EpochManager of an allocator */
+template <typename AllocT>
+class EpochTls : public thread::ThreadLocalData {
+ public:
+  AllocT *alloc_;
+  AllocatorId alloc_id_;
+  EpochManager *epoch_;
+  size_t slot_;
+  size_t depth_;
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  EpochTls(AllocT *alloc, EpochManager *epoch)
+      : alloc_(alloc),
+        alloc_id_(alloc->GetId()),
+        epoch_(epoch),
+        slot_(epoch->Register()),
+        depth_(0) {}
+
+  /** Pin the current epoch. Pins may be nested. */
+  HSHM_INLINE_CROSS_FUN
+  void Enter() {
+    if (depth_++ == 0) {
+      epoch_->Enter(slot_);
+    }
+  }
+
+  /** Unpin the epoch when the outermost pin is released */
+  HSHM_INLINE_CROSS_FUN
+  void Exit() {
+    if (--depth_ == 0) {
+      epoch_->Exit(slot_);
+    }
+  }
+
+  /** Called when the owning thread exits */
+  HSHM_CROSS_FUN
+  void destroy() {
+#ifdef HSHM_IS_HOST
+    // The allocator may have been destroyed before this thread
+    if (HSHM_MEMORY_MANAGER->GetAllocator<AllocT>(alloc_id_) == alloc_) {
+      epoch_->Unregister(slot_);
+    }
+    delete this;
+#endif
+  }
+};
+
+/** Pins the epoch of an allocator for the lifetime of the object */
+template <typename AllocT>
+class ScopedEpoch {
+ public:
+  AllocT *alloc_;
+  MemContext ctx_;
+
+ public:
+  /** Pin the epoch */
+  HSHM_INLINE_CROSS_FUN
+  explicit ScopedEpoch(AllocT *alloc,
+                       const MemContext &ctx = HSHM_DEFAULT_MEM_CTX)
+      : alloc_(alloc), ctx_(ctx) {
+    alloc_->EpochEnter(ctx_);
+  }
+
+  /** Unpin the epoch */
+  HSHM_INLINE_CROSS_FUN
+  ~ScopedEpoch() { alloc_->EpochExit(ctx_); }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_EPOCH_MANAGER_H_
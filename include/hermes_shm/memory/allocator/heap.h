@@ -54,14 +54,39 @@ struct HeapAllocator {
     // if (size % 64 != 0) {
     //   size = (size + 63) & ~63;
     // }
-    hshm::size_t off = heap_off_.fetch_add((hshm::size_t)size);
-    if (off + size > heap_size_) {
-      // HSHM_THROW_ERROR(OUT_OF_MEMORY, size, heap_size_);
-      return OffsetPointer::GetNull();
-    }
+    // A request that does not fit must not consume the rest of the heap
+    hshm::size_t off = heap_off_.load();
+    do {
+      if (off + size > heap_size_) {
+        // HSHM_THROW_ERROR(OUT_OF_MEMORY, size, heap_size_);
+        return OffsetPointer::GetNull();
+      }
+    } while (!heap_off_.compare_exchange_weak(off, off + (hshm::size_t)size));
     return OffsetPointer((size_t)(region_off_ + off));
   }
 
+  /**
+   * Allocate off heap at an offset from the start of the region that is a
+   * multiple of \a alignment. The bytes skipped to align are not reused;
+   * their number is stored in \a skipped if it is not null.
+   * */
+  HSHM_INLINE_CROSS_FUN OffsetPointer AlignedAllocateOffset(
+      size_t size, size_t alignment, hshm::size_t *skipped = nullptr) {
+    hshm::size_t off = heap_off_.load();
+    hshm::size_t aligned;
+    do {
+      aligned = (off + alignment - 1) & ~((hshm::size_t)alignment - 1);
+      if (aligned + size > heap_size_) {
+        return OffsetPointer::GetNull();
+      }
+    } while (
+        !heap_off_.compare_exchange_weak(off, aligned + (hshm::size_t)size));
+    if (skipped) {
+      *skipped = aligned - off;
+    }
+    return OffsetPointer((size_t)(region_off_ + aligned));
+  }
+
   /** Copy assignment operator */
   HSHM_CROSS_FUN
   HeapAllocator &operator=(const HeapAllocator &other) {
@@ -0,0 +1,459 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_LARGE_PAGE_ALLOCATOR_H_
+#define HSHM_MEMORY_ALLOCATOR_LARGE_PAGE_ALLOCATOR_H_
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/thread/lock/mutex.h"
+#include "mp_page.h"
+#include "page_allocator.h"
+#include "stack_allocator.h"
+
+namespace hshm::ipc {
+
+/** Boundary tag placed at the end of every large page */
+struct LargePageTag {
+  size_t span_; /**< Size of the page, including its header and this tag */
+  size_t free_; /**< Whether the page is in a free bin */
+};
+
+/** Free list links of a free large page, stored in its payload */
+struct LargePageLinks {
+  size_t prev_; /**< Offset of the previous free page (0 if none) */
+  size_t next_; /**< Offset of the next free page (0 if none) */
+};
+
+/**
+ * Allocates pages larger than the largest cached size class.
+ *
+ * Large pages are carved from segments of the StackAllocator heap.
+ * Free pages are kept in segregated power-of-two bins. An allocation takes
+ * the first fit in its bin (or the head of any larger bin) and splits off
+ * the remainder. Every page ends with a LargePageTag. On free, the tags of
+ * the physical neighbours are checked and free neighbours are merged.
+ * Segments are bounded by sentinels so merges never cross into memory
+ * owned by other allocators. A new segment that directly follows the
+ * previous one is merged into it.
+ *
+ * Every page, free or allocated, has a payload larger than
+ * PageId::max_cached_size_. Callers can therefore recognize large pages
+ * by PageId::FromPage. Spans are multiples of PageId::min_alignment_.
+ * */
+class LargePageAllocator {
+ public:
+  typedef LargePageTag Tag;
+  /** The power-of-two exponent of the smallest bin */
+  static constexpr size_t min_bin_exp_ = PageId::max_cached_size_exp_;
+  /** The number of bins */
+  static constexpr size_t num_bins_ = 64 - min_bin_exp_;
+  /** The smallest span a page may be split into */
+  static constexpr size_t min_span_ = PageId::max_cached_size_ +
+                                      sizeof(MpPage) + sizeof(Tag) +
+                                      PageId::min_alignment_;
+  /** The span of the sentinel that ends a segment */
+  static constexpr size_t end_sentinel_span_ = sizeof(MpPage) + sizeof(Tag);
+  /** The space used by the sentinels of a segment */
+  static constexpr size_t sentinel_span_ = sizeof(Tag) + end_sentinel_span_;
+
+ public:
+  size_t bins_[num_bins_]; /**< Offset of the first page of each bin */
+  size_t top_;             /**< Offset of the end of the last segment */
+  hipc::Mutex lock_;
+
+ public:
+  /** Default constructor */
+  HSHM_CROSS_FUN
+  LargePageAllocator() = default;
+
+  /** Explicit initialization */
+  HSHM_CROSS_FUN
+  void shm_init() {
+    for (size_t i = 0; i < num_bins_; ++i) {
+      bins_[i] = 0;
+    }
+    top_ = 0;
+    lock_.Init();
+  }
+
+  /**
+   * Allocate a page of at least \a size bytes (including the MpPage),
+   * growing the heap of \a alloc if no free page fits.
+   *
+   * @return the page, with page_size_ set, or null if out of memory
+   * */
+  HSHM_CROSS_FUN
+  MpPage *Allocate(StackAllocator &alloc, size_t size) {
+    size_t need = RoundUp(size + sizeof(Tag));
+    hipc::ScopedMutex lock(lock_, 0);
+    while (true) {
+      size_t off = FindFit(alloc, need);
+      if (off) {
+        return Split(alloc, off, need);
+      }
+      if (!Grow(alloc, need)) {
+        return nullptr;
+      }
+    }
+  }
+
+  /**
+   * Grow \a page in place to at least \a size bytes (including the MpPage)
+   * by absorbing the free page after it. A page at the end of the heap
+   * of \a alloc grows the heap instead.
+   *
+   * @return whether the page now holds \a size bytes
+   * */
+  HSHM_CROSS_FUN
+  bool Expand(StackAllocator &alloc, MpPage *page, size_t size) {
+    size_t need = RoundUp(size + sizeof(Tag));
+    hipc::ScopedMutex lock(lock_, 0);
+    size_t off = alloc.Convert<MpPage, OffsetPointer>(page).load();
+    size_t span = page->page_size_ + sizeof(Tag);
+    if (span >= need) {
+      return true;
+    }
+    if (off + span == top_ - end_sentinel_span_ && IsHeapTop(alloc)) {
+      Grow(alloc, need - span);
+    }
+    MpPage *next = Get<MpPage>(alloc, off + span);
+    size_t next_span = next->page_size_ + sizeof(Tag);
+    if (!GetTag(alloc, off + span, next_span)->free_ ||
+        span + next_span < need) {
+      return false;
+    }
+    Remove(alloc, off + span, next_span);
+    span += next_span;
+    if (span - need >= min_span_) {
+      Insert(alloc, off + need, span - need);
+      span = need;
+    }
+    page->page_size_ = span - sizeof(Tag);
+    Tag *tag = GetTag(alloc, off, span);
+    tag->span_ = span;
+    tag->free_ = false;
+    return true;
+  }
+
+  /** Free a page, merging it with its free neighbours */
+  HSHM_CROSS_FUN
+  void Free(StackAllocator &alloc, MpPage *page) {
+    hipc::ScopedMutex lock(lock_, 0);
+    size_t off = alloc.Convert<MpPage, OffsetPointer>(page).load();
+    Coalesce(alloc, off, page->page_size_ + sizeof(Tag));
+  }
+
+  /**
+   * Return the physical memory of the free pages to the OS. The pages
+   * stay in their bins with their payloads discarded.
+   *
+   * @return the number of bytes discarded
+   * */
+  HSHM_HOST_FUN
+  size_t Discard(StackAllocator &alloc) {
+    hipc::ScopedMutex lock(lock_, 0);
+    size_t discarded = 0;
+    for (size_t bin = 0; bin < num_bins_; ++bin) {
+      for (size_t off = bins_[bin]; off; off = GetLinks(alloc, off)->next_) {
+        // The header and links at the start of the page are kept
+        size_t span = Get<MpPage>(alloc, off)->page_size_ + sizeof(Tag);
+        size_t begin = sizeof(MpPage) + sizeof(LargePageLinks);
+        discarded += SystemInfo::DiscardMemory(Get<char>(alloc, off + begin),
+                                               span - begin - sizeof(Tag));
+      }
+    }
+    return discarded;
+  }
+
+  /**
+   * Cut the free page at the end of the last segment off and shrink the
+   * heap of \a alloc over it. The segment then ends at the page before,
+   * or is removed if it has no other page.
+   *
+   * @return whether the heap shrank
+   * */
+  HSHM_HOST_FUN
+  bool ShrinkHeap(StackAllocator &alloc) {
+    hipc::ScopedMutex lock(lock_, 0);
+    if (!IsHeapTop(alloc)) {
+      return false;
+    }
+    size_t end_sentinel = top_ - end_sentinel_span_;
+    Tag *last_tag = Get<Tag>(alloc, end_sentinel - sizeof(Tag));
+    if (!last_tag->free_) {
+      return false;
+    }
+    size_t span = last_tag->span_;
+    size_t off = end_sentinel - span;
+    bool empty = Get<Tag>(alloc, off - sizeof(Tag))->span_ == 0;
+    size_t new_top = empty ? off - sizeof(Tag) : off + end_sentinel_span_;
+    HeapAllocator<true> &heap = *alloc.heap_;
+    hshm::size_t heap_off = top_ - heap.region_off_;
+    if (!heap.heap_off_.compare_exchange_strong(heap_off,
+                                                new_top - heap.region_off_)) {
+      return false;
+    }
+    Remove(alloc, off, span);
+    if (empty) {
+      // The next segment will not follow a known one
+      top_ = 0;
+    } else {
+      Format(alloc, off, end_sentinel_span_, false);
+      top_ = new_top;
+    }
+    return true;
+  }
+
+  /**
+   * Rebuild the free bins of the segment that starts at \a off after an
+   * unclean shutdown. The bins must have been emptied with shm_init.
+   * Whether a page is free is taken from its MpPage, and runs of free
+   * pages are merged.
+   *
+   * @param end the end of the heap
+   * @param in_use incremented by the size of the allocated pages
+   * @return the end of the segment, or 0 if its pages are corrupt
+   * */
+  HSHM_CROSS_FUN
+  size_t RecoverSegment(StackAllocator &alloc, size_t off, size_t end,
+                        size_t &in_use) {
+    // Check every page before changing any
+    size_t seg_end = 0;
+    for (size_t page_off = off + sizeof(Tag); !seg_end;) {
+      if (end - page_off < end_sentinel_span_) {
+        return 0;
+      }
+      size_t span = Get<MpPage>(alloc, page_off)->page_size_ + sizeof(Tag);
+      if (span == end_sentinel_span_) {
+        seg_end = page_off + span;
+      } else if (span < min_span_ || span % PageId::min_alignment_ ||
+                 span > end - page_off ||
+                 GetTag(alloc, page_off, span)->span_ != span) {
+        return 0;
+      } else {
+        page_off += span;
+      }
+    }
+    // Bin the runs of free pages
+    size_t run_off = 0, run_span = 0;
+    for (size_t page_off = off + sizeof(Tag); page_off < seg_end;) {
+      MpPage *page = Get<MpPage>(alloc, page_off);
+      size_t span = page->page_size_ + sizeof(Tag);
+      if (span != end_sentinel_span_ && !page->IsAllocated()) {
+        if (!run_span) {
+          run_off = page_off;
+        }
+        run_span += span;
+      } else {
+        if (run_span) {
+          Insert(alloc, run_off, run_span);
+          run_span = 0;
+        }
+        if (span != end_sentinel_span_) {
+          in_use += page->page_size_;
+        }
+        GetTag(alloc, page_off, span)->free_ = false;
+      }
+      page_off += span;
+    }
+    top_ = seg_end;
+    return seg_end;
+  }
+
+ private:
+  /** Round \a size up to a multiple of the page alignment */
+  HSHM_INLINE_CROSS_FUN
+  static size_t RoundUp(size_t size) {
+    return (size + PageId::min_alignment_ - 1) &
+           ~(PageId::min_alignment_ - 1);
+  }
+
+  /** Whether the heap of \a alloc still ends at the last segment */
+  HSHM_INLINE_CROSS_FUN
+  bool IsHeapTop(StackAllocator &alloc) {
+    HeapAllocator<true> &heap = *alloc.heap_;
+    return top_ && heap.region_off_ + heap.heap_off_.load() == top_;
+  }
+
+  /** The bin of a page of span \a span */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetBin(size_t span) {
+    return PageId::Log2Floor(span) - min_bin_exp_;
+  }
+
+  /** Get the data at offset \a off of \a alloc */
+  template <typename T>
+  HSHM_INLINE_CROSS_FUN static T *Get(StackAllocator &alloc, size_t off) {
+    return alloc.Convert<T>(OffsetPointer(off));
+  }
+
+  /** Get the boundary tag of the page at \a off with span \a span */
+  HSHM_INLINE_CROSS_FUN
+  static Tag *GetTag(StackAllocator &alloc, size_t off, size_t span) {
+    return Get<Tag>(alloc, off + span - sizeof(Tag));
+  }
+
+  /** Get the free list links of the free page at \a off */
+  HSHM_INLINE_CROSS_FUN
+  static LargePageLinks *GetLinks(StackAllocator &alloc, size_t off) {
+    return Get<LargePageLinks>(alloc, off + sizeof(MpPage));
+  }
+
+  /** Set the header and tag of the page at \a off */
+  HSHM_INLINE_CROSS_FUN
+  static MpPage *Format(StackAllocator &alloc, size_t off, size_t span,
+                        bool free) {
+    MpPage *page = Get<MpPage>(alloc, off);
+    page->UnsetAllocated();
+    page->off_ = 0;
+    page->page_size_ = span - sizeof(Tag);
+    Tag *tag = GetTag(alloc, off, span);
+    tag->span_ = span;
+    tag->free_ = free;
+    return page;
+  }
+
+  /** Add the page at \a off to its bin */
+  HSHM_CROSS_FUN
+  void Insert(StackAllocator &alloc, size_t off, size_t span) {
+    Format(alloc, off, span, true);
+    size_t bin = GetBin(span);
+    LargePageLinks *links = GetLinks(alloc, off);
+    links->prev_ = 0;
+    links->next_ = bins_[bin];
+    if (bins_[bin]) {
+      GetLinks(alloc, bins_[bin])->prev_ = off;
+    }
+    bins_[bin] = off;
+  }
+
+  /** Remove the page at \a off from its bin */
+  HSHM_CROSS_FUN
+  void Remove(StackAllocator &alloc, size_t off, size_t span) {
+    LargePageLinks *links = GetLinks(alloc, off);
+    if (links->prev_) {
+      GetLinks(alloc, links->prev_)->next_ = links->next_;
+    } else {
+      bins_[GetBin(span)] = links->next_;
+    }
+    if (links->next_) {
+      GetLinks(alloc, links->next_)->prev_ = links->prev_;
+    }
+  }
+
+  /**
+   * Find a free page with a span of at least \a need.
+   * The bin of \a need is searched first-fit. Any page in a larger bin
+   * fits, so the first non-empty larger bin is used otherwise.
+   *
+   * @return the offset of the page, or 0 if none fits
+   * */
+  HSHM_CROSS_FUN
+  size_t FindFit(StackAllocator &alloc, size_t need) {
+    size_t bin = GetBin(need);
+    for (size_t off = bins_[bin]; off; off = GetLinks(alloc, off)->next_) {
+      if (Get<MpPage>(alloc, off)->page_size_ + sizeof(Tag) >= need) {
+        return off;
+      }
+    }
+    for (++bin; bin < num_bins_; ++bin) {
+      if (bins_[bin]) {
+        return bins_[bin];
+      }
+    }
+    return 0;
+  }
+
+  /** Take \a need bytes from the free page at \a off and free the rest */
+  HSHM_CROSS_FUN
+  MpPage *Split(StackAllocator &alloc, size_t off, size_t need) {
+    size_t span = Get<MpPage>(alloc, off)->page_size_ + sizeof(Tag);
+    Remove(alloc, off, span);
+    if (span - need >= min_span_) {
+      Insert(alloc, off + need, span - need);
+      span = need;
+    }
+    return Format(alloc, off, span, false);
+  }
+
+  /** Free the page at \a off, merging with free physical neighbours */
+  HSHM_CROSS_FUN
+  void Coalesce(StackAllocator &alloc, size_t off, size_t span) {
+    // Merge with the previous page
+    Tag *prev_tag = Get<Tag>(alloc, off - sizeof(Tag));
+    if (prev_tag->free_) {
+      size_t prev_span = prev_tag->span_;
+      off -= prev_span;
+      span += prev_span;
+      Remove(alloc, off, prev_span);
+    }
+    // Merge with the next page
+    MpPage *next = Get<MpPage>(alloc, off + span);
+    size_t next_span = next->page_size_ + sizeof(Tag);
+    if (GetTag(alloc, off + span, next_span)->free_) {
+      Remove(alloc, off + span, next_span);
+      span += next_span;
+    }
+    Insert(alloc, off, span);
+  }
+
+  /**
+   * Add a segment to the heap large enough to satisfy \a need.
+   * If the heap of \a alloc still ends at the last segment, only the space
+   * not covered by the trailing free page of that segment is requested.
+   *
+   * @return false if the heap of \a alloc is exhausted
+   * */
+  HSHM_CROSS_FUN
+  bool Grow(StackAllocator &alloc, size_t need) {
+    size_t size = need + sentinel_span_;
+    size_t end_sentinel = top_ - end_sentinel_span_;
+    if (IsHeapTop(alloc)) {
+      Tag *last_tag = Get<Tag>(alloc, end_sentinel - sizeof(Tag));
+      if (last_tag->free_) {
+        size = need > last_tag->span_ ? need - last_tag->span_ : 0;
+      } else {
+        size = need;
+      }
+    }
+    // Even if another thread grows the heap first, the segment is usable
+    if (size < min_span_ + sentinel_span_) {
+      size = min_span_ + sentinel_span_;
+    }
+    size = RoundUp(size);
+    OffsetPointer seg = alloc.SubAllocateOffset(size);
+    if (seg.IsNull()) {
+      return false;
+    }
+    size_t off = seg.load();
+    if (top_ && off == top_) {
+      // Extend the last segment over its end sentinel
+      top_ = off + size;
+      Format(alloc, top_ - end_sentinel_span_, end_sentinel_span_, false);
+      Format(alloc, end_sentinel, size, false);
+      Coalesce(alloc, end_sentinel, size);
+    } else {
+      // Start a new segment
+      top_ = off + size;
+      Tag *start = Get<Tag>(alloc, off);
+      start->span_ = 0;
+      start->free_ = false;
+      Format(alloc, top_ - end_sentinel_span_, end_sentinel_span_, false);
+      Insert(alloc, off + sizeof(Tag), size - sentinel_span_);
+    }
+    return true;
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_LARGE_PAGE_ALLOCATOR_H_
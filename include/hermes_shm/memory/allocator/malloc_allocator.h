@@ -25,7 +25,8 @@ class _MallocAllocator;
 typedef BaseAllocator<_MallocAllocator> MallocAllocator;
 
 struct MallocPage {
-  size_t page_size_;
+  size_t page_size_; /**< The size of the payload */
+  size_t off_;       /**< Offset from the malloc'd block to the payload */
 };
 
 struct _MallocAllocatorHeader : public AllocatorHeader {
@@ -87,23 +88,35 @@ class _MallocAllocator : public Allocator {
     auto page =
         reinterpret_cast<MallocPage *>(malloc(sizeof(MallocPage) + size));
     page->page_size_ = size;
+    page->off_ = sizeof(MallocPage);
     header_->AddSize(size);
     return OffsetPointer((size_t)(page + 1));
   }
 
   /**
    * Allocate a memory of \a size size, which is aligned to \a
-   * alignment.
+   * alignment. Returns null if malloc fails or the size overflows.
    * */
   HSHM_CROSS_FUN
   OffsetPointer AlignedAllocateOffset(const hipc::MemContext &ctx, size_t size,
                                       size_t alignment) {
 #ifdef HSHM_IS_HOST
-    auto page = reinterpret_cast<MallocPage *>(
-        SystemInfo::AlignedAlloc(alignment, sizeof(MallocPage) + size));
+    // Over-allocate so the payload can be aligned after the header
+    size_t overhead = sizeof(MallocPage) + alignment;
+    if (overhead < alignment || size > (size_t)-1 - overhead) {
+      return OffsetPointer::GetNull();
+    }
+    char *block = reinterpret_cast<char *>(malloc(overhead + size));
+    if (block == nullptr) {
+      return OffsetPointer::GetNull();
+    }
+    size_t data = ((size_t)block + sizeof(MallocPage) + alignment - 1) &
+                  ~(alignment - 1);
+    auto page = reinterpret_cast<MallocPage *>(data) - 1;
     page->page_size_ = size;
+    page->off_ = data - (size_t)block;
     header_->AddSize(size);
-    return OffsetPointer(size_t(page + 1));
+    return OffsetPointer(data);
 #else
     return OffsetPointer(0);
 #endif
@@ -121,6 +134,15 @@ class _MallocAllocator : public Allocator {
     // Get the input page
     auto page =
         reinterpret_cast<MallocPage *>(p.off_.load() - sizeof(MallocPage));
+    if (page->off_ != sizeof(MallocPage)) {
+      // Aligned pages are not at the start of their malloc'd block
+      OffsetPointer new_p = AllocateOffset(ctx, new_size);
+      size_t old_size = page->page_size_;
+      memcpy((void *)new_p.off_.load(), (void *)p.off_.load(),
+             old_size < new_size ? old_size : new_size);
+      FreeOffsetNoNullCheck(ctx, p);
+      return new_p;
+    }
     header_->AddSize(new_size - page->page_size_);
 
     // Reallocate the input page
@@ -143,7 +165,36 @@ class _MallocAllocator : public Allocator {
     auto page =
         reinterpret_cast<MallocPage *>(p.off_.load() - sizeof(MallocPage));
     header_->SubSize(page->page_size_);
-    free(page);
+    free((char *)p.off_.load() - page->off_);
+  }
+
+  /**
+   * Allocate \a count regions of \a size size
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const hipc::MemContext &ctx,
+                                          size_t size, size_t count,
+                                          PointerT *out) {
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = PointerT(GetId(), AllocateOffset(ctx, size).load());
+    }
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs. malloc keeps no free
+   * lists to group them into, so only the size is updated once.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const hipc::MemContext &ctx,
+                                      PointerT *ptrs, size_t count) {
+    size_t freed = 0;
+    for (size_t i = 0; i < count; ++i) {
+      size_t off = ptrs[i].ToOffsetPointer().off_.load();
+      auto page = reinterpret_cast<MallocPage *>(off - sizeof(MallocPage));
+      freed += page->page_size_;
+      free((char *)off - page->off_);
+    }
+    header_->SubSize(freed);
   }
 
   /**
@@ -18,18 +18,92 @@
 
 namespace hshm::ipc {
 
-struct MpPage : public atomic_list_queue_entry {
-  ibitfield flags_; /**< Flags of the page (e.g., free/alloc) */
+/**
+ * The free-list entry of a freed page or object. It is stored in the
+ * freed memory itself, so allocated memory carries no list link.
+ * */
+struct FreePage : public atomic_list_queue_entry {
+  hshm::size_t class_; /**< The size class of the freed memory */
+};
+
+/**
+ * The header in front of pages that are not carved from chunks of small
+ * objects. It is 16 bytes, so payloads stay 16-byte aligned.
+ * */
+struct MpPage {
+  hshm::size_t page_size_; /**< The total size of the page allocated */
+  hshm::u32 tid_;          /**< The thread ID that allocated the page */
   /** Offset from the start of the page to the beginning of this header */
-  u32 off_;
-  ThreadId tid_;     /**< The thread ID that allocated the page */
-  size_t page_size_; /**< The total size of the page allocated */
+  hshm::u16 off_;
+  hshm::u16 flags_; /**< Flags of the page (e.g., free/alloc) */
+
+  HSHM_INLINE_CROSS_FUN void SetAllocated() { flags_ = 0x1; }
+
+  HSHM_INLINE_CROSS_FUN void UnsetAllocated() { flags_ = 0; }
+
+  HSHM_INLINE_CROSS_FUN bool IsAllocated() const { return flags_ & 0x1; }
+
+  /** Mark the header as the start of bytes skipped to align the heap */
+  HSHM_INLINE_CROSS_FUN void SetPadding() { flags_ = 0x2; }
+
+  HSHM_INLINE_CROSS_FUN bool IsPadding() const { return flags_ & 0x2; }
+
+  /** The thread ID that allocated the page */
+  HSHM_INLINE_CROSS_FUN ThreadId GetTid() const {
+    return tid_ == (hshm::u32)-1 ? ThreadId::GetNull() : ThreadId(tid_);
+  }
+
+  /** Record the thread ID that allocated the page */
+  HSHM_INLINE_CROSS_FUN void SetTid(ThreadId tid) {
+    tid_ = (hshm::u32)tid.tid_;
+  }
+
+  /** The largest alignment supported by aligned allocations */
+  static constexpr size_t max_alignment_ = 4096;
+
+  /** Whether \a alignment is a power of two no larger than max_alignment_ */
+  HSHM_INLINE_CROSS_FUN static bool IsValidAlignment(size_t alignment) {
+    return alignment > 0 && (alignment & (alignment - 1)) == 0 &&
+           alignment <= max_alignment_;
+  }
+
+  /** The extra payload needed to align a page's payload to \a alignment */
+  HSHM_INLINE_CROSS_FUN static size_t GetAlignedOverhead(size_t alignment) {
+    return alignment + sizeof(MpPage);
+  }
 
-  HSHM_INLINE_CROSS_FUN void SetAllocated() { flags_.SetBits(0x1); }
+  /**
+   * Align the payload of this page to \a alignment. The payload must have
+   * GetAlignedOverhead(alignment) spare bytes. If it is not already
+   * aligned, a shadow header is placed directly before the aligned payload
+   * whose off_ points back to this header.
+   *
+   * @return the aligned payload
+   * */
+  HSHM_INLINE_CROSS_FUN char *AlignPayload(size_t alignment) {
+    char *payload = reinterpret_cast<char *>(this + 1);
+    if (((size_t)payload & (alignment - 1)) == 0) {
+      return payload;
+    }
+    size_t aligned_addr =
+        ((size_t)payload + sizeof(MpPage) + alignment - 1) & ~(alignment - 1);
+    MpPage *shadow = reinterpret_cast<MpPage *>(aligned_addr) - 1;
+    shadow->flags_ = flags_;
+    shadow->tid_ = tid_;
+    shadow->page_size_ = page_size_;
+    shadow->off_ = (hshm::u16)((char *)shadow - (char *)this);
+    return reinterpret_cast<char *>(aligned_addr);
+  }
 
-  HSHM_INLINE_CROSS_FUN void UnsetAllocated() { flags_.Clear(); }
+  /** Get the header at the start of the page this header belongs to */
+  HSHM_INLINE_CROSS_FUN MpPage *GetPage() {
+    return reinterpret_cast<MpPage *>((char *)this - off_);
+  }
 
-  HSHM_INLINE_CROSS_FUN bool IsAllocated() const { return flags_.All(0x1); }
+  /** The number of bytes usable after this header */
+  HSHM_INLINE_CROSS_FUN size_t GetDataSize() const {
+    return page_size_ - off_ - sizeof(MpPage);
+  }
 };
 
 }  // namespace hshm::ipc
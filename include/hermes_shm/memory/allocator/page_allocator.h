@@ -1,61 +1,199 @@
 #ifndef HSHM_SHM_INCLUDE_HSHM_SHM_MEMORY_ALLOCATOR_PAGE_ALLOCATOR_H_
 #define HSHM_SHM_INCLUDE_HSHM_SHM_MEMORY_ALLOCATOR_PAGE_ALLOCATOR_H_
 
-#include <cmath>
+#ifdef HSHM_COMPILER_MSVC
+#include <intrin.h>
+#endif
 
 #include "hermes_shm/constants/macros.h"
 #include "hermes_shm/thread/lock/mutex.h"
 #include "mp_page.h"
+#include "page_chunk.h"
 #include "stack_allocator.h"
 
 namespace hshm::ipc {
 
+/**
+ * Compile-time table of the payload sizes of each cached page size class.
+ * The tiny classes are the multiples of 16 bytes up to 64 bytes. Every
+ * power-of-two range (2^k, 2^(k+1)] after that is split into
+ * classes_per_exp_ equally-spaced classes, so a request is rounded up by
+ * at most 25% instead of 2x. Every class is a multiple of 16 bytes.
+ * */
+struct PageSizeClassTable {
+  /** The power-of-two exponent of the largest tiny class (64B) */
+  static constexpr size_t min_exp_ = 6;
+  /** The power-of-two exponent of the maximum size that can be cached (16MB) */
+  static constexpr size_t max_exp_ = 24;
+  /** Log2 of the number of classes per power of two */
+  static constexpr size_t classes_per_exp_log2_ = 2;
+  /** The number of classes per power of two */
+  static constexpr size_t classes_per_exp_ = 1 << classes_per_exp_log2_;
+  /** The spacing of the tiny classes */
+  static constexpr size_t tiny_size_ = 16;
+  /** The number of tiny classes */
+  static constexpr size_t num_tiny_ = ((size_t)1 << min_exp_) / tiny_size_;
+  /** The number of well-defined classes */
+  static constexpr size_t num_classes_ =
+      num_tiny_ + (max_exp_ - min_exp_) * classes_per_exp_;
+
+  size_t sizes_[num_classes_];
+
+  /** Build the table */
+  constexpr PageSizeClassTable() : sizes_() {
+    for (size_t i = 0; i < num_classes_; ++i) {
+      sizes_[i] = ClassSize(i);
+    }
+  }
+
+  /** The payload size of the class \a cls */
+  HSHM_INLINE_CROSS_FUN
+  static constexpr size_t ClassSize(size_t cls) {
+    if (cls < num_tiny_) {
+      return (cls + 1) * tiny_size_;
+    }
+    cls -= num_tiny_;
+    size_t exp = min_exp_ + (cls >> classes_per_exp_log2_);
+    size_t step = cls % classes_per_exp_ + 1;
+    return ((size_t)1 << exp) +
+           step * ((size_t)1 << (exp - classes_per_exp_log2_));
+  }
+};
+
 struct PageId {
  public:
-  /** The power-of-two exponent of the minimum size that can be cached */
-  static const size_t min_cached_size_exp_ = 6;
-  /** The minimum size that can be cached directly (64 bytes) */
-  static const size_t min_cached_size_ =
-      (1 << min_cached_size_exp_) + sizeof(MpPage);
-  /** The power-of-two exponent of the minimum size that can be cached (16KB) */
-  static const size_t max_cached_size_exp_ = 24;
+  typedef PageSizeClassTable Table;
+  /** The minimum size that can be cached directly (16 bytes) */
+  static constexpr size_t min_cached_size_ = Table::tiny_size_;
+  /** The power-of-two exponent of the maximum size that can be cached (16MB) */
+  static constexpr size_t max_cached_size_exp_ = Table::max_exp_;
   /** The maximum size that can be cached directly */
-  static const size_t max_cached_size_ =
-      (1 << max_cached_size_exp_) + sizeof(MpPage);
+  static constexpr size_t max_cached_size_ = (size_t)1
+                                             << max_cached_size_exp_;
   /** The number of well-defined caches */
-  static const size_t num_caches_ =
-      max_cached_size_exp_ - min_cached_size_exp_ + 1;
+  static constexpr size_t num_caches_ = Table::num_classes_;
+  /** The payloads of all classes are aligned to this */
+  static constexpr size_t min_alignment_ = Table::tiny_size_;
+  /** The largest object carved from chunks without a header */
+  static constexpr size_t max_small_size_ = 1024;
+  /** The number of classes carved from chunks */
+  static constexpr size_t num_small_classes_ = 20;
+  static_assert(Table::ClassSize(num_small_classes_ - 1) == max_small_size_,
+                "The small classes must end at max_small_size_");
+  /** The payload sizes of each cache */
+  static constexpr Table table_{};
 
  public:
   size_t orig_;
   size_t round_;
-  size_t exp_;
+  size_t class_;
 
  public:
   /**
-   * Round the size of the requested memory region + sizeof(MpPage)
-   * to the nearest power of two.
+   * Round the payload size of the requested memory region up to the
+   * nearest size class. Sizes beyond the maximum cached size are not
+   * rounded and get class_ == num_caches_.
    * */
   HSHM_INLINE_CROSS_FUN
   PageId(size_t size) {
     orig_ = size;
+    if (size <= ((size_t)1 << Table::min_exp_)) {
+      class_ = size ? (size - 1) / Table::tiny_size_ : 0;
+      round_ = (class_ + 1) * Table::tiny_size_;
+    } else if (size > max_cached_size_) {
+      class_ = num_caches_;
+      round_ = size;
+    } else {
+      size_t exp = Log2Floor(size - 1);
+      size_t shift = exp - Table::classes_per_exp_log2_;
+      size_t step = ((size - 1) >> shift) & (Table::classes_per_exp_ - 1);
+      class_ = Table::num_tiny_ +
+               ((exp - Table::min_exp_) << Table::classes_per_exp_log2_) +
+               step;
 #ifdef HSHM_IS_HOST
-    exp_ = (size_t)std::ceil(std::log2(size - sizeof(MpPage)));
+      round_ = table_.sizes_[class_];
 #else
-    exp_ = ceil(log2(size - sizeof(MpPage)));
+      round_ = Table::ClassSize(class_);
 #endif
-    round_ = (1 << exp_) + sizeof(MpPage);
-    if (exp_ < min_cached_size_exp_) {
-      round_ = min_cached_size_;
-      exp_ = min_cached_size_exp_;
-    } else if (exp_ > max_cached_size_exp_) {
-      round_ = size;
-      exp_ = max_cached_size_exp_;
-    } else {
-      round_ = (1 << exp_) + sizeof(MpPage);
-      exp_ -= min_cached_size_exp_;
     }
   }
+
+  /** Whether the class is carved from chunks without a header */
+  HSHM_INLINE_CROSS_FUN
+  bool IsSmall() const { return class_ < num_small_classes_; }
+
+  /** The size of a page of this class, including its MpPage header */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetPageSize() const { return round_ + sizeof(MpPage); }
+
+  /** Get the class of the page whose header is \a page */
+  HSHM_INLINE_CROSS_FUN
+  static PageId FromPage(const MpPage *page) {
+    return PageId(page->page_size_ - sizeof(MpPage));
+  }
+
+  /** Floor of log2(x) for x > 0 using count-leading-zeros */
+  HSHM_INLINE_CROSS_FUN
+  static size_t Log2Floor(size_t x) {
+#if defined(HSHM_IS_GPU)
+    return 63 - __clzll((long long)x);
+#elif defined(HSHM_COMPILER_MSVC)
+    unsigned long idx;
+    _BitScanReverse64(&idx, (unsigned __int64)x);
+    return (size_t)idx;
+#else
+    return 63 - __builtin_clzll((unsigned long long)x);
+#endif
+  }
+};
+
+/**
+ * Pages released by a batch of frees. Pages are grouped by a key, such as
+ * their size class, so each group is returned to its free list in one
+ * operation.
+ * */
+struct FreePageBatch {
+  static constexpr size_t max_pages_ = 64;
+  FreePage *pages_[max_pages_];
+  hshm::u32 keys_[max_pages_];
+  size_t count_ = 0;
+
+  /** Add \a page to the group \a key */
+  HSHM_INLINE_CROSS_FUN
+  void Add(hshm::u32 key, FreePage *page) {
+    keys_[count_] = key;
+    pages_[count_++] = page;
+  }
+
+  /** Whether no more pages fit */
+  HSHM_INLINE_CROSS_FUN
+  bool IsFull() const { return count_ == max_pages_; }
+
+  /** Call \a free_fn(key, pages, n) once per group and empty the batch */
+  template <typename FreeFn>
+  HSHM_INLINE_CROSS_FUN void Flush(FreeFn &&free_fn) {
+    // Insertion sort: batches are small and often already grouped
+    for (size_t i = 1; i < count_; ++i) {
+      hshm::u32 key = keys_[i];
+      FreePage *page = pages_[i];
+      size_t j = i;
+      for (; j > 0 && keys_[j - 1] > key; --j) {
+        keys_[j] = keys_[j - 1];
+        pages_[j] = pages_[j - 1];
+      }
+      keys_[j] = key;
+      pages_[j] = page;
+    }
+    for (size_t i = 0; i < count_;) {
+      size_t j = i + 1;
+      while (j < count_ && keys_[j] == keys_[i]) {
+        ++j;
+      }
+      free_fn(keys_[i], pages_ + i, j - i);
+      i = j;
+    }
+    count_ = 0;
+  }
 };
 
 template <typename AllocT, bool MPMC, bool LOCAL_HEAP>
@@ -63,12 +201,13 @@ class PageAllocator {
  public:
   typedef StackAllocator Alloc_;
   typedef TlsAllocatorInfo<AllocT> TLS;
-  typedef hipc::lifo_list_queue<MpPage, Alloc_> LIFO_LIST;
-  typedef hipc::mpsc_lifo_list_queue<MpPage, Alloc_> MPSC_LIFO_LIST;
+  typedef hipc::mpsc_lifo_list_queue<FreePage, Alloc_> MPSC_LIFO_LIST;
 
  public:
   hipc::delay_ar<MPSC_LIFO_LIST> free_lists_[PageId::num_caches_];
-  hipc::delay_ar<LIFO_LIST> fallback_list_;
+  hipc::delay_ar<MPSC_LIFO_LIST> remote_list_;
+  /** Offsets of the chunks small objects are currently carved from */
+  hshm::size_t chunks_[PageId::num_small_classes_];
   TLS tls_info_;
   HeapAllocator<MPMC> heap_;
   hipc::Mutex lock_;
@@ -81,7 +220,10 @@ class PageAllocator {
     for (size_t i = 0; i < PageId::num_caches_; ++i) {
       HSHM_MAKE_AR0(free_lists_[i], alloc);
     }
-    HSHM_MAKE_AR0(fallback_list_, alloc);
+    HSHM_MAKE_AR0(remote_list_, alloc);
+    for (size_t i = 0; i < PageId::num_small_classes_; ++i) {
+      chunks_[i] = 0;
+    }
     if constexpr (LOCAL_HEAP) {
       heap_.shm_init(
           alloc->Allocate<OffsetPointer>(HSHM_DEFAULT_MEM_CTX, local_heap_size),
@@ -95,11 +237,15 @@ class PageAllocator {
   HSHM_INLINE_CROSS_FUN
   PageAllocator(PageAllocator &&other) {}
 
+  /** Carve a page with an MpPage header from the local heap */
   HSHM_INLINE_CROSS_FUN
   MpPage *AllocateHeap(const PageId &page_id) {
     if constexpr (LOCAL_HEAP) {
-      if (page_id.exp_ < PageId::num_caches_) {
-        OffsetPointer shm = heap_.AllocateOffset(page_id.round_);
+      if (page_id.class_ < PageId::num_caches_) {
+        OffsetPointer shm = heap_.AllocateOffset(page_id.GetPageSize());
+        if (shm.IsNull()) {
+          return nullptr;
+        }
         return tls_info_.alloc_->template Convert<MpPage>(shm);
       }
     }
@@ -107,7 +253,7 @@ class PageAllocator {
   }
 
   HSHM_INLINE_CROSS_FUN
-  MpPage *Allocate(const PageId &page_id) {
+  FreePage *Allocate(const PageId &page_id) {
     if constexpr (!MPMC) {
       return AllocateMpsc(page_id);
     } else {
@@ -118,38 +264,419 @@ class PageAllocator {
     return nullptr;
   }
 
+  /**
+   * Pop a cached page. Pages larger than the largest cached size class
+   * are managed by the LargePageAllocator instead.
+   * */
   HSHM_INLINE_CROSS_FUN
-  MpPage *AllocateMpsc(const PageId &page_id) {
-    // Allocate cached page
-    if (page_id.exp_ < PageId::num_caches_) {
-      MPSC_LIFO_LIST &free_list = *free_lists_[page_id.exp_];
-      MpPage *page = free_list.pop();
+  FreePage *AllocateMpsc(const PageId &page_id) {
+    if (page_id.class_ < PageId::num_caches_) {
+      MPSC_LIFO_LIST &free_list = *free_lists_[page_id.class_];
+      FreePage *page = free_list.pop();
       return page;
     }
-    // Allocate a large page size
-    for (auto it = fallback_list_->begin(); it != fallback_list_->end(); ++it) {
-      MpPage *page = *it;
-      if (page->page_size_ >= page_id.round_) {
-        fallback_list_->dequeue(it);
-        return page;
+    return nullptr;
+  }
+
+  /**
+   * Pop up to \a count cached pages of the class of \a page_id into
+   * \a pages. The lock is acquired once for the entire batch.
+   *
+   * @return the number of pages popped
+   * */
+  HSHM_INLINE_CROSS_FUN
+  size_t AllocateBatch(const PageId &page_id, FreePage **pages, size_t count) {
+    if (page_id.class_ >= PageId::num_caches_) {
+      return 0;
+    }
+    MPSC_LIFO_LIST &free_list = *free_lists_[page_id.class_];
+    if (free_list.size() == 0) {
+      return 0;
+    }
+    if constexpr (MPMC) {
+      hipc::ScopedMutex lock(lock_, 0);
+      return AllocateBatchMpsc(free_list, pages, count);
+    } else {
+      return AllocateBatchMpsc(free_list, pages, count);
+    }
+  }
+
+  HSHM_INLINE_CROSS_FUN
+  size_t AllocateBatchMpsc(MPSC_LIFO_LIST &free_list, FreePage **pages,
+                           size_t count) {
+    size_t i = 0;
+    for (; i < count; ++i) {
+      pages[i] = free_list.pop();
+      if (pages[i] == nullptr) {
+        break;
       }
     }
-    return nullptr;
+    return i;
+  }
+
+  /**
+   * Carve up to \a count new small objects of the class of \a page_id
+   * into \a objs. Chunks are acquired from \a chunks as they fill and
+   * are tagged with the thread \a tid.
+   *
+   * @return the number of objects carved
+   * */
+  HSHM_INLINE_CROSS_FUN
+  size_t AllocateChunk(PageChunkHeap &chunks, StackAllocator &alloc,
+                       const PageId &page_id, hshm::u32 tid, char **objs,
+                       size_t count) {
+    if constexpr (MPMC) {
+      hipc::ScopedMutex lock(lock_, 0);
+      return AllocateChunkMpsc(chunks, alloc, page_id, tid, objs, count);
+    } else {
+      return AllocateChunkMpsc(chunks, alloc, page_id, tid, objs, count);
+    }
+  }
+
+  HSHM_INLINE_CROSS_FUN
+  size_t AllocateChunkMpsc(PageChunkHeap &chunks, StackAllocator &alloc,
+                           const PageId &page_id, hshm::u32 tid, char **objs,
+                           size_t count) {
+    hshm::size_t &cur = chunks_[page_id.class_];
+    size_t i = 0;
+    while (i < count) {
+      PageChunk *chunk = nullptr;
+      if (cur) {
+        chunk = reinterpret_cast<PageChunk *>(alloc.buffer_ + cur);
+      }
+      if (!chunk || chunk->carved_ == chunk->num_objs_) {
+        chunk = chunks.Acquire(alloc, page_id.class_, page_id.round_, tid);
+        if (!chunk) {
+          break;
+        }
+        cur = (hshm::size_t)(reinterpret_cast<char *>(chunk) - alloc.buffer_);
+      }
+      while (i < count && chunk->carved_ < chunk->num_objs_) {
+        objs[i++] = chunk->GetObject(chunk->carved_++);
+      }
+    }
+    return i;
+  }
+
+  /**
+   * Free a page of class \a cls on behalf of a thread that does not own
+   * this PageAllocator. The page is pushed lock-free to the remote list
+   * and recycled by the owner the next time it allocates.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void RemoteFree(size_t cls, FreePage *page) {
+    page->class_ = cls;
+    remote_list_->enqueue(page);
+  }
+
+  /**
+   * Free \a count pages of class \a cls on behalf of another thread. The
+   * pages are spliced onto the remote list in one operation.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void RemoteFreeBatch(size_t cls, FreePage **pages, size_t count) {
+    if (count == 0) {
+      return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+      pages[i]->class_ = cls;
+    }
+    remote_list_->enqueue_batch(pages, count);
+  }
+
+  /** Move the pages freed by other threads into the local free lists */
+  HSHM_INLINE_CROSS_FUN
+  void DrainRemoteFrees() {
+    MPSC_LIFO_LIST &remote_list = *remote_list_;
+    if (remote_list.size() == 0) {
+      return;
+    }
+    FreePage *page;
+    while ((page = remote_list.pop()) != nullptr) {
+      Free(page->class_, page);
+    }
   }
 
+  /**
+   * Return \a count pages of the cached size class \a cls to the free
+   * lists. The pages are spliced onto their free list in one operation.
+   * */
   HSHM_INLINE_CROSS_FUN
-  void Free(OffsetPointer page_shm, MpPage *page) {
-    PageId page_id(page->page_size_);
-    if (page_id.exp_ < PageId::num_caches_) {
-      free_lists_[page_id.exp_]->enqueue(page);
+  void FreeBatch(size_t cls, FreePage **pages, size_t count) {
+    if (count == 0) {
+      return;
+    }
+    free_lists_[cls]->enqueue_batch(pages, count);
+  }
+
+  /** Return a page of the cached size class \a cls to its free list */
+  HSHM_INLINE_CROSS_FUN
+  void Free(size_t cls, FreePage *page) { free_lists_[cls]->enqueue(page); }
+
+  /**
+   * Return the physical memory of the cached pages to the OS. The pages
+   * stay cached with their payloads discarded. Small objects are not
+   * discarded, since their chunks are shared with allocated objects.
+   *
+   * @return the number of bytes discarded
+   * */
+  HSHM_HOST_FUN
+  size_t Discard(StackAllocator &alloc) {
+    if constexpr (MPMC) {
+      hipc::ScopedMutex lock(lock_, 0);
+      return DiscardMpsc(alloc);
     } else {
-      if constexpr (MPMC) {
-        hipc::ScopedMutex lock(lock_, 0);
-        fallback_list_->enqueue(page);
+      return DiscardMpsc(alloc);
+    }
+  }
+
+  /**
+   * Remove the cached pages at the top of the heap of \a alloc from the
+   * free lists and shrink the heap over them, so any size class can
+   * carve that space again.
+   *
+   * @return whether the heap shrank
+   * */
+  HSHM_HOST_FUN
+  bool ShrinkHeap(StackAllocator &alloc) {
+    if constexpr (MPMC) {
+      hipc::ScopedMutex lock(lock_, 0);
+      return ShrinkHeapMpsc(alloc);
+    } else {
+      return ShrinkHeapMpsc(alloc);
+    }
+  }
+
+ private:
+  HSHM_HOST_FUN
+  size_t DiscardMpsc(StackAllocator &alloc) {
+    FreePage *pages = TakePages(alloc);
+    size_t discarded = 0;
+    for (FreePage *page = pages; page; page = GetNext(alloc, page)) {
+      // The free list entry at the start of the payload is kept
+      MpPage *hdr = reinterpret_cast<MpPage *>(page) - 1;
+      discarded += SystemInfo::DiscardMemory(
+          page + 1, hdr->page_size_ - sizeof(MpPage) - sizeof(FreePage));
+    }
+    CachePages(alloc, pages);
+    return discarded;
+  }
+
+  HSHM_HOST_FUN
+  bool ShrinkHeapMpsc(StackAllocator &alloc) {
+    HeapAllocator<true> &heap = *alloc.heap_;
+    FreePage *pages = SortDescending(alloc, TakePages(alloc));
+    bool shrunk = false;
+    while (pages) {
+      MpPage *hdr = reinterpret_cast<MpPage *>(pages) - 1;
+      hshm::size_t start = (hshm::size_t)(reinterpret_cast<char *>(hdr) -
+                                          alloc.buffer_ - heap.region_off_);
+      hshm::size_t end = start + hdr->page_size_;
+      if (!heap.heap_off_.compare_exchange_strong(end, start)) {
+        break;
+      }
+      shrunk = true;
+      pages = GetNext(alloc, pages);
+    }
+    CachePages(alloc, pages);
+    return shrunk;
+  }
+
+  /** Take the cached pages with a header out of the free lists */
+  HSHM_HOST_FUN
+  FreePage *TakePages(StackAllocator &alloc) {
+    FreePage *pages = nullptr;
+    for (size_t cls = PageId::num_small_classes_; cls < PageId::num_caches_;
+         ++cls) {
+      MPSC_LIFO_LIST &free_list = *free_lists_[cls];
+      FreePage *page;
+      while ((page = free_list.pop()) != nullptr) {
+        page->class_ = cls;
+        SetNext(alloc, page, pages);
+        pages = page;
+      }
+    }
+    return pages;
+  }
+
+  /** Return the pages taken by TakePages to their free lists */
+  HSHM_HOST_FUN
+  void CachePages(StackAllocator &alloc, FreePage *pages) {
+    while (pages) {
+      FreePage *next = GetNext(alloc, pages);
+      Free(pages->class_, pages);
+      pages = next;
+    }
+  }
+
+  /** Link \a page to \a next in a list of pages being trimmed */
+  HSHM_INLINE_HOST_FUN
+  static void SetNext(StackAllocator &alloc, FreePage *page, FreePage *next) {
+    page->next_shm_.off_.store(
+        next ? (size_t)(reinterpret_cast<char *>(next) - alloc.buffer_) : 0);
+  }
+
+  /** The page after \a page in a list of pages being trimmed */
+  HSHM_INLINE_HOST_FUN
+  static FreePage *GetNext(StackAllocator &alloc, FreePage *page) {
+    size_t off = page->next_shm_.off_.load();
+    return off ? reinterpret_cast<FreePage *>(alloc.buffer_ + off) : nullptr;
+  }
+
+  /** Merge sort a list of pages by descending address */
+  HSHM_HOST_FUN
+  static FreePage *SortDescending(StackAllocator &alloc, FreePage *pages) {
+    if (!pages || !GetNext(alloc, pages)) {
+      return pages;
+    }
+    // Split the list in half
+    FreePage *slow = pages, *fast = GetNext(alloc, pages);
+    while (fast && GetNext(alloc, fast)) {
+      slow = GetNext(alloc, slow);
+      fast = GetNext(alloc, GetNext(alloc, fast));
+    }
+    FreePage *right = GetNext(alloc, slow);
+    SetNext(alloc, slow, nullptr);
+    FreePage *left = SortDescending(alloc, pages);
+    right = SortDescending(alloc, right);
+    // Merge the halves
+    FreePage *head = nullptr, *tail = nullptr;
+    while (left || right) {
+      FreePage *next;
+      if (!right || (left && left > right)) {
+        next = left;
+        left = GetNext(alloc, left);
+      } else {
+        next = right;
+        right = GetNext(alloc, right);
+      }
+      if (tail) {
+        SetNext(alloc, tail, next);
       } else {
-        fallback_list_->enqueue(page);
+        head = next;
+      }
+      tail = next;
+    }
+    SetNext(alloc, tail, nullptr);
+    return head;
+  }
+};
+
+/**
+ * A bounded, process-local cache of free pages for a single thread.
+ * Pages of the smaller size classes are allocated from and freed to
+ * this cache without touching shared state. The cache refills from
+ * and flushes to the shared PageAllocator in batches, and is flushed
+ * entirely when the thread exits.
+ * */
+template <typename AllocT, typename PageAllocT>
+class PageMagazine : public thread::ThreadLocalData {
+ public:
+  /** The power-of-two exponent of the largest size class cached (64KB) */
+  static constexpr size_t max_cached_size_exp_ = 16;
+  /** The number of size classes that are cached */
+  static constexpr size_t num_caches_ =
+      PageSizeClassTable::num_tiny_ +
+      (max_cached_size_exp_ - PageSizeClassTable::min_exp_) *
+          PageSizeClassTable::classes_per_exp_;
+  /** The maximum number of pages cached per size class */
+  static constexpr size_t depth_ = 16;
+  /** The number of pages moved per refill or flush */
+  static constexpr size_t batch_ = depth_ / 2;
+
+ public:
+  AllocT *alloc_;
+  AllocatorId alloc_id_;
+  PageAllocT *page_alloc_;
+  u32 count_[num_caches_];
+  FreePage *pages_[num_caches_][depth_];
+
+ public:
+  /** Constructor */
+  HSHM_INLINE_CROSS_FUN
+  PageMagazine(AllocT *alloc, PageAllocT *page_alloc)
+      : alloc_(alloc), alloc_id_(alloc->GetId()), page_alloc_(page_alloc) {
+    for (size_t i = 0; i < num_caches_; ++i) {
+      count_[i] = 0;
+    }
+  }
+
+  /** Allocate a page, refilling from the shared free list if empty */
+  HSHM_INLINE_CROSS_FUN
+  FreePage *Allocate(const PageId &page_id) {
+    if (page_id.class_ >= num_caches_) {
+      return page_alloc_->Allocate(page_id);
+    }
+    u32 &count = count_[page_id.class_];
+    if (count == 0) {
+      count = (u32)page_alloc_->AllocateBatch(page_id, pages_[page_id.class_],
+                                               batch_);
+      if (count == 0) {
+        return nullptr;
       }
     }
+    return pages_[page_id.class_][--count];
+  }
+
+  /**
+   * Free a page of class \a cls, flushing the oldest batch to the free
+   * list if full
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void Free(size_t cls, FreePage *page) {
+    if (cls >= num_caches_) {
+      page_alloc_->Free(cls, page);
+      return;
+    }
+    FreePage **pages = pages_[cls];
+    u32 &count = count_[cls];
+    if (count == depth_) {
+      page_alloc_->FreeBatch(cls, pages, batch_);
+      for (size_t i = batch_; i < depth_; ++i) {
+        pages[i - batch_] = pages[i];
+      }
+      count -= batch_;
+    }
+    pages[count++] = page;
+  }
+
+  /**
+   * Free \a n pages of class \a cls. The pages that do not fit in the
+   * cache are spliced onto the free list in one operation.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void FreeBatch(size_t cls, FreePage **pages, size_t n) {
+    if (cls >= num_caches_) {
+      page_alloc_->FreeBatch(cls, pages, n);
+      return;
+    }
+    u32 &count = count_[cls];
+    size_t fit = depth_ - count < n ? depth_ - count : n;
+    for (size_t i = 0; i < fit; ++i) {
+      pages_[cls][count++] = pages[i];
+    }
+    page_alloc_->FreeBatch(cls, pages + fit, n - fit);
+  }
+
+  /** Return every cached page to the shared free lists */
+  HSHM_INLINE_CROSS_FUN
+  void Flush() {
+    for (size_t i = 0; i < num_caches_; ++i) {
+      page_alloc_->FreeBatch(i, pages_[i], count_[i]);
+      count_[i] = 0;
+    }
+  }
+
+  /** Called when the owning thread exits */
+  HSHM_CROSS_FUN
+  void destroy() {
+#ifdef HSHM_IS_HOST
+    // The allocator may have been destroyed before this thread
+    if (HSHM_MEMORY_MANAGER->GetAllocator<AllocT>(alloc_id_) == alloc_) {
+      Flush();
+    }
+    delete this;
+#endif
   }
 };
 
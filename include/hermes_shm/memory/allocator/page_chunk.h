@@ -0,0 +1,307 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_PAGE_CHUNK_H_
+#define HSHM_MEMORY_ALLOCATOR_PAGE_CHUNK_H_
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/thread/lock/mutex.h"
+#include "hermes_shm/types/atomic.h"
+#include "mp_page.h"
+#include "stack_allocator.h"
+
+namespace hshm::ipc {
+
+/**
+ * The descriptor at the start of a chunk of small objects. Every object
+ * of a chunk has the same size class, so objects carry no header. The
+ * descriptor is followed by a bitmap of the allocated objects, and then
+ * by the objects.
+ * */
+struct PageChunk {
+  hshm::size_t next_;  /**< The next chunk in the free chunk pool */
+  hshm::u32 class_;    /**< The size class of the objects */
+  hshm::u32 tid_;      /**< The thread that carves objects from the chunk */
+  hshm::u32 obj_size_; /**< The size of each object */
+  hshm::u32 num_objs_; /**< The number of objects in the chunk */
+  hshm::u32 obj_off_;  /**< The offset of the first object */
+  hshm::u32 carved_;   /**< The number of objects carved so far */
+
+  /** The bitmap of allocated objects */
+  HSHM_INLINE_CROSS_FUN
+  hipc::atomic<hshm::u64> *GetBitmap() {
+    return reinterpret_cast<hipc::atomic<hshm::u64> *>(this + 1);
+  }
+
+  /** The number of 64-bit words in the bitmap of \a num_objs objects */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetNumWords(size_t num_objs) { return (num_objs + 63) / 64; }
+
+  /** The offset of the first of \a num_objs objects */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetObjOffset(size_t num_objs) {
+    size_t end = sizeof(PageChunk) + GetNumWords(num_objs) * 8;
+    return (end + 63) & ~(size_t)63;
+  }
+
+  /** Get the object at index \a idx */
+  HSHM_INLINE_CROSS_FUN
+  char *GetObject(size_t idx) {
+    return reinterpret_cast<char *>(this) + obj_off_ + idx * obj_size_;
+  }
+
+  /**
+   * Get the index of the object containing \a ptr. Pointers into the
+   * middle of an object, as returned by aligned allocations, are rounded
+   * down to the start of the object.
+   *
+   * @return the index, or num_objs_ if \a ptr is not in a carved object
+   * */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetIndex(const char *ptr) {
+    const char *objs = reinterpret_cast<char *>(this) + obj_off_;
+    if (ptr < objs) {
+      return num_objs_;
+    }
+    size_t idx = (size_t)(ptr - objs) / obj_size_;
+    return idx < carved_ ? idx : num_objs_;
+  }
+
+  /** The number of bytes from \a ptr to the end of its object */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetUsableSize(const char *ptr) {
+    return (size_t)(GetObject(GetIndex(ptr)) + obj_size_ - ptr);
+  }
+
+  /** Mark object \a idx allocated */
+  HSHM_INLINE_CROSS_FUN
+  void SetAllocated(size_t idx) {
+    GetBitmap()[idx / 64].fetch_or((hshm::u64)1 << (idx % 64));
+  }
+
+  /**
+   * Mark object \a idx free
+   *
+   * @return false if the object was already free
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool UnsetAllocated(size_t idx) {
+    hshm::u64 bit = (hshm::u64)1 << (idx % 64);
+    return GetBitmap()[idx / 64].fetch_and(~bit) & bit;
+  }
+
+  /** Whether object \a idx is allocated */
+  HSHM_INLINE_CROSS_FUN
+  bool IsAllocated(size_t idx) {
+    return GetBitmap()[idx / 64].load() & ((hshm::u64)1 << (idx % 64));
+  }
+};
+
+/**
+ * Divides the heap of a StackAllocator into aligned chunks of small
+ * objects.
+ *
+ * Chunks are chunk_size_ bytes and start at a multiple of chunk_size_
+ * from the start of the heap, so the chunk of any object is found by
+ * masking its offset. A map with one byte per chunk-sized unit of the
+ * heap records which units are chunks; the rest of the heap holds pages
+ * with an MpPage header. Chunks are carved from the heap in groups to
+ * limit the bytes skipped for alignment. A chunk keeps its size class
+ * once it is handed out.
+ * */
+class PageChunkHeap {
+ public:
+  /** The power-of-two exponent of the chunk size (64KB) */
+  static constexpr size_t chunk_size_exp_ = 16;
+  /** The size of a chunk */
+  static constexpr size_t chunk_size_ = (size_t)1 << chunk_size_exp_;
+  /** The number of chunks carved from the heap at a time */
+  static constexpr size_t chunks_per_grow_ = 16;
+
+ public:
+  hshm::size_t base_;      /**< Offset of the heap in the StackAllocator */
+  hshm::size_t num_units_; /**< The number of chunk-sized units in the heap */
+  hshm::size_t map_;       /**< Offset of the chunk map */
+  hshm::size_t pool_;      /**< Offset of the first unused chunk */
+  hipc::Mutex lock_;
+
+ public:
+  /** Default constructor */
+  HSHM_CROSS_FUN
+  PageChunkHeap() = default;
+
+  /** Explicit initialization. The map is carved from \a alloc. */
+  HSHM_CROSS_FUN
+  void shm_init(StackAllocator &alloc) {
+    HeapAllocator<true> &heap = *alloc.heap_;
+    base_ = heap.region_off_;
+    num_units_ = heap.heap_size_ >> chunk_size_exp_;
+    map_ = 0;
+    pool_ = 0;
+    lock_.Init();
+    if (num_units_) {
+      OffsetPointer map = alloc.SubAllocateOffset(num_units_);
+      if (map.IsNull()) {
+        num_units_ = 0;
+        return;
+      }
+      map_ = map.load();
+      memset(GetMap(alloc), 0, num_units_);
+    }
+  }
+
+  /**
+   * Get the chunk containing \a ptr
+   *
+   * @return null if \a ptr is not in a chunk
+   * */
+  HSHM_INLINE_CROSS_FUN
+  PageChunk *Find(StackAllocator &alloc, const char *ptr) {
+    size_t off = (size_t)(ptr - alloc.buffer_);
+    if (off < base_) {
+      return nullptr;
+    }
+    size_t unit = (off - base_) >> chunk_size_exp_;
+    if (unit >= num_units_ || !GetMap(alloc)[unit]) {
+      return nullptr;
+    }
+    return Get(alloc, ptr);
+  }
+
+  /** Get the chunk containing \a ptr, which must be in a chunk */
+  HSHM_INLINE_CROSS_FUN
+  PageChunk *Get(StackAllocator &alloc, const char *ptr) {
+    size_t off = (size_t)(ptr - alloc.buffer_) - base_;
+    off &= ~(chunk_size_ - 1);
+    return reinterpret_cast<PageChunk *>(alloc.buffer_ + base_ + off);
+  }
+
+  /**
+   * Get an unused chunk for objects of class \a cls and size \a obj_size
+   * carved by the thread \a tid.
+   *
+   * @return null if the heap is exhausted
+   * */
+  HSHM_CROSS_FUN
+  PageChunk *Acquire(StackAllocator &alloc, size_t cls, size_t obj_size,
+                     hshm::u32 tid) {
+    PageChunk *chunk;
+    {
+      hipc::ScopedMutex lock(lock_, 0);
+      if (!pool_ && !Grow(alloc)) {
+        return nullptr;
+      }
+      chunk = reinterpret_cast<PageChunk *>(alloc.buffer_ + pool_);
+      pool_ = chunk->next_;
+    }
+    size_t num_objs = (chunk_size_ - sizeof(PageChunk)) / obj_size;
+    while (PageChunk::GetObjOffset(num_objs) + num_objs * obj_size >
+           chunk_size_) {
+      --num_objs;
+    }
+    chunk->next_ = 0;
+    chunk->class_ = (hshm::u32)cls;
+    chunk->tid_ = tid;
+    chunk->obj_size_ = (hshm::u32)obj_size;
+    chunk->num_objs_ = (hshm::u32)num_objs;
+    chunk->obj_off_ = (hshm::u32)PageChunk::GetObjOffset(num_objs);
+    chunk->carved_ = 0;
+    hipc::atomic<hshm::u64> *bitmap = chunk->GetBitmap();
+    for (size_t i = 0; i < PageChunk::GetNumWords(num_objs); ++i) {
+      bitmap[i] = 0;
+    }
+    return chunk;
+  }
+
+  /**
+   * Empty the pool of unused chunks after an unclean shutdown. Recovery
+   * returns the unused chunks with Release as it walks the heap.
+   * */
+  HSHM_CROSS_FUN
+  void ResetPool() {
+    pool_ = 0;
+    lock_.Init();
+  }
+
+  /** Return the unused chunk \a chunk to the pool */
+  HSHM_CROSS_FUN
+  void Release(StackAllocator &alloc, PageChunk *chunk) {
+    chunk->next_ = pool_;
+    pool_ = (hshm::size_t)(reinterpret_cast<char *>(chunk) - alloc.buffer_);
+  }
+
+  /**
+   * Find the first chunk at or after the offset \a off of \a alloc
+   *
+   * @return the offset of the chunk, or 0 if there is none
+   * */
+  HSHM_CROSS_FUN
+  size_t FindNext(StackAllocator &alloc, size_t off) {
+    size_t unit = 0;
+    if (off > base_) {
+      unit = (off - base_ + chunk_size_ - 1) >> chunk_size_exp_;
+    }
+    hshm::u8 *map = GetMap(alloc);
+    for (; unit < num_units_; ++unit) {
+      if (map[unit]) {
+        return base_ + (unit << chunk_size_exp_);
+      }
+    }
+    return 0;
+  }
+
+ private:
+  /** The chunk map */
+  HSHM_INLINE_CROSS_FUN
+  hshm::u8 *GetMap(StackAllocator &alloc) {
+    return reinterpret_cast<hshm::u8 *>(alloc.buffer_ + map_);
+  }
+
+  /**
+   * Carve chunks from the heap into the pool. A single chunk is carved
+   * if a group no longer fits.
+   *
+   * @return false if the heap is exhausted
+   * */
+  HSHM_CROSS_FUN
+  bool Grow(StackAllocator &alloc) {
+    size_t count = chunks_per_grow_;
+    OffsetPointer off =
+        alloc.SubAlignedAllocateOffset(count * chunk_size_, chunk_size_);
+    if (off.IsNull()) {
+      count = 1;
+      off = alloc.SubAlignedAllocateOffset(chunk_size_, chunk_size_);
+    }
+    if (off.IsNull() || !num_units_) {
+      return false;
+    }
+    hshm::u8 *map = GetMap(alloc);
+    for (size_t i = count; i > 0; --i) {
+      size_t chunk_off = off.load() + (i - 1) * chunk_size_;
+      PageChunk *chunk =
+          reinterpret_cast<PageChunk *>(alloc.buffer_ + chunk_off);
+      // An unused chunk contains no objects
+      chunk->obj_size_ = 1;
+      chunk->num_objs_ = 0;
+      chunk->obj_off_ = (hshm::u32)chunk_size_;
+      chunk->carved_ = 0;
+      chunk->next_ = pool_;
+      pool_ = chunk_off;
+      map[(chunk_off - base_) >> chunk_size_exp_] = 1;
+    }
+    return true;
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_PAGE_CHUNK_H_
@@ -23,7 +23,11 @@
 #include "hermes_shm/data_structures/ipc/vector.h"
 #include "hermes_shm/memory/allocator/stack_allocator.h"
 #include "hermes_shm/thread/lock.h"
+#include "hermes_shm/util/logging.h"
 #include "hermes_shm/util/timer.h"
+#include "allocator_stats.h"
+#include "epoch_manager.h"
+#include "large_page_allocator.h"
 #include "mp_page.h"
 #include "page_allocator.h"
 
@@ -37,6 +41,10 @@ struct _ScalablePageAllocatorHeader : public AllocatorHeader {
       PageAllocator;
   hipc::atomic<hshm::size_t> total_alloc_;
   hipc::delay_ar<PageAllocator> global_;
+  PageChunkHeap chunks_;
+  LargePageAllocator large_;
+  EpochManager epoch_;
+  AllocatorStatsTable stats_;
 
   HSHM_CROSS_FUN
   _ScalablePageAllocatorHeader() = default;
@@ -48,6 +56,10 @@ struct _ScalablePageAllocatorHeader : public AllocatorHeader {
                                custom_header_size);
     total_alloc_ = 0;
     HSHM_MAKE_AR(global_, alloc, alloc);
+    chunks_.shm_init(*alloc);
+    large_.shm_init();
+    epoch_.shm_init();
+    stats_.shm_init();
   }
 };
 
@@ -57,8 +69,14 @@ class _ScalablePageAllocator : public Allocator {
 
  private:
   typedef _ScalablePageAllocatorHeader::PageAllocator PageAllocator;
+  typedef PageMagazine<_ScalablePageAllocator, PageAllocator> Magazine;
+  typedef hipc::EpochTls<_ScalablePageAllocator> EpochTls;
+  typedef hipc::AllocatorStatsTls<_ScalablePageAllocator> StatsTls;
   _ScalablePageAllocatorHeader *header_;
   StackAllocator alloc_;
+  thread::ThreadLocalKey tls_key_;
+  thread::ThreadLocalKey epoch_key_;
+  thread::ThreadLocalKey stats_key_;
 
  public:
   /**
@@ -79,13 +97,19 @@ class _ScalablePageAllocator : public Allocator {
     buffer_size_ = buffer_size;
     header_ = reinterpret_cast<_ScalablePageAllocatorHeader *>(buffer_);
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
-    size_t region_off = (custom_header_ - buffer_) + custom_header_size;
+    size_t region_off =
+        AlignRegionOffset((custom_header_ - buffer_) + custom_header_size);
     size_t region_size = buffer_size_ - region_off;
     AllocatorId sub_id(id.bits_.major_, id.bits_.minor_ + 1);
+    alloc_.backend_ = backend_;
     alloc_.shm_init(sub_id, 0, buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
     header_->Configure(id, custom_header_size, &alloc_, buffer_size);
+    HSHM_THREAD_MODEL->CreateTls<Magazine>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<EpochTls>(epoch_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
     alloc_.Align();
+    header_->stats_.base_ = alloc_.heap_->heap_off_.load();
   }
 
   /**
@@ -99,46 +123,273 @@ class _ScalablePageAllocator : public Allocator {
     type_ = header_->allocator_type_;
     id_ = header_->alloc_id_;
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
-    size_t region_off =
-        (custom_header_ - buffer_) + header_->custom_header_size_;
+    size_t region_off = AlignRegionOffset((custom_header_ - buffer_) +
+                                          header_->custom_header_size_);
     size_t region_size = buffer_size_ - region_off;
+    alloc_.backend_ = backend_;
     alloc_.shm_deserialize(buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
+    HSHM_THREAD_MODEL->CreateTls<Magazine>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<EpochTls>(epoch_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
+    if (backend_ && backend_->NeedsRecovery()) {
+      size_t lost = Recover();
+#ifdef HSHM_IS_HOST
+      if (lost) {
+        HILOG(kError, "Leaked the last {} bytes of the heap of {}.{}", lost,
+              id_.bits_.major_, id_.bits_.minor_);
+      }
+#endif
+      backend_->FinishRecovery();
+    }
+  }
+
+  /**
+   * Rebuild the shared state of the allocator after every process using
+   * it exited without detaching, e.g., when a persistent heap is reopened
+   * after a crash. The heap is walked from its first page. Small objects
+   * are found through the bitmaps of their chunks and other pages through
+   * their MpPage headers, and everything free returns to the free lists,
+   * including the pages cached by threads of the dead processes. Memory
+   * retired to the epoch manager is freed. A region that cannot be
+   * parsed, such as a header torn by the crash, is leaked up to the next
+   * chunk. If no chunk follows it, the walk stops and the rest of the heap
+   * is leaked, since live pages may lie past the torn header.
+   *
+   * No other process may use the allocator during recovery.
+   *
+   * @return the bytes leaked at the end of the heap
+   * */
+  HSHM_CROSS_FUN
+  size_t Recover() {
+    _ScalablePageAllocatorHeader &header = *header_;
+    HeapAllocator<true> &heap = *alloc_.heap_;
+    hshm::size_t limbo[EpochManager::num_limbo_];
+    for (size_t i = 0; i < EpochManager::num_limbo_; ++i) {
+      limbo[i] = header.epoch_.limbo_[i].load();
+    }
+    header.epoch_.shm_init();
+    HSHM_MAKE_AR(header.global_, &alloc_, &alloc_);
+    header.chunks_.ResetPool();
+    header.large_.shm_init();
+    header.stats_.ReleaseSlots();
+
+    // Return every free object and page to the free lists
+    PageAllocator &page_alloc = *header.global_;
+    size_t in_use = 0, lost = 0;
+    size_t off = heap.region_off_ + header.stats_.base_;
+    size_t end = heap.region_off_ + heap.heap_off_.load();
+    while (off < end) {
+      char *ptr = alloc_.buffer_ + off;
+      PageChunk *chunk = header.chunks_.Find(alloc_, ptr);
+      if (chunk) {
+        in_use += RecoverChunk(page_alloc, chunk);
+        off = (size_t)(reinterpret_cast<char *>(chunk) - alloc_.buffer_) +
+              PageChunkHeap::chunk_size_;
+        continue;
+      }
+      MpPage *page = reinterpret_cast<MpPage *>(ptr);
+      size_t next = 0;
+      if (page->IsPadding()) {
+        if (page->page_size_ >= sizeof(MpPage) &&
+            page->page_size_ <= end - off) {
+          next = off + page->page_size_;
+        }
+      } else if (reinterpret_cast<LargePageTag *>(ptr)->span_ == 0) {
+        // Segments of large pages start with an empty tag
+        next = header.large_.RecoverSegment(alloc_, off, end, in_use);
+      } else if (IsCachedPage(page, end - off)) {
+        if (page->IsAllocated()) {
+          in_use += page->page_size_;
+        } else {
+          page_alloc.Free(PageId::FromPage(page).class_,
+                          reinterpret_cast<FreePage *>(page + 1));
+        }
+        next = off + page->page_size_;
+      }
+      if (!next) {
+        next = header.chunks_.FindNext(alloc_, off);
+        if (!next) {
+          lost = end - off;
+          break;
+        }
+      }
+      off = next;
+    }
+    // Only counted when allocation sizes are tracked
+    header.SubSize(header.GetCurrentlyAllocatedSize());
+    header.AddSize(in_use + lost);
+
+    // Nothing can still read the memory that was retired
+    for (size_t i = 0; i < EpochManager::num_limbo_; ++i) {
+      OffsetPointer node_off(limbo[i]);
+      while (!node_off.IsNull()) {
+        EpochRetireNode *node = Convert<EpochRetireNode>(node_off);
+        OffsetPointer next(node->next_);
+        OffsetPointer p(node->ptr_);
+        if (IsAllocated(p)) {
+          FreeOffsetNoNullCheck(HSHM_DEFAULT_MEM_CTX, p);
+        }
+        if (IsAllocated(node_off)) {
+          FreeOffsetNoNullCheck(HSHM_DEFAULT_MEM_CTX, node_off);
+        }
+        node_off = next;
+      }
+    }
+    return lost;
+  }
+
+ private:
+  /**
+   * Return the free objects of \a chunk to the free lists, or the chunk
+   * to the pool if it is unused. Objects that were not carved yet are
+   * freed too.
+   *
+   * @return the bytes allocated from the chunk
+   * */
+  HSHM_CROSS_FUN
+  size_t RecoverChunk(PageAllocator &page_alloc, PageChunk *chunk) {
+    if (chunk->num_objs_ == 0) {
+      header_->chunks_.Release(alloc_, chunk);
+      return 0;
+    }
+    size_t in_use = 0;
+    chunk->carved_ = chunk->num_objs_;
+    for (size_t i = 0; i < chunk->num_objs_; ++i) {
+      if (chunk->IsAllocated(i)) {
+        in_use += chunk->obj_size_;
+      } else {
+        page_alloc.Free(chunk->class_,
+                        reinterpret_cast<FreePage *>(chunk->GetObject(i)));
+      }
+    }
+    return in_use;
   }
 
   /**
-   * Allocate a memory of \a size size. The page allocator cannot allocate
-   * memory larger than the page size.
+   * Whether \a page looks like a page of a cached size class that ends
+   * within \a avail bytes
+   * */
+  HSHM_INLINE_CROSS_FUN
+  static bool IsCachedPage(MpPage *page, size_t avail) {
+    size_t size = page->page_size_;
+    if (size <= sizeof(MpPage) || size > avail || page->off_ ||
+        page->flags_ > 0x1) {
+      return false;
+    }
+    PageId page_id = PageId::FromPage(page);
+    return page_id.class_ < PageId::num_caches_ &&
+           page_id.GetPageSize() == size;
+  }
+
+ public:
+
+  /**
+   * Get this thread's page magazine, creating it if needed.
+   * Returns null when thread-local storage is unavailable.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  Magazine *GetMagazine() {
+#ifdef HSHM_IS_HOST
+    Magazine *mag = HSHM_THREAD_MODEL->GetTls<Magazine>(tls_key_);
+    if (!mag) {
+      mag = new Magazine(this, header_->global_.get());
+      HSHM_THREAD_MODEL->SetTls(tls_key_, mag);
+    }
+    return mag;
+#else
+    return nullptr;
+#endif
+  }
+
+  /**
+   * Allocate a memory of \a size size. Small objects are carved from
+   * chunks without a header. Larger pages have an MpPage header.
    * */
   HSHM_CROSS_FUN
   OffsetPointer AllocateOffset(const hipc::MemContext &ctx, size_t size) {
-    MpPage *page = nullptr;
-    PageId page_id(size + sizeof(MpPage));
+    PageId page_id(size);
+    if (page_id.IsSmall()) {
+      return AllocateSmall(page_id);
+    }
+    return AllocatePage(page_id);
+  }
 
-    // Case 1: Can we re-use an existing page?
-    PageAllocator &page_alloc = *header_->global_;
-    page = page_alloc.Allocate(page_id);
+ private:
+  /** Allocate a small object from a chunk of its size class */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer AllocateSmall(const PageId &page_id) {
+    // Case 1: Can we re-use an existing object?
+    char *obj;
+    Magazine *mag = GetMagazine();
+    if (mag) {
+      obj = reinterpret_cast<char *>(mag->Allocate(page_id));
+    } else {
+      obj = reinterpret_cast<char *>(header_->global_->Allocate(page_id));
+    }
 
-    // Case 2: Coalesce if enough space is being wasted
-    // if (page == nullptr) {}
+    // Case 2: Carve a new object from a chunk
+    if (obj == nullptr &&
+        !header_->global_->AllocateChunk(header_->chunks_, alloc_, page_id,
+                                         0, &obj, 1)) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, page_id.orig_,
+                       GetCurrentlyAllocatedSize());
+    }
 
-    // Case 3: Allocate from heap if no page found
-    if (page == nullptr) {
-      OffsetPointer off = alloc_.SubAllocateOffset(page_id.round_);
-      if (!off.IsNull()) {
-        page = alloc_.Convert<MpPage>(off);
+    // Mark as allocated
+    PageChunk *chunk = header_->chunks_.Get(alloc_, obj);
+    chunk->SetAllocated(chunk->GetIndex(obj));
+    header_->AddSize(page_id.round_);
+    header_->stats_.RecordAlloc(GetStatsSlot(), page_id.round_);
+    return Convert<char, OffsetPointer>(obj);
+  }
+
+  /** Allocate a page with an MpPage header */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer AllocatePage(const PageId &page_id) {
+    MpPage *page = nullptr;
+    if (page_id.class_ < PageId::num_caches_) {
+      // Case 1: Can we re-use an existing page?
+      Magazine *mag = GetMagazine();
+      FreePage *cached;
+      if (mag) {
+        cached = mag->Allocate(page_id);
+      } else {
+        cached = header_->global_->Allocate(page_id);
+      }
+      if (cached) {
+        page = reinterpret_cast<MpPage *>(cached) - 1;
+      }
+
+      // Case 2: Allocate from heap if no page found
+      if (page == nullptr) {
+        OffsetPointer off = alloc_.SubAllocateOffset(page_id.GetPageSize());
+        if (!off.IsNull()) {
+          page = alloc_.Convert<MpPage>(off);
+          page->page_size_ = page_id.GetPageSize();
+        }
       }
+    } else {
+      // Case 3: Split a large page from the coalescing large page heap
+      page = header_->large_.Allocate(alloc_, page_id.GetPageSize());
     }
 
     // Case 4: Completely out of memory
     if (page == nullptr) {
-      HSHM_THROW_ERROR(OUT_OF_MEMORY, size, GetCurrentlyAllocatedSize());
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, page_id.orig_,
+                       GetCurrentlyAllocatedSize());
     }
 
-    // Mark as allocated
-    header_->AddSize(page_id.round_);
+    return MarkPage(page);
+  }
+
+  /** Mark \a page as allocated and account for it */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer MarkPage(MpPage *page) {
+    header_->AddSize(page->page_size_);
+    header_->stats_.RecordAlloc(GetStatsSlot(), page->page_size_);
     OffsetPointer p = Convert<MpPage, OffsetPointer>(page);
-    page->page_size_ = page_id.round_;
+    page->off_ = 0;
     page->SetAllocated();
     return p + sizeof(MpPage);
   }
@@ -151,23 +402,63 @@ class _ScalablePageAllocator : public Allocator {
   HSHM_CROSS_FUN
   OffsetPointer AlignedAllocateOffset(const hipc::MemContext &ctx, size_t size,
                                       size_t alignment) {
-    HSHM_THROW_ERROR(NOT_IMPLEMENTED, "AlignedAllocateOffset");
-    return OffsetPointer::GetNull();
+    if (!MpPage::IsValidAlignment(alignment)) {
+      HSHM_THROW_ERROR(INVALID_ALIGNMENT, alignment, MpPage::max_alignment_);
+    }
+    if (alignment <= PageId::min_alignment_) {
+      return AllocateOffset(ctx, size);
+    }
+    // Small objects are aligned within the object itself
+    PageId small_id(size + alignment - PageId::min_alignment_);
+    if (small_id.IsSmall()) {
+      OffsetPointer p = AllocateSmall(small_id);
+      size_t addr = (size_t)Convert<char>(p);
+      return p + (((addr + alignment - 1) & ~(alignment - 1)) - addr);
+    }
+    OffsetPointer p =
+        AllocatePage(PageId(size + MpPage::GetAlignedOverhead(alignment)));
+    MpPage *page = Convert<MpPage>(p - sizeof(MpPage));
+    char *aligned = page->AlignPayload(alignment);
+    return p + (size_t)(aligned - reinterpret_cast<char *>(page + 1));
   }
 
   /**
-   * Reallocate \a p pointer to \a new_size new size.
+   * Reallocate \a p pointer to \a new_size new size. The page is reused
+   * if it already has room, and large pages are grown in place when the
+   * memory after them is free.
    *
    * @return whether or not the pointer p was changed
    * */
   HSHM_CROSS_FUN
   OffsetPointer ReallocateOffsetNoNullCheck(const hipc::MemContext &ctx,
                                             OffsetPointer p, size_t new_size) {
+    char *old = Convert<char, OffsetPointer>(p);
+    size_t old_size = GetUsableSize(p);
+
+    // Case 1: The page already has room
+    if (new_size <= old_size) {
+      return p;
+    }
+
+    // Case 2: Grow a large page into the free memory after it
+    if (!header_->chunks_.Find(alloc_, old)) {
+      MpPage *old_hdr = (MpPage *)(old - sizeof(MpPage));
+      size_t old_page_size = old_hdr->page_size_;
+      if (old_hdr->off_ == 0 &&
+          PageId::FromPage(old_hdr).class_ >= PageId::num_caches_ &&
+          header_->large_.Expand(alloc_, old_hdr, new_size + sizeof(MpPage))) {
+        header_->AddSize(old_hdr->page_size_ - old_page_size);
+        AllocatorStatsSlot *slot = GetStatsSlot();
+        header_->stats_.RecordFree(slot, old_page_size);
+        header_->stats_.RecordAlloc(slot, old_hdr->page_size_);
+        return p;
+      }
+    }
+
+    // Case 3: Move the data to a new page
     FullPtr<char, OffsetPointer> new_ptr =
         GetAllocator()->AllocateLocalPtr<char, OffsetPointer>(ctx, new_size);
-    char *old = Convert<char, OffsetPointer>(p);
-    MpPage *old_hdr = (MpPage *)(old - sizeof(MpPage));
-    memcpy(new_ptr.ptr_, old, old_hdr->page_size_ - sizeof(MpPage));
+    memcpy(new_ptr.ptr_, old, old_size);
     FreeOffsetNoNullCheck(ctx.tid_, p);
     return new_ptr.shm_;
   }
@@ -177,16 +468,320 @@ class _ScalablePageAllocator : public Allocator {
    * */
   HSHM_CROSS_FUN
   void FreeOffsetNoNullCheck(const hipc::MemContext &ctx, OffsetPointer p) {
+    size_t cls;
+    FreePage *page = ReleaseOffset(p, cls);
+    if (page) {
+      FreeCached(cls, page);
+    }
+  }
+
+  /**
+   * Get the number of bytes that can be used from \a p to the end of
+   * the object or page it points into.
+   * */
+  HSHM_CROSS_FUN
+  size_t GetUsableSize(OffsetPointer p) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      return chunk->GetUsableSize(ptr);
+    }
+    return ((MpPage *)(ptr - sizeof(MpPage)))->GetDataSize();
+  }
+
+  /** Whether \a p points to memory that is currently allocated */
+  HSHM_CROSS_FUN
+  bool IsAllocated(OffsetPointer p) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      size_t idx = chunk->GetIndex(ptr);
+      return idx < chunk->num_objs_ && chunk->IsAllocated(idx);
+    }
+    return ((MpPage *)(ptr - sizeof(MpPage)))->IsAllocated();
+  }
+
+ private:
+  /**
+   * Mark \a p free and account for it. Large pages are returned to the
+   * large page heap.
+   *
+   * @return the page to cache in the free list of class \a cls, or null
+   * */
+  HSHM_INLINE_CROSS_FUN
+  FreePage *ReleaseOffset(OffsetPointer p, size_t &cls) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      // Small objects are tracked by the bitmap of their chunk
+      size_t idx = chunk->GetIndex(ptr);
+      if (idx == chunk->num_objs_) {
+        HSHM_THROW_ERROR(INVALID_FREE);
+      }
+      if (!chunk->UnsetAllocated(idx)) {
+        HSHM_THROW_ERROR(DOUBLE_FREE, p.load());
+      }
+      header_->SubSize(chunk->obj_size_);
+      header_->stats_.RecordFree(GetStatsSlot(), chunk->obj_size_);
+      cls = chunk->class_;
+      return reinterpret_cast<FreePage *>(chunk->GetObject(idx));
+    }
+
     // Mark as free
-    auto hdr_offset = p - sizeof(MpPage);
-    MpPage *hdr = Convert<MpPage>(hdr_offset);
+    MpPage *hdr = Convert<MpPage>(p - sizeof(MpPage));
+    if (hdr->off_) {
+      // This is the shadow header of an aligned allocation
+      hdr->UnsetAllocated();
+      hdr = hdr->GetPage();
+    }
     if (!hdr->IsAllocated()) {
       HSHM_THROW_ERROR(DOUBLE_FREE, hdr);
     }
     hdr->UnsetAllocated();
     header_->SubSize(hdr->page_size_);
+    header_->stats_.RecordFree(GetStatsSlot(), hdr->page_size_);
+    cls = PageId::FromPage(hdr).class_;
+    if (cls >= PageId::num_caches_) {
+      header_->large_.Free(alloc_, hdr);
+      return nullptr;
+    }
+    return reinterpret_cast<FreePage *>(hdr + 1);
+  }
+
+  /** Return \a n cached objects or pages of class \a cls at once */
+  HSHM_INLINE_CROSS_FUN
+  void FreeCachedBatch(size_t cls, FreePage **pages, size_t n) {
+    Magazine *mag = GetMagazine();
+    if (mag) {
+      mag->FreeBatch(cls, pages, n);
+    } else {
+      header_->global_->FreeBatch(cls, pages, n);
+    }
+  }
+
+  /** Free out[0, done) and null out[0, count) after a batch failed */
+  template <typename PointerT>
+  HSHM_INLINE_CROSS_FUN void RollbackBatch(const hipc::MemContext &ctx,
+                                           PointerT *out, size_t done,
+                                           size_t count) {
+    FreeOffsetBatch(ctx, out, done);
+    for (size_t i = 0; i < count; ++i) {
+      out[i].SetNull();
+    }
+  }
+
+  /** Return a cached object or page of class \a cls to its free list */
+  HSHM_INLINE_CROSS_FUN
+  void FreeCached(size_t cls, FreePage *page) {
+    Magazine *mag = GetMagazine();
+    if (mag) {
+      mag->Free(cls, page);
+    } else {
+      header_->global_->Free(cls, page);
+    }
+  }
+
+ public:
+  /**
+   * Allocate \a count regions of \a size size. Cached pages are taken
+   * from the shared free list with one lock acquisition per chunk, and
+   * the rest are carved from the heap with a single update. If memory
+   * runs out, the regions already allocated are freed and \a out is
+   * nulled before the error is thrown.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const hipc::MemContext &ctx,
+                                          size_t size, size_t count,
+                                          PointerT *out) {
+    constexpr size_t kChunk = 64;
+    PageId page_id(size);
+    if (page_id.class_ >= PageId::num_caches_) {
+      for (size_t i = 0; i < count; ++i) {
+        MpPage *page = header_->large_.Allocate(alloc_, page_id.GetPageSize());
+        if (page == nullptr) {
+          RollbackBatch(ctx, out, i, count);
+          HSHM_THROW_ERROR(OUT_OF_MEMORY, size, GetCurrentlyAllocatedSize());
+        }
+        out[i] = PointerT(GetId(), MarkPage(page).load());
+      }
+      return;
+    }
+    if (page_id.IsSmall()) {
+      AllocateSmallBatch(ctx, page_id, count, out);
+      return;
+    }
+    PageAllocator &page_alloc = *header_->global_;
+    size_t page_size = page_id.GetPageSize();
+    FreePage *pages[kChunk];
+    for (size_t i = 0; i < count;) {
+      size_t n = (count - i) < kChunk ? (count - i) : kChunk;
+      // Case 1: Re-use cached pages
+      size_t cached = page_alloc.AllocateBatch(page_id, pages, n);
+      // Case 2: Allocate the remainder from the heap
+      if (cached < n) {
+        OffsetPointer off = alloc_.SubAllocateOffset(page_size * (n - cached));
+        if (off.IsNull()) {
+          page_alloc.FreeBatch(page_id.class_, pages, cached);
+          RollbackBatch(ctx, out, i, count);
+          HSHM_THROW_ERROR(OUT_OF_MEMORY, size, GetCurrentlyAllocatedSize());
+        }
+        for (size_t j = cached; j < n; ++j) {
+          MpPage *page = alloc_.Convert<MpPage>(off);
+          page->page_size_ = page_size;
+          pages[j] = reinterpret_cast<FreePage *>(page + 1);
+          off += page_size;
+        }
+      }
+      // Mark as allocated
+      for (size_t j = 0; j < n; ++j) {
+        MpPage *page = reinterpret_cast<MpPage *>(pages[j]) - 1;
+        page->off_ = 0;
+        page->SetAllocated();
+        OffsetPointer p = Convert<FreePage, OffsetPointer>(pages[j]);
+        out[i + j] = PointerT(GetId(), p.load());
+      }
+      header_->AddSize(page_size * n);
+      header_->stats_.RecordAlloc(GetStatsSlot(), page_size, n);
+      i += n;
+    }
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs. The freed pages are
+   * grouped by size class, and each group is returned to its free list
+   * in one operation.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const hipc::MemContext &ctx,
+                                      PointerT *ptrs, size_t count) {
+    FreePageBatch batch;
+    auto free_fn = [this](hshm::u32 cls, FreePage **pages, size_t n) {
+      FreeCachedBatch(cls, pages, n);
+    };
+    for (size_t i = 0; i < count; ++i) {
+      size_t cls;
+      FreePage *page = ReleaseOffset(ptrs[i].ToOffsetPointer(), cls);
+      if (page) {
+        batch.Add((hshm::u32)cls, page);
+      }
+      if (batch.IsFull()) {
+        batch.Flush(free_fn);
+      }
+    }
+    batch.Flush(free_fn);
+  }
+
+ private:
+  /**
+   * Allocate \a count small objects of the class of \a page_id. Cached
+   * objects are taken first and the rest are carved from chunks.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateSmallBatch(const hipc::MemContext &ctx,
+                                         const PageId &page_id, size_t count,
+                                         PointerT *out) {
+    constexpr size_t kChunk = 64;
     PageAllocator &page_alloc = *header_->global_;
-    page_alloc.Free(hdr_offset, hdr);
+    char *objs[kChunk];
+    for (size_t i = 0; i < count;) {
+      size_t n = (count - i) < kChunk ? (count - i) : kChunk;
+      // Case 1: Re-use cached objects
+      size_t cached = page_alloc.AllocateBatch(
+          page_id, reinterpret_cast<FreePage **>(objs), n);
+      // Case 2: Carve the remainder from chunks
+      if (cached < n) {
+        size_t carved = page_alloc.AllocateChunk(
+            header_->chunks_, alloc_, page_id, 0, objs + cached, n - cached);
+        if (cached + carved < n) {
+          FreeCachedBatch(page_id.class_, reinterpret_cast<FreePage **>(objs),
+                          cached + carved);
+          RollbackBatch(ctx, out, i, count);
+          HSHM_THROW_ERROR(OUT_OF_MEMORY, page_id.orig_,
+                           GetCurrentlyAllocatedSize());
+        }
+      }
+      // Mark as allocated
+      for (size_t j = 0; j < n; ++j) {
+        PageChunk *chunk = header_->chunks_.Get(alloc_, objs[j]);
+        chunk->SetAllocated(chunk->GetIndex(objs[j]));
+        OffsetPointer p = Convert<char, OffsetPointer>(objs[j]);
+        out[i + j] = PointerT(GetId(), p.load());
+      }
+      header_->AddSize(page_id.round_ * n);
+      header_->stats_.RecordAlloc(GetStatsSlot(), page_id.round_, n);
+      i += n;
+    }
+  }
+
+ public:
+  /**
+   * Get this thread's epoch registration, creating it if needed.
+   * Returns null when thread-local storage is unavailable.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  EpochTls *GetEpochTls() {
+#ifdef HSHM_IS_HOST
+    EpochTls *tls = HSHM_THREAD_MODEL->GetTls<EpochTls>(epoch_key_);
+    if (!tls) {
+      tls = new EpochTls(this, &header_->epoch_);
+      HSHM_THREAD_MODEL->SetTls(epoch_key_, tls);
+    }
+    return tls;
+#else
+    return nullptr;
+#endif
+  }
+
+  /** Release this thread's epoch registration */
+  HSHM_CROSS_FUN
+  void FreeEpochTls() {
+#ifdef HSHM_IS_HOST
+    EpochTls *tls = HSHM_THREAD_MODEL->GetTls<EpochTls>(epoch_key_);
+    if (tls) {
+      header_->epoch_.Unregister(tls->slot_);
+      delete tls;
+      HSHM_THREAD_MODEL->SetTls<EpochTls>(epoch_key_, nullptr);
+    }
+#endif
+  }
+
+  /**
+   * Pin the current epoch. Memory retired while the epoch is pinned is
+   * not reused until this thread calls EpochExit.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void EpochEnter(const hipc::MemContext &ctx) {
+    EpochTls *tls = GetEpochTls();
+    if (tls) {
+      tls->Enter();
+    }
+  }
+
+  /** Unpin the epoch pinned by EpochEnter */
+  HSHM_INLINE_CROSS_FUN
+  void EpochExit(const hipc::MemContext &ctx) {
+    EpochTls *tls = GetEpochTls();
+    if (tls) {
+      tls->Exit();
+    }
+  }
+
+  /**
+   * Free \a p once no thread that pinned the epoch can reach it.
+   * */
+  HSHM_CROSS_FUN
+  void RetireOffset(const hipc::MemContext &ctx, OffsetPointer p) {
+    header_->epoch_.Retire(this, p);
+  }
+
+  /**
+   * Try to advance the epoch and free memory that is no longer reachable.
+   *
+   * @return whether the epoch advanced
+   * */
+  HSHM_CROSS_FUN
+  bool EpochCollect(const hipc::MemContext &ctx) {
+    return header_->epoch_.Collect(this);
   }
 
   /**
@@ -198,17 +793,95 @@ class _ScalablePageAllocator : public Allocator {
     return (size_t)header_->GetCurrentlyAllocatedSize();
   }
 
+  /**
+   * Get this thread's statistics slot, claiming one if needed. Threads
+   * without thread-local storage share a slot.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  AllocatorStatsSlot *GetStatsSlot() {
+#ifdef HSHM_IS_HOST
+    StatsTls *tls = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (!tls) {
+      tls = new StatsTls(this, &header_->stats_);
+      HSHM_THREAD_MODEL->SetTls(stats_key_, tls);
+    }
+    return tls->slot_;
+#else
+    return header_->stats_.GetSharedSlot();
+#endif
+  }
+
+  /** Release this thread's statistics slot. Its counters are kept. */
+  HSHM_CROSS_FUN
+  void FreeStatsTls() {
+#ifdef HSHM_IS_HOST
+    StatsTls *tls = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (tls) {
+      header_->stats_.Unregister(tls->slot_);
+      delete tls;
+      HSHM_THREAD_MODEL->SetTls<StatsTls>(stats_key_, nullptr);
+    }
+#endif
+  }
+
+  /**
+   * Get a snapshot of the allocation statistics of every thread and
+   * process using this allocator
+   * */
+  AllocatorStats GetStats() {
+    return header_->stats_.Snapshot(alloc_.heap_->heap_off_.load());
+  }
+
+  /**
+   * Return the memory of the cached pages to the OS. The pages cached by
+   * this thread are returned to the shared free lists first; the few
+   * pages cached by other threads are not trimmed.
+   *
+   * @return the number of bytes discarded
+   * */
+  HSHM_HOST_FUN
+  size_t Trim(const hipc::MemContext &ctx) {
+#ifdef HSHM_IS_HOST
+    Magazine *mag = HSHM_THREAD_MODEL->GetTls<Magazine>(tls_key_);
+    if (mag) {
+      mag->Flush();
+    }
+#endif
+    PageAllocator &page_alloc = *header_->global_;
+    size_t discarded = page_alloc.Discard(alloc_);
+    discarded += header_->large_.Discard(alloc_);
+    // Shrinking over one kind of page can expose the other at the top
+    bool shrunk = true;
+    while (shrunk) {
+      shrunk = page_alloc.ShrinkHeap(alloc_);
+      shrunk = header_->large_.ShrinkHeap(alloc_) || shrunk;
+    }
+    return discarded;
+  }
+
   /**
    * Create a globally-unique thread ID
    * */
   HSHM_CROSS_FUN
-  void CreateTls(MemContext &ctx) {}
+  void CreateTls(MemContext &ctx) { GetEpochTls(); }
 
   /**
-   * Free a thread-local memory storage
+   * Free a thread-local memory storage. Returns the pages cached by
+   * this thread to the shared free lists.
    * */
   HSHM_CROSS_FUN
-  void FreeTls(const MemContext &ctx) {}
+  void FreeTls(const MemContext &ctx) {
+#ifdef HSHM_IS_HOST
+    Magazine *mag = HSHM_THREAD_MODEL->GetTls<Magazine>(tls_key_);
+    if (mag) {
+      mag->Flush();
+      delete mag;
+      HSHM_THREAD_MODEL->SetTls<Magazine>(tls_key_, nullptr);
+    }
+#endif
+    FreeEpochTls();
+    FreeStatsTls();
+  }
 };
 
 }  // namespace hshm::ipc
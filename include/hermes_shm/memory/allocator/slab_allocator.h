@@ -0,0 +1,624 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_SLAB_ALLOCATOR_H_
+#define HSHM_MEMORY_ALLOCATOR_SLAB_ALLOCATOR_H_
+
+#include "allocator.h"
+#include "allocator_stats.h"
+#include "heap.h"
+#include "hermes_shm/memory/backend/growable_shm_mmap.h"
+#include "hermes_shm/thread/lock.h"
+#include "hermes_shm/util/errors.h"
+
+namespace hshm::ipc {
+
+class _SlabAllocator;
+typedef BaseAllocator<_SlabAllocator> SlabAllocator;
+
+/**
+ * The header at the start of each slab. The bitmap of free objects
+ * follows it, and the objects follow the bitmap.
+ * */
+struct SlabHeader {
+  hipc::atomic<hshm::size_t> state_; /**< (free objects << 1) | owned */
+  hshm::size_t next_;                /**< Next slab in the partial list */
+  hshm::u32 obj_size_;               /**< Size of each object */
+  hshm::u32 num_objs_;               /**< Number of objects in the slab */
+  hshm::u32 obj_off_;                /**< Offset of the first object */
+  hshm::u32 hint_;                   /**< Bitmap word to search first */
+
+  /** The bitmap of free objects */
+  HSHM_INLINE_CROSS_FUN
+  hipc::atomic<hshm::u64> *GetBitmap() {
+    return reinterpret_cast<hipc::atomic<hshm::u64> *>(this + 1);
+  }
+
+  /** The number of 64-bit words in the bitmap */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetNumWords(size_t num_objs) { return (num_objs + 63) / 64; }
+
+  /** The offset of the first object of a slab with \a num_objs objects */
+  HSHM_INLINE_CROSS_FUN
+  static size_t GetObjOffset(size_t num_objs) {
+    size_t end = sizeof(SlabHeader) + GetNumWords(num_objs) * 8;
+    return (end + 63) & ~(size_t)63;
+  }
+};
+
+/** The slabs of one object size that have free objects and no owner */
+struct SlabClass {
+  hshm::size_t partial_; /**< Offset of the first partial slab */
+  hipc::Mutex lock_;
+  char pad_[64 - sizeof(hshm::size_t) - sizeof(hipc::Mutex)];
+};
+
+struct _SlabAllocatorHeader : public AllocatorHeader {
+  /** Object sizes are multiples of this */
+  static constexpr size_t obj_align_ = 8;
+  /** The largest object that can be allocated */
+  static constexpr size_t max_obj_size_ = 1024;
+  /** The number of object sizes */
+  static constexpr size_t num_classes_ = max_obj_size_ / obj_align_;
+
+  HeapAllocator<true> heap_;
+  hshm::size_t slab_size_;
+  SlabClass classes_[num_classes_];
+  AllocatorStatsTable stats_;
+
+  HSHM_CROSS_FUN
+  _SlabAllocatorHeader() = default;
+
+  HSHM_CROSS_FUN
+  void Configure(AllocatorId alloc_id, size_t custom_header_size,
+                 size_t region_off, size_t region_size, size_t slab_size) {
+    AllocatorHeader::Configure(alloc_id, AllocatorType::kSlabAllocator,
+                               custom_header_size);
+    slab_size_ = slab_size;
+    heap_.shm_init(region_off, region_size - region_size % slab_size);
+    for (size_t i = 0; i < num_classes_; ++i) {
+      classes_[i].partial_ = 0;
+      classes_[i].lock_.Init();
+    }
+    stats_.shm_init();
+  }
+};
+
+/** The slabs a thread allocates from, one per object size */
+template <typename AllocT>
+class SlabTls : public thread::ThreadLocalData {
+ public:
+  AllocT *alloc_;
+  AllocatorId alloc_id_;
+  hshm::size_t active_[_SlabAllocatorHeader::num_classes_];
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  explicit SlabTls(AllocT *alloc) : alloc_(alloc), alloc_id_(alloc->GetId()) {
+    for (size_t i = 0; i < _SlabAllocatorHeader::num_classes_; ++i) {
+      active_[i] = 0;
+    }
+  }
+
+  /** Called when the owning thread exits */
+  HSHM_CROSS_FUN
+  void destroy() {
+#ifdef HSHM_IS_HOST
+    // The allocator may have been destroyed before this thread
+    if (HSHM_MEMORY_MANAGER->GetAllocator<Allocator>(alloc_id_) == alloc_) {
+      alloc_->ReleaseSlabs(this);
+    }
+    delete this;
+#endif
+  }
+};
+
+/**
+ * Allocates small objects from slabs without a header per object.
+ *
+ * Each object size gets its own slabs. A slab is a fixed-size,
+ * slab-aligned region holding a bitmap of free objects followed by the
+ * objects, so freeing an object only needs its offset. Each thread owns
+ * one slab per object size and allocates from it without contention.
+ * Any thread or process may free into any slab. A slab whose owner
+ * found it full is returned to its class's partial list by the free
+ * that makes room in it. Slabs keep their object size once carved.
+ *
+ * The allocator is meant for nodes of containers such as list and slist,
+ * which may use it through the AllocT template parameter.
+ * */
+class _SlabAllocator : public Allocator {
+ public:
+  HSHM_ALLOCATOR(_SlabAllocator);
+
+ public:
+  typedef SlabTls<_SlabAllocator> TLS;
+  typedef AllocatorStatsTls<_SlabAllocator> StatsTls;
+  static constexpr size_t obj_align_ = _SlabAllocatorHeader::obj_align_;
+  static constexpr size_t max_obj_size_ = _SlabAllocatorHeader::max_obj_size_;
+  static constexpr size_t num_classes_ = _SlabAllocatorHeader::num_classes_;
+  /** The largest supported alignment */
+  static constexpr size_t max_alignment_ = 64;
+  /** The smallest slab */
+  static constexpr size_t min_slab_size_ = 16384;
+  _SlabAllocatorHeader *header_;
+  size_t region_off_;
+  size_t slab_size_;
+  GrowableShmMmap *growable_; /**< The backend, if it grows on demand */
+  thread::ThreadLocalKey tls_key_;
+  thread::ThreadLocalKey stats_key_;
+
+ public:
+  /**
+   * Allocator constructor
+   * */
+  HSHM_CROSS_FUN
+  _SlabAllocator() : header_(nullptr), growable_(nullptr) {}
+
+  /**
+   * Initialize the allocator in shared memory
+   *
+   * @param slab_size the size of each slab. Rounded up to a power of two
+   * of at least min_slab_size_.
+   * */
+  HSHM_CROSS_FUN
+  void shm_init(AllocatorId id, size_t custom_header_size, char *buffer,
+                size_t buffer_size,
+                size_t slab_size = hshm::Unit<size_t>::Kilobytes(64)) {
+    type_ = AllocatorType::kSlabAllocator;
+    id_ = id;
+    buffer_ = buffer;
+    buffer_size_ = buffer_size;
+    header_ = reinterpret_cast<_SlabAllocatorHeader *>(buffer_);
+    custom_header_ = reinterpret_cast<char *>(header_ + 1);
+    slab_size_ = min_slab_size_;
+    while (slab_size_ < slab_size) {
+      slab_size_ <<= 1;
+    }
+    // Objects are aligned in memory, not just relative to the buffer
+    size_t region_off =
+        AlignRegionOffset((custom_header_ - buffer_) + custom_header_size);
+    size_t misalign = reinterpret_cast<size_t>(buffer_ + region_off) % 64;
+    if (misalign) {
+      region_off += 64 - misalign;
+    }
+    region_off_ = region_off;
+    growable_ = GrowableShmMmap::Get(backend_);
+    if (growable_ && !growable_->Commit(buffer_ + region_off)) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, region_off, (size_t)0);
+    }
+    header_->Configure(id, custom_header_size, region_off,
+                       buffer_size_ - region_off, slab_size_);
+    HSHM_THREAD_MODEL->CreateTls<TLS>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
+  }
+
+  /**
+   * Attach an existing allocator from shared memory
+   * */
+  HSHM_CROSS_FUN
+  void shm_deserialize(char *buffer, size_t buffer_size) {
+    buffer_ = buffer;
+    buffer_size_ = buffer_size;
+    header_ = reinterpret_cast<_SlabAllocatorHeader *>(buffer_);
+    type_ = header_->allocator_type_;
+    id_ = header_->alloc_id_;
+    custom_header_ = reinterpret_cast<char *>(header_ + 1);
+    region_off_ = header_->heap_.region_off_;
+    slab_size_ = header_->slab_size_;
+    growable_ = GrowableShmMmap::Get(backend_);
+    HSHM_THREAD_MODEL->CreateTls<TLS>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
+  }
+
+  /**
+   * Allocate an object of \a size bytes
+   * */
+  HSHM_CROSS_FUN
+  OffsetPointer AllocateOffset(const hipc::MemContext &ctx, size_t size) {
+    size_t cls = GetClass(size);
+    TLS *tls = GetTls();
+    if (!tls) {
+      // Without thread-local storage, hold a slab only for this allocation
+      size_t slab_off = AcquireSlab(cls);
+      OffsetPointer p = TakeObject(slab_off);
+      ReleaseSlab(slab_off);
+      return p;
+    }
+    size_t slab_off = tls->active_[cls];
+    if (slab_off == 0 || !Reserve(GetSlab(slab_off))) {
+      if (slab_off) {
+        ReleaseSlab(slab_off);
+      }
+      slab_off = AcquireSlab(cls);
+      tls->active_[cls] = slab_off;
+      Reserve(GetSlab(slab_off));
+    }
+    return TakeReservedObject(slab_off);
+  }
+
+  /**
+   * Allocate an object of \a size bytes aligned to \a alignment
+   * */
+  HSHM_CROSS_FUN
+  OffsetPointer AlignedAllocateOffset(const hipc::MemContext &ctx, size_t size,
+                                      size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) ||
+        alignment > max_alignment_) {
+      HSHM_THROW_ERROR(INVALID_ALIGNMENT, alignment, max_alignment_);
+    }
+    // Objects are placed at multiples of their size from an aligned base
+    size = (size + alignment - 1) & ~(alignment - 1);
+    return AllocateOffset(ctx, size);
+  }
+
+  /**
+   * Reallocate \a p to \a new_size. Objects that already have room are
+   * left in place.
+   * */
+  HSHM_CROSS_FUN
+  OffsetPointer ReallocateOffsetNoNullCheck(const hipc::MemContext &ctx,
+                                            OffsetPointer p, size_t new_size) {
+    SlabHeader *slab = GetSlab(GetSlabOffset(p.load()));
+    size_t old_size = slab->obj_size_;
+    if (new_size <= old_size) {
+      return p;
+    }
+    OffsetPointer new_p = AllocateOffset(ctx, new_size);
+    memcpy(Convert<void>(new_p), Convert<void>(p), old_size);
+    FreeOffsetNoNullCheck(ctx, p);
+    return new_p;
+  }
+
+  /**
+   * Free \a p. Null check is performed elsewhere.
+   * */
+  HSHM_CROSS_FUN
+  void FreeOffsetNoNullCheck(const hipc::MemContext &ctx, OffsetPointer p) {
+    ReturnObjects(ReleaseObject(p), 1);
+  }
+
+  /**
+   * Allocate \a count objects of \a size bytes
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const hipc::MemContext &ctx,
+                                          size_t size, size_t count,
+                                          PointerT *out) {
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = PointerT(GetId(), AllocateOffset(ctx, size).load());
+    }
+  }
+
+  /**
+   * Free the \a count objects pointed to by \a ptrs. The objects are
+   * grouped by slab, so each slab's free count and the allocator's size
+   * are updated once per group.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const hipc::MemContext &ctx,
+                                      PointerT *ptrs, size_t count) {
+    constexpr size_t kChunk = 64;
+    size_t slabs[kChunk];
+    for (size_t i = 0; i < count;) {
+      size_t n = (count - i) < kChunk ? (count - i) : kChunk;
+      for (size_t j = 0; j < n; ++j) {
+        size_t slab_off = ReleaseObject(ptrs[i + j].ToOffsetPointer());
+        size_t k = j;
+        for (; k > 0 && slabs[k - 1] > slab_off; --k) {
+          slabs[k] = slabs[k - 1];
+        }
+        slabs[k] = slab_off;
+      }
+      for (size_t j = 0; j < n;) {
+        size_t k = j + 1;
+        while (k < n && slabs[k] == slabs[j]) {
+          ++k;
+        }
+        ReturnObjects(slabs[j], k - j);
+        j = k;
+      }
+      i += n;
+    }
+  }
+
+  /**
+   * Get the current amount of data allocated. Can be used for leak
+   * checking.
+   * */
+  HSHM_CROSS_FUN
+  size_t GetCurrentlyAllocatedSize() {
+    return (size_t)header_->GetCurrentlyAllocatedSize();
+  }
+
+  /**
+   * Get a snapshot of the allocation statistics of every thread and
+   * process using this allocator
+   * */
+  AllocatorStats GetStats() {
+    return header_->stats_.Snapshot(header_->heap_.heap_off_.load());
+  }
+
+  /**
+   * Create the thread-local slabs of this thread
+   * */
+  HSHM_CROSS_FUN
+  void CreateTls(MemContext &ctx) { GetTls(); }
+
+  /**
+   * Release the thread-local slabs of this thread
+   * */
+  HSHM_CROSS_FUN
+  void FreeTls(const hipc::MemContext &ctx) {
+#ifdef HSHM_IS_HOST
+    TLS *tls = HSHM_THREAD_MODEL->GetTls<TLS>(tls_key_);
+    if (tls) {
+      ReleaseSlabs(tls);
+      delete tls;
+      HSHM_THREAD_MODEL->SetTls<TLS>(tls_key_, nullptr);
+    }
+    StatsTls *stats = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (stats) {
+      header_->stats_.Unregister(stats->slot_);
+      delete stats;
+      HSHM_THREAD_MODEL->SetTls<StatsTls>(stats_key_, nullptr);
+    }
+#endif
+  }
+
+  /** Return the slabs owned by \a tls to their partial lists */
+  HSHM_CROSS_FUN
+  void ReleaseSlabs(TLS *tls) {
+    for (size_t i = 0; i < num_classes_; ++i) {
+      if (tls->active_[i]) {
+        ReleaseSlab(tls->active_[i]);
+        tls->active_[i] = 0;
+      }
+    }
+  }
+
+ private:
+  /**
+   * Mark the object \a p free in the bitmap of its slab
+   *
+   * @return the offset of the slab
+   * */
+  HSHM_INLINE_CROSS_FUN
+  size_t ReleaseObject(OffsetPointer p) {
+    size_t off = p.load();
+    // Only carved slabs have a valid header
+    size_t carved = header_->heap_.heap_off_.load();
+    if (off < region_off_ || off >= region_off_ + carved) {
+      HSHM_THROW_ERROR(INVALID_FREE);
+    }
+    size_t slab_off = GetSlabOffset(off);
+    SlabHeader *slab = GetSlab(slab_off);
+    size_t rel = off - slab_off - slab->obj_off_;
+    size_t idx = rel / slab->obj_size_;
+    if (off < slab_off + slab->obj_off_ || rel % slab->obj_size_ ||
+        idx >= slab->num_objs_) {
+      HSHM_THROW_ERROR(INVALID_FREE);
+    }
+    hshm::u64 bit = (hshm::u64)1 << (idx % 64);
+    if (slab->GetBitmap()[idx / 64].fetch_or(bit) & bit) {
+      HSHM_THROW_ERROR(DOUBLE_FREE, off);
+    }
+    return slab_off;
+  }
+
+  /** Count \a count objects released to the slab at \a slab_off as free */
+  HSHM_INLINE_CROSS_FUN
+  void ReturnObjects(size_t slab_off, size_t count) {
+    SlabHeader *slab = GetSlab(slab_off);
+    header_->SubSize(slab->obj_size_ * count);
+    header_->stats_.RecordFree(GetStatsSlot(), slab->obj_size_, count);
+    // The free that makes room in an unowned full slab lists it again
+    if (slab->state_.fetch_add(2 * count) == 0) {
+      PushPartial(slab->obj_size_ / obj_align_ - 1, slab_off);
+    }
+  }
+
+  /** Get the size class of an object of \a size bytes */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetClass(size_t size) {
+    if (size > max_obj_size_) {
+      HSHM_THROW_ERROR(SLAB_OBJECT_TOO_LARGE, max_obj_size_, size);
+    }
+    if (size == 0) {
+      return 0;
+    }
+    return (size - 1) / obj_align_;
+  }
+
+  /** Get the slabs of this thread */
+  HSHM_INLINE_CROSS_FUN
+  TLS *GetTls() {
+#ifdef HSHM_IS_HOST
+    TLS *tls = HSHM_THREAD_MODEL->GetTls<TLS>(tls_key_);
+    if (!tls) {
+      tls = new TLS(this);
+      HSHM_THREAD_MODEL->SetTls(tls_key_, tls);
+    }
+    return tls;
+#else
+    return nullptr;
+#endif
+  }
+
+  /**
+   * Get this thread's statistics slot, claiming one if needed. Threads
+   * without thread-local storage share a slot.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  AllocatorStatsSlot *GetStatsSlot() {
+#ifdef HSHM_IS_HOST
+    StatsTls *tls = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (!tls) {
+      tls = new StatsTls(this, &header_->stats_);
+      HSHM_THREAD_MODEL->SetTls(stats_key_, tls);
+    }
+    return tls->slot_;
+#else
+    return header_->stats_.GetSharedSlot();
+#endif
+  }
+
+  /** Get the offset of the slab containing offset \a off */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetSlabOffset(size_t off) {
+    return region_off_ + ((off - region_off_) & ~(slab_size_ - 1));
+  }
+
+  /** Get the slab at offset \a slab_off */
+  HSHM_INLINE_CROSS_FUN
+  SlabHeader *GetSlab(size_t slab_off) {
+    return reinterpret_cast<SlabHeader *>(buffer_ + slab_off);
+  }
+
+  /**
+   * Reserve a free object of a slab owned by this thread.
+   *
+   * @return false if the slab is full
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool Reserve(SlabHeader *slab) {
+    hshm::size_t state = slab->state_.load();
+    while (state >> 1) {
+      if (slab->state_.compare_exchange_weak(state, state - 2)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Take the object reserved by Reserve. Only the owner clears bits, so
+   * the reserved object stays free until it is found.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer TakeReservedObject(size_t slab_off) {
+    SlabHeader *slab = GetSlab(slab_off);
+    hipc::atomic<hshm::u64> *bitmap = slab->GetBitmap();
+    size_t num_words = SlabHeader::GetNumWords(slab->num_objs_);
+    size_t word = slab->hint_;
+    while (true) {
+      hshm::u64 bits = bitmap[word].load();
+      if (bits) {
+        size_t bit = CountTrailingZeros(bits);
+        bitmap[word].fetch_and(~((hshm::u64)1 << bit));
+        slab->hint_ = (hshm::u32)word;
+        header_->AddSize(slab->obj_size_);
+        header_->stats_.RecordAlloc(GetStatsSlot(), slab->obj_size_);
+        return OffsetPointer(slab_off + slab->obj_off_ +
+                             (word * 64 + bit) * slab->obj_size_);
+      }
+      word = (word + 1) % num_words;
+    }
+  }
+
+  /** Take an object from a slab owned by this thread that has room */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer TakeObject(size_t slab_off) {
+    Reserve(GetSlab(slab_off));
+    return TakeReservedObject(slab_off);
+  }
+
+  /**
+   * Get a slab with free objects of class \a cls for this thread. The
+   * partial list is used first; otherwise a new slab is carved.
+   * */
+  HSHM_CROSS_FUN
+  size_t AcquireSlab(size_t cls) {
+    SlabClass &slab_class = header_->classes_[cls];
+    {
+      hipc::ScopedMutex lock(slab_class.lock_, 0);
+      size_t slab_off = slab_class.partial_;
+      if (slab_off) {
+        SlabHeader *slab = GetSlab(slab_off);
+        slab_class.partial_ = slab->next_;
+        slab->state_.fetch_or(1);
+        return slab_off;
+      }
+    }
+    OffsetPointer p = header_->heap_.AllocateOffset(slab_size_);
+    if (!p.IsNull() && growable_ &&
+        !growable_->Commit(buffer_ + p.load() + slab_size_)) {
+      p.SetNull();
+    }
+    if (p.IsNull()) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, slab_size_, header_->heap_.heap_size_);
+    }
+    size_t slab_off = p.load();
+    SlabHeader *slab = GetSlab(slab_off);
+    size_t obj_size = (cls + 1) * obj_align_;
+    size_t num_objs = (slab_size_ - sizeof(SlabHeader)) / obj_size;
+    while (SlabHeader::GetObjOffset(num_objs) + num_objs * obj_size >
+           slab_size_) {
+      --num_objs;
+    }
+    slab->next_ = 0;
+    slab->obj_size_ = (hshm::u32)obj_size;
+    slab->num_objs_ = (hshm::u32)num_objs;
+    slab->obj_off_ = (hshm::u32)SlabHeader::GetObjOffset(num_objs);
+    slab->hint_ = 0;
+    hipc::atomic<hshm::u64> *bitmap = slab->GetBitmap();
+    for (size_t i = 0; i < SlabHeader::GetNumWords(num_objs); ++i) {
+      size_t left = num_objs - i * 64;
+      bitmap[i] = left >= 64 ? ~(hshm::u64)0 : ((hshm::u64)1 << left) - 1;
+    }
+    slab->state_ = (num_objs << 1) | 1;
+    return slab_off;
+  }
+
+  /**
+   * Give up ownership of a slab. A slab with free objects goes to the
+   * partial list; a full one is listed by the next free.
+   * */
+  HSHM_CROSS_FUN
+  void ReleaseSlab(size_t slab_off) {
+    SlabHeader *slab = GetSlab(slab_off);
+    hshm::size_t state = slab->state_.load();
+    while (!slab->state_.compare_exchange_weak(state, state & ~1)) {
+    }
+    if (state >> 1) {
+      PushPartial(slab->obj_size_ / obj_align_ - 1, slab_off);
+    }
+  }
+
+  /** Add a slab to the partial list of class \a cls */
+  HSHM_CROSS_FUN
+  void PushPartial(size_t cls, size_t slab_off) {
+    SlabClass &slab_class = header_->classes_[cls];
+    hipc::ScopedMutex lock(slab_class.lock_, 0);
+    GetSlab(slab_off)->next_ = slab_class.partial_;
+    slab_class.partial_ = slab_off;
+  }
+
+  /** The index of the lowest set bit of \a x, which must be nonzero */
+  HSHM_INLINE_CROSS_FUN
+  static size_t CountTrailingZeros(hshm::u64 x) {
+#if defined(HSHM_IS_GPU)
+    return __ffsll((long long)x) - 1;
+#elif defined(HSHM_COMPILER_MSVC)
+    unsigned long idx;
+    _BitScanForward64(&idx, x);
+    return idx;
+#else
+    return __builtin_ctzll(x);
+#endif
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_SLAB_ALLOCATOR_H_
@@ -16,6 +16,7 @@
 #include "allocator.h"
 #include "heap.h"
 #include "hermes_shm/memory/allocator/mp_page.h"
+#include "hermes_shm/memory/backend/growable_shm_mmap.h"
 #include "hermes_shm/thread/lock.h"
 
 namespace hshm::ipc {
@@ -23,6 +24,12 @@ namespace hshm::ipc {
 class _StackAllocator;
 typedef BaseAllocator<_StackAllocator> StackAllocator;
 
+/** A position in a StackAllocator that Rollback() returns to */
+struct StackMark {
+  hshm::size_t heap_off_;   /**< The top of the heap */
+  hshm::size_t alloc_size_; /**< The allocated size at the mark */
+};
+
 struct _StackAllocatorHeader : public AllocatorHeader {
   HeapAllocator<true> heap_;
   hipc::atomic<hshm::size_t> total_alloc_;
@@ -48,13 +55,14 @@ class _StackAllocator : public Allocator {
   typedef BaseAllocator<_StackAllocator> AllocT;
   _StackAllocatorHeader *header_;
   HeapAllocator<true> *heap_;
+  GrowableShmMmap *growable_; /**< The backend, if it grows on demand */
 
  public:
   /**
    * Allocator constructor
    * */
   HSHM_CROSS_FUN
-  _StackAllocator() : header_(nullptr) {}
+  _StackAllocator() : header_(nullptr), growable_(nullptr) {}
 
   /**
    * Initialize the allocator in shared memory
@@ -68,8 +76,13 @@ class _StackAllocator : public Allocator {
     buffer_size_ = buffer_size;
     header_ = reinterpret_cast<_StackAllocatorHeader *>(buffer_);
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
-    size_t region_off = (custom_header_ - buffer_) + custom_header_size;
+    size_t region_off =
+        AlignRegionOffset((custom_header_ - buffer_) + custom_header_size);
     size_t region_size = buffer_size_ - region_off;
+    growable_ = GrowableShmMmap::Get(backend_);
+    if (!Commit(buffer_ + region_off)) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, region_off, (size_t)0);
+    }
     header_->Configure(id, custom_header_size, region_off, region_size);
     heap_ = &header_->heap_;
     Align();
@@ -87,6 +100,16 @@ class _StackAllocator : public Allocator {
     id_ = header_->alloc_id_;
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
     heap_ = &header_->heap_;
+    growable_ = GrowableShmMmap::Get(backend_);
+  }
+
+  /**
+   * Make sure the buffer up to \a end is backed by memory. Only a
+   * growable backend can be short of it.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool Commit(const char *end) {
+    return growable_ == nullptr || growable_->Commit(end);
   }
 
   /**
@@ -95,7 +118,32 @@ class _StackAllocator : public Allocator {
    * */
   HSHM_INLINE_CROSS_FUN
   OffsetPointer SubAllocateOffset(size_t size) {
-    return heap_->AllocateOffset(size);
+    OffsetPointer p = heap_->AllocateOffset(size);
+    if (!p.IsNull() && !Commit(buffer_ + p.load() + size)) {
+      return OffsetPointer::GetNull();
+    }
+    return p;
+  }
+
+  /**
+   * Allocate a memory of \a size size at an offset from the start of the
+   * heap that is a multiple of \a alignment. The bytes skipped to align
+   * start with a padding MpPage, so a walk of the heap can step over them.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer SubAlignedAllocateOffset(size_t size, size_t alignment) {
+    hshm::size_t skipped;
+    OffsetPointer p = heap_->AlignedAllocateOffset(size, alignment, &skipped);
+    if (!p.IsNull() && !Commit(buffer_ + p.load() + size)) {
+      return OffsetPointer::GetNull();
+    }
+    if (!p.IsNull() && skipped >= sizeof(MpPage)) {
+      MpPage *pad = Convert<MpPage>(p - skipped);
+      pad->page_size_ = skipped;
+      pad->off_ = 0;
+      pad->SetPadding();
+    }
+    return p;
   }
 
   /** Align the memory to the next page boundary */
@@ -114,7 +162,10 @@ class _StackAllocator : public Allocator {
   HSHM_CROSS_FUN
   OffsetPointer AllocateOffset(const hipc::MemContext &ctx, size_t size) {
     size += sizeof(MpPage);
-    OffsetPointer p = heap_->AllocateOffset(size);
+    OffsetPointer p = SubAllocateOffset(size);
+    if (p.IsNull()) {
+      return p;
+    }
     auto hdr = Convert<MpPage>(p);
     hdr->SetAllocated();
     hdr->page_size_ = size;
@@ -125,13 +176,25 @@ class _StackAllocator : public Allocator {
 
   /**
    * Allocate a memory of \a size size, which is aligned to \a
-   * alignment.
+   * alignment. Returns null if the heap cannot fit it.
    * */
   HSHM_CROSS_FUN
   OffsetPointer AlignedAllocateOffset(const hipc::MemContext &ctx, size_t size,
                                       size_t alignment) {
-    HSHM_THROW_ERROR(NOT_IMPLEMENTED, "AlignedAllocateOffset");
-    return OffsetPointer::GetNull();
+    if (!MpPage::IsValidAlignment(alignment)) {
+      HSHM_THROW_ERROR(INVALID_ALIGNMENT, alignment, MpPage::max_alignment_);
+    }
+    size_t overhead = MpPage::GetAlignedOverhead(alignment);
+    if (size > (size_t)-1 - overhead - sizeof(MpPage)) {
+      return OffsetPointer::GetNull();
+    }
+    OffsetPointer p = AllocateOffset(ctx, size + overhead);
+    if (p.IsNull()) {
+      return p;
+    }
+    auto hdr = Convert<MpPage>(p - sizeof(MpPage));
+    char *aligned = hdr->AlignPayload(alignment);
+    return p + (size_t)(aligned - reinterpret_cast<char *>(hdr + 1));
   }
 
   /**
@@ -145,7 +208,10 @@ class _StackAllocator : public Allocator {
     OffsetPointer new_p;
     void *src = Convert<void>(p);
     auto hdr = Convert<MpPage>(p - sizeof(MpPage));
-    size_t old_size = hdr->page_size_ - sizeof(MpPage);
+    size_t old_size = hdr->GetDataSize();
+    if (new_size <= old_size) {
+      return p;
+    }
     void *dst = ((AllocT *)this)
                     ->AllocatePtr<void, OffsetPointer>(ctx, new_size, new_p);
     memcpy((void *)dst, (void *)src, old_size);
@@ -162,8 +228,75 @@ class _StackAllocator : public Allocator {
     if (!hdr->IsAllocated()) {
       HSHM_THROW_ERROR(DOUBLE_FREE);
     }
+    MpPage *page = hdr->GetPage();
     hdr->UnsetAllocated();
-    header_->SubSize(hdr->page_size_);
+    page->UnsetAllocated();
+    header_->SubSize(page->page_size_);
+  }
+
+  /**
+   * Allocate \a count regions of \a size size with a single update to
+   * the heap.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const hipc::MemContext &ctx,
+                                          size_t size, size_t count,
+                                          PointerT *out) {
+    size_t page_size = size + sizeof(MpPage);
+    OffsetPointer p = SubAllocateOffset(page_size * count);
+    if (p.IsNull()) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, page_size * count,
+                       GetCurrentlyAllocatedSize());
+    }
+    for (size_t i = 0; i < count; ++i) {
+      auto hdr = Convert<MpPage>(p);
+      hdr->SetAllocated();
+      hdr->page_size_ = page_size;
+      hdr->off_ = 0;
+      out[i] = PointerT(GetId(), (p + sizeof(MpPage)).load());
+      p += page_size;
+    }
+    header_->AddSize(page_size * count);
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const hipc::MemContext &ctx,
+                                      PointerT *ptrs, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      FreeOffsetNoNullCheck(ctx, ptrs[i].ToOffsetPointer());
+    }
+  }
+
+  /** Remember the top of the stack */
+  HSHM_INLINE_CROSS_FUN
+  StackMark Mark() {
+    return StackMark{heap_->heap_off_.load(),
+                     header_->GetCurrentlyAllocatedSize()};
+  }
+
+  /**
+   * Free everything allocated after \a mark in O(1). This frees the
+   * allocations of every thread, so marks must be rolled back in the
+   * reverse order they were taken, and only while no other thread
+   * allocates from the stack. Threads that need their own scratch space
+   * should use a StackArena instead. Rolling back to a mark above the
+   * top of the stack does nothing.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void Rollback(const StackMark &mark) {
+    hshm::size_t off = heap_->heap_off_.load();
+    do {
+      if (off < mark.heap_off_) {
+        return;
+      }
+    } while (!heap_->heap_off_.compare_exchange_weak(off, mark.heap_off_));
+    hshm::size_t alloc_size = header_->GetCurrentlyAllocatedSize();
+    if (alloc_size > mark.alloc_size_) {
+      header_->SubSize(alloc_size - mark.alloc_size_);
+    }
   }
 
   /**
@@ -0,0 +1,178 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_MEMORY_ALLOCATOR_STACK_ARENA_H_
+#define HSHM_MEMORY_ALLOCATOR_STACK_ARENA_H_
+
+#include "hermes_shm/util/errors.h"
+#include "stack_allocator.h"
+
+namespace hshm::ipc {
+
+/** The header at the start of each chunk of a StackArena */
+struct StackArenaChunk {
+  OffsetPointer next_; /**< The chunk to continue in once this one is full */
+  hshm::size_t size_;  /**< Usable bytes after the header */
+};
+
+/** A position in a StackArena that Rollback() returns to */
+struct StackArenaMark {
+  OffsetPointer chunk_; /**< The chunk being filled */
+  hshm::size_t off_;    /**< The bytes used in chunk_ */
+};
+
+/**
+ * A bump allocator owned by a single thread. It carves chunks from a
+ * shared StackAllocator, so allocating does no atomic operations unless a
+ * chunk fills up, and the memory is addressable by every process that
+ * attaches the allocator.
+ *
+ * Rollback() frees everything allocated after a mark in O(1). Chunks are
+ * never returned to the stack by the arena: the chunks filled after the
+ * mark are kept and reused as the arena grows again. To return them,
+ * roll the StackAllocator back to a mark taken before the arena was
+ * created.
+ * */
+class StackArena {
+ public:
+  StackAllocator *alloc_;
+  MemContext ctx_;
+  size_t chunk_size_;   /**< Usable bytes of a new chunk */
+  OffsetPointer head_;  /**< The first chunk */
+  OffsetPointer cur_;   /**< The chunk being filled */
+  StackArenaChunk *chunk_;
+  size_t off_;          /**< The bytes used in chunk_ */
+
+ public:
+  /** Constructor. No memory is carved until the first allocation. */
+  HSHM_CROSS_FUN
+  explicit StackArena(StackAllocator *alloc,
+                      size_t chunk_size = hshm::Unit<size_t>::Kilobytes(64),
+                      const MemContext &ctx = HSHM_DEFAULT_MEM_CTX)
+      : alloc_(alloc),
+        ctx_(ctx),
+        chunk_size_(chunk_size),
+        head_(OffsetPointer::GetNull()),
+        cur_(OffsetPointer::GetNull()),
+        chunk_(nullptr),
+        off_(0) {}
+
+  /** Allocate \a size bytes aligned to \a alignment */
+  template <typename T = char>
+  HSHM_INLINE_CROSS_FUN FullPtr<T> Allocate(size_t size,
+                                            size_t alignment = 8) {
+    size_t off = AlignOffset(alignment);
+    if (chunk_ == nullptr || off + size > chunk_->size_) {
+      NextChunk(size + alignment);
+      off = AlignOffset(alignment);
+    }
+    off_ = off + size;
+    size_t shm_off = cur_.load() + sizeof(StackArenaChunk) + off;
+    T *ptr = reinterpret_cast<T *>(reinterpret_cast<char *>(chunk_ + 1) + off);
+    return FullPtr<T>(ptr, Pointer(alloc_->GetId(), shm_off));
+  }
+
+  /** Remember the top of the arena */
+  HSHM_INLINE_CROSS_FUN
+  StackArenaMark Mark() const { return StackArenaMark{cur_, off_}; }
+
+  /** Free everything allocated after \a mark */
+  HSHM_INLINE_CROSS_FUN
+  void Rollback(const StackArenaMark &mark) {
+    cur_ = mark.chunk_;
+    off_ = mark.off_;
+    chunk_ = cur_.IsNull() ? nullptr : alloc_->Convert<StackArenaChunk>(cur_);
+  }
+
+  /** Free everything in the arena */
+  HSHM_INLINE_CROSS_FUN
+  void Reset() { Rollback(StackArenaMark{head_, 0}); }
+
+ private:
+  /** The first offset in the current chunk aligned to \a alignment */
+  HSHM_INLINE_CROSS_FUN
+  size_t AlignOffset(size_t alignment) {
+    if (chunk_ == nullptr) {
+      return 0;
+    }
+    size_t start = reinterpret_cast<size_t>(chunk_ + 1);
+    size_t addr = (start + off_ + alignment - 1) & ~(alignment - 1);
+    return addr - start;
+  }
+
+  /**
+   * Continue in a chunk with at least \a size usable bytes. The chunks
+   * that follow the current one are reused if the next one is big enough;
+   * otherwise a new chunk is carved and linked in front of them.
+   * */
+  HSHM_CROSS_FUN
+  void NextChunk(size_t size) {
+    OffsetPointer next = OffsetPointer::GetNull();
+    if (chunk_ == nullptr && !head_.IsNull()) {
+      next = head_;
+    } else if (chunk_ != nullptr) {
+      next = chunk_->next_;
+    }
+    if (!next.IsNull()) {
+      auto *chunk = alloc_->Convert<StackArenaChunk>(next);
+      if (chunk->size_ >= size) {
+        cur_ = next;
+        chunk_ = chunk;
+        off_ = 0;
+        return;
+      }
+    }
+    size_t chunk_size = size > chunk_size_ ? size : chunk_size_;
+    OffsetPointer p =
+        alloc_->AllocateOffset(ctx_, sizeof(StackArenaChunk) + chunk_size);
+    if (p.IsNull()) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, chunk_size,
+                       alloc_->GetCurrentlyAllocatedSize());
+    }
+    auto *chunk = alloc_->Convert<StackArenaChunk>(p);
+    chunk->next_ = next;
+    chunk->size_ = chunk_size;
+    if (chunk_ != nullptr) {
+      chunk_->next_ = p;
+    } else {
+      head_ = p;
+    }
+    cur_ = p;
+    chunk_ = chunk;
+    off_ = 0;
+  }
+};
+
+/**
+ * Takes a mark of a StackAllocator or StackArena on construction and rolls
+ * back to it on destruction. Frames nest like the scopes they live in.
+ * */
+template <typename StackT>
+class ScopedStackFrame {
+ public:
+  StackT &stack_;
+  decltype(stack_.Mark()) mark_;
+
+ public:
+  /** Mark the top of \a stack */
+  HSHM_INLINE_CROSS_FUN
+  explicit ScopedStackFrame(StackT &stack)
+      : stack_(stack), mark_(stack.Mark()) {}
+
+  /** Free everything allocated in the frame */
+  HSHM_INLINE_CROSS_FUN
+  ~ScopedStackFrame() { stack_.Rollback(mark_); }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_MEMORY_ALLOCATOR_STACK_ARENA_H_
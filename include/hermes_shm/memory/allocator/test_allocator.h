@@ -108,6 +108,7 @@ class _TestAllocator : public Allocator {
     size_t region_off = (custom_header_ - buffer_) + custom_header_size;
     size_t region_size = buffer_size_ - region_off;
     AllocatorId sub_id(id.bits_.major_, id.bits_.minor_ + 1);
+    alloc_.backend_ = backend_;
     alloc_.shm_init(sub_id, 0, buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
     header_->Configure(id, custom_header_size, &alloc_, buffer_size,
@@ -130,6 +131,7 @@ class _TestAllocator : public Allocator {
     size_t region_off =
         (custom_header_ - buffer_) + header_->custom_header_size_;
     size_t region_size = buffer_size_ - region_off;
+    alloc_.backend_ = backend_;
     alloc_.shm_deserialize(buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
     HSHM_THREAD_MODEL->CreateTls<TLS>(tls_key_, nullptr);
@@ -161,19 +163,22 @@ class _TestAllocator : public Allocator {
   HSHM_CROSS_FUN
   OffsetPointer AllocateOffset(const hipc::MemContext &ctx, size_t size) {
     MpPage *page = nullptr;
-    PageId page_id(size + sizeof(MpPage));
+    PageId page_id(size);
 
     // Case 1: Can we re-use an existing page?
     ThreadId tid = GetOrCreateTid(ctx);
     PageAllocator &page_alloc = (*header_->tls_)[(size_t)tid.tid_];
-    page = page_alloc.Allocate(page_id);
+    FreePage *cached = page_alloc.Allocate(page_id);
+    if (cached) {
+      page = reinterpret_cast<MpPage *>(cached) - 1;
+    }
 
     // Case 2: Can we allocate of thread's heap?
     if (page == nullptr) {
       page = page_alloc.AllocateHeap(page_id);
       if (page) {
-        page->tid_ = tid;
-        page->page_size_ = page_id.round_;
+        page->SetTid(tid);
+        page->page_size_ = page_id.GetPageSize();
       }
     }
 
@@ -241,8 +246,9 @@ class _TestAllocator : public Allocator {
     // }
     // hdr->UnsetAllocated();
     // header_->SubSize(hdr->page_size_);
-    PageAllocator &page_alloc = (*header_->tls_)[(size_t)hdr->tid_.tid_];
-    page_alloc.Free(hdr_offset, hdr);
+    PageAllocator &page_alloc = (*header_->tls_)[(size_t)hdr->tid_];
+    page_alloc.Free(PageId::FromPage(hdr).class_,
+                    reinterpret_cast<FreePage *>(hdr + 1));
   }
 
   /**
@@ -25,6 +25,9 @@
 #include "hermes_shm/thread/lock.h"
 #include "hermes_shm/util/logging.h"
 #include "hermes_shm/util/timer.h"
+#include "allocator_stats.h"
+#include "epoch_manager.h"
+#include "large_page_allocator.h"
 #include "mp_page.h"
 #include "page_allocator.h"
 
@@ -35,7 +38,8 @@ typedef BaseAllocator<_ThreadLocalAllocator> ThreadLocalAllocator;
 
 struct _ThreadLocalAllocatorHeader : public AllocatorHeader {
   typedef TlsAllocatorInfo<_ThreadLocalAllocator> TLS;
-  typedef hipc::PageAllocator<_ThreadLocalAllocator, false, true> PageAllocator;
+  typedef hipc::PageAllocator<_ThreadLocalAllocator, false, false>
+      PageAllocator;
   typedef hipc::vector<PageAllocator, StackAllocator> PageAllocVec;
   typedef hipc::vector<hshm::size_t, StackAllocator> PageAllocIdVec;
 
@@ -44,6 +48,10 @@ struct _ThreadLocalAllocatorHeader : public AllocatorHeader {
   hipc::atomic<hshm::size_t> tid_heap_;
   hipc::atomic<hshm::size_t> total_alloc_;
   hipc::SpinLock lock_;
+  PageChunkHeap chunks_;
+  LargePageAllocator large_;
+  EpochManager epoch_;
+  AllocatorStatsTable stats_;
 
   HSHM_CROSS_FUN
   _ThreadLocalAllocatorHeader() = default;
@@ -59,6 +67,10 @@ struct _ThreadLocalAllocatorHeader : public AllocatorHeader {
     free_tids_->resize(0);
     total_alloc_ = 0;
     tid_heap_ = 0;
+    chunks_.shm_init(*alloc);
+    large_.shm_init();
+    epoch_.shm_init();
+    stats_.shm_init();
   }
 
   HSHM_INLINE_CROSS_FUN
@@ -96,9 +108,13 @@ class _ThreadLocalAllocator : public Allocator {
  private:
   typedef TlsAllocatorInfo<_ThreadLocalAllocator> TLS;
   typedef _ThreadLocalAllocatorHeader::PageAllocator PageAllocator;
+  typedef hipc::EpochTls<_ThreadLocalAllocator> EpochTls;
+  typedef hipc::AllocatorStatsTls<_ThreadLocalAllocator> StatsTls;
   _ThreadLocalAllocatorHeader *header_;
   StackAllocator alloc_;
   thread::ThreadLocalKey tls_key_;
+  thread::ThreadLocalKey epoch_key_;
+  thread::ThreadLocalKey stats_key_;
 
  public:
   /**
@@ -119,15 +135,20 @@ class _ThreadLocalAllocator : public Allocator {
     buffer_size_ = buffer_size;
     header_ = reinterpret_cast<_ThreadLocalAllocatorHeader *>(buffer_);
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
-    size_t region_off = (custom_header_ - buffer_) + custom_header_size;
+    size_t region_off =
+        AlignRegionOffset((custom_header_ - buffer_) + custom_header_size);
     size_t region_size = buffer_size_ - region_off;
     AllocatorId sub_id(id.bits_.major_, id.bits_.minor_ + 1);
+    alloc_.backend_ = backend_;
     alloc_.shm_init(sub_id, 0, buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
     header_->Configure(id, custom_header_size, &alloc_, buffer_size,
                        max_threads);
     HSHM_THREAD_MODEL->CreateTls<TLS>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<EpochTls>(epoch_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
     alloc_.Align();
+    header_->stats_.base_ = alloc_.heap_->heap_off_.load();
   }
 
   /**
@@ -141,12 +162,15 @@ class _ThreadLocalAllocator : public Allocator {
     type_ = header_->allocator_type_;
     id_ = header_->alloc_id_;
     custom_header_ = reinterpret_cast<char *>(header_ + 1);
-    size_t region_off =
-        (custom_header_ - buffer_) + header_->custom_header_size_;
+    size_t region_off = AlignRegionOffset((custom_header_ - buffer_) +
+                                          header_->custom_header_size_);
     size_t region_size = buffer_size_ - region_off;
+    alloc_.backend_ = backend_;
     alloc_.shm_deserialize(buffer + region_off, region_size);
     HSHM_MEMORY_MANAGER->RegisterSubAllocator(&alloc_);
     HSHM_THREAD_MODEL->CreateTls<TLS>(tls_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<EpochTls>(epoch_key_, nullptr);
+    HSHM_THREAD_MODEL->CreateTls<StatsTls>(stats_key_, nullptr);
   }
 
   /** Get or create TID */
@@ -168,47 +192,97 @@ class _ThreadLocalAllocator : public Allocator {
     return tid;
   }
 
+  /** Get the TID of this thread without creating one */
+  HSHM_INLINE_CROSS_FUN
+  hshm::ThreadId GetTid(const hipc::MemContext &ctx) {
+    if (!ctx.tid_.IsNull()) {
+      return ctx.tid_;
+    }
+    TLS *tls = HSHM_THREAD_MODEL->GetTls<TLS>(tls_key_);
+    if (!tls) {
+      return hshm::ThreadId::GetNull();
+    }
+    return tls->tid_;
+  }
+
   /**
-   * Allocate a memory of \a size size. The page allocator cannot allocate
-   * memory larger than the page size.
+   * Allocate a memory of \a size size. Small objects are carved from
+   * chunks owned by this thread without a header. Larger pages have an
+   * MpPage header.
    * */
   HSHM_CROSS_FUN
   OffsetPointer AllocateOffset(const hipc::MemContext &ctx, size_t size) {
-    MpPage *page = nullptr;
-    PageId page_id(size + sizeof(MpPage));
-
-    // Case 1: Can we re-use an existing page?
+    PageId page_id(size);
     ThreadId tid = GetOrCreateTid(ctx);
+    if (page_id.IsSmall()) {
+      return AllocateSmall(tid, page_id);
+    }
+    return AllocatePage(tid, page_id);
+  }
+
+ private:
+  /** Allocate a small object from a chunk of its size class */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer AllocateSmall(ThreadId tid, const PageId &page_id) {
+    // Case 1: Can we re-use an existing object?
     PageAllocator &page_alloc = (*header_->tls_)[(size_t)tid.tid_];
-    page = page_alloc.Allocate(page_id);
+    page_alloc.DrainRemoteFrees();
+    char *obj = reinterpret_cast<char *>(page_alloc.Allocate(page_id));
+
+    // Case 2: Carve a new object from a chunk of this thread
+    if (obj == nullptr &&
+        !page_alloc.AllocateChunk(header_->chunks_, alloc_, page_id,
+                                  (hshm::u32)tid.tid_, &obj, 1)) {
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, page_id.orig_,
+                       GetCurrentlyAllocatedSize());
+    }
 
-    // Case 2: Can we allocate of thread's heap?
-    if (page == nullptr) {
-      page = page_alloc.AllocateHeap(page_id);
-      if (page) {
-        page->tid_ = tid;
-        page->page_size_ = page_id.round_;
+    // Mark as allocated
+    PageChunk *chunk = header_->chunks_.Get(alloc_, obj);
+    chunk->SetAllocated(chunk->GetIndex(obj));
+    header_->AddSize(page_id.round_);
+    header_->stats_.RecordAlloc(GetStatsSlot(), page_id.round_);
+    return Convert<char, OffsetPointer>(obj);
+  }
+
+  /** Allocate a page with an MpPage header */
+  HSHM_INLINE_CROSS_FUN
+  OffsetPointer AllocatePage(ThreadId tid, const PageId &page_id) {
+    MpPage *page = nullptr;
+    if (page_id.class_ < PageId::num_caches_) {
+      // Case 1: Can we re-use an existing page?
+      PageAllocator &page_alloc = (*header_->tls_)[(size_t)tid.tid_];
+      page_alloc.DrainRemoteFrees();
+      FreePage *cached = page_alloc.Allocate(page_id);
+      if (cached) {
+        page = reinterpret_cast<MpPage *>(cached) - 1;
       }
-    }
 
-    // Case 3: Allocate from heap if no page found
-    if (page == nullptr) {
-      OffsetPointer off = alloc_.SubAllocateOffset(page_id.round_);
-      if (!off.IsNull()) {
-        page = alloc_.Convert<MpPage>(off);
-        page->tid_ = tid;
-        page->page_size_ = page_id.round_;
+      // Case 2: Allocate from heap if no page found
+      if (page == nullptr) {
+        OffsetPointer off = alloc_.SubAllocateOffset(page_id.GetPageSize());
+        if (!off.IsNull()) {
+          page = alloc_.Convert<MpPage>(off);
+          page->page_size_ = page_id.GetPageSize();
+        }
       }
+    } else {
+      // Case 3: Large pages are shared by all threads and coalesced
+      page = header_->large_.Allocate(alloc_, page_id.GetPageSize());
     }
 
     // Case 4: Completely out of memory
     if (page == nullptr) {
-      HSHM_THROW_ERROR(OUT_OF_MEMORY, size, GetCurrentlyAllocatedSize());
+      HSHM_THROW_ERROR(OUT_OF_MEMORY, page_id.orig_,
+                       GetCurrentlyAllocatedSize());
     }
 
     // Mark as allocated
-    header_->AddSize(page_id.round_);
+    header_->AddSize(page->page_size_);
+    header_->stats_.RecordAlloc(GetStatsSlot(), page->page_size_);
     OffsetPointer p = Convert<MpPage, OffsetPointer>(page);
+    page->SetTid(tid);
+    page->off_ = 0;
     page->SetAllocated();
     return p + sizeof(MpPage);
   }
@@ -221,23 +295,64 @@ class _ThreadLocalAllocator : public Allocator {
   HSHM_CROSS_FUN
   OffsetPointer AlignedAllocateOffset(const hipc::MemContext &ctx, size_t size,
                                       size_t alignment) {
-    HSHM_THROW_ERROR(NOT_IMPLEMENTED, "AlignedAllocateOffset");
-    return OffsetPointer::GetNull();
+    if (!MpPage::IsValidAlignment(alignment)) {
+      HSHM_THROW_ERROR(INVALID_ALIGNMENT, alignment, MpPage::max_alignment_);
+    }
+    if (alignment <= PageId::min_alignment_) {
+      return AllocateOffset(ctx, size);
+    }
+    // Small objects are aligned within the object itself
+    ThreadId tid = GetOrCreateTid(ctx);
+    PageId small_id(size + alignment - PageId::min_alignment_);
+    if (small_id.IsSmall()) {
+      OffsetPointer p = AllocateSmall(tid, small_id);
+      size_t addr = (size_t)Convert<char>(p);
+      return p + (((addr + alignment - 1) & ~(alignment - 1)) - addr);
+    }
+    OffsetPointer p = AllocatePage(
+        tid, PageId(size + MpPage::GetAlignedOverhead(alignment)));
+    MpPage *page = Convert<MpPage>(p - sizeof(MpPage));
+    char *aligned = page->AlignPayload(alignment);
+    return p + (size_t)(aligned - reinterpret_cast<char *>(page + 1));
   }
 
   /**
-   * Reallocate \a p pointer to \a new_size new size.
+   * Reallocate \a p pointer to \a new_size new size. The page is reused
+   * if it already has room, and large pages are grown in place when the
+   * memory after them is free.
    *
    * @return whether or not the pointer p was changed
    * */
   HSHM_CROSS_FUN
   OffsetPointer ReallocateOffsetNoNullCheck(const hipc::MemContext &ctx,
                                             OffsetPointer p, size_t new_size) {
+    char *old = Convert<char, OffsetPointer>(p);
+    size_t old_size = GetUsableSize(p);
+
+    // Case 1: The page already has room
+    if (new_size <= old_size) {
+      return p;
+    }
+
+    // Case 2: Grow a large page into the free memory after it
+    if (!header_->chunks_.Find(alloc_, old)) {
+      MpPage *old_hdr = (MpPage *)(old - sizeof(MpPage));
+      size_t old_page_size = old_hdr->page_size_;
+      if (old_hdr->off_ == 0 &&
+          PageId::FromPage(old_hdr).class_ >= PageId::num_caches_ &&
+          header_->large_.Expand(alloc_, old_hdr, new_size + sizeof(MpPage))) {
+        header_->AddSize(old_hdr->page_size_ - old_page_size);
+        AllocatorStatsSlot *slot = GetStatsSlot();
+        header_->stats_.RecordFree(slot, old_page_size);
+        header_->stats_.RecordAlloc(slot, old_hdr->page_size_);
+        return p;
+      }
+    }
+
+    // Case 3: Move the data to a new page
     FullPtr<char, OffsetPointer> new_ptr =
         GetAllocator()->AllocateLocalPtr<char, OffsetPointer>(ctx, new_size);
-    char *old = Convert<char, OffsetPointer>(p);
-    MpPage *old_hdr = (MpPage *)(old - sizeof(MpPage));
-    memcpy(new_ptr.ptr_, old, old_hdr->page_size_ - sizeof(MpPage));
+    memcpy(new_ptr.ptr_, old, old_size);
     FreeOffsetNoNullCheck(ctx.tid_, p);
     return new_ptr.shm_;
   }
@@ -247,16 +362,232 @@ class _ThreadLocalAllocator : public Allocator {
    * */
   HSHM_CROSS_FUN
   void FreeOffsetNoNullCheck(const hipc::MemContext &ctx, OffsetPointer p) {
+    ThreadId owner;
+    size_t cls;
+    FreePage *page = ReleaseOffset(p, owner, cls);
+    if (page) {
+      FreeCached(ctx, owner, cls, page);
+    }
+  }
+
+  /**
+   * Get the number of bytes that can be used from \a p to the end of
+   * the object or page it points into.
+   * */
+  HSHM_CROSS_FUN
+  size_t GetUsableSize(OffsetPointer p) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      return chunk->GetUsableSize(ptr);
+    }
+    return ((MpPage *)(ptr - sizeof(MpPage)))->GetDataSize();
+  }
+
+  /** Whether \a p points to memory that is currently allocated */
+  HSHM_CROSS_FUN
+  bool IsAllocated(OffsetPointer p) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      size_t idx = chunk->GetIndex(ptr);
+      return idx < chunk->num_objs_ && chunk->IsAllocated(idx);
+    }
+    return ((MpPage *)(ptr - sizeof(MpPage)))->IsAllocated();
+  }
+
+ private:
+  /**
+   * Mark \a p free and account for it. Large pages are returned to the
+   * large page heap.
+   *
+   * @return the page to cache in the class \a cls free list of the
+   * thread \a owner, or null
+   * */
+  HSHM_INLINE_CROSS_FUN
+  FreePage *ReleaseOffset(OffsetPointer p, ThreadId &owner, size_t &cls) {
+    char *ptr = Convert<char, OffsetPointer>(p);
+    PageChunk *chunk = header_->chunks_.Find(alloc_, ptr);
+    if (chunk) {
+      // Small objects are tracked by the bitmap of their chunk
+      size_t idx = chunk->GetIndex(ptr);
+      if (idx == chunk->num_objs_) {
+        HSHM_THROW_ERROR(INVALID_FREE);
+      }
+      if (!chunk->UnsetAllocated(idx)) {
+        HSHM_THROW_ERROR(DOUBLE_FREE);
+      }
+      header_->SubSize(chunk->obj_size_);
+      header_->stats_.RecordFree(GetStatsSlot(), chunk->obj_size_);
+      owner = ThreadId(chunk->tid_);
+      cls = chunk->class_;
+      return reinterpret_cast<FreePage *>(chunk->GetObject(idx));
+    }
+
     // Mark as free
-    auto hdr_offset = p - sizeof(MpPage);
-    MpPage *hdr = Convert<MpPage>(hdr_offset);
+    MpPage *hdr = Convert<MpPage>(p - sizeof(MpPage));
+    if (hdr->off_) {
+      // This is the shadow header of an aligned allocation
+      hdr->UnsetAllocated();
+      hdr = hdr->GetPage();
+    }
     if (!hdr->IsAllocated()) {
       HSHM_THROW_ERROR(DOUBLE_FREE);
     }
     hdr->UnsetAllocated();
     header_->SubSize(hdr->page_size_);
-    PageAllocator &page_alloc = (*header_->tls_)[(size_t)hdr->tid_.tid_];
-    page_alloc.Free(hdr_offset, hdr);
+    header_->stats_.RecordFree(GetStatsSlot(), hdr->page_size_);
+    cls = PageId::FromPage(hdr).class_;
+    if (cls >= PageId::num_caches_) {
+      header_->large_.Free(alloc_, hdr);
+      return nullptr;
+    }
+    owner = hdr->GetTid();
+    return reinterpret_cast<FreePage *>(hdr + 1);
+  }
+
+  /**
+   * Return \a n cached objects or pages of class \a cls to the free
+   * lists of the thread \a owner at once
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void FreeCachedBatch(const hipc::MemContext &ctx, ThreadId owner,
+                       size_t cls, FreePage **pages, size_t n) {
+    PageAllocator &page_alloc = (*header_->tls_)[(size_t)owner.tid_];
+    if (GetTid(ctx) == owner) {
+      page_alloc.FreeBatch(cls, pages, n);
+    } else {
+      page_alloc.RemoteFreeBatch(cls, pages, n);
+    }
+  }
+
+  /**
+   * Return a cached object or page of class \a cls to the free lists of
+   * the thread \a owner.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void FreeCached(const hipc::MemContext &ctx, ThreadId owner, size_t cls,
+                  FreePage *page) {
+    PageAllocator &page_alloc = (*header_->tls_)[(size_t)owner.tid_];
+    if (GetTid(ctx) == owner) {
+      page_alloc.Free(cls, page);
+    } else {
+      // Pages owned by other threads are handed off to avoid races
+      page_alloc.RemoteFree(cls, page);
+    }
+  }
+
+ public:
+  /**
+   * Allocate \a count regions of \a size size. The thread's TID is
+   * resolved once for the entire batch.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void AllocateOffsetBatch(const hipc::MemContext &ctx,
+                                          size_t size, size_t count,
+                                          PointerT *out) {
+    hipc::MemContext tid_ctx(GetOrCreateTid(ctx));
+    for (size_t i = 0; i < count; ++i) {
+      out[i] = PointerT(GetId(), AllocateOffset(tid_ctx, size).load());
+    }
+  }
+
+  /**
+   * Free the \a count regions pointed to by \a ptrs. The freed pages are
+   * grouped by owning thread and size class, and each group is returned
+   * to its free list in one operation.
+   * */
+  template <typename PointerT>
+  HSHM_CROSS_FUN void FreeOffsetBatch(const hipc::MemContext &ctx,
+                                      PointerT *ptrs, size_t count) {
+    constexpr size_t kClasses = PageId::num_caches_;
+    FreePageBatch batch;
+    auto free_fn = [&](hshm::u32 key, FreePage **pages, size_t n) {
+      FreeCachedBatch(ctx, ThreadId(key / kClasses), key % kClasses, pages,
+                      n);
+    };
+    for (size_t i = 0; i < count; ++i) {
+      ThreadId owner;
+      size_t cls;
+      FreePage *page = ReleaseOffset(ptrs[i].ToOffsetPointer(), owner, cls);
+      if (page) {
+        batch.Add((hshm::u32)(owner.tid_ * kClasses + cls), page);
+      }
+      if (batch.IsFull()) {
+        batch.Flush(free_fn);
+      }
+    }
+    batch.Flush(free_fn);
+  }
+
+  /**
+   * Get this thread's epoch registration, creating it if needed.
+   * Returns null when thread-local storage is unavailable.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  EpochTls *GetEpochTls() {
+#ifdef HSHM_IS_HOST
+    EpochTls *tls = HSHM_THREAD_MODEL->GetTls<EpochTls>(epoch_key_);
+    if (!tls) {
+      tls = new EpochTls(this, &header_->epoch_);
+      HSHM_THREAD_MODEL->SetTls(epoch_key_, tls);
+    }
+    return tls;
+#else
+    return nullptr;
+#endif
+  }
+
+  /** Release this thread's epoch registration */
+  HSHM_CROSS_FUN
+  void FreeEpochTls() {
+#ifdef HSHM_IS_HOST
+    EpochTls *tls = HSHM_THREAD_MODEL->GetTls<EpochTls>(epoch_key_);
+    if (tls) {
+      header_->epoch_.Unregister(tls->slot_);
+      delete tls;
+      HSHM_THREAD_MODEL->SetTls<EpochTls>(epoch_key_, nullptr);
+    }
+#endif
+  }
+
+  /**
+   * Pin the current epoch. Memory retired while the epoch is pinned is
+   * not reused until this thread calls EpochExit.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  void EpochEnter(const hipc::MemContext &ctx) {
+    EpochTls *tls = GetEpochTls();
+    if (tls) {
+      tls->Enter();
+    }
+  }
+
+  /** Unpin the epoch pinned by EpochEnter */
+  HSHM_INLINE_CROSS_FUN
+  void EpochExit(const hipc::MemContext &ctx) {
+    EpochTls *tls = GetEpochTls();
+    if (tls) {
+      tls->Exit();
+    }
+  }
+
+  /**
+   * Free \a p once no thread that pinned the epoch can reach it.
+   * */
+  HSHM_CROSS_FUN
+  void RetireOffset(const hipc::MemContext &ctx, OffsetPointer p) {
+    header_->epoch_.Retire(this, p);
+  }
+
+  /**
+   * Try to advance the epoch and free memory that is no longer reachable.
+   *
+   * @return whether the epoch advanced
+   * */
+  HSHM_CROSS_FUN
+  bool EpochCollect(const hipc::MemContext &ctx) {
+    return header_->epoch_.Collect(this);
   }
 
   /**
@@ -268,11 +599,120 @@ class _ThreadLocalAllocator : public Allocator {
     return (size_t)header_->GetCurrentlyAllocatedSize();
   }
 
+  /**
+   * Get this thread's statistics slot, claiming one if needed. Threads
+   * without thread-local storage share a slot.
+   * */
+  HSHM_INLINE_CROSS_FUN
+  AllocatorStatsSlot *GetStatsSlot() {
+#ifdef HSHM_IS_HOST
+    StatsTls *tls = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (!tls) {
+      tls = new StatsTls(this, &header_->stats_);
+      HSHM_THREAD_MODEL->SetTls(stats_key_, tls);
+    }
+    return tls->slot_;
+#else
+    return header_->stats_.GetSharedSlot();
+#endif
+  }
+
+  /** Release this thread's statistics slot. Its counters are kept. */
+  HSHM_CROSS_FUN
+  void FreeStatsTls() {
+#ifdef HSHM_IS_HOST
+    StatsTls *tls = HSHM_THREAD_MODEL->GetTls<StatsTls>(stats_key_);
+    if (tls) {
+      header_->stats_.Unregister(tls->slot_);
+      delete tls;
+      HSHM_THREAD_MODEL->SetTls<StatsTls>(stats_key_, nullptr);
+    }
+#endif
+  }
+
+  /**
+   * Get a snapshot of the allocation statistics of every thread and
+   * process using this allocator
+   * */
+  AllocatorStats GetStats() {
+    return header_->stats_.Snapshot(alloc_.heap_->heap_off_.load());
+  }
+
+  /**
+   * Return the memory of the cached pages of this thread and of exited
+   * threads to the OS. The free lists of running threads are only
+   * touched by their owners, so they are not trimmed.
+   *
+   * @return the number of bytes discarded
+   * */
+  HSHM_HOST_FUN
+  size_t Trim(const hipc::MemContext &ctx) {
+    ThreadId tid = GetTid(ctx);
+    // The TIDs of exited threads are not reused while the lock is held
+    ScopedSpinLock lock(header_->lock_, 0);
+    _ThreadLocalAllocatorHeader::PageAllocIdVec &free_tids =
+        *header_->free_tids_;
+    std::vector<PageAllocator *> page_allocs;
+    if (!tid.IsNull()) {
+      page_allocs.emplace_back(&(*header_->tls_)[(size_t)tid.tid_]);
+    }
+    for (size_t i = 0; i < free_tids.size(); ++i) {
+      page_allocs.emplace_back(&(*header_->tls_)[(size_t)free_tids[i]]);
+    }
+    size_t discarded = header_->large_.Discard(alloc_);
+    for (PageAllocator *page_alloc : page_allocs) {
+      page_alloc->DrainRemoteFrees();
+      discarded += page_alloc->Discard(alloc_);
+    }
+    // Shrinking over one kind of page can expose the other at the top
+    bool shrunk = true;
+    while (shrunk) {
+      shrunk = header_->large_.ShrinkHeap(alloc_);
+      for (PageAllocator *page_alloc : page_allocs) {
+        shrunk = page_alloc->ShrinkHeap(alloc_) || shrunk;
+      }
+    }
+    return discarded;
+  }
+
+ public:
+  /**
+   * Acquire the locks of the allocator. Holding them across fork() gives
+   * the child a consistent heap while other threads are allocating.
+   * */
+  HSHM_CROSS_FUN
+  void LockAll() {
+    header_->lock_.Lock(0);
+    header_->chunks_.lock_.Lock(0);
+    header_->large_.lock_.Lock(0);
+  }
+
+  /** Release the locks acquired by LockAll */
+  HSHM_CROSS_FUN
+  void UnlockAll() {
+    header_->large_.lock_.Unlock();
+    header_->chunks_.lock_.Unlock();
+    header_->lock_.Unlock();
+  }
+
+  /**
+   * The end of the memory carved from the buffer so far. Nothing past it
+   * holds allocator state or user data.
+   * */
+  HSHM_CROSS_FUN
+  char *GetHeapEnd() {
+    HeapAllocator<true> &heap = *alloc_.heap_;
+    return alloc_.buffer_ + heap.region_off_ + heap.heap_off_.load();
+  }
+
   /**
    * Create a globally-unique thread ID
    * */
   HSHM_CROSS_FUN
-  void CreateTls(MemContext &ctx) { ctx.tid_ = GetOrCreateTid(ctx); }
+  void CreateTls(MemContext &ctx) {
+    ctx.tid_ = GetOrCreateTid(ctx);
+    GetEpochTls();
+  }
 
   /**
    * Free a thread-local memory storage
@@ -285,6 +725,8 @@ class _ThreadLocalAllocator : public Allocator {
     }
     header_->FreeTid(tid);
     HSHM_THREAD_MODEL->SetTls<TLS>(tls_key_, nullptr);
+    FreeEpochTls();
+    FreeStatsTls();
   }
 };
 
@@ -0,0 +1,273 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_INCLUDE_MEMORY_BACKEND_GROWABLE_SHM_MMAP_H
+#define HSHM_INCLUDE_MEMORY_BACKEND_GROWABLE_SHM_MMAP_H
+
+#include <string.h>
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/introspect/system_info.h"
+#include "hermes_shm/thread/lock/spin_lock.h"
+#include "hermes_shm/util/errors.h"
+#include "hermes_shm/util/logging.h"
+#include "memory_backend.h"
+
+namespace hshm::ipc {
+
+/** Sizing options for a GrowableShmMmap backend */
+struct GrowableShmMmapOptions {
+  /** Bytes of data backed by the shm file at creation */
+  size_t initial_size_ = hshm::Unit<size_t>::Megabytes(64);
+  /** The data grows to a multiple of this size */
+  size_t grow_size_ = hshm::Unit<size_t>::Megabytes(64);
+};
+
+/** Shared header of a GrowableShmMmap backend */
+struct GrowableShmMmapHeader : public MemoryBackendHeader {
+  hipc::atomic<hshm::size_t> committed_; /**< Bytes of data in the file */
+  size_t grow_size_;
+  hshm::SpinLock lock_;
+};
+
+/**
+ * A shared-memory backend whose data can grow after creation.
+ *
+ * The backend reserves a virtual range of data_size_ bytes, but the shm
+ * file only backs the first committed_ bytes of it. Commit() extends the
+ * file with ftruncate when an allocator carves past the committed size
+ * and bumps the generation counter of the header. Every process maps the
+ * whole range once, so pages become usable in all processes as soon as
+ * the file covers them; the generation only tells attached processes to
+ * reload the committed size they cache.
+ * */
+class GrowableShmMmap : public MemoryBackend, public UrlMemoryBackend {
+ protected:
+  File fd_;
+  hshm::chararr url_;
+  hipc::atomic<hshm::size_t> committed_; /**< Cached committed size */
+  hipc::atomic<hshm::u64> generation_;   /**< Generation of committed_ */
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  GrowableShmMmap() {}
+
+  /** Destructor */
+  HSHM_CROSS_FUN
+  ~GrowableShmMmap() {
+#ifdef HSHM_IS_HOST
+    if (IsOwned()) {
+      _Destroy();
+    } else {
+      _Detach();
+    }
+#endif
+  }
+
+  /** Initialize backend. \a size is the most the data can grow to. */
+  bool shm_init(const MemoryBackendId &backend_id, size_t size,
+                const hshm::chararr &url,
+                const GrowableShmMmapOptions &opts = GrowableShmMmapOptions()) {
+    SetInitialized();
+    Own();
+    SystemInfo::DestroySharedMemory(url.c_str());
+    url_ = url;
+    data_size_ = size;
+    size_t committed = RoundUp(opts.initial_size_);
+    if (committed > size) {
+      committed = size;
+    }
+    if (!SystemInfo::CreateNewSharedMemory(
+            fd_, url.c_str(), HSHM_SYSTEM_INFO->page_size_ + committed)) {
+      char *err_buf = strerror(errno);
+      HILOG(kError, "shm_open failed: {}", err_buf);
+      return false;
+    }
+    auto *header = (GrowableShmMmapHeader *)_ShmMap(
+        HSHM_SYSTEM_INFO->page_size_, 0);
+    header_ = header;
+    header->type_ = MemoryBackendType::kGrowableShmMmap;
+    header->id_ = backend_id;
+    header->data_size_ = size;
+    header->generation_ = 0;
+    header->committed_ = committed;
+    header->grow_size_ = opts.grow_size_;
+    header->lock_.Init();
+    committed_ = committed;
+    generation_ = 0;
+    data_ = _ShmMap(size, HSHM_SYSTEM_INFO->page_size_);
+    return true;
+  }
+
+  /** Deserialize the backend */
+  bool shm_deserialize(const hshm::chararr &url) {
+    SetInitialized();
+    Disown();
+    if (!SystemInfo::OpenSharedMemory(fd_, url.c_str())) {
+      const char *err_buf = strerror(errno);
+      HILOG(kError, "shm_open failed: {}", err_buf);
+      return false;
+    }
+    url_ = url;
+    auto *header = (GrowableShmMmapHeader *)_ShmMap(
+        HSHM_SYSTEM_INFO->page_size_, 0);
+    header_ = header;
+    data_size_ = header->data_size_;
+    generation_ = header->generation_.load();
+    committed_ = header->committed_.load();
+    data_ = _ShmMap(data_size_, HSHM_SYSTEM_INFO->page_size_);
+    return true;
+  }
+
+  /** Detach the mapped memory */
+  void shm_detach() { _Detach(); }
+
+  /** Destroy the mapped memory */
+  void shm_destroy() { _Destroy(); }
+
+  /** Get \a backend as a growable backend, or null if it is not one */
+  HSHM_INLINE_CROSS_FUN
+  static GrowableShmMmap *Get(MemoryBackend *backend) {
+    if (backend == nullptr ||
+        backend->header_->type_ != MemoryBackendType::kGrowableShmMmap) {
+      return nullptr;
+    }
+    return static_cast<GrowableShmMmap *>(backend);
+  }
+
+  /** The number of data bytes backed by the shm file */
+  HSHM_INLINE_CROSS_FUN
+  size_t GetCommittedSize() {
+    Refresh();
+    return committed_.load();
+  }
+
+  /**
+   * Make sure the data up to \a end is backed by the shm file
+   *
+   * @return false if \a end is outside the reserved range or the file
+   * could not be extended
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool Commit(const char *end) {
+    size_t size = (size_t)(end - data_);
+    if (size <= committed_.load()) {
+      return true;
+    }
+    return Grow(size);
+  }
+
+  /**
+   * Reload the committed size if another process grew the data
+   *
+   * @return true if the data grew since the last refresh
+   * */
+  HSHM_INLINE_CROSS_FUN
+  bool Refresh() {
+    hshm::u64 generation = header_->generation_.load();
+    if (generation == generation_.load()) {
+      return false;
+    }
+    generation_ = generation;
+    committed_ = GetHeader()->committed_.load();
+    return true;
+  }
+
+ protected:
+  /** The shared header */
+  HSHM_INLINE_CROSS_FUN
+  GrowableShmMmapHeader *GetHeader() {
+    return reinterpret_cast<GrowableShmMmapHeader *>(header_);
+  }
+
+  /** Round \a size up to a page */
+  static size_t RoundUp(size_t size) {
+    size_t page_size = HSHM_SYSTEM_INFO->page_size_;
+    return (size + page_size - 1) / page_size * page_size;
+  }
+
+  /** Extend the shm file so that it backs at least \a size data bytes */
+  HSHM_CROSS_FUN
+  bool Grow(size_t size) {
+    if (size > data_size_) {
+      return false;
+    }
+    if (Refresh() && size <= committed_.load()) {
+      return true;
+    }
+#ifdef HSHM_IS_HOST
+    GrowableShmMmapHeader *header = GetHeader();
+    hshm::ScopedSpinLock lock(header->lock_, 0);
+    size_t committed = header->committed_.load();
+    if (size <= committed) {
+      committed_ = committed;
+      return true;
+    }
+    size_t grow_size = RoundUp(header->grow_size_);
+    if (grow_size == 0) {
+      grow_size = HSHM_SYSTEM_INFO->page_size_;
+    }
+    size_t new_size = (size + grow_size - 1) / grow_size * grow_size;
+    if (new_size > data_size_) {
+      new_size = data_size_;
+    }
+    if (!SystemInfo::ResizeSharedMemory(
+            fd_, HSHM_SYSTEM_INFO->page_size_ + new_size)) {
+      HILOG(kError, "Could not grow {} to {} bytes", url_.str(), new_size);
+      return false;
+    }
+    header->committed_ = new_size;
+    header->generation_.fetch_add(1);
+    committed_ = new_size;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  /** Map shared memory */
+  char *_ShmMap(size_t size, i64 off) {
+    char *ptr =
+        reinterpret_cast<char *>(SystemInfo::MapSharedMemory(fd_, size, off));
+    if (!ptr) {
+      HSHM_THROW_ERROR(SHMEM_CREATE_FAILED);
+    }
+    return ptr;
+  }
+
+  /** Unmap shared memory */
+  void _Detach() {
+    if (!IsInitialized()) {
+      return;
+    }
+    SystemInfo::UnmapMemory(data_, data_size_);
+    SystemInfo::UnmapMemory(reinterpret_cast<void *>(header_),
+                            HSHM_SYSTEM_INFO->page_size_);
+    SystemInfo::CloseSharedMemory(fd_);
+    UnsetInitialized();
+  }
+
+  /** Destroy shared memory */
+  void _Destroy() {
+    if (!IsInitialized()) {
+      return;
+    }
+    _Detach();
+    SystemInfo::DestroySharedMemory(url_.c_str());
+    UnsetInitialized();
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_INCLUDE_MEMORY_BACKEND_GROWABLE_SHM_MMAP_H
@@ -26,6 +26,14 @@
 
 namespace hshm::ipc {
 
+/** Creation options for a MallocBackend */
+struct MallocBackendOptions {
+  bool populate_ = false; /**< Pre-fault the data pages during init */
+  bool zero_ = false;     /**< Zero the data during init; implies populate_ */
+  /** Threads that pre-fault the data. 0 uses one per CPU. */
+  int prefault_threads_ = 0;
+};
+
 class MallocBackend : public MemoryBackend {
  private:
   size_t total_size_;
@@ -37,7 +45,8 @@ class MallocBackend : public MemoryBackend {
   ~MallocBackend() {}
 
   HSHM_CROSS_FUN
-  bool shm_init(const MemoryBackendId &backend_id, size_t size) {
+  bool shm_init(const MemoryBackendId &backend_id, size_t size,
+                const MallocBackendOptions &opts = MallocBackendOptions()) {
     SetInitialized();
     Own();
     total_size_ = sizeof(MemoryBackendHeader) + size;
@@ -48,6 +57,14 @@ class MallocBackend : public MemoryBackend {
     header_->data_size_ = size;
     data_size_ = size;
     data_ = (char *)(header_ + 1);
+#ifdef HSHM_IS_HOST
+    if (opts.populate_ || opts.zero_) {
+      int nthreads = opts.prefault_threads_ > 0 ? opts.prefault_threads_
+                                                : HSHM_SYSTEM_INFO->ncpu_;
+      prefault_msec_ = SystemInfo::ParallelPrefaultMemory(data_, size,
+                                                          opts.zero_, nthreads);
+    }
+#endif
     return true;
   }
 
@@ -0,0 +1,187 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_INCLUDE_MEMORY_BACKEND_MEMFD_BACKEND_H
+#define HSHM_INCLUDE_MEMORY_BACKEND_MEMFD_BACKEND_H
+
+#include <string.h>
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/introspect/system_info.h"
+#include "hermes_shm/util/errors.h"
+#include "hermes_shm/util/logging.h"
+#include "memory_backend.h"
+
+namespace hshm::ipc {
+
+/**
+ * Anonymous shared memory that other processes attach to by receiving its
+ * file descriptor.
+ *
+ * The memory is a memfd with its size sealed, so it has no name in
+ * /dev/shm and is freed by the kernel once the last process unmaps it,
+ * even if every process crashed. The url is the path of a Unix socket the
+ * creator listens on; a url starting with '@' is in the abstract socket
+ * namespace and leaves no file behind either. shm_deserialize connects to
+ * the socket and receives the descriptor over SCM_RIGHTS, so attaching
+ * never resolves a name through the filesystem.
+ *
+ * The creator answers one attach per call to ServeAttach(), so it should
+ * call it once per process it expects, e.g., from the loop that forks its
+ * workers or from a dedicated thread. Processes forked after shm_init
+ * already share the mapping and do not need to attach.
+ * */
+class MemfdBackend : public MemoryBackend, public UrlMemoryBackend {
+ protected:
+  File fd_;
+  File sock_;
+  hshm::chararr url_;
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  MemfdBackend() {}
+
+  /** Destructor */
+  HSHM_CROSS_FUN
+  ~MemfdBackend() {
+#ifdef HSHM_IS_HOST
+    if (IsOwned()) {
+      _Destroy();
+    } else {
+      _Detach();
+    }
+#endif
+  }
+
+  /** Create the memory and listen for attaches on the socket \a url */
+  bool shm_init(const MemoryBackendId &backend_id, size_t size,
+                const hshm::chararr &url) {
+    SetInitialized();
+    Own();
+    url_ = url;
+    data_size_ = size;
+    if (!SystemInfo::CreateSealedMemory(
+            fd_, url.str(), HSHM_SYSTEM_INFO->page_size_ + size)) {
+      char *err_buf = strerror(errno);
+      HILOG(kError, "memfd_create failed: {}", err_buf);
+      UnsetInitialized();
+      return false;
+    }
+    if (!SystemInfo::ListenSocket(sock_, url.str())) {
+      char *err_buf = strerror(errno);
+      HILOG(kError, "Could not listen on {}: {}", url.str(), err_buf);
+      SystemInfo::CloseSharedMemory(fd_);
+      UnsetInitialized();
+      return false;
+    }
+    header_ = (MemoryBackendHeader *)_ShmMap(HSHM_SYSTEM_INFO->page_size_, 0);
+    header_->type_ = MemoryBackendType::kMemfdBackend;
+    header_->id_ = backend_id;
+    header_->data_size_ = size;
+    header_->generation_ = 0;
+    data_ = _ShmMap(size, HSHM_SYSTEM_INFO->page_size_);
+    return true;
+  }
+
+  /** Receive the memory from the process listening on \a url */
+  bool shm_deserialize(const hshm::chararr &url) {
+    SetInitialized();
+    Disown();
+    File sock;
+    if (!SystemInfo::ConnectSocket(sock, url.str())) {
+      const char *err_buf = strerror(errno);
+      HILOG(kError, "Could not connect to {}: {}", url.str(), err_buf);
+      UnsetInitialized();
+      return false;
+    }
+    bool received = SystemInfo::RecvFile(sock, fd_);
+    SystemInfo::CloseSocket(sock);
+    if (!received) {
+      HILOG(kError, "{} did not send a memory descriptor", url.str());
+      UnsetInitialized();
+      return false;
+    }
+    // The size must not change under the mapping
+    if (!SystemInfo::IsSealedMemory(fd_)) {
+      HILOG(kError, "The memory received from {} is not sealed", url.str());
+      SystemInfo::CloseSharedMemory(fd_);
+      UnsetInitialized();
+      return false;
+    }
+    url_ = url;
+    header_ = (MemoryBackendHeader *)_ShmMap(HSHM_SYSTEM_INFO->page_size_, 0);
+    data_size_ = header_->data_size_;
+    data_ = _ShmMap(data_size_, HSHM_SYSTEM_INFO->page_size_);
+    return true;
+  }
+
+  /**
+   * Wait for one process to connect and send it the memory descriptor
+   *
+   * @return false if the backend is not listening or the send failed
+   * */
+  bool ServeAttach() {
+    if (!IsOwned() || !IsInitialized()) {
+      return false;
+    }
+    File conn;
+    if (!SystemInfo::AcceptSocket(sock_, conn)) {
+      return false;
+    }
+    bool sent = SystemInfo::SendFile(conn, fd_);
+    SystemInfo::CloseSocket(conn);
+    return sent;
+  }
+
+  /** Detach the mapped memory */
+  void shm_detach() { _Detach(); }
+
+  /** Stop serving attaches and detach the mapped memory */
+  void shm_destroy() { _Destroy(); }
+
+ protected:
+  /** Map shared memory */
+  char *_ShmMap(size_t size, i64 off) {
+    char *ptr =
+        reinterpret_cast<char *>(SystemInfo::MapSharedMemory(fd_, size, off));
+    if (!ptr) {
+      HSHM_THROW_ERROR(SHMEM_CREATE_FAILED);
+    }
+    return ptr;
+  }
+
+  /** Unmap shared memory */
+  void _Detach() {
+    if (!IsInitialized()) {
+      return;
+    }
+    SystemInfo::UnmapMemory(data_, data_size_);
+    SystemInfo::UnmapMemory(reinterpret_cast<void *>(header_),
+                            HSHM_SYSTEM_INFO->page_size_);
+    SystemInfo::CloseSharedMemory(fd_);
+    UnsetInitialized();
+  }
+
+  /** Close the socket. The memory is freed after the last process unmaps. */
+  void _Destroy() {
+    if (!IsInitialized()) {
+      return;
+    }
+    SystemInfo::CloseSocket(sock_, url_.str());
+    _Detach();
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_INCLUDE_MEMORY_BACKEND_MEMFD_BACKEND_H
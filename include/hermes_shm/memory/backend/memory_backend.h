@@ -33,6 +33,9 @@ enum class MemoryBackendType {
   kPosixMmap,
   kRocmMalloc,
   kRocmShmMmap,
+  kGrowableShmMmap,
+  kPosixFileMmap,
+  kMemfdBackend,
 };
 
 /** ID for memory backend */
@@ -82,10 +85,15 @@ class MemoryBackendId {
 };
 typedef MemoryBackendId memory_backend_id_t;
 
-struct MemoryBackendHeader {
+/**
+ * The header of a backend. Some backends place the data directly after
+ * it, so it is aligned like the allocations made from the data.
+ * */
+struct alignas(16) MemoryBackendHeader {
   MemoryBackendType type_;
   MemoryBackendId id_;
   size_t data_size_;
+  hipc::atomic<hshm::u64> generation_; /**< Bumped when the data grows */
 
   HSHM_CROSS_FUN
   void Print() const {
@@ -98,6 +106,7 @@ struct MemoryBackendHeader {
 #define MEMORY_BACKEND_INITIALIZED BIT_OPT(u32, 0)
 #define MEMORY_BACKEND_OWNED BIT_OPT(u32, 1)
 #define MEMORY_BACKEND_SCANNED BIT_OPT(u32, 2)
+#define MEMORY_BACKEND_RECOVER BIT_OPT(u32, 3)
 
 class UrlMemoryBackend {};
 
@@ -107,10 +116,17 @@ class MemoryBackend {
   char *data_;
   size_t data_size_;
   ibitfield flags_;
+  double prefault_msec_; /**< Time spent pre-faulting the data at init */
+  /** Called once the allocator of the data has recovered */
+  void (*on_recovered_)(MemoryBackend *backend);
 
  public:
   HSHM_CROSS_FUN
-  MemoryBackend() : header_(nullptr), data_(nullptr) {}
+  MemoryBackend()
+      : header_(nullptr),
+        data_(nullptr),
+        prefault_msec_(0),
+        on_recovered_(nullptr) {}
 
   ~MemoryBackend() = default;
 
@@ -142,6 +158,33 @@ class MemoryBackend {
   HSHM_CROSS_FUN
   void Own() { flags_.SetBits(MEMORY_BACKEND_OWNED); }
 
+  /** The data was not closed cleanly and its allocator must recover */
+  HSHM_CROSS_FUN
+  void SetNeedsRecovery() { flags_.SetBits(MEMORY_BACKEND_RECOVER); }
+
+  /** Check if the allocator of the data must recover */
+  HSHM_CROSS_FUN
+  bool NeedsRecovery() { return flags_.Any(MEMORY_BACKEND_RECOVER); }
+
+  /** Mark the allocator of the data as recovered */
+  HSHM_CROSS_FUN
+  void UnsetNeedsRecovery() { flags_.UnsetBits(MEMORY_BACKEND_RECOVER); }
+
+  /**
+   * Mark the allocator of the data as recovered and let the backend admit
+   * the processes waiting to attach
+   * */
+  HSHM_CROSS_FUN
+  void FinishRecovery() {
+    UnsetNeedsRecovery();
+#ifdef HSHM_IS_HOST
+    if (on_recovered_) {
+      on_recovered_(this);
+      on_recovered_ = nullptr;
+    }
+#endif
+  }
+
   /** This is owned */
   HSHM_CROSS_FUN
   bool IsOwned() { return flags_.Any(MEMORY_BACKEND_OWNED); }
@@ -14,10 +14,13 @@
 #define HSHM_MEMORY_BACKEND_MEMORY_BACKEND_FACTORY_H_
 
 #include "array_backend.h"
+#include "growable_shm_mmap.h"
 #include "hermes_shm/memory/allocator/allocator_factory.h"
 #include "hermes_shm/memory/memory_manager_.h"
 #include "malloc_backend.h"
+#include "memfd_backend.h"
 #include "memory_backend.h"
+#include "posix_file_mmap.h"
 #include "posix_mmap.h"
 #include "posix_shm_mmap.h"
 #ifdef HSHM_ENABLE_CUDA
@@ -76,6 +79,9 @@ class MemoryBackendFactory {
     HSHM_CREATE_BACKEND(RocmShmMmap)
 #endif
 
+    HSHM_CREATE_BACKEND(GrowableShmMmap)
+    HSHM_CREATE_BACKEND(PosixFileMmap)
+    HSHM_CREATE_BACKEND(MemfdBackend)
     HSHM_CREATE_BACKEND(PosixMmap)
     HSHM_CREATE_BACKEND(MallocBackend)
     HSHM_CREATE_BACKEND(ArrayBackend)
@@ -99,6 +105,9 @@ class MemoryBackendFactory {
       HSHM_DESERIALIZE_BACKEND(RocmShmMmap)
 #endif
 
+      HSHM_DESERIALIZE_BACKEND(GrowableShmMmap)
+      HSHM_DESERIALIZE_BACKEND(PosixFileMmap)
+      HSHM_DESERIALIZE_BACKEND(MemfdBackend)
       HSHM_DESERIALIZE_BACKEND(PosixMmap)
       HSHM_DESERIALIZE_BACKEND(MallocBackend)
       HSHM_DESERIALIZE_BACKEND(ArrayBackend)
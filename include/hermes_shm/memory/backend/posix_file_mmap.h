@@ -0,0 +1,242 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_INCLUDE_MEMORY_BACKEND_POSIX_FILE_MMAP_H
+#define HSHM_INCLUDE_MEMORY_BACKEND_POSIX_FILE_MMAP_H
+
+#include <string.h>
+
+#include "hermes_shm/constants/macros.h"
+#include "hermes_shm/introspect/system_info.h"
+#include "hermes_shm/types/atomic.h"
+#include "hermes_shm/util/errors.h"
+#include "hermes_shm/util/logging.h"
+#include "memory_backend.h"
+
+namespace hshm::ipc {
+
+/** Mapping options for a PosixFileMmap backend */
+struct PosixFileMmapOptions {
+  /**
+   * Map the file with MAP_SYNC, so stores to a file on a DAX filesystem
+   * are durable without Sync(). Other files fall back to a regular
+   * mapping.
+   * */
+  bool dax_ = false;
+};
+
+/** Persistent header of a PosixFileMmap backend */
+struct PosixFileMmapHeader : public MemoryBackendHeader {
+  /**
+   * The number of processes attached to the file. It stays nonzero if
+   * one of them exited without detaching.
+   * */
+  hipc::atomic<hshm::u32> attached_;
+  hshm::u32 dax_; /**< Whether the data is mapped with MAP_SYNC */
+};
+
+/**
+ * A backend whose data lives in a regular file, so it survives process
+ * restarts and reboots.
+ *
+ * The file holds a header page followed by the data. Every process holds
+ * a shared lock on the file while it is attached, and counts itself in
+ * the header. The first process to attach takes the lock exclusively; if
+ * the count is not zero, a process that had the file open exited without
+ * detaching, and the backend is marked as needing recovery. The allocator
+ * of the data then rebuilds its free lists during shm_deserialize and
+ * calls FinishRecovery. Only then is the lock downgraded, so no other
+ * process attaches to a half-recovered allocator. The last process to
+ * detach flushes the data, which leaves the count at zero. A backend
+ * that was never recovered does not count itself out, so the next
+ * process to attach recovers again.
+ *
+ * The file is only removed by shm_destroy. Destroying the backend object
+ * detaches, even in the process that created the file.
+ * */
+class PosixFileMmap : public MemoryBackend, public UrlMemoryBackend {
+ protected:
+  File fd_;
+  hshm::chararr url_;
+  bool dax_ = false;
+
+ public:
+  /** Constructor */
+  HSHM_CROSS_FUN
+  PosixFileMmap() {}
+
+  /** Destructor */
+  HSHM_CROSS_FUN
+  ~PosixFileMmap() {
+#ifdef HSHM_IS_HOST
+    _Detach();
+#endif
+  }
+
+  /** Create a new file at \a url, replacing any existing one */
+  bool shm_init(const MemoryBackendId &backend_id, size_t size,
+                const hshm::chararr &url,
+                const PosixFileMmapOptions &opts = PosixFileMmapOptions()) {
+    SetInitialized();
+    Own();
+    SystemInfo::DestroyFileMemory(url.str());
+    url_ = url;
+    data_size_ = size;
+    if (!SystemInfo::CreateNewFileMemory(
+            fd_, url.str(), HSHM_SYSTEM_INFO->page_size_ + size)) {
+      char *err_buf = strerror(errno);
+      HILOG(kError, "open {} failed: {}", url.str(), err_buf);
+      return false;
+    }
+    SystemInfo::LockFile(fd_, false, true);
+    _Map(opts.dax_);
+    auto *header = GetHeader();
+    header->type_ = MemoryBackendType::kPosixFileMmap;
+    header->id_ = backend_id;
+    header->data_size_ = size;
+    header->generation_ = 0;
+    header->attached_ = 1;
+    header->dax_ = dax_;
+    return true;
+  }
+
+  /** Open the file at \a url, which was created by shm_init */
+  bool shm_deserialize(const hshm::chararr &url) {
+    SetInitialized();
+    Disown();
+    if (!SystemInfo::OpenFileMemory(fd_, url.str())) {
+      const char *err_buf = strerror(errno);
+      HILOG(kError, "open {} failed: {}", url.str(), err_buf);
+      return false;
+    }
+    url_ = url;
+    // Only the first process to attach gets the lock exclusively
+    bool first = SystemInfo::LockFile(fd_, true, false);
+    if (!first) {
+      SystemInfo::LockFile(fd_, false, true);
+    }
+    auto *header = (PosixFileMmapHeader *)SystemInfo::MapSharedMemory(
+        fd_, HSHM_SYSTEM_INFO->page_size_, 0);
+    if (!header) {
+      HSHM_THROW_ERROR(SHMEM_CREATE_FAILED);
+    }
+    data_size_ = header->data_size_;
+    bool dax = header->dax_;
+    SystemInfo::UnmapMemory(header, HSHM_SYSTEM_INFO->page_size_);
+    _Map(dax);
+    if (!first) {
+      GetHeader()->attached_.fetch_add(1);
+    } else {
+      bool dirty = GetHeader()->attached_.load() != 0;
+      GetHeader()->attached_ = 1;
+      if (dirty) {
+        // Other processes wait for the lock until recovery is done
+        HILOG(kWarning, "{} was not detached cleanly, recovering",
+              url.str());
+        SetNeedsRecovery();
+        on_recovered_ = &PosixFileMmap::ShareLock;
+      } else {
+        SystemInfo::LockFile(fd_, false, true);
+      }
+    }
+    return true;
+  }
+
+  /** Detach the mapped memory */
+  void shm_detach() { _Detach(); }
+
+  /** Detach the mapped memory and remove the file */
+  void shm_destroy() { _Destroy(); }
+
+  /**
+   * Write the modified data back to the file
+   *
+   * @return false if the data could not be written
+   * */
+  bool Sync() {
+    if (dax_) {
+      return true;
+    }
+    return SystemInfo::SyncMemory(data_, data_size_) &&
+           SystemInfo::SyncMemory(header_, HSHM_SYSTEM_INFO->page_size_);
+  }
+
+ protected:
+  /** The persistent header */
+  PosixFileMmapHeader *GetHeader() {
+    return reinterpret_cast<PosixFileMmapHeader *>(header_);
+  }
+
+  /** Downgrade the exclusive lock held during recovery */
+  static void ShareLock(MemoryBackend *backend) {
+    auto *self = static_cast<PosixFileMmap *>(backend);
+    SystemInfo::LockFile(self->fd_, false, true);
+  }
+
+  /** Map the file. The whole file is mapped at once for MAP_SYNC. */
+  void _Map(bool dax) {
+    size_t size = HSHM_SYSTEM_INFO->page_size_ + data_size_;
+    char *ptr = nullptr;
+    dax_ = false;
+    if (dax) {
+      ptr =
+          reinterpret_cast<char *>(SystemInfo::MapSyncMemory(fd_, size, 0));
+      dax_ = ptr != nullptr;
+      if (!dax_) {
+        HILOG(kWarning, "{} does not support MAP_SYNC, use Sync() to flush",
+              url_.str());
+      }
+    }
+    if (!ptr) {
+      ptr =
+          reinterpret_cast<char *>(SystemInfo::MapSharedMemory(fd_, size, 0));
+    }
+    if (!ptr) {
+      HSHM_THROW_ERROR(SHMEM_CREATE_FAILED);
+    }
+    header_ = reinterpret_cast<MemoryBackendHeader *>(ptr);
+    data_ = ptr + HSHM_SYSTEM_INFO->page_size_;
+  }
+
+  /**
+   * Unmap the file. The last process to detach leaves it clean, unless
+   * its data still needs recovery.
+   * */
+  void _Detach() {
+    if (!IsInitialized()) {
+      return;
+    }
+    Sync();
+    if (!NeedsRecovery() && GetHeader()->attached_.fetch_sub(1) == 1 &&
+        !dax_) {
+      SystemInfo::SyncMemory(header_, HSHM_SYSTEM_INFO->page_size_);
+    }
+    SystemInfo::UnmapMemory(reinterpret_cast<void *>(header_),
+                            HSHM_SYSTEM_INFO->page_size_ + data_size_);
+    SystemInfo::CloseSharedMemory(fd_);
+    UnsetInitialized();
+  }
+
+  /** Unmap and remove the file */
+  void _Destroy() {
+    if (!IsInitialized()) {
+      return;
+    }
+    _Detach();
+    SystemInfo::DestroyFileMemory(url_.str());
+    UnsetInitialized();
+  }
+};
+
+}  // namespace hshm::ipc
+
+#endif  // HSHM_INCLUDE_MEMORY_BACKEND_POSIX_FILE_MMAP_H
@@ -28,10 +28,40 @@
 
 namespace hshm::ipc {
 
+/** Page sizes the backend may be asked to map data with */
+enum class HugePageMode {
+  kNone,         /**< Regular pages */
+  kTransparent,  /**< Regular mapping + madvise(MADV_HUGEPAGE) */
+  kHugeTlb       /**< Explicit huge pages from a hugetlbfs mount */
+};
+
+/** Placement options for a PosixShmMmap backend */
+struct PosixShmMmapOptions {
+  HugePageMode huge_pages_ = HugePageMode::kNone;
+  size_t huge_page_size_ = hshm::Unit<size_t>::Megabytes(2);
+  std::string hugetlbfs_dir_ = "/dev/hugepages";
+  NumaPolicy numa_policy_ = NumaPolicy::kDefault;
+  u64 numa_nodes_ = 0; /**< Bitmask of NUMA nodes for numa_policy_ */
+  bool populate_ = false; /**< Pre-fault the data pages during init */
+  bool zero_ = false;     /**< Zero the data during init; implies populate_ */
+  /** Threads that pre-fault the data. 0 uses one per CPU. */
+  int prefault_threads_ = 0;
+};
+
+/** Shared header of a PosixShmMmap backend */
+struct PosixShmMmapHeader : public MemoryBackendHeader {
+  size_t map_size_;  /**< Size of the data mapping */
+  bool hugetlb_;     /**< Whether data lives in data_path_ */
+  hshm::chararr_templ<255, true> data_path_;
+};
+
 class PosixShmMmap : public MemoryBackend, public UrlMemoryBackend {
  protected:
   File fd_;
+  File data_fd_;
   hshm::chararr url_;
+  size_t map_size_ = 0;
+  bool hugetlb_ = false;
 
  public:
   /** Constructor */
@@ -52,23 +82,60 @@ class PosixShmMmap : public MemoryBackend, public UrlMemoryBackend {
 
   /** Initialize backend */
   bool shm_init(const MemoryBackendId &backend_id, size_t size,
-                const hshm::chararr &url) {
+                const hshm::chararr &url,
+                const PosixShmMmapOptions &opts = PosixShmMmapOptions()) {
     SetInitialized();
     Own();
     SystemInfo::DestroySharedMemory(url.c_str());
-    if (!SystemInfo::CreateNewSharedMemory(
-            fd_, url.c_str(), size + HSHM_SYSTEM_INFO->page_size_)) {
+    url_ = url;
+    data_size_ = size;
+    map_size_ = size;
+    std::string data_path;
+    hugetlb_ = opts.huge_pages_ == HugePageMode::kHugeTlb &&
+               _HugeTlbMap(size, opts, data_path);
+    if (opts.huge_pages_ == HugePageMode::kHugeTlb && !hugetlb_) {
+      HILOG(kWarning,
+            "Huge pages unavailable in {}, falling back to transparent "
+            "huge pages",
+            opts.hugetlbfs_dir_);
+    }
+    size_t shm_size = HSHM_SYSTEM_INFO->page_size_;
+    if (!hugetlb_) {
+      shm_size += size;
+    }
+    if (!SystemInfo::CreateNewSharedMemory(fd_, url.c_str(), shm_size)) {
       char *err_buf = strerror(errno);
       HILOG(kError, "shm_open failed: {}", err_buf);
       return false;
     }
-    url_ = url;
-    header_ = (MemoryBackendHeader *)_ShmMap(HSHM_SYSTEM_INFO->page_size_, 0);
-    header_->type_ = MemoryBackendType::kPosixShmMmap;
-    header_->id_ = backend_id;
-    header_->data_size_ = size;
-    data_size_ = size;
-    data_ = _ShmMap(size, HSHM_SYSTEM_INFO->page_size_);
+    auto *header = (PosixShmMmapHeader *)_ShmMap(
+        fd_, HSHM_SYSTEM_INFO->page_size_, 0);
+    header_ = header;
+    header->type_ = MemoryBackendType::kPosixShmMmap;
+    header->id_ = backend_id;
+    header->data_size_ = size;
+    header->map_size_ = map_size_;
+    header->hugetlb_ = hugetlb_;
+    header->data_path_ = data_path;
+    if (!hugetlb_) {
+      data_ = _ShmMap(fd_, size, HSHM_SYSTEM_INFO->page_size_);
+      if (opts.huge_pages_ != HugePageMode::kNone) {
+        SystemInfo::AdviseHugePages(data_, size);
+      }
+    }
+    if (opts.numa_policy_ != NumaPolicy::kDefault &&
+        !SystemInfo::BindNumaMemory(data_, map_size_, opts.numa_policy_,
+                                    opts.numa_nodes_)) {
+      HILOG(kWarning, "Could not apply NUMA policy to {}", url.str());
+    }
+    if (opts.populate_ || opts.zero_) {
+      int nthreads = opts.prefault_threads_ > 0 ? opts.prefault_threads_
+                                                : HSHM_SYSTEM_INFO->ncpu_;
+      prefault_msec_ = SystemInfo::ParallelPrefaultMemory(
+          data_, map_size_, opts.zero_, nthreads);
+      HILOG(kDebug, "Pre-faulted {} bytes of {} in {} ms", map_size_,
+            url.str(), prefault_msec_);
+    }
     return true;
   }
 
@@ -81,9 +148,23 @@ class PosixShmMmap : public MemoryBackend, public UrlMemoryBackend {
       HILOG(kError, "shm_open failed: {}", err_buf);
       return false;
     }
-    header_ = (MemoryBackendHeader *)_ShmMap(HSHM_SYSTEM_INFO->page_size_, 0);
-    data_size_ = header_->data_size_;
-    data_ = _ShmMap(data_size_, HSHM_SYSTEM_INFO->page_size_);
+    auto *header = (PosixShmMmapHeader *)_ShmMap(
+        fd_, HSHM_SYSTEM_INFO->page_size_, 0);
+    header_ = header;
+    data_size_ = header->data_size_;
+    map_size_ = header->map_size_;
+    hugetlb_ = header->hugetlb_;
+    if (hugetlb_) {
+      if (!SystemInfo::OpenFileMemory(data_fd_, header->data_path_.str())) {
+        const char *err_buf = strerror(errno);
+        HILOG(kError, "open {} failed: {}", header->data_path_.str(),
+              err_buf);
+        return false;
+      }
+      data_ = _ShmMap(data_fd_, map_size_, 0);
+    } else {
+      data_ = _ShmMap(fd_, data_size_, HSHM_SYSTEM_INFO->page_size_);
+    }
     return true;
   }
 
@@ -95,23 +176,60 @@ class PosixShmMmap : public MemoryBackend, public UrlMemoryBackend {
 
  protected:
   /** Map shared memory */
-  char *_ShmMap(size_t size, i64 off) {
+  char *_ShmMap(const File &fd, size_t size, i64 off) {
     char *ptr =
-        reinterpret_cast<char *>(SystemInfo::MapSharedMemory(fd_, size, off));
+        reinterpret_cast<char *>(SystemInfo::MapSharedMemory(fd, size, off));
     if (!ptr) {
       HSHM_THROW_ERROR(SHMEM_CREATE_FAILED);
     }
     return ptr;
   }
 
+  /**
+   * Place the data in a hugetlbfs file. MAP_HUGETLB cannot be combined
+   * with a /dev/shm descriptor, so the file lives in the hugetlbfs mount
+   * and its path is published in the header for other processes.
+   * */
+  bool _HugeTlbMap(size_t size, const PosixShmMmapOptions &opts,
+                   std::string &path) {
+    size_t huge = opts.huge_page_size_;
+    size_t map_size = ((size + huge - 1) / huge) * huge;
+    std::string name = url_.str();
+    for (char &c : name) {
+      if (c == '/') {
+        c = '_';
+      }
+    }
+    path = opts.hugetlbfs_dir_ + "/" + name;
+    if (path.size() > 255) {
+      return false;
+    }
+    SystemInfo::DestroyFileMemory(path);
+    if (!SystemInfo::CreateNewFileMemory(data_fd_, path, map_size)) {
+      return false;
+    }
+    data_ = reinterpret_cast<char *>(
+        SystemInfo::MapSharedMemory(data_fd_, map_size, 0));
+    if (!data_) {
+      SystemInfo::CloseSharedMemory(data_fd_);
+      SystemInfo::DestroyFileMemory(path);
+      return false;
+    }
+    map_size_ = map_size;
+    return true;
+  }
+
   /** Unmap shared memory */
   void _Detach() {
     if (!IsInitialized()) {
       return;
     }
+    SystemInfo::UnmapMemory(data_, map_size_);
+    if (hugetlb_) {
+      SystemInfo::CloseSharedMemory(data_fd_);
+    }
     SystemInfo::UnmapMemory(reinterpret_cast<void *>(header_),
                             HSHM_SYSTEM_INFO->page_size_);
-    SystemInfo::UnmapMemory(data_, data_size_);
     SystemInfo::CloseSharedMemory(fd_);
     UnsetInitialized();
   }
@@ -121,7 +239,14 @@ class PosixShmMmap : public MemoryBackend, public UrlMemoryBackend {
     if (!IsInitialized()) {
       return;
     }
+    std::string data_path;
+    if (hugetlb_) {
+      data_path = ((PosixShmMmapHeader *)header_)->data_path_.str();
+    }
     _Detach();
+    if (hugetlb_) {
+      SystemInfo::DestroyFileMemory(data_path);
+    }
     SystemInfo::DestroySharedMemory(url_.c_str());
     UnsetInitialized();
   }
@@ -190,7 +190,7 @@ struct OffsetPointerBase : public ShmPointer {
   HSHM_INLINE_CROSS_FUN bool compare_exchange_strong(
       size_t &expected, size_t desired,
       std::memory_order order = std::memory_order_seq_cst) {
-    return off_.compare_exchange_weak(expected, desired, order);
+    return off_.compare_exchange_strong(expected, desired, order);
   }
 
   /** Atomic add operator */
@@ -666,11 +666,10 @@ class MemoryAlignment {
    * @return the new size  (e.g., 8192)
    * */
   static size_t AlignTo(size_t alignment, size_t size) {
-    auto page_size = HSHM_SYSTEM_INFO->page_size_;
     size_t new_size = size;
     size_t page_off = size % alignment;
     if (page_off) {
-      new_size = size + page_size - page_off;
+      new_size = size + alignment - page_off;
     }
     return new_size;
   }
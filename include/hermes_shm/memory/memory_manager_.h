@@ -8,6 +8,7 @@
 #include "allocator/allocator_factory_.h"
 #include "hermes_shm/memory/allocator/allocator.h"
 #include "hermes_shm/memory/backend/posix_mmap.h"
+#include "hermes_shm/thread/lock/spin_lock.h"
 #include "hermes_shm/types/numbers.h"
 #include "hermes_shm/util/singleton.h"
 
@@ -24,6 +25,26 @@ namespace hshm::ipc {
 /** Max number of memory backends that can be mounted */
 #define MAX_BACKENDS 16
 
+/** Max # of disjoint address ranges in the allocator index */
+#define MAX_ALLOCATOR_RANGES (2 * MAX_ALLOCATORS)
+
+/** An address range [start_, end_) owned by a single allocator */
+struct AllocatorRange {
+  size_t start_;
+  size_t end_;
+  Allocator *alloc_;
+};
+
+/**
+ * The allocators sorted by address. Ranges are disjoint: where allocator
+ * buffers overlap (e.g., a sub-allocator inside its parent), the range
+ * belongs to the allocator with the lowest index.
+ * */
+struct AllocatorRangeTable {
+  AllocatorRange ranges_[MAX_ALLOCATOR_RANGES];
+  size_t count_;
+};
+
 /** Memory manager class */
 class MemoryManager {
  public:
@@ -32,6 +53,13 @@ class MemoryManager {
   Allocator *root_alloc_;
   MemoryBackend *backends_[MAX_BACKENDS];
   Allocator *allocators_[MAX_ALLOCATORS];
+  AllocatorRangeTable range_tables_[2];
+  /**
+   * Bumped when a rebuild of the index starts and when it is published.
+   * Readers use table (range_seq_ / 2) % 2.
+   * */
+  hipc::atomic<hshm::size_t> range_seq_;
+  hshm::SpinLock index_lock_; /**< Serializes rebuilds of the index */
   Allocator *default_allocator_;
   char root_backend_space_[64];
   char root_alloc_space_[64];
@@ -165,9 +193,55 @@ class MemoryManager {
     }
     auto alloc = allocators_[alloc_id.ToIndex()];
     allocators_[alloc_id.ToIndex()] = nullptr;
+    IndexAllocators();
     return alloc;
   }
 
+  /**
+   * Rebuild the address index used by Convert(T*). Rebuilds are
+   * serialized, and each one writes the table that is not being read
+   * before publishing it. A lookup that overlaps the rewrite of its own
+   * table (two rebuilds later) retries.
+   * */
+  HSHM_CROSS_FUN
+  HSHM_DLL void IndexAllocators();
+
+  /**
+   * Find the allocator whose buffer contains \a ptr with a binary search
+   * over the address index.
+   *
+   * @return the allocator or nullptr if no allocator owns \a ptr
+   * */
+  HSHM_INLINE_CROSS_FUN
+  Allocator *FindAllocator(const void *ptr) {
+    size_t addr = reinterpret_cast<size_t>(ptr);
+    while (true) {
+      hshm::size_t seq = range_seq_.load();
+      const AllocatorRangeTable &table = range_tables_[(seq / 2) % 2];
+      size_t lo = 0, hi = table.count_;
+      if (hi > MAX_ALLOCATOR_RANGES) {
+        hi = MAX_ALLOCATOR_RANGES;
+      }
+      while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (table.ranges_[mid].start_ <= addr) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+      Allocator *alloc = nullptr;
+      if (lo > 0 && addr < table.ranges_[lo - 1].end_) {
+        alloc = table.ranges_[lo - 1].alloc_;
+      }
+      // The table is only rewritten once the next rebuild starts
+      hipc::full_fence();
+      if (range_seq_.load() - (seq & ~(hshm::size_t)1) <= 2) {
+        return alloc;
+      }
+    }
+  }
+
   template <typename AllocT>
   HSHM_CROSS_FUN void DestroyAllocator(const AllocatorId &alloc_id);
 
@@ -237,10 +311,9 @@ class MemoryManager {
    * */
   template <typename T, typename POINTER_T = Pointer>
   HSHM_INLINE_CROSS_FUN POINTER_T Convert(T *ptr) {
-    for (auto &alloc : allocators_) {
-      if (alloc && alloc->ContainsPtr(ptr)) {
-        return alloc->template Convert<T, POINTER_T>(ptr);
-      }
+    Allocator *alloc = FindAllocator(ptr);
+    if (alloc) {
+      return alloc->template Convert<T, POINTER_T>(ptr);
     }
     return Pointer::GetNull();
   }
@@ -0,0 +1,138 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef HSHM_THREAD_LOCK_FUTEX_H_
+#define HSHM_THREAD_LOCK_FUTEX_H_
+
+#include <climits>
+
+#include "hermes_shm/introspect/system_info.h"
+#include "hermes_shm/thread/thread_model_manager.h"
+#include "hermes_shm/types/atomic.h"
+#include "hermes_shm/types/numbers.h"
+#include "hermes_shm/util/timer.h"
+
+namespace hshm {
+
+/**
+ * Lets threads of any process that maps it sleep until another thread
+ * changes some state, e.g., until a queue is not empty.
+ *
+ * A waiter registers in waiters_ and then checks the state; a notifier
+ * changes the state and then checks waiters_. Both put a full fence
+ * between their store and their load, so one of the two always sees the
+ * other and a wakeup is never lost, whatever order the state is written
+ * with. A notify with no waiters costs a fence and a load.
+ * */
+struct Futex {
+  ipc::atomic<hshm::u32> seq_;     /**< Bumped by each notify with waiters */
+  ipc::atomic<hshm::u32> waiters_; /**< Threads in Wait() */
+
+  /** Wait without a timeout */
+  static constexpr size_t kForever = SystemInfo::kFutexForever;
+  /** Tries before a thread in Await() goes to sleep */
+  static constexpr int kSpinCount = 64;
+
+  /** Default constructor */
+  HSHM_INLINE_CROSS_FUN
+  Futex() : seq_(0), waiters_(0) {}
+
+  /** Copy constructor. Waiters are not copied. */
+  HSHM_INLINE_CROSS_FUN
+  Futex(const Futex &other) : seq_(0), waiters_(0) {}
+
+  /** Explicit initialization */
+  HSHM_INLINE_CROSS_FUN
+  void Init() {
+    seq_ = 0;
+    waiters_ = 0;
+  }
+
+  /**
+   * Sleep until a notify or until \a timeout_us passes, unless \a ready()
+   * says the state the caller waits for is already there.
+   *
+   * @return false if the timeout passed
+   * */
+  template <typename ReadyT>
+  HSHM_INLINE_CROSS_FUN bool Wait(ReadyT &&ready,
+                                  size_t timeout_us = kForever) {
+    waiters_.fetch_add(1);
+    ipc::full_fence();
+    u32 seq = seq_.load();
+    bool woke = true;
+    if (!ready()) {
+      woke = HSHM_THREAD_MODEL->FutexWait(&seq_, seq, timeout_us);
+    }
+    waiters_.fetch_sub(1);
+    return woke;
+  }
+
+  /** Wake one waiter */
+  HSHM_INLINE_CROSS_FUN
+  void NotifyOne() { Notify(1); }
+
+  /** Wake every waiter */
+  HSHM_INLINE_CROSS_FUN
+  void NotifyAll() { Notify(INT_MAX); }
+
+  /** Wake up to \a count waiters, if there are any */
+  HSHM_INLINE_CROSS_FUN
+  void Notify(int count) {
+    ipc::full_fence();
+    if (waiters_.load() == 0) {
+      return;
+    }
+    seq_.fetch_add(1);
+    HSHM_THREAD_MODEL->FutexWake(&seq_, count);
+  }
+
+  /**
+   * Call \a op until it returns a non-null token. The first kSpinCount
+   * tries are back to back; after that, the thread sleeps between tries
+   * while \a ready() is false.
+   *
+   * @return the token from \a op, or a null token once \a timeout_us passed
+   * */
+  template <typename OpT, typename ReadyT>
+  HSHM_INLINE_CROSS_FUN auto Await(OpT &&op, ReadyT &&ready,
+                                   size_t timeout_us = kForever) {
+    auto ret = op();
+    for (int i = 0; ret.IsNull() && i < kSpinCount; ++i) {
+      ret = op();
+    }
+    if (!ret.IsNull() || timeout_us == 0) {
+      return ret;
+    }
+    Timepoint start;
+    start.Now();
+    while (true) {
+      size_t left = kForever;
+      if (timeout_us != kForever) {
+        size_t spent = (size_t)start.GetUsecFromStart();
+        if (spent >= timeout_us) {
+          return ret;
+        }
+        left = timeout_us - spent;
+      }
+      Wait(ready, left);
+      ret = op();
+      if (!ret.IsNull()) {
+        return ret;
+      }
+    }
+  }
+};
+
+}  // namespace hshm
+
+#endif  // HSHM_THREAD_LOCK_FUTEX_H_
@@ -35,9 +35,13 @@ struct Mutex {
   HSHM_INLINE_CROSS_FUN
   Mutex(const Mutex &other) {}
 
-  /** Explicit initialization */
+  /** Explicit initialization. Also resets a mutex that was used before. */
   HSHM_INLINE_CROSS_FUN
-  void Init() { lock_ = 0; }
+  void Init() {
+    lock_ = 0;
+    head_ = 0;
+    try_lock_ = 0;
+  }
 
   /** Acquire lock */
   HSHM_INLINE_CROSS_FUN
@@ -54,6 +54,20 @@ class Argobots : public ThreadModel {
 #endif
   }
 
+  /**
+   * Blocking in the kernel would stall every ULT on the execution
+   * stream, so this only yields and lets the caller check again.
+   * */
+  HSHM_CROSS_FUN
+  bool FutexWait(void *addr, u32 expected, size_t timeout_us) {
+    Yield();
+    return true;
+  }
+
+  /** Nothing sleeps in FutexWait */
+  HSHM_CROSS_FUN
+  void FutexWake(void *addr, int count) {}
+
   /** Create thread-local storage */
   template <typename TLS>
   HSHM_CROSS_FUN bool CreateTls(ThreadLocalKey &key, TLS *data) {
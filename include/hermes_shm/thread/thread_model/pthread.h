@@ -57,6 +57,30 @@ class Pthread : public ThreadModel {
 #endif
   }
 
+  /**
+   * Sleep while the 32-bit word at \a addr is \a expected, until a
+   * FutexWake on it or \a timeout_us passes. The word may be in memory
+   * shared with other processes.
+   *
+   * @return false if the timeout passed
+   * */
+  HSHM_CROSS_FUN
+  bool FutexWait(void *addr, u32 expected, size_t timeout_us) {
+#ifdef HSHM_IS_HOST
+    return SystemInfo::FutexWait(addr, expected, timeout_us);
+#else
+    return true;
+#endif
+  }
+
+  /** Wake up to \a count threads sleeping on \a addr */
+  HSHM_CROSS_FUN
+  void FutexWake(void *addr, int count) {
+#ifdef HSHM_IS_HOST
+    SystemInfo::FutexWake(addr, count);
+#endif
+  }
+
   /** Create thread-local storage */
   template <typename TLS>
   HSHM_CROSS_FUN bool CreateTls(ThreadLocalKey &key, TLS *data) {
@@ -39,6 +39,16 @@ class Rocm : public ThreadModel {
   HSHM_CROSS_FUN
   void Yield() {}
 
+  /** GPU threads cannot sleep on a futex, so the caller polls */
+  HSHM_CROSS_FUN
+  bool FutexWait(void *addr, u32 expected, size_t timeout_us) {
+    return true;
+  }
+
+  /** Nothing sleeps in FutexWait */
+  HSHM_CROSS_FUN
+  void FutexWake(void *addr, int count) {}
+
   /** Create thread-local storage */
   template <typename TLS>
   HSHM_CROSS_FUN bool CreateTls(ThreadLocalKey &key, TLS *data) {
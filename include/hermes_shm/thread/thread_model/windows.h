@@ -25,6 +25,19 @@ class WindowsThread : public ThreadModel {
   HSHM_CROSS_FUN
   void Yield() { std::this_thread::yield(); }
 
+  /**
+   * Sleep while the word at \a addr is \a expected. SystemInfo polls it
+   * with short sleeps here, so FutexWake has nothing to do.
+   * */
+  HSHM_CROSS_FUN
+  bool FutexWait(void *addr, u32 expected, size_t timeout_us) {
+    return SystemInfo::FutexWait(addr, expected, timeout_us);
+  }
+
+  /** Wake up to \a count threads sleeping on \a addr */
+  HSHM_CROSS_FUN
+  void FutexWake(void *addr, int count) { SystemInfo::FutexWake(addr, count); }
+
   /** Create thread-local storage */
   template <typename TLS>
   HSHM_CROSS_FUN bool CreateTls(ThreadLocalKey &key, TLS *data) {
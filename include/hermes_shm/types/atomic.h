@@ -83,6 +83,24 @@ struct nonatomic {
     return orig_x;
   }
 
+  /** Atomic fetch_or wrapper*/
+  HSHM_INLINE_CROSS_FUN T
+  fetch_or(T bits, std::memory_order order = std::memory_order_seq_cst) {
+    (void)order;
+    T orig_x = x;
+    x |= bits;
+    return orig_x;
+  }
+
+  /** Atomic fetch_and wrapper*/
+  HSHM_INLINE_CROSS_FUN T
+  fetch_and(T bits, std::memory_order order = std::memory_order_seq_cst) {
+    (void)order;
+    T orig_x = x;
+    x &= bits;
+    return orig_x;
+  }
+
   /** Atomic load wrapper */
   HSHM_INLINE_CROSS_FUN T
   load(std::memory_order order = std::memory_order_seq_cst) const {
@@ -97,10 +115,12 @@ struct nonatomic {
   HSHM_INLINE_CROSS_FUN const T &ref() const { return x; }
 
   /** Atomic exchange wrapper */
-  HSHM_INLINE_CROSS_FUN void exchange(
-      T count, std::memory_order order = std::memory_order_seq_cst) {
+  HSHM_INLINE_CROSS_FUN T
+  exchange(T count, std::memory_order order = std::memory_order_seq_cst) {
     (void)order;
+    T old = x;
     x = count;
+    return old;
   }
 
   /** Atomic compare exchange weak wrapper */
@@ -269,6 +289,18 @@ struct rocm_atomic {
     return atomicAdd(&x, -count);
   }
 
+  /** Atomic fetch_or wrapper*/
+  HSHM_INLINE_CROSS_FUN T
+  fetch_or(T bits, std::memory_order order = std::memory_order_seq_cst) {
+    return atomicOr(&x, bits);
+  }
+
+  /** Atomic fetch_and wrapper*/
+  HSHM_INLINE_CROSS_FUN T
+  fetch_and(T bits, std::memory_order order = std::memory_order_seq_cst) {
+    return atomicAnd(&x, bits);
+  }
+
   /** Atomic load wrapper */
   HSHM_INLINE_CROSS_FUN T
   load(std::memory_order order = std::memory_order_seq_cst) const {
@@ -461,6 +493,18 @@ struct std_atomic {
     return x.fetch_sub(count, order);
   }
 
+  /** Atomic fetch_or wrapper*/
+  HSHM_INLINE T fetch_or(T bits,
+                         std::memory_order order = std::memory_order_seq_cst) {
+    return x.fetch_or(bits, order);
+  }
+
+  /** Atomic fetch_and wrapper*/
+  HSHM_INLINE T fetch_and(T bits,
+                          std::memory_order order = std::memory_order_seq_cst) {
+    return x.fetch_and(bits, order);
+  }
+
   /** Atomic load wrapper */
   HSHM_INLINE T
   load(std::memory_order order = std::memory_order_seq_cst) const {
@@ -474,9 +518,9 @@ struct std_atomic {
   }
 
   /** Atomic exchange wrapper */
-  HSHM_INLINE void exchange(
-      T count, std::memory_order order = std::memory_order_seq_cst) {
-    x.exchange(count, order);
+  HSHM_INLINE T
+  exchange(T count, std::memory_order order = std::memory_order_seq_cst) {
+    return x.exchange(count, order);
   }
 
   /** Atomic compare exchange weak wrapper */
@@ -591,6 +635,15 @@ template <typename T, bool is_atomic>
 using opt_atomic =
     typename std::conditional<is_atomic, atomic<T>, nonatomic<T>>::type;
 
+/** Order every earlier store before every later load */
+HSHM_INLINE_CROSS_FUN static void full_fence() {
+#ifdef HSHM_IS_GPU
+  __threadfence_system();
+#else
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+}
+
 }  // namespace hshm::ipc
 
 #endif  // HSHM_INCLUDE_HSHM_TYPES_ATOMIC_H_
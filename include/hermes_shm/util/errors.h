@@ -29,10 +29,18 @@ const Error SHMEM_RESERVE_FAILED("Failed to reserve SHMEM");
 const Error SHMEM_NOT_SUPPORTED("Attempting to deserialize a non-shm backend");
 const Error MEMORY_BACKEND_CREATE_FAILED("Failed to load memory backend");
 const Error MEMORY_BACKEND_NOT_FOUND("Failed to find the memory backend");
+const Error MEMORY_BACKEND_UNRECOVERABLE(
+    "The allocator of backend {} cannot recover from a crash");
 const Error OUT_OF_MEMORY(
     "could not allocate memory of size {} from heap of size {}");
 const Error INVALID_FREE("could not free memory");
 const Error DOUBLE_FREE("Freeing the same memory twice: {}!");
+const Error INVALID_ALIGNMENT(
+    "Alignment {} must be a power of two no larger than {}");
+const Error TOO_MANY_EPOCH_THREADS(
+    "At most {} threads can pin an allocator epoch");
+const Error SLAB_OBJECT_TOO_LARGE(
+    "Slab objects can be at most {} bytes, but {} were requested");
 
 const Error IPC_ARGS_NOT_SHM_COMPATIBLE("Args are not compatible with SHM");
 
@@ -10,59 +10,459 @@
  * have access to the file, you may request a copy from help@hdfgroup.org.   *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+/**
+ * A malloc replacement built on the hipc allocators. Load it with
+ * LD_PRELOAD=libhermes_shm_malloc.so.
+ *
+ * The heap is a ThreadLocalAllocator over a PosixShmMmap backend, so
+ * each thread allocates from its own free lists without locking, and
+ * other processes can read the objects in the heap by attaching it:
+ *
+ *   HSHM_MEMORY_MANAGER->AttachBackend(MemoryBackendType::kPosixShmMmap,
+ *                                      "hshm_malloc_<pid>");
+ *
+ * The shared memory is unlinked when the process that created it exits.
+ * A forked child must not share the heap with its parent, so fork()
+ * copies the used part of the heap and the child maps the copy privately
+ * in place of the shared memory. A shared mapping cannot be made
+ * copy-on-write, so the copy is eager: each fork() costs a memcpy of the
+ * used heap, during which every allocator lock is held and allocating
+ * threads wait. Heaps that use more than HSHM_MALLOC_FORK_COPY bytes are
+ * not copied. Their children allocate from glibc, leak the heap blocks
+ * they free, and may only read the blocks their parent keeps alive.
+ *
+ * Memory is served by glibc instead while the heap does not exist yet,
+ * when the allocator itself calls malloc, and when the heap is out of
+ * memory. free() routes each block back to its owner by address.
+ *
+ * Environment variables:
+ *   HSHM_MALLOC_SIZE: size of the heap (e.g., 512m). Default 1g.
+ *   HSHM_MALLOC_URL: name of the shared memory. Default hshm_malloc_<pid>.
+ *   HSHM_MALLOC_FORK_COPY: the most heap fork() copies. Default 64m.
+ * */
+
+#include <dlfcn.h>
+#include <errno.h>
 #include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
 
 #include "hermes_shm/memory/memory_manager.h"
+#include "hermes_shm/util/config_parse.h"
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+void __libc_free(void *ptr);
+}
+
+namespace hshm::ipc {
+
+/** The allocator managing the heap */
+typedef ThreadLocalAllocator MallocAllocT;
+
+/** The default size of the heap */
+static constexpr size_t kDefaultHeapSize = hshm::Unit<size_t>::Gigabytes(1);
+
+/** The default number of used heap bytes fork() copies for the child */
+static constexpr size_t kDefaultForkCopySize =
+    hshm::Unit<size_t>::Megabytes(64);
+
+/** The alignment of every block returned by malloc */
+static constexpr size_t kMinAlignment = 16;
 
-using hshm::ipc::Allocator;
-using hshm::ipc::Pointer;
+/**
+ * The heap uses the last backend and allocator ids. These are functions
+ * because the heap is created before the static objects of this library
+ * are constructed.
+ * */
+static MemoryBackendId GetHeapBackendId() {
+  return MemoryBackendId(MAX_BACKENDS - 1);
+}
+static AllocatorId GetHeapAllocId() {
+  return AllocatorId(MAX_ALLOCATORS / 2 - 1, 0);
+}
+
+/** The glibc functions that this library overrides by name */
+typedef size_t (*malloc_usable_size_t)(void *ptr);
+typedef int (*malloc_trim_t)(size_t pad);
+
+/** The state of the preloaded heap */
+struct MallocHeap {
+  std::atomic<MallocAllocT *> alloc_;
+  malloc_usable_size_t libc_usable_size_;
+  malloc_trim_t libc_trim_;
+  char *data_;           /**< The shared memory of the heap */
+  size_t size_;          /**< The size of data_ */
+  char url_[64];         /**< The name of the shared memory */
+  pid_t owner_;          /**< The process that unlinks the shared memory */
+  char *fork_copy_;      /**< The copy of the heap a forked child maps */
+  size_t fork_copy_max_; /**< The most heap bytes fork() copies */
+  bool detached_;        /**< The heap is shared but this process is a child */
+};
+static MallocHeap heap_;
+
+/** Whether this thread is already inside the heap */
+static __thread bool in_heap_ __attribute__((tls_model("initial-exec")));
+
+/**
+ * Claims the heap for the calling thread. The heap is unavailable if it
+ * does not exist, the thread re-entered malloc from inside the heap, or
+ * the process is a forked child that could not get a copy of it.
+ * */
+class HeapAccess {
+ public:
+  MallocAllocT *alloc_;
+
+ public:
+  HeapAccess() : alloc_(nullptr) {
+    if (in_heap_ || heap_.detached_) {
+      return;
+    }
+    alloc_ = heap_.alloc_.load(std::memory_order_acquire);
+    if (alloc_) {
+      in_heap_ = true;
+    }
+  }
+
+  ~HeapAccess() {
+    if (alloc_) {
+      in_heap_ = false;
+    }
+  }
+};
+
+/** Whether \a ptr was allocated from the heap */
+static bool IsHeapBlock(void *ptr) {
+  MallocAllocT *alloc = heap_.alloc_.load(std::memory_order_acquire);
+  return alloc && alloc->ContainsPtr(ptr);
+}
+
+/** The number of usable bytes of a heap block */
+static size_t GetHeapBlockSize(void *ptr) {
+  MallocAllocT *alloc = heap_.alloc_.load(std::memory_order_acquire);
+  return alloc->GetUsableSize(
+      alloc->Convert<char, OffsetPointer>(reinterpret_cast<char *>(ptr)));
+}
+
+/**
+ * Allocate from the heap.
+ * @return null if the heap is unavailable or out of memory
+ * */
+static void *HeapAllocate(size_t size, size_t alignment, bool clear) {
+  HeapAccess access;
+  if (!access.alloc_) {
+    return nullptr;
+  }
+  try {
+    if (clear) {
+      return access.alloc_->ClearAllocatePtr<void>(HSHM_DEFAULT_MEM_CTX, size,
+                                                   alignment);
+    }
+    return access.alloc_->AllocatePtr<void>(HSHM_DEFAULT_MEM_CTX, size,
+                                            alignment);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+/**
+ * Return a block to the heap. A block freed by an allocator callback
+ * or an atfork handler during fork() is leaked instead.
+ * */
+static void HeapFree(void *ptr) {
+  HeapAccess access;
+  if (access.alloc_) {
+    access.alloc_->FreePtr(HSHM_DEFAULT_MEM_CTX, ptr);
+  }
+}
+
+/**
+ * Resize a block of the heap.
+ * @return null if the block could not be resized in the heap
+ * */
+static void *HeapReallocate(void *ptr, size_t size) {
+  HeapAccess access;
+  if (!access.alloc_) {
+    return nullptr;
+  }
+  try {
+    return access.alloc_->ReallocatePtr(HSHM_DEFAULT_MEM_CTX, ptr, size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+/** The size of the heap, or 0 if it does not exist */
+static size_t GetHeapSize() {
+  return heap_.alloc_.load(std::memory_order_acquire) ? heap_.size_ : 0;
+}
+
+/** Create the heap in shared memory that other processes can attach */
+static void CreateHeap() {
+  size_t size = kDefaultHeapSize;
+  const char *size_env = getenv("HSHM_MALLOC_SIZE");
+  if (size_env) {
+    size = ConfigParse::ParseSize(size_env);
+  }
+  const char *url_env = getenv("HSHM_MALLOC_URL");
+  if (url_env) {
+    snprintf(heap_.url_, sizeof(heap_.url_), "%s", url_env);
+  } else {
+    snprintf(heap_.url_, sizeof(heap_.url_), "hshm_malloc_%d", (int)getpid());
+  }
+  heap_.fork_copy_max_ = kDefaultForkCopySize;
+  const char *fork_env = getenv("HSHM_MALLOC_FORK_COPY");
+  if (fork_env) {
+    heap_.fork_copy_max_ = ConfigParse::ParseSize(fork_env);
+  }
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  try {
+    MemoryBackend *backend = mem_mngr->CreateBackend<PosixShmMmap>(
+        GetHeapBackendId(), size, hshm::chararr(heap_.url_));
+    heap_.owner_ = getpid();
+    heap_.data_ = backend->data_;
+    heap_.size_ = backend->data_size_;
+    // The heap must not become the default allocator of the program
+    Allocator *prior = mem_mngr->GetDefaultAllocator<Allocator>();
+    MallocAllocT *alloc = mem_mngr->CreateAllocator<MallocAllocT>(
+        GetHeapBackendId(), GetHeapAllocId(), 0);
+    mem_mngr->SetDefaultAllocator(prior);
+    heap_.alloc_.store(alloc, std::memory_order_release);
+  } catch (...) {
+    HELOG(kError, "Could not create a heap of {} bytes in {}, using glibc",
+          size, heap_.url_);
+  }
+}
+
+/**
+ * Lock the heap before fork() and copy its used part for the child, if
+ * it is at most fork_copy_max_ bytes. Allocations made by other atfork
+ * handlers until the lock is released are served by glibc.
+ * */
+static void OnForkPrepare() {
+  MallocAllocT *alloc = heap_.alloc_.load();
+  if (alloc == nullptr) {
+    return;
+  }
+  in_heap_ = true;
+  alloc->LockAll();
+  size_t used = alloc->GetHeapEnd() - heap_.data_;
+  if (used > heap_.fork_copy_max_) {
+    heap_.fork_copy_ = nullptr;
+    return;
+  }
+  void *copy = mmap(nullptr, heap_.size_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (copy == MAP_FAILED) {
+    heap_.fork_copy_ = nullptr;
+    return;
+  }
+  heap_.fork_copy_ = reinterpret_cast<char *>(copy);
+  memcpy(heap_.fork_copy_, heap_.data_, used);
+}
+
+/** Unlock the heap after fork() and drop the child's copy */
+static void OnForkParent() {
+  MallocAllocT *alloc = heap_.alloc_.load();
+  if (alloc == nullptr) {
+    return;
+  }
+  if (heap_.fork_copy_) {
+    munmap(heap_.fork_copy_, heap_.size_);
+    heap_.fork_copy_ = nullptr;
+  }
+  alloc->UnlockAll();
+  in_heap_ = false;
+}
+
+/**
+ * Replace the shared heap with the parent's copy in the child of fork().
+ * Without a copy, the child must not touch the shared heap: it allocates
+ * from glibc and leaks the heap blocks it frees.
+ * */
+static void OnForkChild() {
+  MallocAllocT *alloc = heap_.alloc_.load();
+  if (alloc == nullptr) {
+    return;
+  }
+  void *heap = nullptr;
+  if (heap_.fork_copy_) {
+    heap = mremap(heap_.fork_copy_, heap_.size_, heap_.size_,
+                  MREMAP_MAYMOVE | MREMAP_FIXED, heap_.data_);
+    heap_.fork_copy_ = nullptr;
+  }
+  if (heap != heap_.data_) {
+    // The locks belong to the parent, so they stay held
+    heap_.detached_ = true;
+  } else {
+    alloc->UnlockAll();
+  }
+  in_heap_ = false;
+}
+
+/**
+ * Create the heap once the libraries this one depends on are initialized.
+ * Until then, every allocation is served by glibc.
+ * */
+__attribute__((constructor)) static void InitMallocHeap() {
+  heap_.libc_usable_size_ =
+      (malloc_usable_size_t)dlsym(RTLD_NEXT, "malloc_usable_size");
+  heap_.libc_trim_ = (malloc_trim_t)dlsym(RTLD_NEXT, "malloc_trim");
+  CreateHeap();
+  pthread_atfork(OnForkPrepare, OnForkParent, OnForkChild);
+}
+
+/** Unlink the shared memory of the heap. Attached processes keep it. */
+__attribute__((destructor)) static void FiniMallocHeap() {
+  if (heap_.alloc_.load() && heap_.owner_ == getpid()) {
+    SystemInfo::DestroySharedMemory(heap_.url_);
+  }
+}
+
+/**
+ * Whether memalign accepts \a alignment: a power of two no larger than
+ * the heap. Alignments larger than the heap could never be honored.
+ * */
+static bool IsValidAlignment(size_t alignment) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    return false;
+  }
+  size_t heap_size = GetHeapSize();
+  return heap_size == 0 || alignment <= heap_size;
+}
+
+/** The usable size of any block */
+static size_t GetBlockSize(void *ptr) {
+  if (IsHeapBlock(ptr)) {
+    return GetHeapBlockSize(ptr);
+  }
+  if (heap_.libc_usable_size_) {
+    return heap_.libc_usable_size_(ptr);
+  }
+  return 0;
+}
+
+}  // namespace hshm::ipc
 
 /** Allocate SIZE bytes of memory. */
-void* malloc(size_t size) {
-  auto alloc = HSHM_DEFAULT_ALLOC;
-  return alloc->AllocatePtr<void>(HSHM_DEFAULT_MEM_CTX, size);
+void *malloc(size_t size) {
+  void *ptr = hshm::ipc::HeapAllocate(size, 0, false);
+  if (ptr) {
+    return ptr;
+  }
+  return __libc_malloc(size);
 }
 
 /** Allocate NMEMB elements of SIZE bytes each, all initialized to 0. */
-void* calloc(size_t nmemb, size_t size) {
-  auto alloc = HSHM_DEFAULT_ALLOC;
-  return alloc->ClearAllocatePtr<void>(nmemb * size);
+void *calloc(size_t nmemb, size_t size) {
+  size_t total;
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  void *ptr = hshm::ipc::HeapAllocate(total, 0, true);
+  if (ptr) {
+    return ptr;
+  }
+  return __libc_calloc(nmemb, size);
+}
+
+/** Free a block allocated by `malloc', `realloc' or `calloc'. */
+void free(void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  if (hshm::ipc::IsHeapBlock(ptr)) {
+    hshm::ipc::HeapFree(ptr);
+  } else {
+    __libc_free(ptr);
+  }
 }
 
 /**
  * Re-allocate the previously allocated block in ptr, making the new
  * block SIZE bytes long.
  * */
-void* realloc(void* ptr, size_t size) {
-  Pointer p = HSHM_MEMORY_MANAGER->Convert(ptr);
-  auto alloc = HSHM_MEMORY_MANAGER->GetAllocator(p.alloc_id_);
-  return alloc->AllocatePtr<void>(HSHM_DEFAULT_MEM_CTX, size);
+void *realloc(void *ptr, size_t size) {
+  if (ptr == nullptr) {
+    return malloc(size);
+  }
+  if (size == 0) {
+    free(ptr);
+    return nullptr;
+  }
+  if (!hshm::ipc::IsHeapBlock(ptr)) {
+    return __libc_realloc(ptr, size);
+  }
+  void *new_ptr = hshm::ipc::HeapReallocate(ptr, size);
+  if (new_ptr) {
+    return new_ptr;
+  }
+  // The heap is full, so move the block to glibc
+  new_ptr = malloc(size);
+  if (new_ptr == nullptr) {
+    return nullptr;
+  }
+  size_t old_size = hshm::ipc::GetHeapBlockSize(ptr);
+  memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+  free(ptr);
+  return new_ptr;
 }
 
 /**
  * Re-allocate the previously allocated block in PTR, making the new
  * block large enough for NMEMB elements of SIZE bytes each.
  * */
-void* reallocarray(void* ptr, size_t nmemb, size_t size) {
-  return realloc(ptr, nmemb * size);
-}
-
-/** Free a block allocated by `malloc', `realloc' or `calloc'. */
-void free(void* ptr) {
-  Pointer p = HSHM_MEMORY_MANAGER->Convert(ptr);
-  auto alloc = HSHM_MEMORY_MANAGER->GetAllocator(p.alloc_id_);
-  alloc->Free(p);
+void *reallocarray(void *ptr, size_t nmemb, size_t size) {
+  size_t total;
+  if (__builtin_mul_overflow(nmemb, size, &total)) {
+    errno = ENOMEM;
+    return nullptr;
+  }
+  return realloc(ptr, total);
 }
 
-/** Allocate SIZE bytes allocated to ALIGNMENT bytes. */
-void* memalign(size_t alignment, size_t size) {
-  // TODO(llogan): need to add an aligned allocator
-  return malloc(size);
+/**
+ * Allocate SIZE bytes allocated to ALIGNMENT bytes. Like glibc, an
+ * ALIGNMENT that is not a power of two is rounded up to one.
+ * */
+void *memalign(size_t alignment, size_t size) {
+  if (alignment & (alignment - 1)) {
+    if (alignment > ((size_t)-1 >> 1)) {
+      errno = EINVAL;
+      return nullptr;
+    }
+    size_t pow2 = hshm::ipc::kMinAlignment;
+    while (pow2 < alignment) {
+      pow2 <<= 1;
+    }
+    alignment = pow2;
+  }
+  if (alignment <= hshm::ipc::kMinAlignment) {
+    return malloc(size);
+  }
+  if (hshm::ipc::IsValidAlignment(alignment) &&
+      hshm::ipc::MpPage::IsValidAlignment(alignment)) {
+    void *ptr = hshm::ipc::HeapAllocate(size, alignment, false);
+    if (ptr) {
+      return ptr;
+    }
+  }
+  return __libc_memalign(alignment, size);
 }
 
 /** Allocate SIZE bytes on a page boundary. */
-void* valloc(size_t size) {
+void *valloc(size_t size) {
   return memalign(HSHM_SYSTEM_INFO->page_size_, size);
 }
 
@@ -70,7 +470,7 @@ void* valloc(size_t size) {
  * Equivalent to valloc(minimum-page-that-holds(n)),
  * that is, round up size to nearest pagesize.
  * */
-void* pvalloc(size_t size) {
+void *pvalloc(size_t size) {
   size_t new_size = hipc::MemoryAlignment::AlignToPageSize(size);
   return valloc(new_size);
 }
@@ -79,16 +479,57 @@ void* pvalloc(size_t size) {
  * Allocates size bytes and places the address of the
  * allocated memory in *memptr. The address of the allocated memory
  * will be a multiple of alignment, which must be a power of two and a multiple
- * of sizeof(void*). Returns NULL if size is 0. */
-int posix_memalign(void** memptr, size_t alignment, size_t size) {
-  (*memptr) = memalign(alignment, size);
+ * of sizeof(void*). */
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+  if (alignment < sizeof(void *) ||
+      !hshm::ipc::IsValidAlignment(alignment)) {
+    return EINVAL;
+  }
+  void *ptr = memalign(alignment, size);
+  if (ptr == nullptr) {
+    return ENOMEM;
+  }
+  (*memptr) = ptr;
   return 0;
 }
 
 /**
- * Aligned to an alignment with a size that is a multiple of the
- * alignment
+ * Allocate SIZE bytes aligned to ALIGNMENT bytes (C11). Unlike memalign,
+ * ALIGNMENT must be a power of two.
+ * */
+void *aligned_alloc(size_t alignment, size_t size) {
+  if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+    errno = EINVAL;
+    return nullptr;
+  }
+  return memalign(alignment, size);
+}
+
+/** The number of usable bytes in the block pointed to by PTR */
+size_t malloc_usable_size(void *ptr) {
+  if (ptr == nullptr) {
+    return 0;
+  }
+  return hshm::ipc::GetBlockSize(ptr);
+}
+
+/**
+ * Release free memory to the system. The cached pages of the heap are
+ * discarded, and the glibc heap, which serves bootstrap allocations, is
+ * trimmed.
+ *
+ * @return 1 if any memory was released
  * */
-void* aligned_alloc(size_t alignment, size_t size) {
-  return memalign(alignment, hshm::ipc::NextAlignmentMultiple(alignment, size));
+int malloc_trim(size_t pad) {
+  int ret = 0;
+  {
+    hshm::ipc::HeapAccess access;
+    if (access.alloc_ && access.alloc_->Trim(HSHM_DEFAULT_MEM_CTX)) {
+      ret = 1;
+    }
+  }
+  if (hshm::ipc::heap_.libc_trim_ && hshm::ipc::heap_.libc_trim_(pad)) {
+    ret = 1;
+  }
+  return ret;
 }
@@ -37,6 +37,9 @@ void MemoryManager::Init() {
   // Initialize tables
   memset(backends_, 0, sizeof(backends_));
   memset(allocators_, 0, sizeof(allocators_));
+  memset(range_tables_, 0, sizeof(range_tables_));
+  range_seq_ = 0;
+  index_lock_.Init();
 
   // Root backend
   ArrayBackend *root_backend = (ArrayBackend *)root_backend_space_;
@@ -81,6 +84,13 @@ MemoryBackend *MemoryManager::AttachBackend(MemoryBackendType type,
   MemoryBackend *backend = MemoryBackendFactory::shm_deserialize(type, url);
   RegisterBackend(backend);
   ScanBackends();
+  if (backend->NeedsRecovery()) {
+    // Only file backends recover. Detaching leaves the file dirty.
+    MemoryBackendId backend_id = backend->GetId();
+    static_cast<PosixFileMmap *>(backend)->shm_detach();
+    DestroyBackend(backend_id);
+    HSHM_THROW_ERROR(MEMORY_BACKEND_UNRECOVERABLE, backend_id.id_);
+  }
   backend->Disown();
   return backend;
 #else
@@ -196,6 +206,15 @@ void MemoryManager::ScanBackends(bool find_allocs) {
     backend->SetScanned();
     if (find_allocs) {
       auto *alloc = AllocatorFactory::shm_deserialize(backend);
+      if (backend->NeedsRecovery()) {
+        // Only the ScalablePageAllocator can rebuild its state. The
+        // backend stays locked out so no one uses the broken heap.
+#ifdef HSHM_IS_HOST
+        HILOG(kError, "The allocator of backend {} cannot recover",
+              backend->GetId().id_);
+#endif
+        continue;
+      }
       if (!alloc) {
         continue;
       }
@@ -230,17 +249,80 @@ Allocator *MemoryManager::RegisterAllocator(Allocator *alloc, bool do_scan) {
     }
   }
   uint32_t idx = alloc->GetId().ToIndex();
-  if (idx > MAX_ALLOCATORS) {
+  if (idx >= MAX_ALLOCATORS) {
     HILOG(kError, "Allocator index out of range: {}", idx);
     HSHM_THROW_ERROR(TOO_MANY_ALLOCATORS);
   }
   allocators_[idx] = alloc;
+  IndexAllocators();
   if (do_scan) {
     ScanBackends(false);
   }
   return alloc;
 }
 
+/**
+ * Rebuild the address index used by Convert(T*).
+ * */
+HSHM_CROSS_FUN
+void MemoryManager::IndexAllocators() {
+  hshm::ScopedSpinLock lock(index_lock_, 0);
+
+  // Collect the sorted, unique boundaries of every allocator buffer
+  size_t bounds[MAX_ALLOCATOR_RANGES];
+  size_t num_bounds = 0;
+  for (Allocator *alloc : allocators_) {
+    if (alloc == nullptr || alloc->buffer_size_ == 0) {
+      continue;
+    }
+    size_t start = reinterpret_cast<size_t>(alloc->buffer_);
+    size_t edges[2] = {start, start + alloc->buffer_size_};
+    for (size_t edge : edges) {
+      size_t i = num_bounds;
+      while (i > 0 && bounds[i - 1] > edge) {
+        --i;
+      }
+      if (i > 0 && bounds[i - 1] == edge) {
+        continue;
+      }
+      memmove(&bounds[i + 1], &bounds[i], (num_bounds - i) * sizeof(size_t));
+      bounds[i] = edge;
+      ++num_bounds;
+    }
+  }
+
+  // Assign each interval between boundaries to its owner. Like the
+  // linear scan this replaces, the allocator with the lowest index wins.
+  // Readers that loaded the sequence before the last publish may still
+  // be in this table, and retry once they see the odd sequence.
+  hshm::size_t seq = range_seq_.load() + 1;
+  range_seq_.store(seq);
+  hipc::full_fence();
+  AllocatorRangeTable &table = range_tables_[(seq / 2 + 1) % 2];
+  table.count_ = 0;
+  for (size_t i = 0; i + 1 < num_bounds; ++i) {
+    Allocator *owner = nullptr;
+    for (Allocator *alloc : allocators_) {
+      if (alloc && alloc->ContainsPtr(reinterpret_cast<char *>(bounds[i]))) {
+        owner = alloc;
+        break;
+      }
+    }
+    if (owner == nullptr) {
+      continue;
+    }
+    if (table.count_ > 0) {
+      AllocatorRange &prev = table.ranges_[table.count_ - 1];
+      if (prev.alloc_ == owner && prev.end_ == bounds[i]) {
+        prev.end_ = bounds[i + 1];
+        continue;
+      }
+    }
+    table.ranges_[table.count_++] = {bounds[i], bounds[i + 1], owner};
+  }
+  range_seq_.store(seq + 1);
+}
+
 }  // namespace hshm::ipc
 
 // TODO(llogan): Fix. A hack for HIP compiler to function
@@ -10,6 +10,13 @@
  * have access to the file, you may request a copy from help@hdfgroup.org.   *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <set>
+
+#include "hermes_shm/data_structures/ipc/list.h"
+#include "hermes_shm/memory/allocator/stack_arena.h"
 #include "test_init.h"
 
 TEST_CASE("FullPtr") {
@@ -28,17 +35,142 @@ TEST_CASE("FullPtr") {
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
+TEST_CASE("ConvertRawPointer") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  // Pointers inside the nested sub-allocator map to the outer allocator
+  std::vector<hipc::FullPtr<char>> ptrs;
+  for (size_t size = 64; size <= hshm::Unit<size_t>::Megabytes(1);
+       size *= 4) {
+    ptrs.emplace_back(
+        alloc->AllocateLocalPtr<char>(HSHM_DEFAULT_MEM_CTX, size));
+  }
+  for (hipc::FullPtr<char> &p : ptrs) {
+    REQUIRE(mem_mngr->Convert(p.ptr_) == p.shm_);
+    REQUIRE(mem_mngr->FindAllocator(p.ptr_) == alloc);
+    alloc->FreeLocalPtr(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  // Pointers owned by no allocator are null
+  int local;
+  REQUIRE(mem_mngr->Convert(&local).IsNull());
+  // The root allocator is still indexed
+  auto root = mem_mngr->GetRootAllocator<HSHM_ROOT_ALLOC_T>();
+  hipc::FullPtr<int> root_ptr = root->NewObjLocal<int>(HSHM_DEFAULT_MEM_CTX);
+  REQUIRE(mem_mngr->Convert(root_ptr.ptr_) == root_ptr.shm_);
+  root->DelObjLocal(HSHM_DEFAULT_MEM_CTX, root_ptr);
+  // Unregistered allocators are removed from the index
+  char *inside = alloc->buffer_;
+  REQUIRE(mem_mngr->FindAllocator(inside) == alloc);
+  mem_mngr->UnregisterAllocator(alloc->GetId());
+  REQUIRE(mem_mngr->FindAllocator(inside) != alloc);
+  mem_mngr->RegisterAllocator(alloc);
+  REQUIRE(mem_mngr->FindAllocator(inside) == alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
 TEST_CASE("StackAllocator") {
   auto alloc = Pretest<hipc::PosixShmMmap, hipc::StackAllocator>();
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Workloads<hipc::StackAllocator>::PageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::StackAllocator>::AlignedAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::StackAllocator>::BatchAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
+TEST_CASE("StackAllocatorRollback") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::StackAllocator>();
+  hipc::StackMark base = alloc->Mark();
+
+  // Nested frames free their allocations in O(1)
+  Pointer outer, inner;
+  {
+    hipc::ScopedStackFrame<hipc::StackAllocator> frame(*alloc);
+    outer = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 1024);
+    {
+      hipc::ScopedStackFrame<hipc::StackAllocator> nested(*alloc);
+      inner = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 4096);
+      REQUIRE(inner.off_.load() > outer.off_.load());
+    }
+    // The space of the nested frame is reused
+    Pointer again = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 4096);
+    REQUIRE(again == inner);
+  }
+  REQUIRE(alloc->Mark().heap_off_ == base.heap_off_);
+  REQUIRE(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 1024) == outer);
+
+  // A mark above the top of the stack is ignored
+  hipc::StackMark top = alloc->Mark();
+  alloc->Rollback(base);
+  alloc->Rollback(top);
+  REQUIRE(alloc->Mark().heap_off_ == base.heap_off_);
+
+  // Arenas bump within chunks carved from the stack
+  size_t chunk_size = hshm::Unit<size_t>::Kilobytes(16);
+  hipc::StackArena arena(alloc, chunk_size);
+  std::vector<hipc::FullPtr<char>> ps;
+  for (size_t i = 0; i < 64; ++i) {
+    ps.emplace_back(arena.Allocate(1000, 64));
+    REQUIRE(((size_t)ps.back().ptr_ & 63) == 0);
+    REQUIRE(alloc->Convert<char>(ps.back().shm_) == ps.back().ptr_);
+    memset(ps.back().ptr_, (int)i, 1000);
+  }
+  for (size_t i = 0; i < 64; ++i) {
+    REQUIRE(ps[i].ptr_[0] == (char)i);
+    REQUIRE(ps[i].ptr_[999] == (char)i);
+  }
+  hipc::StackMark carved = alloc->Mark();
+
+  // Rolling the arena back reuses its chunks without carving more
+  for (int round = 0; round < 4; ++round) {
+    hipc::ScopedStackFrame<hipc::StackArena> frame(arena);
+    hipc::FullPtr<char> big = arena.Allocate(chunk_size * 2);
+    memset(big.ptr_, round, chunk_size * 2);
+    for (size_t i = 0; i < 64; ++i) {
+      arena.Allocate(1000);
+    }
+  }
+  hipc::StackMark after = alloc->Mark();
+  arena.Reset();
+  for (size_t i = 0; i < 64; ++i) {
+    REQUIRE(arena.Allocate(1000, 64) == ps[i]);
+  }
+  REQUIRE(alloc->Mark().heap_off_ == after.heap_off_);
+  REQUIRE(after.heap_off_ > carved.heap_off_);
+
+  // Rolling the stack back returns the chunks of the arena
+  alloc->Rollback(base);
+  REQUIRE(alloc->Mark().heap_off_ == base.heap_off_);
+
+  // Aligned allocations that do not fit fail without moving the stack
+  size_t heap_size = hshm::Unit<size_t>::Gigabytes(1);
+  REQUIRE(alloc->AlignedAllocateOffset(HSHM_DEFAULT_MEM_CTX, heap_size, 64)
+              .IsNull());
+  REQUIRE(alloc->AlignedAllocateOffset(HSHM_DEFAULT_MEM_CTX, (size_t)-1, 64)
+              .IsNull());
+  REQUIRE(alloc->Mark().heap_off_ == base.heap_off_);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Posttest();
 }
 
 TEST_CASE("MallocAllocator") {
   auto alloc = Pretest<hipc::MallocBackend, hipc::MallocAllocator>();
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  // Aligned allocations that cannot be satisfied fail
+  size_t huge = (size_t)1 << 62;
+  REQUIRE(alloc->AlignedAllocateOffset(HSHM_DEFAULT_MEM_CTX, huge, 64)
+              .IsNull());
+  REQUIRE(alloc->AlignedAllocateOffset(HSHM_DEFAULT_MEM_CTX, (size_t)-1, 64)
+              .IsNull());
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Workloads<hipc::MallocAllocator>::PageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 
@@ -55,6 +187,14 @@ TEST_CASE("ScalablePageAllocator") {
   Workloads<hipc::ScalablePageAllocator>::PageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ScalablePageAllocator>::AlignedAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ScalablePageAllocator>::BatchAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Workloads<hipc::ScalablePageAllocator>::MultiPageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
@@ -63,15 +203,85 @@ TEST_CASE("ScalablePageAllocator") {
   Workloads<hipc::ScalablePageAllocator>::ReallocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ScalablePageAllocator>::InPlaceReallocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ScalablePageAllocator>::LargePageAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  Posttest();
+}
+
+TEST_CASE("ScalablePageAllocatorReuse") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  size_t count = 1024;
+  std::vector<size_t> sizes = {64, 100, 4096, 5000};
+  std::set<size_t> offs;
+
+  // Freed pages should be re-used, whether cached by this thread or not
+  for (int round = 0; round < 2; ++round) {
+    std::vector<hipc::Pointer> ps;
+    for (size_t i = 0; i < count; ++i) {
+      size_t size = sizes[i % sizes.size()];
+      hipc::Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+      if (round == 0) {
+        offs.emplace(p.off_.load());
+      } else {
+        REQUIRE(offs.find(p.off_.load()) != offs.end());
+      }
+      ps.emplace_back(p);
+    }
+    for (hipc::Pointer &p : ps) {
+      alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+    }
+    REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+    // Return the cached pages to the shared free lists
+    alloc->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  }
   Posttest();
 }
 
+TEST_CASE("ScalablePageAllocatorBatchRollback") {
+  // Batches of cached and of large pages that do not fit in the backend
+  std::vector<std::pair<size_t, size_t>> batches = {
+      {hshm::Unit<size_t>::Megabytes(1), 1200},
+      {hshm::Unit<size_t>::Megabytes(64), 20}};
+  for (auto &[size, count] : batches) {
+    auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+    std::vector<Pointer> ps(count);
+    REQUIRE_THROWS(
+        alloc->AllocateBatch(HSHM_DEFAULT_MEM_CTX, size, count, ps.data()));
+    for (size_t i = 0; i < count; ++i) {
+      REQUIRE(ps[i].IsNull());
+    }
+    REQUIRE(alloc->GetStats().bytes_in_use_ == 0);
+    REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+    // The memory of the failed batch can be allocated again
+    size_t fits = count / 2;
+    alloc->AllocateBatch(HSHM_DEFAULT_MEM_CTX, size, fits, ps.data());
+    alloc->FreeBatch(HSHM_DEFAULT_MEM_CTX, ps.data(), fits);
+    REQUIRE(alloc->GetStats().bytes_in_use_ == 0);
+    Posttest();
+  }
+}
+
 TEST_CASE("ThreadLocalAllocator") {
   auto alloc = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Workloads<hipc::ThreadLocalAllocator>::PageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ThreadLocalAllocator>::AlignedAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ThreadLocalAllocator>::BatchAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   Workloads<hipc::ThreadLocalAllocator>::MultiPageAllocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
@@ -80,9 +290,512 @@ TEST_CASE("ThreadLocalAllocator") {
   Workloads<hipc::ThreadLocalAllocator>::ReallocationTest(alloc);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ThreadLocalAllocator>::InPlaceReallocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Workloads<hipc::ThreadLocalAllocator>::LargePageAllocationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
   Posttest();
 }
 
+TEST_CASE("SlabAllocator") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::SlabAllocator>();
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  size_t count = 4096;
+  std::vector<hipc::FullPtr<char>> ptrs;
+  std::set<size_t> offs;
+
+  // Objects of every size class do not overlap
+  for (int round = 0; round < 2; ++round) {
+    for (size_t i = 0; i < count; ++i) {
+      size_t size = 1 + (i * 7) % hipc::_SlabAllocator::max_obj_size_;
+      hipc::FullPtr<char> p =
+          alloc->AllocateLocalPtr<char>(HSHM_DEFAULT_MEM_CTX, size);
+      memset(p.ptr_, (char)i, size);
+      if (round == 0) {
+        offs.emplace(p.shm_.off_.load());
+      } else {
+        // Freed objects are re-used
+        REQUIRE(offs.find(p.shm_.off_.load()) != offs.end());
+      }
+      ptrs.emplace_back(p);
+    }
+    for (size_t i = 0; i < count; ++i) {
+      size_t size = 1 + (i * 7) % hipc::_SlabAllocator::max_obj_size_;
+      REQUIRE(ptrs[i].ptr_[0] == (char)i);
+      REQUIRE(ptrs[i].ptr_[size - 1] == (char)i);
+      alloc->FreeLocalPtr(HSHM_DEFAULT_MEM_CTX, ptrs[i]);
+    }
+    REQUIRE(offs.size() == count);
+    ptrs.clear();
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+
+  // Aligned objects
+  for (size_t align = 8; align <= 64; align *= 2) {
+    hipc::Pointer p = alloc->AlignedAllocate(HSHM_DEFAULT_MEM_CTX, 100, align);
+    REQUIRE(reinterpret_cast<size_t>(alloc->Convert<char>(p)) % align == 0);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+
+  // Batches
+  std::vector<hipc::Pointer> batch(256);
+  alloc->AllocateBatch(HSHM_DEFAULT_MEM_CTX, 48, batch.size(), batch.data());
+  alloc->FreeBatch(HSHM_DEFAULT_MEM_CTX, batch.data(), batch.size());
+
+  // Objects that are too large, misaligned frees, and double frees throw
+  REQUIRE_THROWS(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 1025));
+  hipc::Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 64);
+  hipc::Pointer mid = p;
+  mid.off_ += 8;
+  REQUIRE_THROWS(alloc->Free(HSHM_DEFAULT_MEM_CTX, mid));
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  REQUIRE_THROWS(alloc->Free(HSHM_DEFAULT_MEM_CTX, p));
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
+TEST_CASE("SlabAllocatorAttach") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::SlabAllocator>();
+  // A second instance, as another process would create, shares the slabs
+  auto other = static_cast<hipc::SlabAllocator *>(
+      hipc::AllocatorFactory::shm_attach(alloc));
+  REQUIRE(other != nullptr);
+  REQUIRE(other->type_ == hipc::AllocatorType::kSlabAllocator);
+  REQUIRE(other->GetId() == alloc->GetId());
+  std::vector<hipc::Pointer> ps;
+  for (size_t i = 0; i < 1024; ++i) {
+    ps.emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32));
+    ps.emplace_back(other->Allocate(HSHM_DEFAULT_MEM_CTX, 32));
+  }
+  std::set<size_t> offs;
+  for (hipc::Pointer &p : ps) {
+    offs.emplace(p.off_.load());
+  }
+  REQUIRE(offs.size() == ps.size());
+  // Each instance frees the other's objects
+  for (size_t i = 0; i < ps.size(); ++i) {
+    if (i % 2) {
+      alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+    } else {
+      other->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+    }
+  }
+  other->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  HSHM_ROOT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, other);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
+TEST_CASE("SlabAllocatorList") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::SlabAllocator>();
+  // Node-based containers opt in through their allocator parameter
+  {
+    hipc::list<int, hipc::SlabAllocator> list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+      list.emplace_back(i);
+    }
+    int i = 0;
+    for (int x : list) {
+      REQUIRE(x == i++);
+    }
+    REQUIRE(i == 1000);
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
+TEST_CASE("PageSizeClasses") {
+  // Small sizes round to the 16-byte tiny classes
+  REQUIRE(hipc::PageId(1).class_ == 0);
+  REQUIRE(hipc::PageId(1).round_ == hipc::PageId::min_cached_size_);
+  REQUIRE(hipc::PageId(17).round_ == 32);
+  REQUIRE(hipc::PageId(64).round_ == 64);
+  // Sizes just above a power of two round up by at most 25%
+  REQUIRE(hipc::PageId(65).round_ == 80);
+  REQUIRE(hipc::PageId(1025).round_ == 1280);
+  REQUIRE(hipc::PageId(1280).round_ == 1280);
+  REQUIRE(hipc::PageId(1281).round_ == 1536);
+  REQUIRE(hipc::PageId(2048).round_ == 2048);
+  // Only objects up to max_small_size_ are carved from chunks
+  REQUIRE(hipc::PageId(hipc::PageId::max_small_size_).IsSmall());
+  REQUIRE(!hipc::PageId(hipc::PageId::max_small_size_ + 1).IsSmall());
+  // Every size maps to the smallest class that fits it
+  size_t prev_class = 0;
+  for (size_t size = 1; size <= hshm::Unit<size_t>::Megabytes(1); ++size) {
+    hipc::PageId page_id(size);
+    REQUIRE(page_id.class_ < hipc::PageId::num_caches_);
+    REQUIRE(page_id.round_ >= size);
+    REQUIRE(page_id.round_ % hipc::PageId::min_alignment_ == 0);
+    REQUIRE(page_id.class_ >= prev_class);
+    if (page_id.class_ > 0) {
+      REQUIRE(hipc::PageId::table_.sizes_[page_id.class_ - 1] < size);
+    }
+    // Freed pages map back to the same class
+    REQUIRE(hipc::PageId(page_id.round_).class_ == page_id.class_);
+    prev_class = page_id.class_;
+  }
+  // The largest cached size and beyond
+  hipc::PageId max_id(hipc::PageId::max_cached_size_);
+  REQUIRE(max_id.class_ == hipc::PageId::num_caches_ - 1);
+  REQUIRE(max_id.round_ == hipc::PageId::max_cached_size_);
+  hipc::PageId big_id(hipc::PageId::max_cached_size_ + 1);
+  REQUIRE(big_id.class_ == hipc::PageId::num_caches_);
+  REQUIRE(big_id.round_ == hipc::PageId::max_cached_size_ + 1);
+}
+
+template <typename AllocT>
+void SmallObjectTest(AllocT *alloc) {
+  // Objects of a class are packed back to back without a header
+  size_t count = 256;
+  std::vector<Pointer> ps(count);
+  for (size_t i = 0; i < count; ++i) {
+    ps[i] = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32);
+    REQUIRE((size_t)alloc->template Convert<char>(ps[i]) % 16 == 0);
+    REQUIRE(alloc->GetUsableSize(ps[i].ToOffsetPointer()) == 32);
+    REQUIRE(alloc->IsAllocated(ps[i].ToOffsetPointer()));
+  }
+  size_t packed = 0;
+  for (size_t i = 1; i < count; ++i) {
+    packed += ps[i].off_.load() == ps[i - 1].off_.load() + 32;
+  }
+  REQUIRE(packed >= count - 2);
+  for (size_t i = 0; i < count; ++i) {
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+    REQUIRE(!alloc->IsAllocated(ps[i].ToOffsetPointer()));
+  }
+  REQUIRE_THROWS(alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[0]));
+
+  // Aligned small objects are aligned within the object
+  Pointer p = alloc->AlignedAllocate(HSHM_DEFAULT_MEM_CTX, 100, 256);
+  REQUIRE((size_t)alloc->template Convert<char>(p) % 256 == 0);
+  REQUIRE(alloc->GetUsableSize(p.ToOffsetPointer()) >= 100);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+
+  // Small objects grow into headed pages
+  p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 1000);
+  memset(alloc->template Convert<char>(p), 7, 1000);
+  alloc->Reallocate(HSHM_DEFAULT_MEM_CTX, p, 5000);
+  REQUIRE(alloc->template Convert<char>(p)[999] == 7);
+  REQUIRE(alloc->GetUsableSize(p.ToOffsetPointer()) >= 5000);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("PageAllocatorSmallObjects") {
+  auto spa = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  SmallObjectTest(spa);
+  Posttest();
+  auto tla = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
+  SmallObjectTest(tla);
+  Posttest();
+}
+
+template <typename AllocT>
+void TrimTest(AllocT *alloc) {
+  size_t mb = hshm::Unit<size_t>::Megabytes(1);
+  size_t reserved = alloc->GetStats().bytes_reserved_;
+
+  // A burst of pages at the top of the heap is given back entirely
+  std::vector<Pointer> ps(64);
+  for (Pointer &p : ps) {
+    p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, mb);
+    memset(alloc->template Convert<char>(p), 1, mb);
+  }
+  Pointer large = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32 * mb);
+  size_t burst_end = alloc->GetStats().bytes_reserved_;
+  REQUIRE(burst_end >= reserved + 96 * mb);
+  for (Pointer &p : ps) {
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, large);
+  REQUIRE(alloc->Trim(HSHM_DEFAULT_MEM_CTX) >= 64 * (mb - 4096));
+  REQUIRE(alloc->GetStats().bytes_reserved_ < reserved + 2 * mb);
+
+  // Another size class reuses the space
+  Pointer other = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 3 * mb);
+  REQUIRE(other.off_.load() < ps[0].off_.load() + 3 * mb);
+
+  // A cached page below the top stays cached with its payload discarded
+  Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, mb);
+  Pointer top = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 2 * mb);
+  memset(alloc->template Convert<char>(p), 1, mb);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  size_t before = alloc->GetStats().bytes_reserved_;
+  REQUIRE(alloc->Trim(HSHM_DEFAULT_MEM_CTX) >= mb - 8192);
+  REQUIRE(alloc->GetStats().bytes_reserved_ == before);
+  Pointer again = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, mb);
+  REQUIRE(again == p);
+  REQUIRE(alloc->template Convert<char>(again)[mb / 2] == 0);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, again);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, top);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, other);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("AllocatorTrim") {
+  auto spa = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  TrimTest(spa);
+  Posttest();
+  auto tla = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
+  TrimTest(tla);
+  Posttest();
+}
+
+TEST_CASE("AllocatorStats") {
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::SlabAllocator>();
+  REQUIRE(alloc->GetStats().bytes_in_use_ == 0);
+  std::vector<Pointer> ps;
+  for (size_t i = 0; i < 100; ++i) {
+    ps.emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32));
+  }
+  for (size_t i = 0; i < 50; ++i) {
+    ps.emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 100));
+  }
+  hipc::AllocatorStats stats = alloc->GetStats();
+  REQUIRE(stats.allocs_[hipc::AllocatorStatsSlot::GetClass(32)] == 100);
+  REQUIRE(stats.allocs_[hipc::AllocatorStatsSlot::GetClass(104)] == 50);
+  REQUIRE(stats.bytes_in_use_ == 100 * 32 + 50 * 104);
+  REQUIRE(stats.bytes_reserved_ >= stats.bytes_in_use_);
+  REQUIRE(stats.bytes_cached_ ==
+          stats.bytes_reserved_ - stats.bytes_in_use_);
+  REQUIRE(stats.peak_bytes_ == stats.bytes_in_use_);
+  REQUIRE(stats.threads_.size() == 1);
+  REQUIRE(stats.threads_[0].active_);
+  REQUIRE(stats.threads_[0].allocs_ == 150);
+
+  // Another instance, as another process would create, reads the same
+  // counters and counts its own allocations in a separate slot
+  auto other = static_cast<hipc::SlabAllocator *>(
+      hipc::AllocatorFactory::shm_attach(alloc));
+  REQUIRE(other->GetStats().bytes_in_use_ == stats.bytes_in_use_);
+  Pointer p = other->Allocate(HSHM_DEFAULT_MEM_CTX, 32);
+  REQUIRE(alloc->GetStats().threads_.size() == 2);
+  other->Free(HSHM_DEFAULT_MEM_CTX, p);
+  other->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  HSHM_ROOT_ALLOC->DelObj(HSHM_DEFAULT_MEM_CTX, other);
+
+  // Freed memory stays reserved and shows up as cached
+  for (Pointer &p : ps) {
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  stats = alloc->GetStats();
+  REQUIRE(stats.bytes_in_use_ == 0);
+  REQUIRE(stats.bytes_cached_ == stats.bytes_reserved_);
+  REQUIRE(stats.fragmentation_ == 1);
+  REQUIRE(stats.peak_bytes_ >= 100 * 32 + 50 * 104);
+  REQUIRE(stats.frees_[hipc::AllocatorStatsSlot::GetClass(32)] == 101);
+
+  // A burst freed before the next snapshot still raises the peak
+  ps.clear();
+  for (size_t i = 0; i < 400; ++i) {
+    ps.emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 64));
+  }
+  for (Pointer &p : ps) {
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  stats = alloc->GetStats();
+  REQUIRE(stats.bytes_in_use_ == 0);
+  REQUIRE(stats.peak_bytes_ >= 400 * 64);
+  alloc->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  REQUIRE(!alloc->GetStats().threads_[0].active_);
+  Posttest();
+}
+
+template <typename AllocT>
+void GrowableBackendTest(AllocT *alloc) {
+  auto backend = hipc::GrowableShmMmap::Get(
+      HSHM_MEMORY_MANAGER->GetBackend(hipc::MemoryBackendId::Get(0)));
+  REQUIRE(backend != nullptr);
+  size_t initial = backend->GetCommittedSize();
+  size_t mb = hshm::Unit<size_t>::Megabytes(1);
+  size_t size = 100 * 1024;
+  size_t count = 2 * initial / size;
+  std::vector<Pointer> ps(count);
+  for (size_t i = 0; i < count; ++i) {
+    ps[i] = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+    REQUIRE(!ps[i].IsNull());
+    memset(alloc->template Convert<char>(ps[i]), (char)i, size);
+  }
+  REQUIRE(backend->GetCommittedSize() > initial);
+  for (size_t i = 0; i < count; ++i) {
+    REQUIRE(alloc->template Convert<char>(ps[i])[size - 1] == (char)i);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+  }
+  Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, mb);
+  memset(alloc->template Convert<char>(p), 0, mb);
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("GrowableBackend") {
+  auto spa = Pretest<hipc::GrowableShmMmap, hipc::ScalablePageAllocator>();
+  GrowableBackendTest(spa);
+  Workloads<hipc::ScalablePageAllocator>::MultiPageAllocationTest(spa);
+  Posttest();
+  auto tla = Pretest<hipc::GrowableShmMmap, hipc::ThreadLocalAllocator>();
+  GrowableBackendTest(tla);
+  Posttest();
+  auto slab = Pretest<hipc::GrowableShmMmap, hipc::SlabAllocator>();
+  std::vector<Pointer> ps;
+  for (size_t i = 0; i < 1000000; ++i) {
+    ps.emplace_back(slab->Allocate(HSHM_DEFAULT_MEM_CTX, 128));
+    memset(slab->Convert<char>(ps.back()), 1, 128);
+  }
+  for (Pointer &p : ps) {
+    slab->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  slab->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  REQUIRE(slab->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+}
+
+/** What a crashed process left in a persistent heap */
+struct RecoveryHeader {
+  size_t count_;
+  size_t idx_[256];  /**< The iteration each allocation was made in */
+  Pointer ps_[256];  /**< The allocations that were not freed */
+  Pointer retired_;  /**< An allocation retired to the epoch manager */
+};
+
+/** The size allocated in iteration \a i of the recovery test */
+static size_t RecoverySize(size_t i) {
+  std::vector<size_t> sizes = {64, 100, 1000, 4096, 5000,
+                               hshm::Unit<size_t>::Megabytes(20)};
+  return i < sizes.size() ? sizes[i] : sizes[i % (sizes.size() - 1)];
+}
+
+/** Whether the recovery test keeps the allocation of iteration \a i */
+static bool IsRecoveryKept(size_t i) { return i % 16 == 0 || i < 6; }
+
+TEST_CASE("ScalablePageAllocatorRecovery") {
+  std::string path = "/tmp/test_allocators_recovery";
+  AllocatorId alloc_id(1, 0);
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  mem_mngr->UnregisterAllocator(alloc_id);
+  mem_mngr->DestroyBackend(hipc::MemoryBackendId::Get(0));
+  size_t count = 2048;
+
+  // The child fills a persistent heap and exits without detaching
+  pid_t pid = fork();
+  if (pid == 0) {
+    try {
+      mem_mngr->CreateBackendWithUrl<hipc::PosixFileMmap>(
+          hipc::MemoryBackendId::Get(0), hshm::Unit<size_t>::Megabytes(256),
+          path);
+      auto alloc = mem_mngr->CreateAllocator<hipc::ScalablePageAllocator>(
+          hipc::MemoryBackendId::Get(0), alloc_id, sizeof(RecoveryHeader));
+      auto hdr = alloc->GetCustomHeader<RecoveryHeader>();
+      hdr->count_ = 0;
+      std::vector<Pointer> freed;
+      for (size_t i = 0; i < count; ++i) {
+        size_t size = RecoverySize(i);
+        Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+        memset(alloc->Convert<char>(p), (char)i, size);
+        if (IsRecoveryKept(i)) {
+          hdr->idx_[hdr->count_] = i;
+          hdr->ps_[hdr->count_++] = p;
+        } else {
+          freed.emplace_back(p);
+        }
+      }
+      // Most of these stay cached by this thread
+      for (Pointer &p : freed) {
+        alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+      }
+      hdr->retired_ = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 256);
+      alloc->Retire(HSHM_DEFAULT_MEM_CTX, hdr->retired_);
+    } catch (...) {
+      _exit(1);
+    }
+    _exit(0);
+  }
+  int status;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+
+  // Attaching recovers the allocator
+  MemoryBackend *backend =
+      mem_mngr->AttachBackend(MemoryBackendType::kPosixFileMmap, path);
+  REQUIRE(!backend->NeedsRecovery());
+  auto alloc = mem_mngr->GetAllocator<hipc::ScalablePageAllocator>(alloc_id);
+  REQUIRE(alloc != nullptr);
+  auto hdr = alloc->GetCustomHeader<RecoveryHeader>();
+  REQUIRE(!alloc->IsAllocated(hdr->retired_.ToOffsetPointer()));
+  for (size_t k = 0; k < hdr->count_; ++k) {
+    REQUIRE(alloc->IsAllocated(hdr->ps_[k].ToOffsetPointer()));
+  }
+
+  // Freed memory is reused without touching the surviving allocations
+  size_t reserved = alloc->GetStats().bytes_reserved_;
+  std::vector<Pointer> ps;
+  for (size_t i = 0; i < count; ++i) {
+    if (IsRecoveryKept(i)) {
+      continue;
+    }
+    size_t size = RecoverySize(i);
+    ps.emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size));
+    memset(alloc->Convert<char>(ps.back()), -1, size);
+  }
+  REQUIRE(alloc->GetStats().bytes_reserved_ == reserved);
+  for (size_t k = 0; k < hdr->count_; ++k) {
+    size_t i = hdr->idx_[k];
+    char *ptr = alloc->Convert<char>(hdr->ps_[k]);
+    REQUIRE(VerifyBuffer(ptr, RecoverySize(i), (char)i));
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, hdr->ps_[k]);
+  }
+  for (Pointer &p : ps) {
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  mem_mngr->UnregisterAllocator(alloc_id);
+  mem_mngr->DestroyBackend(hipc::MemoryBackendId::Get(0));
+  hshm::SystemInfo::DestroyFileMemory(path);
+}
+
+TEST_CASE("StackAllocatorRecovery") {
+  std::string path = "/tmp/test_allocators_recovery";
+  AllocatorId alloc_id(1, 0);
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  mem_mngr->UnregisterAllocator(alloc_id);
+  mem_mngr->DestroyBackend(hipc::MemoryBackendId::Get(0));
+
+  // The child crashes while using an allocator that cannot recover
+  pid_t pid = fork();
+  if (pid == 0) {
+    try {
+      mem_mngr->CreateBackendWithUrl<hipc::PosixFileMmap>(
+          hipc::MemoryBackendId::Get(0), hshm::Unit<size_t>::Megabytes(16),
+          path);
+      auto alloc = mem_mngr->CreateAllocator<hipc::StackAllocator>(
+          hipc::MemoryBackendId::Get(0), alloc_id, 0);
+      alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 1024);
+    } catch (...) {
+      _exit(1);
+    }
+    _exit(0);
+  }
+  int status;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+
+  // The attach fails, and the heap still needs recovery afterwards
+  REQUIRE_THROWS(
+      mem_mngr->AttachBackend(MemoryBackendType::kPosixFileMmap, path));
+  REQUIRE(mem_mngr->GetBackend(hipc::MemoryBackendId::Get(0)) == nullptr);
+  REQUIRE(mem_mngr->GetAllocator<hipc::StackAllocator>(alloc_id) == nullptr);
+  hipc::PosixFileMmap backend;
+  REQUIRE(backend.shm_deserialize(path));
+  REQUIRE(backend.NeedsRecovery());
+  backend.FinishRecovery();
+  backend.shm_destroy();
+}
+
 TEST_CASE("LocaFullPtrs") {
   auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
@@ -10,6 +10,9 @@
  * have access to the file, you may request a copy from help@hdfgroup.org.   *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <set>
+
+#include "hermes_shm/memory/allocator/stack_arena.h"
 #include "test_init.h"
 
 #ifdef HSHM_ENABLE_OPENMP
@@ -45,6 +48,41 @@ TEST_CASE("StackAllocatorMultithreaded") {
   HSHM_ERROR_HANDLE_END()
 }
 
+TEST_CASE("StackArenaMultithreaded") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::StackAllocator>();
+  hipc::StackMark base = alloc->Mark();
+  size_t nthreads = 4;
+  std::atomic<size_t> corrupt(0);
+  omp_set_dynamic(0);
+#pragma omp parallel shared(alloc, corrupt) num_threads(nthreads)
+  {
+    size_t rank = omp_get_thread_num();
+    hipc::StackArena arena(alloc, hshm::Unit<size_t>::Kilobytes(64));
+    for (int round = 0; round < 64; ++round) {
+      hipc::ScopedStackFrame<hipc::StackArena> frame(arena);
+      std::vector<hipc::FullPtr<char>> ps;
+      for (size_t i = 0; i < 256; ++i) {
+        size_t size = 64 + (i % 7) * 100;
+        ps.emplace_back(arena.Allocate(size));
+        memset(ps.back().ptr_, (int)(rank + 1), size);
+      }
+      for (size_t i = 0; i < ps.size(); ++i) {
+        size_t size = 64 + (i % 7) * 100;
+        if (ps[i].ptr_[0] != (char)(rank + 1) ||
+            ps[i].ptr_[size - 1] != (char)(rank + 1)) {
+          corrupt += 1;
+        }
+      }
+    }
+  }
+  REQUIRE(corrupt == 0);
+  alloc->Rollback(base);
+  REQUIRE(alloc->Mark().heap_off_ == base.heap_off_);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
 TEST_CASE("ScalablePageAllocatorMultithreaded") {
   HSHM_ERROR_HANDLE_START()
   auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
@@ -54,3 +92,268 @@ TEST_CASE("ScalablePageAllocatorMultithreaded") {
   Posttest();
   HSHM_ERROR_HANDLE_END()
 }
+
+TEST_CASE("ThreadLocalAllocatorRemoteFree") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  size_t count = 1024;
+  std::vector<size_t> sizes = {64, 100, 4096, 5000,
+                               hshm::Unit<size_t>::Megabytes(17)};
+  std::vector<Pointer> ps(count);
+  std::set<size_t> offs;
+  omp_set_dynamic(0);
+#pragma omp parallel shared(alloc, ps, offs) num_threads(2)
+  {
+    int rank = omp_get_thread_num();
+    for (int round = 0; round < 3; ++round) {
+      // Thread 0 allocates the pages
+      if (rank == 0) {
+        for (size_t i = 0; i < count; ++i) {
+          size_t size = sizes[i % sizes.size()];
+          if (size > hshm::Unit<size_t>::Megabytes(1) && i > 16) {
+            size = sizes[0];
+          }
+          ps[i] = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+          if (round == 0) {
+            offs.emplace(ps[i].off_.load());
+          } else {
+            REQUIRE(offs.find(ps[i].off_.load()) != offs.end());
+          }
+        }
+      }
+#pragma omp barrier
+      // Thread 1 frees them, once in a single batch
+      if (rank == 1 && round == 1) {
+        alloc->FreeBatch(HSHM_DEFAULT_MEM_CTX, ps.data(), count);
+      } else if (rank == 1) {
+        for (size_t i = 0; i < count; ++i) {
+          alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+        }
+      }
+#pragma omp barrier
+    }
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
+struct EpochNode {
+  size_t val_;
+  size_t check_;
+};
+
+template <typename AllocT>
+void EpochReclamationTest(AllocT *alloc) {
+  // Retired memory is not freed while this thread pins the epoch
+  Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 64);
+  alloc->EpochEnter(HSHM_DEFAULT_MEM_CTX);
+  alloc->Retire(HSHM_DEFAULT_MEM_CTX, p);
+  for (int i = 0; i < 8; ++i) {
+    alloc->EpochCollect(HSHM_DEFAULT_MEM_CTX);
+  }
+  REQUIRE(alloc->IsAllocated(p.ToOffsetPointer()));
+  alloc->EpochExit(HSHM_DEFAULT_MEM_CTX);
+  for (int i = 0; i < 3; ++i) {
+    REQUIRE(alloc->EpochCollect(HSHM_DEFAULT_MEM_CTX));
+  }
+  REQUIRE(!alloc->IsAllocated(p.ToOffsetPointer()));
+
+  // Readers never observe a node that was reclaimed
+  hipc::atomic<hshm::size_t> shared;
+  Pointer first = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, sizeof(EpochNode));
+  EpochNode *node = alloc->template Convert<EpochNode>(first);
+  node->val_ = 0;
+  node->check_ = ~(size_t)0;
+  shared = first.off_.load();
+  hipc::atomic<hshm::size_t> done;
+  done = 0;
+  size_t nthreads = 4;
+  size_t count = 20000;
+  omp_set_dynamic(0);
+#pragma omp parallel shared(alloc, shared, done) num_threads(nthreads)
+  {
+    int rank = omp_get_thread_num();
+    hipc::MemContext ctx;
+    alloc->CreateTls(ctx);
+    if (rank == 0) {
+      // The writer publishes new nodes and retires the old ones
+      for (size_t i = 1; i <= count; ++i) {
+        Pointer np = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, sizeof(EpochNode));
+        EpochNode *n = alloc->template Convert<EpochNode>(np);
+        n->val_ = i;
+        n->check_ = ~i;
+        hshm::size_t old = shared.exchange(np.off_.load());
+        alloc->Retire(HSHM_DEFAULT_MEM_CTX, Pointer(alloc->GetId(), old));
+      }
+      done = 1;
+    } else {
+      // Readers validate whatever node is currently published
+      while (done.load() == 0) {
+        hipc::ScopedEpoch<AllocT> epoch(alloc);
+        Pointer rp(alloc->GetId(), shared.load());
+        EpochNode *n = alloc->template Convert<EpochNode>(rp);
+        size_t val = n->val_;
+        REQUIRE(n->check_ == ~val);
+        REQUIRE(alloc->IsAllocated(rp.ToOffsetPointer()));
+      }
+    }
+#pragma omp barrier
+    alloc->FreeTls(ctx);
+  }
+  Pointer last(alloc->GetId(), shared.load());
+  alloc->Free(HSHM_DEFAULT_MEM_CTX, last);
+  for (int i = 0; i < 3; ++i) {
+    REQUIRE(alloc->EpochCollect(HSHM_DEFAULT_MEM_CTX));
+  }
+}
+
+TEST_CASE("SlabAllocatorRemoteFree") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::SlabAllocator>();
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  size_t nthreads = 4;
+  size_t count = 8192;
+  std::vector<std::vector<Pointer>> ps(nthreads);
+  std::atomic<size_t> corrupt(0);
+  omp_set_dynamic(0);
+#pragma omp parallel shared(alloc, ps, corrupt) num_threads(nthreads)
+  {
+    size_t rank = omp_get_thread_num();
+    for (int round = 0; round < 4; ++round) {
+      // Each thread fills slabs of its own
+      for (size_t i = 0; i < count; ++i) {
+        size_t size = 8 + (i % 16) * 24;
+        Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+        memset(alloc->Convert<char>(p), (char)rank, size);
+        ps[rank].emplace_back(p);
+      }
+#pragma omp barrier
+      // And frees the objects of its neighbor
+      std::vector<Pointer> &other = ps[(rank + 1) % nthreads];
+      for (size_t i = 0; i < count; ++i) {
+        char *ptr = alloc->Convert<char>(other[i]);
+        if (*ptr != (char)((rank + 1) % nthreads)) {
+          corrupt += 1;
+        }
+        alloc->Free(HSHM_DEFAULT_MEM_CTX, other[i]);
+      }
+#pragma omp barrier
+      ps[rank].clear();
+#pragma omp barrier
+    }
+    alloc->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  }
+  REQUIRE(corrupt == 0);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
+TEST_CASE("ScalablePageAllocatorEpoch") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  EpochReclamationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
+TEST_CASE("ThreadLocalAllocatorEpoch") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
+  EpochReclamationTest(alloc);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
+template <typename AllocT>
+void AllocatorStatsTest(AllocT *alloc) {
+  size_t nthreads = 4;
+  size_t count = 1000;
+  std::vector<std::vector<Pointer>> ps(nthreads);
+  omp_set_dynamic(0);
+#pragma omp parallel shared(alloc, ps) num_threads(nthreads)
+  {
+    size_t rank = omp_get_thread_num();
+    for (size_t i = 0; i < count; ++i) {
+      ps[rank].emplace_back(alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 64));
+    }
+#pragma omp barrier
+    if (rank == 0) {
+      hipc::AllocatorStats stats = alloc->GetStats();
+      REQUIRE(stats.bytes_in_use_ == nthreads * count * 64);
+      REQUIRE(stats.threads_.size() == nthreads);
+      for (hipc::AllocatorThreadStats &thread : stats.threads_) {
+        REQUIRE(thread.active_);
+        REQUIRE(thread.allocs_ == count);
+        REQUIRE(thread.peak_ == count * 64);
+      }
+    }
+#pragma omp barrier
+    // Each thread frees the objects of its neighbor
+    for (Pointer &p : ps[(rank + 1) % nthreads]) {
+      alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+    }
+#pragma omp barrier
+    alloc->FreeTls(HSHM_DEFAULT_MEM_CTX);
+  }
+  hipc::AllocatorStats stats = alloc->GetStats();
+  size_t allocs = 0, frees = 0;
+  for (size_t i = 0; i < hipc::AllocatorStats::num_classes_; ++i) {
+    allocs += stats.allocs_[i];
+    frees += stats.frees_[i];
+  }
+  REQUIRE(allocs == nthreads * count);
+  REQUIRE(frees == nthreads * count);
+  REQUIRE(stats.bytes_in_use_ == 0);
+  REQUIRE(stats.peak_bytes_ == nthreads * count * 64);
+}
+
+TEST_CASE("AllocatorStatsMultithreaded") {
+  HSHM_ERROR_HANDLE_START()
+  auto spa = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  AllocatorStatsTest(spa);
+  Posttest();
+  auto tla = Pretest<hipc::PosixShmMmap, hipc::ThreadLocalAllocator>();
+  AllocatorStatsTest(tla);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
+
+TEST_CASE("ConvertRawPointerMultithreaded") {
+  HSHM_ERROR_HANDLE_START()
+  auto alloc = Pretest<hipc::PosixShmMmap, hipc::ScalablePageAllocator>();
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  hipc::AllocatorId id = alloc->GetId();
+  hipc::AllocatorId sub_id(id.bits_.major_, id.bits_.minor_ + 1);
+  hipc::Allocator *sub = mem_mngr->GetAllocator<hipc::Allocator>(sub_id);
+  REQUIRE(sub != nullptr);
+  size_t nthreads = 4;
+  std::atomic<size_t> misses(0);
+  omp_set_dynamic(0);
+#pragma omp parallel shared(mem_mngr, sub, misses) num_threads(nthreads)
+  {
+    // Two threads rebuild the index while the others search it
+    size_t rank = omp_get_thread_num();
+    for (size_t i = 0; i < 4096; ++i) {
+      if (rank == 0) {
+        mem_mngr->UnregisterAllocator(sub_id);
+        mem_mngr->RegisterSubAllocator(sub);
+      } else if (rank == 1) {
+        mem_mngr->RegisterSubAllocator(sub);
+      } else {
+        char *ptr = alloc->buffer_ + (i * 4099) % alloc->buffer_size_;
+        if (mem_mngr->FindAllocator(ptr) != alloc) {
+          misses += 1;
+        }
+      }
+    }
+  }
+  REQUIRE(misses == 0);
+  REQUIRE(mem_mngr->GetAllocator<hipc::Allocator>(sub_id) == sub);
+  Posttest();
+  HSHM_ERROR_HANDLE_END()
+}
@@ -0,0 +1,275 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ * Distributed under BSD 3-Clause license.                                   *
+ * Copyright by The HDF Group.                                               *
+ * Copyright by the Illinois Institute of Technology.                        *
+ * All rights reserved.                                                      *
+ *                                                                           *
+ * This file is part of Hermes. The full Hermes copyright notice, including  *
+ * terms governing use, modification, and redistribution, is contained in    *
+ * the COPYING file, which can be found at the top directory. If you do not  *
+ * have access to the file, you may request a copy from help@hdfgroup.org.   *
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "basic_test.h"
+#include "hermes_shm/memory/memory_manager.h"
+
+/** Whether \a ptr was allocated from the preloaded heap */
+static bool InHeap(void *ptr) {
+  hipc::Allocator *alloc = HSHM_MEMORY_MANAGER->FindAllocator(ptr);
+  return alloc && alloc->type_ == hipc::AllocatorType::kThreadLocalAllocator;
+}
+
+/** Whether \a ptr is aligned to \a alignment */
+static bool IsAligned(void *ptr, size_t alignment) {
+  return reinterpret_cast<size_t>(ptr) % alignment == 0;
+}
+
+TEST_CASE("MallocPreloadBasic") {
+  // Allocations come from the heap and are aligned like glibc's
+  for (size_t size = 1; size <= hshm::Unit<size_t>::Megabytes(1); size *= 3) {
+    char *ptr = (char *)malloc(size);
+    REQUIRE(ptr != nullptr);
+    REQUIRE(InHeap(ptr));
+    REQUIRE(IsAligned(ptr, 16));
+    REQUIRE(malloc_usable_size(ptr) >= size);
+    memset(ptr, 1, size);
+    free(ptr);
+  }
+  free(nullptr);
+
+  // Calloc zeroes recycled memory
+  char *dirty = (char *)malloc(1024);
+  memset(dirty, 0xff, 1024);
+  free(dirty);
+  char *zero = (char *)calloc(64, 16);
+  REQUIRE(InHeap(zero));
+  for (size_t i = 0; i < 1024; ++i) {
+    REQUIRE(zero[i] == 0);
+  }
+  free(zero);
+  volatile size_t huge = SIZE_MAX / 2;
+  REQUIRE(calloc(huge, 4) == nullptr);
+  REQUIRE(errno == ENOMEM);
+}
+
+TEST_CASE("MallocPreloadRealloc") {
+  // Growing a block keeps its contents
+  char *ptr = (char *)realloc(nullptr, 64);
+  REQUIRE(InHeap(ptr));
+  for (size_t i = 0; i < 64; ++i) {
+    ptr[i] = (char)i;
+  }
+  ptr = (char *)realloc(ptr, hshm::Unit<size_t>::Kilobytes(100));
+  REQUIRE(InHeap(ptr));
+  for (size_t i = 0; i < 64; ++i) {
+    REQUIRE(ptr[i] == (char)i);
+  }
+
+  // Shrinking a block keeps its prefix
+  ptr = (char *)realloc(ptr, 16);
+  for (size_t i = 0; i < 16; ++i) {
+    REQUIRE(ptr[i] == (char)i);
+  }
+  REQUIRE(realloc(ptr, 0) == nullptr);
+
+  // Overflowing reallocarray fails
+  volatile size_t huge = SIZE_MAX / 2;
+  REQUIRE(reallocarray(nullptr, huge, 4) == nullptr);
+  ptr = (char *)reallocarray(nullptr, 16, 4);
+  REQUIRE(InHeap(ptr));
+  free(ptr);
+}
+
+TEST_CASE("MallocPreloadAligned") {
+  // Alignments up to a page are served by the heap
+  for (size_t align = 32; align <= 4096; align *= 2) {
+    void *ptr = memalign(align, 100);
+    REQUIRE(InHeap(ptr));
+    REQUIRE(IsAligned(ptr, align));
+    free(ptr);
+  }
+  void *ptr;
+  REQUIRE(posix_memalign(&ptr, 256, 1000) == 0);
+  REQUIRE(InHeap(ptr));
+  REQUIRE(IsAligned(ptr, 256));
+  free(ptr);
+  REQUIRE(posix_memalign(&ptr, 3, 1000) == EINVAL);
+
+  // Like glibc, memalign rounds other alignments up to a power of two
+  ptr = memalign(48, 100);
+  REQUIRE(InHeap(ptr));
+  REQUIRE(IsAligned(ptr, 64));
+  free(ptr);
+  ptr = memalign(0, 100);
+  REQUIRE(ptr != nullptr);
+  free(ptr);
+  errno = 0;
+  REQUIRE(memalign(~(size_t)0, 100) == nullptr);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(memalign((size_t)1 << 63, 100) == nullptr);
+  errno = 0;
+  REQUIRE(aligned_alloc(48, 100) == nullptr);
+  REQUIRE(errno == EINVAL);
+  REQUIRE(aligned_alloc(hshm::Unit<size_t>::Terabytes(1), 100) == nullptr);
+  REQUIRE(posix_memalign(&ptr, (size_t)1 << 63, 1000) == EINVAL);
+  ptr = aligned_alloc(64, 128);
+  REQUIRE(IsAligned(ptr, 64));
+  free(ptr);
+  ptr = valloc(10);
+  REQUIRE(IsAligned(ptr, HSHM_SYSTEM_INFO->page_size_));
+  free(ptr);
+  ptr = pvalloc(10);
+  REQUIRE(IsAligned(ptr, HSHM_SYSTEM_INFO->page_size_));
+  REQUIRE(malloc_usable_size(ptr) >= (size_t)HSHM_SYSTEM_INFO->page_size_);
+  free(ptr);
+
+  // Larger alignments fall back to glibc
+  ptr = memalign(hshm::Unit<size_t>::Kilobytes(64), 100);
+  REQUIRE(!InHeap(ptr));
+  REQUIRE(IsAligned(ptr, hshm::Unit<size_t>::Kilobytes(64)));
+  REQUIRE(malloc_usable_size(ptr) >= 100);
+  ptr = realloc(ptr, 200);
+  free(ptr);
+}
+
+TEST_CASE("MallocPreloadOutOfMemory") {
+  // The test heap is smaller than this allocation, so glibc serves it
+  size_t size = hshm::Unit<size_t>::Megabytes(512);
+  char *ptr = (char *)malloc(size);
+  REQUIRE(ptr != nullptr);
+  REQUIRE(!InHeap(ptr));
+  ptr[0] = 1;
+  ptr[size - 1] = 1;
+  free(ptr);
+  REQUIRE(malloc_trim(0) >= 0);
+}
+
+TEST_CASE("MallocPreloadTrim") {
+  // Freed heap pages are returned to the system by malloc_trim
+  size_t size = hshm::Unit<size_t>::Megabytes(1);
+  std::vector<char *> ptrs(32);
+  for (char *&ptr : ptrs) {
+    ptr = (char *)malloc(size);
+    REQUIRE(InHeap(ptr));
+    memset(ptr, 1, size);
+  }
+  for (char *ptr : ptrs) {
+    free(ptr);
+  }
+  REQUIRE(malloc_trim(0) == 1);
+  char *ptr = (char *)malloc(size);
+  REQUIRE(InHeap(ptr));
+  free(ptr);
+}
+
+TEST_CASE("MallocPreloadMultithreaded") {
+  // Threads allocate concurrently and free each other's blocks
+  size_t nthreads = 8;
+  size_t count = 2048;
+  std::vector<std::vector<void *>> blocks(nthreads);
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.emplace_back([&blocks, i, count]() {
+      for (size_t j = 0; j < count; ++j) {
+        size_t size = 16 + (j % 64) * 16;
+        char *ptr = (char *)malloc(size);
+        memset(ptr, (int)i, size);
+        blocks[i].push_back(ptr);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  std::atomic<size_t> misses(0);
+  for (size_t i = 0; i < nthreads; ++i) {
+    threads.emplace_back([&blocks, &misses, i, nthreads]() {
+      for (void *ptr : blocks[(i + 1) % nthreads]) {
+        if (!InHeap(ptr)) {
+          misses += 1;
+        }
+        free(ptr);
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  REQUIRE(misses == 0);
+}
+
+TEST_CASE("MallocPreloadShared") {
+  // The heap is shared memory that another mapping of it sees
+  char *ptr = (char *)malloc(64);
+  REQUIRE(InHeap(ptr));
+  strcpy(ptr, "shared");
+  hipc::MemoryBackend *backend = nullptr;
+  for (int i = 0; i < MAX_BACKENDS && backend == nullptr; ++i) {
+    hipc::MemoryBackend *cur =
+        HSHM_MEMORY_MANAGER->GetBackend(hipc::MemoryBackendId(i));
+    if (cur && cur->data_ <= ptr && ptr < cur->data_ + cur->data_size_) {
+      backend = cur;
+    }
+  }
+  REQUIRE(backend != nullptr);
+  std::string url = "hshm_malloc_" + std::to_string(getpid());
+  int fd = shm_open(url.c_str(), O_RDONLY, 0);
+  REQUIRE(fd >= 0);
+  size_t page_size = HSHM_SYSTEM_INFO->page_size_;
+  size_t off = ptr - backend->data_;
+  char *map = (char *)mmap(nullptr, page_size + off + 64, PROT_READ,
+                           MAP_SHARED, fd, 0);
+  REQUIRE(map != MAP_FAILED);
+  REQUIRE(strcmp(map + page_size + off, "shared") == 0);
+  strcpy(ptr, "updated");
+  REQUIRE(strcmp(map + page_size + off, "updated") == 0);
+  munmap(map, page_size + off + 64);
+  close(fd);
+  free(ptr);
+}
+
+TEST_CASE("MallocPreloadFork") {
+  char *parent = (char *)malloc(128);
+  strcpy(parent, "parent");
+  pid_t pid = fork();
+  REQUIRE(pid >= 0);
+  if (pid == 0) {
+    // The child uses a private copy of the heap
+    int rc = 0;
+    if (strcmp(parent, "parent") != 0) {
+      rc = 1;
+    }
+    strcpy(parent, "child");
+    char *child = (char *)malloc(128);
+    if (!InHeap(child)) {
+      rc = 2;
+    }
+    parent = (char *)realloc(parent, 4096);
+    if (!InHeap(parent) || strcmp(parent, "child") != 0) {
+      rc = 3;
+    }
+    free(parent);
+    free(child);
+    _exit(rc);
+  }
+  int status;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(strcmp(parent, "parent") == 0);
+  free(parent);
+}
@@ -13,6 +13,8 @@
 #ifndef HSHM_TEST_UNIT_ALLOCATORS_TEST_INIT_H_
 #define HSHM_TEST_UNIT_ALLOCATORS_TEST_INIT_H_
 
+#include <random>
+
 #include "basic_test.h"
 #include "hermes_shm/memory/memory_manager.h"
 
@@ -140,16 +142,141 @@ class Workloads {
       char *new_ptr = alloc->template ReallocatePtr<char>(HSHM_DEFAULT_MEM_CTX,
                                                           p, large_size);
       for (size_t i = 0; i < small_size; ++i) {
-        REQUIRE(ptr[i] == 10);
+        REQUIRE(new_ptr[i] == 10);
       }
       memset(new_ptr, 0, large_size);
       alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
     }
   }
 
+  static void InPlaceReallocationTest(AllocT *alloc) {
+    size_t mb = hshm::Unit<size_t>::Megabytes(1);
+
+    // Growing within the rounded size of a page does not move it
+    Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 100);
+    Pointer old_p = p;
+    REQUIRE(alloc->Reallocate(HSHM_DEFAULT_MEM_CTX, p, 104));
+    REQUIRE(p == old_p);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+
+    // A large page absorbs the free page after it
+    Pointer a = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32 * mb);
+    Pointer b = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32 * mb);
+    Pointer c = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 32 * mb);
+    FillLargePage(alloc->template Convert<char>(a), 32 * mb, 1);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, b);
+    old_p = a;
+    char *ptr = alloc->template ReallocatePtr<char>(HSHM_DEFAULT_MEM_CTX, a,
+                                                    60 * mb);
+    REQUIRE(a == old_p);
+    REQUIRE(VerifyLargePage(ptr, 32 * mb, 1));
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, c);
+
+    // Keep growing the page, in place or not, without losing data
+    size_t size = 60 * mb;
+    while (size < 400 * mb) {
+      FillLargePage(ptr, size, 2);
+      size = 5 * size / 4;
+      ptr = alloc->template ReallocatePtr<char>(HSHM_DEFAULT_MEM_CTX, a, size);
+      REQUIRE(VerifyLargePage(ptr, 4 * size / 5, 2));
+    }
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, a);
+  }
+
+  static void BatchAllocationTest(AllocT *alloc) {
+    std::vector<size_t> sizes = {64, 100, hshm::Unit<size_t>::Kilobytes(4),
+                                 hshm::Unit<size_t>::Kilobytes(65)};
+    size_t count = 200;
+    for (int round = 0; round < 2; ++round) {
+      for (size_t size : sizes) {
+        // Allocate a batch of pages
+        std::vector<Pointer> ps(count);
+        alloc->AllocateBatch(HSHM_DEFAULT_MEM_CTX, size, count, ps.data());
+        for (size_t i = 0; i < count; ++i) {
+          REQUIRE(!ps[i].IsNull());
+          REQUIRE(ps[i].alloc_id_ == alloc->GetId());
+          memset(alloc->template Convert<char>(ps[i]), (char)i, size);
+        }
+        // Ensure the pages do not overlap
+        for (size_t i = 0; i < count; ++i) {
+          char *ptr = alloc->template Convert<char>(ps[i]);
+          REQUIRE(VerifyBuffer(ptr, size, (char)i));
+        }
+        // Free the pages
+        alloc->FreeBatch(HSHM_DEFAULT_MEM_CTX, ps.data(), count);
+      }
+    }
+
+    // Offset pointers work too
+    std::vector<hipc::OffsetPointer> offs(count);
+    alloc->AllocateBatch(HSHM_DEFAULT_MEM_CTX, 256, count, offs.data());
+    for (size_t i = 0; i < count; ++i) {
+      REQUIRE(!offs[i].IsNull());
+    }
+    alloc->FreeBatch(HSHM_DEFAULT_MEM_CTX, offs.data(), count);
+  }
+
+  static void FillLargePage(char *ptr, size_t size, char val) {
+    for (size_t i = 0; i < size; i += 4096) {
+      ptr[i] = val;
+    }
+    ptr[size - 1] = val;
+  }
+
+  static bool VerifyLargePage(char *ptr, size_t size, char val) {
+    for (size_t i = 0; i < size; i += 4096) {
+      if (ptr[i] != val) {
+        return false;
+      }
+    }
+    return ptr[size - 1] == val;
+  }
+
+  static void LargePageAllocationTest(AllocT *alloc) {
+    size_t mb = hshm::Unit<size_t>::Megabytes(1);
+
+    // Neighbouring large pages are coalesced and re-used
+    std::vector<Pointer> ps(4);
+    for (size_t i = 0; i < ps.size(); ++i) {
+      ps[i] = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 64 * mb);
+    }
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[1]);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[0]);
+    Pointer merged = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, 128 * mb);
+    REQUIRE(merged == ps[0]);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, merged);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[2]);
+    alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[3]);
+
+    // Varying sizes must not fragment the heap until it is exhausted
+    std::mt19937 rng(12);
+    std::vector<std::tuple<Pointer, size_t, char>> live;
+    for (size_t i = 0; i < 512; ++i) {
+      if (live.size() == 4) {
+        size_t idx = rng() % live.size();
+        auto &[p, size, val] = live[idx];
+        char *ptr = alloc->template Convert<char>(p);
+        REQUIRE(VerifyLargePage(ptr, size, val));
+        alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+        live.erase(live.begin() + idx);
+      }
+      size_t size = 17 * mb + rng() % (111 * mb);
+      Pointer p = alloc->Allocate(HSHM_DEFAULT_MEM_CTX, size);
+      FillLargePage(alloc->template Convert<char>(p), size, (char)i);
+      live.emplace_back(p, size, (char)i);
+    }
+    for (auto &[p, size, val] : live) {
+      alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
+    }
+  }
+
   static void AlignedAllocationTest(AllocT *alloc) {
     std::vector<std::pair<size_t, size_t>> sizes = {
         {hshm::Unit<size_t>::Kilobytes(4), hshm::Unit<size_t>::Kilobytes(4)},
+        {64, 64},
+        {100, 64},
+        {5000, 512},
+        {hshm::Unit<size_t>::Kilobytes(64), hshm::Unit<size_t>::Kilobytes(4)},
     };
 
     // Aligned allocate pages
@@ -163,6 +290,23 @@ class Workloads {
         alloc->Free(HSHM_DEFAULT_MEM_CTX, p);
       }
     }
+
+    // Hold many aligned pages at once and make sure they do not overlap
+    size_t count = 256;
+    std::vector<Pointer> ps(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto &[size, alignment] = sizes[i % sizes.size()];
+      char *ptr = alloc->template AllocatePtr<char>(HSHM_DEFAULT_MEM_CTX,
+                                                    size, ps[i], alignment);
+      REQUIRE(((size_t)ptr % alignment) == 0);
+      memset(ptr, (char)i, size);
+    }
+    for (size_t i = 0; i < count; ++i) {
+      auto &[size, alignment] = sizes[i % sizes.size()];
+      char *ptr = alloc->template Convert<char>(ps[i]);
+      REQUIRE(VerifyBuffer(ptr, size, (char)i));
+      alloc->Free(HSHM_DEFAULT_MEM_CTX, ps[i]);
+    }
   }
 };
 
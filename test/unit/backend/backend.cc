@@ -10,7 +10,16 @@
  * have access to the file, you may request a copy from help@hdfgroup.org.   *
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 #include "basic_test.h"
+#include "hermes_shm/memory/backend/growable_shm_mmap.h"
+#include "hermes_shm/memory/backend/malloc_backend.h"
+#include "hermes_shm/memory/backend/memfd_backend.h"
+#include "hermes_shm/memory/backend/posix_file_mmap.h"
 #include "hermes_shm/memory/backend/posix_shm_mmap.h"
 
 using hshm::ipc::PosixShmMmap;
@@ -27,4 +36,236 @@ TEST_CASE("BackendReserve") {
 
   // Destroy SHMEM
   b1.shm_destroy();
-}
\ No newline at end of file
+}
+
+TEST_CASE("BackendHugePages") {
+  size_t size = hshm::Unit<size_t>::Megabytes(64);
+  std::vector<hipc::PosixShmMmapOptions> configs(3);
+  configs[1].huge_pages_ = hipc::HugePageMode::kTransparent;
+  configs[1].populate_ = true;
+  // Falls back to transparent huge pages if hugetlbfs is unavailable
+  configs[2].huge_pages_ = hipc::HugePageMode::kHugeTlb;
+  configs[2].populate_ = true;
+  for (hipc::PosixShmMmapOptions &opts : configs) {
+    PosixShmMmap b1;
+    REQUIRE(b1.shm_init(hipc::MemoryBackendId::Get(0), size, "shmem_test",
+                        opts));
+    memset(b1.data_, 1, size);
+
+    // Attach from a second mapping and check the data is shared
+    PosixShmMmap b2;
+    REQUIRE(b2.shm_deserialize("shmem_test"));
+    REQUIRE(b2.data_size_ == size);
+    REQUIRE(b2.data_[0] == 1);
+    REQUIRE(b2.data_[size - 1] == 1);
+    b2.shm_detach();
+    b1.shm_destroy();
+  }
+}
+
+/** Check that every page of [ptr, ptr + size) is resident and zero */
+static bool IsFaultedZero(char *ptr, size_t size) {
+  size_t page_size = HSHM_SYSTEM_INFO->page_size_;
+  std::vector<unsigned char> resident(size / page_size);
+  if (mincore(ptr, size, resident.data()) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < resident.size(); ++i) {
+    if (!(resident[i] & 1) || ptr[i * page_size] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+TEST_CASE("BackendPrefault") {
+  size_t size = hshm::Unit<size_t>::Megabytes(64);
+  std::vector<hipc::PosixShmMmapOptions> configs(3);
+  configs[0].populate_ = true;
+  configs[1].zero_ = true;
+  configs[1].prefault_threads_ = 4;
+  // More threads than 2MB chunks
+  configs[2].populate_ = true;
+  configs[2].prefault_threads_ = 64;
+  for (hipc::PosixShmMmapOptions &opts : configs) {
+    PosixShmMmap b1;
+    REQUIRE(b1.shm_init(hipc::MemoryBackendId::Get(0), size, "shmem_test",
+                        opts));
+    REQUIRE(b1.prefault_msec_ > 0);
+    REQUIRE(IsFaultedZero(b1.data_, size));
+    b1.shm_destroy();
+  }
+
+  hipc::MallocBackendOptions opts;
+  opts.zero_ = true;
+  hipc::MallocBackend b2;
+  REQUIRE(b2.shm_init(hipc::MemoryBackendId::Get(0), size, opts));
+  REQUIRE(b2.prefault_msec_ > 0);
+  for (size_t i = 0; i < size; i += 4096) {
+    REQUIRE(b2.data_[i] == 0);
+  }
+  b2.shm_destroy();
+}
+
+TEST_CASE("BackendGrowable") {
+  size_t mb = hshm::Unit<size_t>::Megabytes(1);
+  hipc::GrowableShmMmapOptions opts;
+  opts.initial_size_ = 4 * mb;
+  opts.grow_size_ = 4 * mb;
+  hipc::GrowableShmMmap b1;
+  REQUIRE(b1.shm_init(hipc::MemoryBackendId::Get(0),
+                      hshm::Unit<size_t>::Gigabytes(8), "shmem_test", opts));
+  REQUIRE(b1.GetCommittedSize() == 4 * mb);
+  memset(b1.data_, 1, 4 * mb);
+
+  // Attach before the data grows
+  hipc::GrowableShmMmap b2;
+  REQUIRE(b2.shm_deserialize("shmem_test"));
+  REQUIRE(b2.data_size_ == hshm::Unit<size_t>::Gigabytes(8));
+  REQUIRE(!b2.Refresh());
+
+  // Growth is visible to the attached process without remapping
+  REQUIRE(b1.Commit(b1.data_ + 9 * mb));
+  REQUIRE(b1.GetCommittedSize() == 12 * mb);
+  memset(b1.data_ + 4 * mb, 2, 8 * mb);
+  REQUIRE(b2.Refresh());
+  REQUIRE(b2.GetCommittedSize() == 12 * mb);
+  REQUIRE(b2.data_[0] == 1);
+  REQUIRE(b2.data_[12 * mb - 1] == 2);
+
+  // The attached process can grow the data too
+  REQUIRE(b2.Commit(b2.data_ + 20 * mb));
+  b2.data_[20 * mb - 1] = 3;
+  REQUIRE(b1.data_[20 * mb - 1] == 3);
+  REQUIRE(b1.GetCommittedSize() == 20 * mb);
+
+  // The data cannot grow past the reserved range
+  REQUIRE(!b1.Commit(b1.data_ + hshm::Unit<size_t>::Gigabytes(9)));
+  b2.shm_detach();
+  b1.shm_destroy();
+}
+
+TEST_CASE("BackendFile") {
+  size_t mb = hshm::Unit<size_t>::Megabytes(1);
+  std::string path = "/tmp/test_backend_file";
+  {
+    hipc::PosixFileMmap b1;
+    REQUIRE(b1.shm_init(hipc::MemoryBackendId::Get(0), 16 * mb, path));
+    memset(b1.data_, 1, 16 * mb);
+
+    // Attaching while another process has the file open is not a crash
+    hipc::PosixFileMmap b2;
+    REQUIRE(b2.shm_deserialize(path));
+    REQUIRE(!b2.NeedsRecovery());
+    REQUIRE(b2.data_[16 * mb - 1] == 1);
+    b2.data_[0] = 2;
+    b2.shm_detach();
+    REQUIRE(b1.Sync());
+  }
+
+  // The data outlives every process that had the file open
+  hipc::PosixFileMmap b3;
+  REQUIRE(b3.shm_deserialize(path));
+  REQUIRE(!b3.NeedsRecovery());
+  REQUIRE(b3.data_size_ == 16 * mb);
+  REQUIRE(b3.data_[0] == 2);
+  REQUIRE(b3.data_[16 * mb - 1] == 1);
+  b3.shm_detach();
+
+  // Processes that detach at the same time still leave the file clean
+  int nprocs = 4;
+  auto *barrier = (pthread_barrier_t *)mmap(
+      nullptr, sizeof(pthread_barrier_t), PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  pthread_barrierattr_t attr;
+  pthread_barrierattr_init(&attr);
+  pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+  pthread_barrier_init(barrier, &attr, nprocs);
+  for (int round = 0; round < 8; ++round) {
+    std::vector<pid_t> pids;
+    for (int i = 0; i < nprocs; ++i) {
+      pids.emplace_back(fork());
+      if (pids.back() == 0) {
+        hipc::PosixFileMmap b;
+        bool ok = b.shm_deserialize(path) && !b.NeedsRecovery();
+        pthread_barrier_wait(barrier);
+        b.shm_detach();
+        _exit(ok ? 0 : 1);
+      }
+    }
+    for (pid_t child : pids) {
+      int status;
+      REQUIRE(waitpid(child, &status, 0) == child);
+      REQUIRE(WEXITSTATUS(status) == 0);
+    }
+  }
+  pthread_barrier_destroy(barrier);
+  munmap(barrier, sizeof(pthread_barrier_t));
+  hipc::PosixFileMmap clean;
+  REQUIRE(clean.shm_deserialize(path));
+  REQUIRE(!clean.NeedsRecovery());
+  clean.shm_detach();
+
+  // A process that exits without detaching leaves the file dirty
+  pid_t pid = fork();
+  if (pid == 0) {
+    hipc::PosixFileMmap b4;
+    b4.shm_deserialize(path);
+    b4.data_[0] = 3;
+    _exit(0);
+  }
+  REQUIRE(waitpid(pid, nullptr, 0) == pid);
+  hipc::PosixFileMmap b5;
+  REQUIRE(b5.shm_deserialize(path));
+  REQUIRE(b5.NeedsRecovery());
+  REQUIRE(b5.data_[0] == 3);
+
+  // Other processes cannot attach until the data is recovered
+  pid = fork();
+  if (pid == 0) {
+    hipc::PosixFileMmap b6;
+    bool ok = b6.shm_deserialize(path) && !b6.NeedsRecovery();
+    _exit(ok ? 0 : 1);
+  }
+  usleep(200000);
+  REQUIRE(waitpid(pid, nullptr, WNOHANG) == 0);
+  b5.FinishRecovery();
+  REQUIRE(!b5.NeedsRecovery());
+  int status;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  b5.shm_destroy();
+}
+
+TEST_CASE("BackendMemfd") {
+  size_t mb = hshm::Unit<size_t>::Megabytes(1);
+  std::string url = "@test_backend_memfd";
+  hipc::MemfdBackend b1;
+  REQUIRE(b1.shm_init(hipc::MemoryBackendId::Get(0), 16 * mb, url));
+  memset(b1.data_, 1, 16 * mb);
+
+  // A worker receives the memory over the socket
+  pid_t pid = fork();
+  if (pid == 0) {
+    hipc::MemfdBackend b2;
+    if (!b2.shm_deserialize(url) || b2.data_size_ != 16 * mb ||
+        b2.data_[16 * mb - 1] != 1) {
+      _exit(1);
+    }
+    b2.data_[0] = 2;
+    b2.shm_detach();
+    _exit(0);
+  }
+  REQUIRE(b1.ServeAttach());
+  int status;
+  REQUIRE(waitpid(pid, &status, 0) == pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  REQUIRE(b1.data_[0] == 2);
+
+  // Nothing is left to attach to once the creator stops serving
+  b1.shm_destroy();
+  hipc::MemfdBackend b3;
+  REQUIRE(!b3.shm_deserialize(url));
+}
@@ -31,9 +31,9 @@ void lifo_list_queueTest() {
   test.EraseTest();
 }
 
-TEST_CASE("lifo_list_queueOfMpPage") {
+TEST_CASE("lifo_list_queueOfFreePage") {
   auto *alloc = HSHM_DEFAULT_ALLOC;
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
-  lifo_list_queueTest<MpPage>();
+  lifo_list_queueTest<FreePage>();
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
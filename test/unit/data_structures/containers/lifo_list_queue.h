@@ -17,7 +17,7 @@
 #include "hermes_shm/memory/allocator/mp_page.h"
 #include "test_init.h"
 
-using hipc::MpPage;
+using hipc::FreePage;
 
 template <typename T, typename Container,
           typename AllocT = HSHM_DEFAULT_ALLOC_T>
@@ -36,7 +36,7 @@ class lifo_list_queueTestSuite {
       hipc::OffsetPointer p;
       auto page =
           alloc_->template AllocateConstructObjs<T>(HSHM_DEFAULT_MEM_CTX, 1, p);
-      page->page_size_ = count - i - 1;
+      page->class_ = count - i - 1;
       obj_.enqueue(page);
     }
     REQUIRE(obj_.size() == count);
@@ -59,7 +59,7 @@ class lifo_list_queueTestSuite {
   void ForwardIteratorTest(size_t count = 30) {
     size_t fcur = 0;
     for (T *page : obj_) {
-      REQUIRE(page->page_size_ == fcur);
+      REQUIRE(page->class_ == fcur);
       ++fcur;
     }
   }
@@ -70,7 +70,7 @@ class lifo_list_queueTestSuite {
     size_t fcur = 0;
     for (auto iter = obj.cbegin(); iter != obj.cend(); ++iter) {
       T *page = *iter;
-      REQUIRE(page->page_size_ == fcur);
+      REQUIRE(page->class_ == fcur);
       ++fcur;
     }
   }
@@ -84,10 +84,10 @@ class lifo_list_queueTestSuite {
       ++iter;
     }
     auto page = obj_.dequeue(iter);
-    REQUIRE(page->page_size_ == mid);
+    REQUIRE(page->class_ == mid);
     REQUIRE(obj_.size() == count - 1);
     for (T *page : obj_) {
-      REQUIRE(page->page_size_ != mid);
+      REQUIRE(page->class_ != mid);
     }
     obj_.enqueue(page);
   }
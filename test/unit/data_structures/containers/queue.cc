@@ -49,6 +49,13 @@ TEST_CASE("TestSplitTicketQueueIntMultiThreaded") {
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
+TEST_CASE("TestSplitTicketQueueBatch") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsumeBatch<hipc::split_ticket_queue<int>, int>(4, 8192, 64, 32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
 /**
  * TEST DYNAMIC QUEUE
  * */
@@ -72,6 +79,7 @@ TEST_CASE("TestDynamicQueueIntMultiThreaded") {
   auto *alloc = HSHM_DEFAULT_ALLOC;
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   ProduceAndConsume<hipc::dynamic_queue<int>, int>(8, 1, 8192, 32);
+  ProduceAndConsume<hipc::dynamic_queue<int>, int>(8, 8, 8192, 32);
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
@@ -80,9 +88,81 @@ TEST_CASE("TestDynamicQueueStringMultiThreaded") {
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
   ProduceAndConsume<hipc::dynamic_queue<hipc::string>, hipc::string>(8, 1, 8192,
                                                                      32);
+  ProduceAndConsume<hipc::dynamic_queue<hipc::string>, hipc::string>(8, 8, 8192,
+                                                                     32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestDynamicQueueSegmentReuse") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  {
+    hipc::dynamic_queue<int> queue(4);
+    size_t allocated = 0;
+    hshm::qtok_id next = 0;
+    for (int lap = 0; lap < 8; ++lap) {
+      for (int i = 0; i < 8; ++i) {
+        REQUIRE(queue.emplace(i).id_ == next++);
+      }
+      REQUIRE(queue.GetSize() == 8);
+      for (int i = 0; i < 8; ++i) {
+        int val;
+        REQUIRE(!queue.pop(val).IsNull());
+        REQUIRE(val == i);
+      }
+      REQUIRE(queue.pop().IsNull());
+      REQUIRE(queue.GetSize() == 0);
+      // The segment at the head stays linked after a lap, so the pool is
+      // full after the second lap. Laps after it only reuse segments.
+      if (lap == 1) {
+        allocated = alloc->GetCurrentlyAllocatedSize();
+      } else if (lap > 1) {
+        REQUIRE(alloc->GetCurrentlyAllocatedSize() == allocated);
+      }
+    }
+  }
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
+TEST_CASE("TestDynamicQueueOutOfMemory") {
+  auto mem_mngr = HSHM_MEMORY_MANAGER;
+  hipc::MemoryBackendId backend_id = hipc::MemoryBackendId::Get(1);
+  AllocatorId alloc_id(2, 0);
+  mem_mngr->CreateBackend<PosixShmMmap>(
+      backend_id, hshm::Unit<size_t>::Megabytes(4), "test_dynamic_queue_oom");
+  auto *alloc = mem_mngr->CreateAllocator<hipc::ScalablePageAllocator>(
+      backend_id, alloc_id, 0);
+  {
+    hipc::dynamic_queue<int, hipc::ScalablePageAllocator> queue(alloc, 1024);
+    // Segments in the pool are reused after the heap runs out, so every
+    // fill after the first holds as many elements
+    std::vector<size_t> filled;
+    for (int round = 0; round < 4; ++round) {
+      size_t count = 0;
+      try {
+        while (true) {
+          queue.emplace((int)count);
+          ++count;
+        }
+      } catch (hshm::Error &) {
+      }
+      REQUIRE(count > 0);
+      filled.emplace_back(count);
+      for (size_t i = 0; i < count; ++i) {
+        int val;
+        REQUIRE(!queue.pop(val).IsNull());
+        REQUIRE(val == (int)i);
+      }
+      REQUIRE(queue.pop().IsNull());
+    }
+    for (int round = 2; round < 4; ++round) {
+      REQUIRE(filled[round] == filled[1]);
+    }
+  }
+  mem_mngr->UnregisterAllocator(alloc_id);
+  mem_mngr->DestroyBackend(backend_id);
+}
+
 /**
  * TEST SPSC LIST QUEUE
  * */
@@ -168,6 +248,26 @@ TEST_CASE("TestMpscQueuePeek") {
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
+TEST_CASE("TestMpscQueueWait") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsumeWait<hipc::mpsc_ptr_queue<size_t>, size_t>(1, 8192, 4);
+  WaitTimeout<hipc::mpsc_queue<int>, int>(4);
+  WaitTimeout<hipc::mpsc_ptr_queue<size_t>, size_t>(4);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpscQueueBatchMultiThreaded") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  // Batches larger than the queue are pushed a queue's depth at a time
+  ProduceAndConsumeBatch<hipc::mpsc_queue<int>, int>(8, 8192, 64, 32);
+  ProduceAndConsumeBatch<hipc::mpsc_queue<int>, int>(8, 8192, 16, 256);
+  ProduceAndConsumeBatch<hipc::mpsc_ptr_queue<size_t>, size_t>(8, 8192, 64,
+                                                               32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
 /**
  * MPSC Pointer Queue
  * */
@@ -204,6 +304,91 @@ TEST_CASE("TestMpscPointerQueueCompile") {
   REQUIRE(off_p == hipc::Pointer(AllocatorId(5, 2), 1));
 }
 
+/**
+ * TEST MPMC QUEUE
+ * */
+
+TEST_CASE("TestMpmcQueueInt") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceThenConsume<hipc::mpmc_queue<int>, int>(1, 1, 32, 32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcQueueString") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceThenConsume<hipc::mpmc_queue<hipc::string>, hipc::string>(1, 1, 32,
+                                                                   32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcQueueIntMultiThreaded") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsume<hipc::mpmc_queue<int>, int>(8, 1, 8192, 32);
+  ProduceAndConsume<hipc::mpmc_queue<int>, int>(8, 8, 8192, 32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcQueueStringMultiThreaded") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsume<hipc::mpmc_queue<hipc::string>, hipc::string>(8, 8, 8192,
+                                                                  32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcQueueFullEmpty") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  {
+    hipc::mpmc_queue<int> queue(4);
+    int val;
+    REQUIRE(queue.pop(val).IsNull());
+    // Wrap around the ring a few times
+    for (int lap = 0; lap < 3; ++lap) {
+      for (int i = 0; i < 4; ++i) {
+        REQUIRE(!queue.emplace(lap * 4 + i).IsNull());
+      }
+      REQUIRE(queue.emplace(-1).IsNull());
+      REQUIRE(queue.GetSize() == 4);
+      for (int i = 0; i < 4; ++i) {
+        REQUIRE(!queue.pop(val).IsNull());
+        REQUIRE(val == lap * 4 + i);
+      }
+      REQUIRE(queue.pop(val).IsNull());
+    }
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcQueueWait") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsumeWait<hipc::mpmc_queue<int>, int>(4, 8192, 4);
+  ProduceAndConsumeWait<hipc::mpmc_ptr_queue<size_t>, size_t>(4, 8192, 4);
+  WaitTimeout<hipc::mpmc_queue<int>, int>(4);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcPtrQueueIntMultiThreaded") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceThenConsume<hipc::mpmc_ptr_queue<int>, int>(1, 1, 32, 32);
+  ProduceAndConsume<hipc::mpmc_ptr_queue<int>, int>(8, 8, 8192, 32);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestMpmcPointerQueueCompile") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  hipc::mpmc_ptr_queue<hipc::Pointer> queue(alloc);
+  hipc::Pointer off_p;
+  queue.emplace(hipc::Pointer(AllocatorId(5, 2), 1));
+  queue.pop(off_p);
+  REQUIRE(off_p == hipc::Pointer(AllocatorId(5, 2), 1));
+}
+
 /**
  * TEST SPSC QUEUE
  * */
@@ -243,6 +428,76 @@ TEST_CASE("TestSpscQueuePopBack") {
   REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
 }
 
+TEST_CASE("TestSpscQueueFullEmpty") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  PAGE_DIVIDE("TEST") {
+    hshm::spsc_queue<int> queue(alloc, 4);
+    // The producer and consumer groups do not share a cache line, no
+    // matter where the queue is placed
+    char *producer_end = (char *)(&queue.head_cache_ + 1);
+    REQUIRE((char *)&queue.head_ - producer_end >= 64);
+    REQUIRE((size_t)&queue.head_cache_ / 64 != (size_t)&queue.head_ / 64);
+    char *consumer_end = (char *)(&queue.tail_cache_ + 1);
+    REQUIRE((char *)&queue.pop_event_ - consumer_end >= 64);
+    int val;
+    for (int round = 0; round < 4; ++round) {
+      REQUIRE(queue.pop(val).IsNull());
+      for (int i = 0; i < 4; ++i) {
+        REQUIRE(!queue.emplace(i).IsNull());
+      }
+      // The cached head says full until the consumer moves
+      REQUIRE(queue.emplace(4).IsNull());
+      REQUIRE(!queue.pop(val).IsNull());
+      REQUIRE(val == 0);
+      REQUIRE(!queue.emplace(4).IsNull());
+      REQUIRE(!queue.pop_back(val).IsNull());
+      REQUIRE(val == 4);
+      for (int i = 1; i < 4; ++i) {
+        REQUIRE(!queue.pop(val).IsNull());
+        REQUIRE(val == i);
+      }
+      REQUIRE(queue.GetSize() == 0);
+    }
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestSpscQueueWait") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  ProduceAndConsumeWait<hipc::spsc_queue<int>, int>(1, 8192, 4);
+  WaitTimeout<hipc::spsc_queue<int>, int>(4);
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
+TEST_CASE("TestSpscQueueBatch") {
+  auto *alloc = HSHM_DEFAULT_ALLOC;
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+  // The indices of SPSC queues are not atomic, so one thread does both
+  ProduceThenConsumeBatch<hipc::spsc_queue<int>, int>(8192, 64, 32);
+  ProduceThenConsumeBatch<hipc::spsc_ptr_queue<size_t>, size_t>(8192, 8, 32);
+  {
+    // A full queue takes part of a batch
+    hipc::spsc_queue<hipc::string> queue(4);
+    std::vector<hipc::string> vals;
+    for (int i = 0; i < 6; ++i) {
+      vals.emplace_back(std::to_string(i));
+    }
+    REQUIRE(queue.push_n(vals.data(), 6) == 4);
+    REQUIRE(queue.push_n(vals.data(), 6) == 0);
+    std::vector<hipc::string> out(6);
+    REQUIRE(queue.pop_n(out.data(), 3) == 3);
+    REQUIRE(queue.push_n(vals.data() + 4, 2) == 2);
+    REQUIRE(queue.pop_n(out.data() + 3, 6) == 3);
+    REQUIRE(queue.pop_n(out.data(), 6) == 0);
+    for (int i = 0; i < 6; ++i) {
+      REQUIRE(out[i] == std::to_string(i));
+    }
+  }
+  REQUIRE(alloc->GetCurrentlyAllocatedSize() == 0);
+}
+
 template <typename T>
 void PointerQueueTest(T base_val) {
   auto *alloc = HSHM_DEFAULT_ALLOC;
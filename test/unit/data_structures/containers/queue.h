@@ -227,4 +227,146 @@ void ProduceAndConsume(size_t nproducers, size_t nconsumers,
   }
 }
 
+template <typename QueueT, typename T>
+void ProduceAndConsumeWait(size_t nthreads, size_t count_per_rank,
+                           size_t depth) {
+  QueueT queue(depth);
+  std::vector<size_t> entries(nthreads * count_per_rank);
+  std::atomic<size_t> count = 0;
+
+  // Half the threads produce and half consume, all of them blocking
+  omp_set_dynamic(0);
+#pragma omp parallel shared(queue, entries, count) num_threads(2 * nthreads)
+  {  // NOLINT
+    size_t rank = omp_get_thread_num();
+#pragma omp barrier
+    if (rank < nthreads) {
+      for (size_t i = 0; i < count_per_rank; ++i) {
+        T var = static_cast<T>(rank * count_per_rank + i);
+        REQUIRE(!queue.push_wait(var).IsNull());
+      }
+    } else {
+      T var;
+      for (size_t i = 0; i < count_per_rank; ++i) {
+        REQUIRE(!queue.pop_wait(var).IsNull());
+        entries[count.fetch_add(1)] = static_cast<size_t>(var);
+      }
+    }
+#pragma omp barrier
+  }
+
+  T var;
+  REQUIRE(queue.pop(var).IsNull());
+  std::sort(entries.begin(), entries.end());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    REQUIRE(entries[i] == i);
+  }
+}
+
+template <typename QueueT, typename T>
+void ProduceAndConsumeBatch(size_t nproducers, size_t count_per_rank,
+                            size_t batch, size_t depth) {
+  QueueT queue(depth);
+  size_t total = nproducers * count_per_rank;
+  std::vector<size_t> entries;
+  entries.reserve(total);
+
+  // The last thread consumes in batches while the others produce
+  omp_set_dynamic(0);
+#pragma omp parallel shared(queue, entries) num_threads(nproducers + 1)
+  {  // NOLINT
+    size_t rank = omp_get_thread_num();
+#pragma omp barrier
+    if (rank < nproducers) {
+      std::vector<T> vars(batch);
+      for (size_t i = 0; i < count_per_rank; i += batch) {
+        size_t n = std::min(batch, count_per_rank - i);
+        for (size_t j = 0; j < n; ++j) {
+          vars[j] = static_cast<T>(rank * count_per_rank + i + j);
+        }
+        size_t pushed = 0;
+        while (pushed < n) {
+          pushed += queue.push_n(vars.data() + pushed, n - pushed);
+        }
+      }
+    } else {
+      std::vector<T> vars(batch);
+      while (entries.size() < total) {
+        size_t n = queue.pop_n(vars.data(), batch);
+        if (n == 0) {
+          continue;
+        }
+        REQUIRE(n <= batch);
+        for (size_t j = 0; j < n; ++j) {
+          entries.emplace_back(static_cast<size_t>(vars[j]));
+        }
+      }
+    }
+#pragma omp barrier
+  }
+
+  T var;
+  REQUIRE(queue.pop_n(&var, 1) == 0);
+  std::sort(entries.begin(), entries.end());
+  for (size_t i = 0; i < total; ++i) {
+    REQUIRE(entries[i] == i);
+  }
+}
+
+template <typename QueueT, typename T>
+void ProduceThenConsumeBatch(size_t count, size_t batch, size_t depth) {
+  QueueT queue(depth);
+  std::vector<T> vars(batch);
+  size_t pushed = 0, popped = 0;
+
+  // Fill the queue in batches, then drain it in batches
+  while (popped < count) {
+    while (pushed < count) {
+      size_t n = std::min(batch, count - pushed);
+      for (size_t j = 0; j < n; ++j) {
+        vars[j] = static_cast<T>(pushed + j);
+      }
+      n = queue.push_n(vars.data(), n);
+      if (n == 0) {
+        break;
+      }
+      pushed += n;
+    }
+    size_t n;
+    while ((n = queue.pop_n(vars.data(), batch)) > 0) {
+      REQUIRE(n <= batch);
+      for (size_t j = 0; j < n; ++j) {
+        REQUIRE(static_cast<size_t>(vars[j]) == popped + j);
+      }
+      popped += n;
+    }
+  }
+  REQUIRE(pushed == count);
+}
+
+template <typename QueueT, typename T>
+void WaitTimeout(size_t depth) {
+  QueueT queue(depth);
+  T var = 0;
+  hshm::Timer t;
+  t.Resume();
+  REQUIRE(queue.pop_wait(var, 20000).IsNull());
+  t.Pause();
+  REQUIRE(t.GetMsec() >= 10);
+  for (size_t i = 0; i < depth; ++i) {
+    REQUIRE(!queue.push_wait(var, 20000).IsNull());
+  }
+  t.Reset();
+  REQUIRE(queue.push_wait(var, 20000).IsNull());
+  t.Pause();
+  REQUIRE(t.GetMsec() >= 10);
+  // A push that timed out leaves nothing behind
+  for (size_t i = 0; i < depth; ++i) {
+    REQUIRE(!queue.pop_wait(var, 20000).IsNull());
+  }
+  REQUIRE(queue.pop_wait(var, 0).IsNull());
+  REQUIRE(!queue.push_wait(var, 20000).IsNull());
+  REQUIRE(!queue.pop_wait(var, 20000).IsNull());
+}
+
 #endif  // HSHM_SHM_TEST_UNIT_DATA_STRUCTURES_CONTAINERS_QUEUE_H_
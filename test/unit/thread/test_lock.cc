@@ -15,6 +15,7 @@
 #include "omp.h"
 #include "hermes_shm/thread/lock.h"
 
+using hshm::Futex;
 using hshm::Mutex;
 using hshm::RwLock;
 
@@ -74,6 +75,50 @@ void RwLockTest(int producers, int consumers, size_t loop_count) {
   }
 }
 
+void FutexTest(int nthreads) {
+  Futex futex;
+  hipc::atomic<int> flag(0);
+  hipc::atomic<int> woke(0);
+
+  omp_set_dynamic(0);
+#pragma omp parallel shared(futex, flag, woke) num_threads(nthreads)
+  {  // NOLINT
+    int tid = omp_get_thread_num();
+#pragma omp barrier
+    if (tid == 0) {
+      // Let the others go to sleep
+      while (futex.waiters_.load() < (hshm::u32)(nthreads - 1)) {
+        HSHM_THREAD_MODEL->Yield();
+      }
+      flag = 1;
+      futex.NotifyAll();
+    } else {
+      while (flag.load() == 0) {
+        futex.Wait([&] { return flag.load() != 0; });
+      }
+      woke.fetch_add(1);
+    }
+#pragma omp barrier
+  }
+  REQUIRE(woke.load() == nthreads - 1);
+  REQUIRE(futex.waiters_.load() == 0);
+}
+
+TEST_CASE("Futex") {
+  FutexTest(8);
+
+  // A wait with nothing to wake it times out
+  Futex futex;
+  hshm::Timer t;
+  t.Resume();
+  REQUIRE(!futex.Wait([] { return false; }, 20000));
+  t.Pause();
+  REQUIRE(t.GetMsec() >= 10);
+
+  // A wait for a state that is already there returns at once
+  REQUIRE(futex.Wait([] { return true; }, 20000));
+}
+
 TEST_CASE("Mutex") {
   MutexTest(8);
 }